@@ -0,0 +1,135 @@
+/******************************************************************************
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this
+ * distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ ******************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include	<config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "MIArena.h"
+
+#define MI_ARENA_CHUNK	8192
+#define MI_ARENA_ALIGN	8
+#define MI_ARENA_ROUND(n)	(((n) + MI_ARENA_ALIGN - 1) & ~(size_t)(MI_ARENA_ALIGN - 1))
+
+/* the chunk header is followed by its data */
+#define MI_ARENA_HEADER	MI_ARENA_ROUND(sizeof(MIArenaChunk))
+
+static MIArenaChunk *
+NewChunk(size_t size)
+{
+	MIArenaChunk *	chunk = (MIArenaChunk *)malloc(MI_ARENA_HEADER + size);
+
+	if (chunk == NULL) {
+		return NULL;
+	}
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+/*
+ * Create an arena with one reference. The first chunk holds at least
+ * size_hint bytes. Returns NULL if out of memory.
+ */
+MIArena *
+MIArenaNew(size_t size_hint)
+{
+	MIArena *	arena = (MIArena *)malloc(sizeof(MIArena));
+	size_t		size = MI_ARENA_ROUND(size_hint);
+
+	if (arena == NULL) {
+		return NULL;
+	}
+	if (size < MI_ARENA_CHUNK) {
+		size = MI_ARENA_CHUNK;
+	}
+	if ((arena->chunks = NewChunk(size)) == NULL) {
+		free(arena);
+		return NULL;
+	}
+	arena->refs = 1;
+	return arena;
+}
+
+/*
+ * Allocate uninitialized memory that lives as long as the arena.
+ */
+void *
+MIArenaAlloc(MIArena *arena, size_t size)
+{
+	MIArenaChunk *	chunk = arena->chunks;
+	void *			p;
+
+	size = MI_ARENA_ROUND(size);
+	if (chunk == NULL || chunk->size - chunk->used < size) {
+		MIArenaChunk *	c;
+
+		if (size > MI_ARENA_CHUNK / 4 && chunk != NULL) {
+			/* a large block gets a chunk of its own behind the current one */
+			if ((c = NewChunk(size)) == NULL) {
+				return NULL;
+			}
+			c->next = chunk->next;
+			chunk->next = c;
+			c->used = size;
+			return (char *)c + MI_ARENA_HEADER;
+		}
+		if ((c = NewChunk(size > MI_ARENA_CHUNK ? size : MI_ARENA_CHUNK)) == NULL) {
+			return NULL;
+		}
+		c->next = chunk;
+		arena->chunks = chunk = c;
+	}
+	p = (char *)chunk + MI_ARENA_HEADER + chunk->used;
+	chunk->used += size;
+	return p;
+}
+
+/*
+ * Copy len characters of str into the arena and terminate them.
+ */
+char *
+MIArenaCopy(MIArena *arena, const char *str, size_t len)
+{
+	char *	s = (char *)MIArenaAlloc(arena, len + 1);
+
+	if (s != NULL) {
+		memcpy(s, str, len);
+		s[len] = '\0';
+	}
+	return s;
+}
+
+void
+MIArenaRetain(MIArena *arena)
+{
+	arena->refs++;
+}
+
+/*
+ * Drop a reference and free all chunks with the last one.
+ */
+void
+MIArenaRelease(MIArena *arena)
+{
+	MIArenaChunk *	chunk;
+	MIArenaChunk *	next;
+
+	if (--arena->refs > 0) {
+		return;
+	}
+	for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	free(arena);
+}
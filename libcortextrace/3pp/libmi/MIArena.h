@@ -0,0 +1,37 @@
+/******************************************************************************
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this
+ * distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ ******************************************************************************/
+
+#ifndef _MIARENA_H_
+#define _MIARENA_H_
+
+#include <stddef.h>
+
+/*
+ * Memory for the parse tree of one GDB response. Nodes are allocated by
+ * bumping a pointer in large chunks and are never freed one by one; the
+ * whole arena is freed when the last record that refers to it is freed.
+ */
+struct MIArenaChunk {
+	struct MIArenaChunk *	next;
+	size_t					size;
+	size_t					used;
+};
+typedef struct MIArenaChunk MIArenaChunk;
+
+struct MIArena {
+	MIArenaChunk *	chunks;		/* current chunk first */
+	int				refs;
+};
+typedef struct MIArena MIArena;
+
+extern MIArena *MIArenaNew(size_t size_hint);
+extern void *MIArenaAlloc(MIArena *arena, size_t size);
+extern char *MIArenaCopy(MIArena *arena, const char *str, size_t len);
+extern void MIArenaRetain(MIArena *arena);
+extern void MIArenaRelease(MIArena *arena);
+#endif /* _MIARENA_H_ */
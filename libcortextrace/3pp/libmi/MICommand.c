@@ -51,6 +51,8 @@ MICommandNew(char *command, int class)
 	cmd->output = MIOutputNew();
 	cmd->callback = NULL;
 	cmd->timeout = 0;
+	cmd->token = -1;
+	cmd->reply_bytes = 0;
 	return cmd;
 }
 
@@ -249,7 +251,7 @@ MICommandToString(MICommand *cmd)
 	static int		str_size = 0;
 	static char *	str_res = NULL;
 
-	size = cmd_len + 3;
+	size = cmd_len + 3 + 11;
 
 	for (i = 0; i < cmd->num_options; i++)
 		size += strlen(cmd->options[i]) + 1;
@@ -263,6 +265,8 @@ MICommandToString(MICommand *cmd)
 	}
 
 	s = str_res;
+	if (cmd->token >= 0)
+		s += sprintf(s, "%d", cmd->token);
 	memcpy(s, cmd->command, cmd_len);
 	s += cmd_len;
 
@@ -39,6 +39,8 @@ struct MICommand {
 	void			(*callback)(MIResultRecord *, void *);	/* command completed callback */
 	void *			cb_data;								/* callback data */
 	long			timeout;								/* timeout to wait for response (ms) */
+	int				token;									/* token to match the reply, or -1 */
+	long			reply_bytes;							/* length of the output for the command */
 };
 typedef struct MICommand	MICommand;
 
@@ -162,6 +164,7 @@ extern MICommand *MITargetDetachAll(void);
  * -data-* commands
  */
 extern MICommand *MIDataReadMemory(long, char *, char *, int, int, int, char *);
+extern MICommand *MIDataReadMemoryBytes(long offset, char *address, int count);
 extern MICommand *MIDataWriteMemory(long offset, char * address, char * format, int wordSize, char * value);
 extern MICommand *MIDataWriteMemoryBytes(char *address, char *contents);
 extern MICommand *MIDataReadDisassemble(char* startAddr, char* endAddr, char* format);
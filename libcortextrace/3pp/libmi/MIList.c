@@ -355,3 +355,15 @@ MIListSize(MIList *l)
 
 	return l->l_nel;
 }
+
+/*
+ * Get the first element without removing it
+ */
+void *
+MIListGetFirstElement(MIList *l)
+{
+	if ( l == (MIList *)NULL || l->l_head == (MIListElement *)NULL )
+		return NULL;
+
+	return l->l_head->l_value;
+}
@@ -56,6 +56,20 @@ MIDataReadMemory(long offset, char* address, char* format, int wordSize, int row
 	return cmd;
 }
 
+MICommand *
+MIDataReadMemoryBytes(long offset, char* address, int count)
+{
+	MICommand * cmd;
+	cmd = MICommandNew("-data-read-memory-bytes", MIResultRecordDONE);
+
+	if (offset != 0) {
+		MICommandAddOption(cmd, "-o", MIIntToCString(offset));
+	}
+	MICommandAddOption(cmd, address, NULL);
+	MICommandAddOption(cmd, MIIntToCString(count), NULL);
+	return cmd;
+}
+
 MICommand *
 MIDataWriteMemory(long offset, char* address, char* format, int wordSize, char* value)
 {
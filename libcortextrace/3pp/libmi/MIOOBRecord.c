@@ -44,6 +44,7 @@ NewMIMIOOBRecord(void)
 	oob->results = NULL;
 	oob->class = NULL;
 	oob->cstring = NULL;
+	oob->arena = NULL;
 	return oob;
 }
 
@@ -104,6 +105,10 @@ NewMILogStreamOutput(void)
 void 
 MIOOBRecordFree(MIOOBRecord *oob)
 {
+	if (oob->arena != NULL) {
+		MIArenaRelease(oob->arena);
+		return;
+	}
 	if (oob->results != NULL)
 		MIListFree(oob->results, MIResultFree);
 	if (oob->class != NULL)
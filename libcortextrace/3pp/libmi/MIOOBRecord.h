@@ -28,6 +28,7 @@
 #define _MIOOBRECORD_H_
 
 #include "MIList.h"
+#include "MIArena.h"
 
 #define MIOOBRecordTypeAsync	1
 #define MIOOBRecordTypeStream	2
@@ -50,6 +51,7 @@ struct MIOOBRecord {
 	char *class;
 	int token;
 	char *cstring;
+	MIArena *arena;	/* holds the record if it was parsed */
 };
 typedef struct MIOOBRecord MIOOBRecord;
 
@@ -109,24 +109,95 @@
 #include <ctype.h>
 
 #include "MIList.h"
+#include "MIArena.h"
+#include "MIError.h"
 #include "MIOOBRecord.h"
 #include "MIValue.h"
 #include "MIResult.h"
 #include "MIResultRecord.h"
 #include "MIOutput.h"
 
-static MIResultRecord *processMIResultRecord(char *buffer, int id);
-static MIOOBRecord *processMIOOBRecord(char *buffer, int id);
-static MIList *processMIResults(char **buffer);
-static MIResult *processMIResult(char **buffer);
-static MIValue *processMIValue(char **buffer);
-static MIValue *processMITuple(char **buffer);
-static MIValue *processMIList(char **buffer);
+static MIResultRecord *processMIResultRecord(MIArena *arena, char *buffer, int id);
+static MIOOBRecord *processMIOOBRecord(MIArena *arena, char *buffer, int id);
+static MIList *processMIResults(MIArena *arena, char **buffer);
+static MIResult *processMIResult(MIArena *arena, char **buffer);
+static MIValue *processMIValue(MIArena *arena, char **buffer);
+static MIValue *processMITuple(MIArena *arena, char **buffer);
+static MIValue *processMIList(MIArena *arena, char **buffer);
 static char *translateCString(char **buffer);
 
 char *primaryPrompt = "(gdb)"; //$NON-NLS-1$
 char *secondaryPrompt = ">"; //$NON-NLS-1$
 
+/*
+ * The parse tree of a response lives in one arena. The text is copied into
+ * the arena once and parsed in place, so strings point into the copy and
+ * only need unescaping when they contain a backslash. Each record holds a
+ * reference to the arena, which is freed with the last record.
+ */
+
+static MIList *
+newList(MIArena *arena)
+{
+	MIList *	l = (MIList *)MIArenaAlloc(arena, sizeof(MIList));
+
+	l->l_head = NULL;
+	l->l_tail = &l->l_head;
+	l->l_nel = 0;
+	l->l_scan = NULL;
+	return l;
+}
+
+static void
+listAdd(MIArena *arena, MIList *l, void *v)
+{
+	MIListElement *	e = (MIListElement *)MIArenaAlloc(arena, sizeof(MIListElement));
+
+	e->l_value = v;
+	e->l_next = NULL;
+	*(l->l_tail) = e;
+	l->l_tail = &e->l_next;
+	l->l_nel++;
+}
+
+static MIValue *
+newValue(MIArena *arena, int type)
+{
+	MIValue *	val = (MIValue *)MIArenaAlloc(arena, sizeof(MIValue));
+
+	val->type = type;
+	val->cstring = NULL;
+	val->values = NULL;
+	val->results = NULL;
+	return val;
+}
+
+static MIResult *
+newResult(MIArena *arena)
+{
+	MIResult *	res = (MIResult *)MIArenaAlloc(arena, sizeof(MIResult));
+
+	res->variable = NULL;
+	res->value = NULL;
+	return res;
+}
+
+static MIOOBRecord *
+newOOBRecord(MIArena *arena, int type, int sub_type, int id)
+{
+	MIOOBRecord *	oob = (MIOOBRecord *)MIArenaAlloc(arena, sizeof(MIOOBRecord));
+
+	oob->type = type;
+	oob->sub_type = sub_type;
+	oob->results = NULL;
+	oob->class = NULL;
+	oob->token = id;
+	oob->cstring = NULL;
+	oob->arena = arena;
+	MIArenaRetain(arena);
+	return oob;
+}
+
 /**
  * Point of entry to create an AST for MI.
  *
@@ -138,8 +209,18 @@ char *secondaryPrompt = ">"; //$NON-NLS-1$
  MIParse(char *buffer, MIOutput *mi) 
  {
 	int id = -1;
-	char *pos = buffer;
-	char *token = buffer;
+	size_t len = strlen(buffer);
+	MIArena *arena = MIArenaNew(len + 1);
+	char *pos;
+	char *token;
+
+	// Nothing is parsed if there is no memory for the copy
+	if (arena == NULL) {
+		MISetError(MI_ERROR_SYSTEM, "Out of memory for MI output");
+		return;
+	}
+	pos = MIArenaCopy(arena, buffer, len);
+	token = pos;
 
 	while (pos != NULL && *pos != '\0') 
 	{
@@ -150,6 +231,7 @@ char *secondaryPrompt = ">"; //$NON-NLS-1$
 		}
 		
 		// Fetch the Token/Id
+		id = -1;
 		if (*token != '\0' && isdigit(*token)) {
 			id = strtol(token, &token, 10);
 		}
@@ -158,11 +240,11 @@ char *secondaryPrompt = ">"; //$NON-NLS-1$
 		if (*token != '\0') {
 			if (*token == '^') {
 				++token;
-				mi->rr = processMIResultRecord(token, id);
+				mi->rr = processMIResultRecord(arena, token, id);
 			} else if (strncmp(token, primaryPrompt, strlen(primaryPrompt)) == 0) {
 				// Do nothing.
 			} else {
-				MIOOBRecord *oob = processMIOOBRecord(token, id);
+				MIOOBRecord *oob = processMIOOBRecord(arena, token, id);
 				if (oob != NULL) {
 					if (mi->oobs == NULL) {
 						mi->oobs = MIListNew();
@@ -175,16 +257,23 @@ char *secondaryPrompt = ">"; //$NON-NLS-1$
 		// set token to the current position pointer
 		token = pos;
 	}
+
+	// The records keep the arena alive
+	MIArenaRelease(arena);
 }
 
 /**
  * Assuming '^' was deleted from the Result Record.
  */
 static MIResultRecord *
-processMIResultRecord(char *buffer, int id)
+processMIResultRecord(MIArena *arena, char *buffer, int id)
 {
-	MIResultRecord *rr = MIResultRecordNew();
+	MIResultRecord *rr = (MIResultRecord *)MIArenaAlloc(arena, sizeof(MIResultRecord));
+	rr->results = NULL;
+	rr->resultClass = MIResultRecordINVALID;
 	rr->token = id;
+	rr->arena = arena;
+	MIArenaRetain(arena);
 	
 	if (strncmp(buffer, "done", 4) == 0) {
 		rr->resultClass = MIResultRecordDONE;
@@ -209,7 +298,7 @@ processMIResultRecord(char *buffer, int id)
 	// Results are separated by commas.
 	if (*buffer != '\0' && *buffer == ',') {
 		buffer++;
-		MIList *res = processMIResults(&buffer);
+		MIList *res = processMIResults(arena, &buffer);
 		rr->results = res;
 	}
 	return rr;
@@ -219,7 +308,7 @@ processMIResultRecord(char *buffer, int id)
  * Find OutOfBand Records depending on the starting token.
  */
 static MIOOBRecord *
-processMIOOBRecord(char *buffer, int id)
+processMIOOBRecord(MIArena *arena, char *buffer, int id)
 {
 	MIOOBRecord *oob = NULL;
 	char c = *buffer;
@@ -230,30 +319,28 @@ processMIOOBRecord(char *buffer, int id)
 		buffer++;
 		switch (c) {
 			case '*' :
-				oob = NewMIExecAsyncOutput();
+				oob = newOOBRecord(arena, MIOOBRecordTypeAsync, MIOOBRecordExecAsync, id);
 				break;
 
 			case '+' :
-				oob = NewMIStatusAsyncOutput();
+				oob = newOOBRecord(arena, MIOOBRecordTypeAsync, MIOOBRecordStatusAsync, id);
 				break;
 
 			case '=' :
-				oob = NewMINotifyAsyncOutput();
+				oob = newOOBRecord(arena, MIOOBRecordTypeAsync, MIOOBRecordNotifyAsync, id);
 				break;
 		}
-		oob->token = id;
 		// Extract the Async-Class
 		char *s = strchr(buffer, ',');
+		oob->class = buffer;
 		if (s != NULL) {
 			*s++ = '\0';
-			oob->class = strdup(buffer);
 			// Consume the async-class and the comma
 			buffer = s;
 		} else {
-			oob->class = strdup(buffer);
 			buffer += strlen(buffer);
 		}
-		MIList *res = processMIResults(&buffer);
+		MIList *res = processMIResults(arena, &buffer);
 		oob->results = res;
 		
 	// stream records
@@ -262,15 +349,15 @@ processMIOOBRecord(char *buffer, int id)
 		buffer++;
 		switch (c) {
 			case '~' :
-				oob = NewMIConsoleStreamOutput();
+				oob = newOOBRecord(arena, MIOOBRecordTypeStream, MIOOBRecordConsoleStream, id);
 				break;
 
 			case '@' :
-				oob = NewMITargetStreamOutput();
+				oob = newOOBRecord(arena, MIOOBRecordTypeStream, MIOOBRecordTargetStream, id);
 				break;
 
 			case '&' :
-				oob = NewMILogStreamOutput();
+				oob = newOOBRecord(arena, MIOOBRecordTypeStream, MIOOBRecordLogStream, id);
 				break;
 		}
 		if (*buffer != '\0' && *buffer == '"') {
@@ -279,8 +366,8 @@ processMIOOBRecord(char *buffer, int id)
 		oob->cstring = translateCString(&buffer);
 	} else {
 		// Badly format MI line, just pass it to the user as target stream
-		oob = NewMITargetStreamOutput();
-		oob->cstring = strdup(buffer); //$NON-NLS-1$
+		oob = newOOBRecord(arena, MIOOBRecordTypeStream, MIOOBRecordTargetStream, id);
+		oob->cstring = buffer; //$NON-NLS-1$
 	}
 	return oob;
 }
@@ -290,20 +377,20 @@ processMIOOBRecord(char *buffer, int id)
  * Extract the MI Result comma seperated responses.
  */
 static MIList *
-processMIResults(char **buffer)
+processMIResults(MIArena *arena, char **buffer)
 {
-	MIList *	aList = MIListNew();
-	MIResult *	result = processMIResult(buffer);
+	MIList *	aList = newList(arena);
+	MIResult *	result = processMIResult(arena, buffer);
 
 	if (result != NULL) {
-		MIListAdd(aList, (void *)result);
+		listAdd(arena, aList, (void *)result);
 	}
 	while (*(*buffer) != '\0' && *(*buffer) == ',') 
 	{
 		(*buffer)++;
-		result = processMIResult(buffer);
+		result = processMIResult(arena, buffer);
 		if (result != NULL) {
-			MIListAdd(aList, (void *)result);
+			listAdd(arena, aList, (void *)result);
 		}
 	}
 	return aList;
@@ -314,43 +401,30 @@ processMIResults(char **buffer)
  * moving forward constructing the AST.
  */
 static MIResult *
-processMIResult(char **buffer)
+processMIResult(MIArena *arena, char **buffer)
 {
-        int             len;
-	MIResult *	result = MIResultNew();
+	MIResult *	result = newResult(arena);
 	MIValue *	value;
-	char *          variable;
 	char *		equal = strchr(*buffer, '=');
 
 	if (*(*buffer) != '\0' && isalpha(*(*buffer)) && equal != NULL) 
 	{
-		variable = *buffer;
+		result->variable = *buffer;
 		*equal++ = '\0';
 		
-		// copy the variable to the result->variable
-		len = strlen(variable)*sizeof(char);
-		result->variable = malloc(len+1);
-		if (result->variable == (void *)0)
-		{
-		        fprintf(stderr, "Malloc failed.\n");
-		        return (MIResult *)NULL;
-		}
-		memset(result->variable, 0, len+1);
-		memcpy(result->variable, variable, len);
-		
 		*buffer = equal;
-		value = processMIValue(buffer);
+		value = processMIValue(arena, buffer);
 		result->value = value;
 	} else if(*(*buffer) != '\0' && *(*buffer) == '"') 
 	{
 		// This an error but we just swallow it and move on.
-		value = processMIValue(buffer);
+		value = processMIValue(arena, buffer);
 		result->value = value;
 	} else 
 	{
-		result->variable = strdup(*buffer);
-		result->value = NewMIConst(); // Empty string:???
-		*(*buffer) = '\0';
+		result->variable = *buffer;
+		result->value = newValue(arena, MIValueTypeConst); // Empty string:???
+		*buffer += strlen(*buffer);
 	}
 	return result;
 }
@@ -359,20 +433,20 @@ processMIResult(char **buffer)
  * Find a MIValue implementation or return null.
  */
 static MIValue *
-processMIValue(char **buffer)
+processMIValue(MIArena *arena, char **buffer)
 {
 	MIValue *value = NULL;
 	
 	if (*(*buffer) != '\0') {
 		if (*(*buffer) == '{') {
 			(*buffer)++;
-			value = processMITuple(buffer);
+			value = processMITuple(arena, buffer);
 		} else if (*(*buffer) == '[') {
 			(*buffer)++;
-			value = processMIList(buffer);
+			value = processMIList(arena, buffer);
 		} else if (*(*buffer) == '"') {
 			(*buffer)++;
-			value = NewMIConst();
+			value = newValue(arena, MIValueTypeConst);
 			value->cstring = translateCString(buffer);
 		}
 	}
@@ -385,11 +459,11 @@ processMIValue(char **buffer)
  * This is usually call by processMIvalue();
  */
 static MIValue *
-processMITuple(char **buffer)
+processMITuple(MIArena *arena, char **buffer)
 {
-	MIValue *tuple = NewMITuple();
+	MIValue *tuple = newValue(arena, MIValueTypeTuple);
 #ifdef __APPLE__
-	MIList *values = MIListNew();
+	MIList *values = newList(arena);
 	MIValue *value;
 	MIResult *result;
 #endif /* __APPLE__ */
@@ -399,20 +473,20 @@ processMITuple(char **buffer)
 	{
 #ifdef __APPLE__
 		// Try for the MIValue first
-		value = processMIValue(buffer);
+		value = processMIValue(arena, buffer);
 		if (value != NULL) 
 		{
-			MIListAdd(values, (void *)value);
+			listAdd(arena, values, (void *)value);
 		} else 
 		{
-			result = processMIResult(buffer);
+			result = processMIResult(arena, buffer);
 			if (result != NULL) 
 			{
 				if (results == NULL) 
 				{
-					results = MIListNew();
+					results = newList(arena);
 				}
-				MIListAdd(results, (void *)result);
+				listAdd(arena, results, (void *)result);
 			}
 		}
 		if (*(*buffer) != '\0' && *(*buffer) == ',') 
@@ -420,7 +494,7 @@ processMITuple(char **buffer)
 			(*buffer)++;
 		}
 #else /* __APPLE__ */
-		results = processMIResults(buffer);
+		results = processMIResults(arena, buffer);
 #endif /* __APPLE__ */
 	}
 	if (*(*buffer) != '\0' && *(*buffer) == '}') 
@@ -439,27 +513,27 @@ processMITuple(char **buffer)
  * ']' consuming/delete chars from the StringBuffer.
  */
 static MIValue *
-processMIList(char **buffer)
+processMIList(MIArena *arena, char **buffer)
 {
-	MIValue *list = NewMIList();
-	MIList *valueList = MIListNew();
-	MIList *resultList = MIListNew();
+	MIValue *list = newValue(arena, MIValueTypeList);
+	MIList *valueList = newList(arena);
+	MIList *resultList = newList(arena);
 	MIValue *value;
 	MIResult *result;
 	// catch closing ']'
 	while (*(*buffer) != '\0' && *(*buffer) != ']') 
 	{
 		// Try for the MIValue first
-		value = processMIValue(buffer);
+		value = processMIValue(arena, buffer);
 		if (value != NULL) 
 		{
-			MIListAdd(valueList, (void *)value);
+			listAdd(arena, valueList, (void *)value);
 		} else 
 		{
-			result = processMIResult(buffer);
+			result = processMIResult(arena, buffer);
 			if (result != NULL) 
 			{
-				MIListAdd(resultList, (void *)result);
+				listAdd(arena, resultList, (void *)result);
 			}
 		}
 		if (*(*buffer) != '\0' && *(*buffer) == ',') 
@@ -483,103 +557,39 @@ processMIList(char **buffer)
  * This method will stop at the closing double quote remove the extra
  * backslach escaping and return the string __without__ the enclosing double quotes
  * The orignal StringBuffer will move forward.
+ *
+ * The string is unescaped in place, replacing the closing quote with a
+ * NUL, so the result points into the buffer. Without backslashes nothing
+ * is moved.
  */
 static char *
 translateCString(char **buffer)
 {
-	int escape = 0;
-	int closingQuotes = 0;
-	size_t len = 0;
-	char *s = *buffer;
-	char *sb;
-	char *p, *q;
-	
-	while (*s != '\0' && !closingQuotes)
-	{
-	        switch (*s)
-	        {
-	                case '\\':
-	                        if (escape)
-	                        {
-	                                escape = 0;
-	                        } else
-	                        {
-	                                escape = 1;
-	                        }
-	                        ++len;
-	                        ++s;
-	                        break;
-	                        
-	                case '"':
-	                        if (escape)
-	                        {
-	                                escape = 0;
-	                                ++s;
-	                                ++len;
-	                        } else
-	                        {
-	                                ++s;
-	                                ++closingQuotes;
-	                        }
-	                        break;
-	                        
-	                default:
-	                        ++len;
-	                        ++s;
-	                        escape = 0;
-	        }
-	}
-	
-	if ((sb = malloc((len+1)*sizeof(char))) == (void *)0)
-	{
-	        fprintf(stderr, "Malloc failed.\n");
-	        return NULL;
+	char *	start = *buffer;
+	char *	s = start + strcspn(start, "\"\\");
+	char *	q = s;
+	size_t	n;
+
+	while (*s != '\0') {
+		if (*s == '"') {
+			s++;
+			break;
+		}
+		// an escaped backslash or quote stands for itself, others are kept
+		s++;
+		if (*s == '\\' || *s == '"') {
+			*q++ = *s++;
+		} else {
+			*q++ = '\\';
+		}
+		n = strcspn(s, "\"\\");
+		memmove(q, s, n);
+		q += n;
+		s += n;
 	}
-	memset(sb, 0, len+1);
-	memcpy(sb, *buffer, len);
-	
+	*q = '\0';
+
 	// point buffer past the closing quote
 	*buffer = s;
-	
-	p = sb;
-	q = sb;
-	sb[len] = '\0';       // get rid of the final quote
-	escape = 0;
-	
-	// strip out any escape backslashes
-	for (; *p != '\0'; p++)
-	{
-	        switch (*p)
-	        {
-	                case '\\':
-	                        if (escape)
-	                        {
-	                                *q++ = *p;
-	                                escape = 0;
-	                        } else
-	                        {
-	                                escape = 1;
-	                        }
-	                        break;
-	                        
-	                case '"':
-	                        if (escape)
-	                        {
-	                                *q++ = *p;
-	                                escape = 0;
-	                        }
-	                        break;
-	                
-	                default:
-	                        if (escape)
-	                        {
-	                                *q++ = '\\';
-	                        }
-	                        *q++ = *p;
-	                        escape = 0;
-	        }
-	}
-	*q = '\0';
-	
-	return sb;
+	return start;
 }
@@ -45,6 +45,7 @@ MIResultRecordNew(void)
 	rr->results = NULL;
 	rr->resultClass = MIResultRecordINVALID;
 	rr->token = -1;
+	rr->arena = NULL;
 	return rr;
 }
 
@@ -94,6 +95,10 @@ MIResultRecordToString(MIResultRecord *rr)
 void
 MIResultRecordFree(MIResultRecord *rr)
 {
+	if (rr->arena != NULL) {
+		MIArenaRelease(rr->arena);
+		return;
+	}
 	if (rr->results != NULL)
 		MIListFree(rr->results, MIResultFree);
 	free(rr);
@@ -25,6 +25,7 @@
 #define _MIRESULTRECORD_H_
 
 #include "MIList.h"
+#include "MIArena.h"
 #include "MIString.h"
 
 #define MIResultRecordINVALID	0
@@ -41,6 +42,7 @@ struct MIResultRecord {
 	MIList *	results;
 	int			resultClass;
 	int			token;
+	MIArena *	arena;	/* holds the record if it was parsed */
 };
 typedef struct MIResultRecord MIResultRecord;
 
@@ -35,6 +35,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <pthread.h>
+#include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
@@ -52,9 +54,13 @@ static struct timeval	MISessionDefaultSelectTimeout = {0, 1000};
 static int				MISessionDebug = 0;
 
 static void DoOOBCallbacks(MISession *sess, MIList *oobs);
+static void ProcessResponse(MISession *sess, char *str);
+static void CommandDone(MISession *sess, MICommand *cmd);
 //static void HandleChild(int sig);
 static int WriteCommand(int fd, char *cmd);
-static char *ReadResponse(int fd);
+static int FillReadBuffer(MISession *sess, int fd);
+static char *NextResponse(MISession *sess, int flush);
+static int ReadTargetOutput(MISession *sess);
 #ifdef __gnu_linux__
 static int IsExecAsyncStopped(MISession *sess, MIList *oobs);
 #endif /* __gnu_linux__ */
@@ -76,6 +82,15 @@ MISessionNew(void)
 	sess->exit_status = 0;
 	sess->command = NULL;
 	sess->send_queue = MIListNew();
+	sess->in_flight = MIListNew();
+	sess->pipeline_depth = 1;
+	sess->next_token = 1;
+	sess->read_buf = NULL;
+	sess->read_size = 0;
+	sess->read_start = 0;
+	sess->read_lines = 0;
+	sess->read_scan = 0;
+	sess->read_end = 0;
 	sess->gdb_path = NULL;
 	sess->data_directory = NULL;
 	sess->event_callback = NULL;
@@ -99,6 +114,9 @@ void
 MISessionFree(MISession *sess)
 {
 	MIListRemove(MISessionList, (void *)sess);
+	MIListFree(sess->send_queue, NULL);
+	MIListFree(sess->in_flight, NULL);
+	free(sess->read_buf);
 	if (sess->gdb_path != NULL)
 	{
 		free(sess->gdb_path);
@@ -144,6 +162,16 @@ MISessionSetDebug(int debug)
 	MISessionDebug = debug;
 }
 
+/*
+ * Allow up to depth commands to be sent before the reply to the first
+ * one has arrived. Replies are matched to commands by their tokens.
+ */
+void
+MISessionSetPipelineDepth(MISession *sess, int depth)
+{
+	sess->pipeline_depth = depth < 1 ? 1 : depth;
+}
+
 int
 MISessionStartLocal(MISession *sess, char *prog)
 {
@@ -305,7 +333,8 @@ MISessionSetGDBDataDirectory(MISession *sess, char *path)
 }
 
 /*
- * Send command to debugger.
+ * Send command to debugger. The command gets a token unless it already
+ * has one.
  */
 int
 MISessionSendCommand(MISession *sess, MICommand *cmd)
@@ -315,11 +344,46 @@ MISessionSendCommand(MISession *sess, MICommand *cmd)
 		return -1;
 	}
 
+	if (cmd->token < 0) {
+		cmd->token = sess->next_token++;
+	}
 	MIListAdd(sess->send_queue, (void *)cmd);
 	
 	return 0;
 }
 
+/*
+ * Write with SIGPIPE blocked, so that writing to a GDB that has exited
+ * fails with EPIPE instead of killing the process. The SIGPIPE the write
+ * raised is taken off the pending set before the mask is restored, unless
+ * one was already pending.
+ */
+static ssize_t
+WriteNoSigpipe(int fd, const char *buf, size_t len)
+{
+	sigset_t		pipe_set;
+	sigset_t		old_set;
+	sigset_t		pending;
+	struct timespec	zero = { 0, 0 };
+	ssize_t			n;
+	int				saved;
+
+	sigemptyset(&pipe_set);
+	sigaddset(&pipe_set, SIGPIPE);
+	sigemptyset(&pending);
+	sigpending(&pending);
+	pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+	n = write(fd, buf, len);
+	if (n < 0 && errno == EPIPE && !sigismember(&pending, SIGPIPE)) {
+		saved = errno;
+		while (sigtimedwait(&pipe_set, NULL, &zero) < 0 && errno == EINTR)
+			;
+		errno = saved;
+	}
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+	return n;
+}
+
 /*
  * Send command to GDB. We keep writing
  * until the whole command has been sent.
@@ -340,7 +404,7 @@ WriteCommand(int fd, char *cmd)
 	}
 		
 	while (len > 0) {
-		n = write(fd, cmd, len);
+		n = WriteNoSigpipe(fd, cmd, len);
 		if (n <= 0) {
 			if (n < 0) {
 				if (errno == EINTR)
@@ -358,170 +422,175 @@ WriteCommand(int fd, char *cmd)
 }
 
 /*
- * Read BUFSIZ chunks of data until we have read
- * everything available.
- * 
- * Everything has been read if:
- * 1) the read returns less than BUFSIZ
- * 2) the read would block (errno == EAGAIN)
- * 
- * The assumption is that O_NONBLOCK has been set 
- * of the file descriptor.
- * 
- * The buffer is static, so we just reuse it for each
- * call and increase the size if necessary.
+ * Output from GDB is read into a buffer that belongs to the session and
+ * is kept between reads, so that a reply split over several reads is not
+ * copied or searched more than once. Complete lines are handed to the
+ * parser in place; a partial line stays in the buffer until the rest of
+ * it arrives.
+ *
+ *	read_start	first byte not processed yet
+ *	read_lines	end of the complete lines, just past a newline
+ *	read_scan	end of the data already searched for newlines
+ *	read_end	end of the data read
  */
-#define MI_BUFSIZ 256000
-static char *
-ReadResponse(int fd)
+#define MI_READ_BUFSIZ	16384
+
+/*
+ * Read everything available from GDB into the session buffer, growing it
+ * if necessary. Assumes that O_NONBLOCK has been set on the descriptor.
+ *
+ * Returns -1 on EOF or error, 0 otherwise.
+ */
+static int
+FillReadBuffer(MISession *sess, int fd)
 {
 	int		n;
-	int		done = 0;
-	int		len = 0;
-	int		room = MI_BUFSIZ;
-	char *	p;
-	int		res_buf_len = MI_BUFSIZ;
-	char *	res_buf = NULL;
-	int 	spin_cnt = 0;
-	
-	if ((res_buf = malloc(sizeof(char)*MI_BUFSIZ)) == (void *)0)
-	{
-		if (MISessionDebug) {
-			printf("MI: ERROR ReadResponse malloc error!\n");
-			fflush(stdout);
-		}
-		MISetError(MI_ERROR_SYSTEM, strerror(errno));
-		return NULL;
-	}
-	
-	// Null the buffer
-	memset(res_buf, 0, sizeof(char)*MI_BUFSIZ);
-	
-	p = res_buf;
-	
-	for (;;) 
-	{	
-		// read up to MI_BUFSIZ-1 at a time
-		if ((n = read(fd, p, room)) <= 0)
-		{
-			if (n < 0) 
-			{
-				// since we are non-blocking, we only want to
-				// return if we have the done flag set
-				if (errno == EAGAIN)
-				{
-					// we are done, break from loop
-					if (done)
-					{
-						break;
-					} else
-					{
-						// This fixes a bug where asynchronous thread messages
-						// were provided by gdb, but no (gdb) terminator was 
-						// present. Let things spin for awhile and return if we
-						// don't read anything.
-						if (spin_cnt++ == 10000000)
-						{
-							break;
-						}
-						
-						// not done, continue until
-						// we have input from the pipe.
-						continue;
-					}
-				}
-				if (errno == EINTR)
-				{
-					continue;
+
+	for (;;) {
+		/* always leave room for a terminating NUL */
+		if (sess->read_end + 1 >= sess->read_size) {
+			if (sess->read_start > 0) {
+				int len = sess->read_end - sess->read_start;
+				memmove(sess->read_buf, sess->read_buf + sess->read_start, len);
+				sess->read_lines -= sess->read_start;
+				sess->read_scan -= sess->read_start;
+				sess->read_start = 0;
+				sess->read_end = len;
+			} else {
+				int size = sess->read_size > 0 ? sess->read_size * 2 : MI_READ_BUFSIZ;
+				char *buf = realloc(sess->read_buf, size);
+				if (buf == NULL) {
+					MISetError(MI_ERROR_SYSTEM, strerror(errno));
+					return -1;
 				}
-				MISetError(MI_ERROR_SYSTEM, strerror(errno));
-			}
-			
-			// Before calling error condition, we want to ensure that the ^exit
-			// record is not in the buffer. We do not expect to have a command
-			// terminator if exit was called.
-			if (!strncmp(res_buf, "^exit", 5))
-			{
-				// point p to the char right after the ^exit.
-				p = &res_buf[5];
-				break;
+				sess->read_buf = buf;
+				sess->read_size = size;
 			}
-			
-			if (MISessionDebug) {
-				printf("MI: ERROR ReadResponse read returned 0!\n");
-				printf("MI: room is %d\n", room);
-				printf("MI: Buffer is: %s\n", res_buf);
-				fflush(stdout);
-			}
-			
-			// error condition
-			free(res_buf);
-			MISetError(MI_ERROR_SESSION, "Unexpected EOF from gdb/mi fd.");
-			
-			return NULL;
+			continue;
 		}
-		
-		// reset spin_cnt
-		spin_cnt = 0;
-		
-		// check command terminator condition
-		p += n-1;
-		if (*p-- == '\n')
-		{
-			if (*p-- == ' ')
-			{
-				if (*p-- == ')')
-				{
-					if (*p-- == 'b')
-					{
-						if (*p-- == 'd')
-						{
-							if (*p-- == 'g')
-							{
-								if (*p-- == '(')
-								{
-									++done;
-								}
-							}
-						}
-					}
-				}
-			}
+
+		n = read(fd, sess->read_buf + sess->read_end, sess->read_size - sess->read_end - 1);
+		if (n > 0) {
+			sess->read_end += n;
+			continue;
 		}
-			
-		len += n;
-		// ensure that res_buf still has room
-		if (len < res_buf_len-1)
-		{
-			// reset p
-			p = &res_buf[len];
-			room -= n;
+		if (n < 0 && errno == EINTR) {
 			continue;
 		}
-		
-		res_buf_len += MI_BUFSIZ;
-		if ((res_buf = realloc(res_buf, sizeof(char)*res_buf_len)) == (void *)0)
-		{
+		if (n < 0 && errno == EAGAIN) {
+			return 0;
+		}
+		if (n < 0) {
 			MISetError(MI_ERROR_SYSTEM, strerror(errno));
+		} else {
+			MISetError(MI_ERROR_SESSION, "Unexpected EOF from gdb/mi fd.");
+		}
+		return -1;
+	}
+}
+
+/*
+ * Find the prompt that ends a reply, at the start of a line.
+ */
+static char *
+FindPrompt(char *data, int len)
+{
+	char *	p = data;
+	char *	end = data + len;
+
+	while ((p = memchr(p, '(', end - p)) != NULL) {
+		if (end - p >= 7 && memcmp(p, "(gdb) \n", 7) == 0 && (p == data || p[-1] == '\n')) {
+			return p;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+/*
+ * Take the next segment of complete lines from the session buffer: up to
+ * and including the next prompt, or all complete lines if there is none.
+ * The segment is NUL-terminated in place and stays valid until the next
+ * read. If flush is set, a partial last line is returned as well.
+ *
+ * Returns NULL if there is nothing to process.
+ */
+static char *
+NextResponse(MISession *sess, int flush)
+{
+	char *	buf = sess->read_buf;
+	char *	data;
+	char *	end;
+
+	if (sess->read_lines <= sess->read_start) {
+		/* only the data read since the last search can hold a new line */
+		char *nl = NULL;
+		for (end = buf + sess->read_end; end > buf + sess->read_scan; end--) {
+			if (end[-1] == '\n') {
+				nl = end;
+				break;
+			}
+		}
+		sess->read_scan = sess->read_end;
+		if (nl != NULL) {
+			sess->read_lines = nl - buf;
+		} else if (flush && sess->read_end > sess->read_start) {
+			sess->read_lines = sess->read_end;
+		} else {
 			return NULL;
 		}
-		p = &res_buf[len];
-		memset(p, 0, sizeof(char)*MI_BUFSIZ);
-		// reset room
-		room = MI_BUFSIZ;
 	}
-	
-	// set the final entry in resbuf to 0
-	*p = '\0';
+
+	data = buf + sess->read_start;
+	end = FindPrompt(data, sess->read_lines - sess->read_start);
+	if (end != NULL) {
+		end += 6;
+		*end = '\0';
+		sess->read_start = end + 1 - buf;
+	} else {
+		end = buf + sess->read_lines;
+		if (end[-1] == '\n') {
+			end[-1] = '\0';
+		} else {
+			*end = '\0';
+		}
+		sess->read_start = sess->read_lines;
+	}
+
+	/* an empty buffer starts again from the beginning */
+	if (sess->read_start == sess->read_end) {
+		sess->read_start = sess->read_lines = sess->read_scan = sess->read_end = 0;
+	}
 
 	if (MISessionDebug) {
-		printf("MI: RECV %s", res_buf); 
-		if (res_buf[strlen(res_buf)-1] != '\n')
-			printf("\n");
+		printf("MI: RECV %s\n", data);
 		fflush(stdout);
 	}
 
-	return res_buf;
+	return data;
+}
+
+/*
+ * Pass the application output that is available to the target callback.
+ */
+static int
+ReadTargetOutput(MISession *sess)
+{
+	char	buf[BUFSIZ];
+	int		n;
+
+	do {
+		n = read(sess->pty_fd, buf, sizeof(buf) - 1);
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0) {
+		return -1;
+	}
+	buf[n] = '\0';
+	if (sess->target_callback != NULL) {
+		sess->target_callback(buf);
+	}
+	return 0;
 }
 
 /*
@@ -537,19 +606,34 @@ void
 MISessionProcessCommandsAndResponses(MISession *sess, fd_set *rfds, fd_set *wfds)
 {
 	char *		str;
-	MIOutput *	output;
 	
 	if (sess->pid == -1) {
 		return;
 	}
 		
-	if (sess->in_fd != -1
+	while (sess->in_fd != -1
 		&& !MIListIsEmpty(sess->send_queue)
-		&& sess->command == NULL
+		&& MIListSize(sess->in_flight) < sess->pipeline_depth
 		&& (wfds == NULL || FD_ISSET(sess->in_fd, wfds))
 	)
-	{	
-		sess->command = (MICommand *)MIListRemoveFirst(sess->send_queue);
+	{
+		MICommand *cmd = (MICommand *)MIListGetFirstElement(sess->send_queue);
+
+		/*
+		 * An interrupt is completed by a stopped record rather than a reply,
+		 * so it is never in flight together with other commands.
+		 */
+		if (sess->command != NULL &&
+				(strcmp(cmd->command, "-exec-interrupt") == 0 ||
+				strcmp(sess->command->command, "-exec-interrupt") == 0)) {
+			break;
+		}
+
+		MIListRemoveFirst(sess->send_queue);
+		MIListAdd(sess->in_flight, (void *)cmd);
+		if (sess->command == NULL) {
+			sess->command = cmd;
+		}
 
 #ifdef __gnu_linux__
 		/*
@@ -557,106 +641,141 @@ MISessionProcessCommandsAndResponses(MISession *sess, fd_set *rfds, fd_set *wfds
 		 * presumably if the 'tty' command is issued.) Without this, the only way to
 		 * interrupt a running process seems to be from the command line.
 		 */
-		if (strcmp(sess->command->command, "-exec-interrupt") == 0) {
+		if (strcmp(cmd->command, "-exec-interrupt") == 0) {
 			if (MISessionDebug) {
 				printf("MI: sending SIGINT to %d\n", sess->pid); 
 				fflush(stdout);
 			}		
 			kill(sess->pid, SIGINT);
-		} else if (WriteCommand(sess->in_fd, MICommandToString(sess->command)) < 0) {
+		} else if (WriteCommand(sess->in_fd, MICommandToString(cmd)) < 0) {
 			sess->in_fd = -1;
 		}
 #else /* __gnu_linux__ */
-		if (WriteCommand(sess->in_fd, MICommandToString(sess->command)) < 0) {
+		if (WriteCommand(sess->in_fd, MICommandToString(cmd)) < 0) {
 			sess->in_fd = -1;
 		}
 #endif /* __gnu_linux */
 	}
 
 	if (sess->out_fd != -1 && FD_ISSET(sess->out_fd, rfds)) {
-		if ((str = ReadResponse(sess->out_fd)) == NULL) {
+		/*
+		 * With several commands in flight, one read can hold several
+		 * replies. Each one ends with a prompt. Whatever GDB wrote before
+		 * exiting, such as ^exit, is still processed.
+		 */
+		int eof = FillReadBuffer(sess, sess->out_fd) < 0;
+
+		while ((str = NextResponse(sess, eof)) != NULL) {
+			ProcessResponse(sess, str);
+		}
+		if (eof) {
 			if (MISessionDebug) {
-				printf("MI: ERROR ReadResponse returned null!\n");
+				printf("MI: ERROR reading from gdb: %s\n", MIGetErrorStr());
 				fflush(stdout);
 			}
 			sess->out_fd = -1;
 			return;
 		}
-		
-		/*
-		 * If there's a command in progress, use the MIOutput saved with the command
-		 * to process any output. Otherwise create a new one.
-		 */
-		if (sess->command != NULL) {
-			output = sess->command->output;
-		} else {
-			output = MIOutputNew();
+	}
+	
+	/* process application output */
+	if (sess->pty_fd != -1 && FD_ISSET(sess->pty_fd, rfds)) {
+		if (ReadTargetOutput(sess) < 0) {
+			sess->pty_fd = -1;
 		}
+	}
+}
 
-		MIParse(str, output);
-		free(str);
-			
-		/*
-		 * The output can consist of:
-		 * 	async oob records that are not necessarily the result of a command
-		 * 	stream oob records that always result from a command
-		 *	result records from a command
-		 * 
-		 * Async and stream oob records are processed immediately and removed.
-		 * 
-		 * If there are result records, then the output *should* have resulted
-		 * from the execution of a command. Mark the command as completed an
-		 * invoke its callback.
-		 * 
-		 * The stream oob and result records are freed when the command is freed.
-		 */
-		 
-		if (output->oobs != NULL) {
+/*
+ * Remove a completed command from the commands in flight.
+ */
+static void
+CommandDone(MISession *sess, MICommand *cmd)
+{
+	cmd->completed = 1;
+	MIListRemove(sess->in_flight, (void *)cmd);
+	sess->command = (MICommand *)MIListGetFirstElement(sess->in_flight);
+}
+
+/*
+ * Process the output up to and including one prompt.
+ * 
+ * The output can consist of:
+ * 	async oob records that are not necessarily the result of a command
+ * 	stream oob records that always result from a command
+ *	result records from a command
+ * 
+ * Async oob records are processed immediately and removed. Stream oob
+ * records are passed to their callbacks and saved with the oldest command
+ * in flight, which is the one GDB is working on.
+ * 
+ * A result record completes the command with the same token, or the oldest
+ * command if the record has no token. Its callback is invoked.
+ * 
+ * The length of the output is added to the command it was saved with.
+ *
+ * The stream oob and result records are freed when the command is freed.
+ */
+static void
+ProcessResponse(MISession *sess, char *str)
+{
+	MIOutput *	output = MIOutputNew();
+	MICommand *	cmd = sess->command;
+	MICommand *	c;
+	size_t		len = strlen(str);
+
+	MIParse(str, output);
+
+	if (output->oobs != NULL) {
 #ifdef __gnu_linux__
-			if (sess->command != NULL &&
-					strcmp(sess->command->command, "-exec-interrupt") == 0 &&
-					IsExecAsyncStopped(sess, output->oobs)) {
-				sess->command->completed = 1;
-			}
-#endif /* __gnu_linux__ */
-			DoOOBCallbacks(sess, output->oobs);
+		if (cmd != NULL &&
+				strcmp(cmd->command, "-exec-interrupt") == 0 &&
+				IsExecAsyncStopped(sess, output->oobs)) {
+			CommandDone(sess, cmd);
 		}
+#endif /* __gnu_linux__ */
+		DoOOBCallbacks(sess, output->oobs);
+	}
 
-		/*
-		 * If there's a command in progress, process it.
-		 */
-		if (sess->command != NULL) {
-			if (output->rr != NULL) {
-				if (MISessionDebug) {
-					printf("MI: PROCESS COMMAND CALLBACK\n");
-					fflush(stdout);
-				}
-				if (sess->command->callback != NULL) {
-					sess->command->callback(output->rr, sess->command->cb_data);
-				}
-				sess->command->completed = 1;
+	if (output->rr != NULL && output->rr->token >= 0) {
+		for (MIListSet(sess->in_flight); (c = (MICommand *)MIListGet(sess->in_flight)) != NULL; ) {
+			if (c->token == output->rr->token) {
+				cmd = c;
+				break;
 			}
-		} else {
-			MIOutputFree(output);
 		}
+	}
 
-		if (sess->command != NULL && sess->command->completed) {
-			sess->command = NULL;
-		}
+	if (cmd != NULL) {
+		cmd->reply_bytes += len;
 	}
-	
-	/* process application output */
-	if (sess->pty_fd != -1 && FD_ISSET(sess->pty_fd, rfds))
-	{		
-	if ((str = ReadResponse(sess->pty_fd)) != NULL) {
-		if (sess->target_callback != NULL) {
-			sess->target_callback(str);
+
+	if (cmd != NULL && output->oobs != NULL && !MIListIsEmpty(output->oobs)) {
+		if (cmd->output->oobs == NULL) {
+			cmd->output->oobs = MIListNew();
 		}
-		free(str);
-	} else {
-		sess->pty_fd = -1;
+		MIListAppend(cmd->output->oobs, output->oobs);
+		MIListFree(output->oobs, NULL);
+		output->oobs = NULL;
 	}
+
+	if (cmd != NULL && !cmd->completed && output->rr != NULL) {
+		if (MISessionDebug) {
+			printf("MI: PROCESS COMMAND CALLBACK\n");
+			fflush(stdout);
+		}
+		if (cmd->output->rr != NULL) {
+			MIResultRecordFree(cmd->output->rr);
+		}
+		cmd->output->rr = output->rr;
+		output->rr = NULL;
+		if (cmd->callback != NULL) {
+			cmd->callback(cmd->output->rr, cmd->cb_data);
+		}
+		CommandDone(sess, cmd);
 	}
+
+	MIOutputFree(output);
 }
 
 /*
@@ -896,8 +1015,7 @@ MISessionProgress(MISession *sess)
 				sess->command->timeout -= (sess->select_timeout.tv_sec * 1000 + sess->select_timeout.tv_usec / 1000);
 				if (sess->command->timeout <= 0) {
 					sess->command->timeout = -1;
-					sess->command->completed = 1;
-					sess->command = NULL;
+					CommandDone(sess, sess->command);
 					return 0;
 				}
 			}
@@ -36,8 +36,17 @@ struct MISession {
 	int				pid;
 	int				exited;
 	int				exit_status;
-	MICommand *		command;
+	MICommand *		command;	/* oldest command in flight */
 	MIList *		send_queue;
+	MIList *		in_flight;	/* commands sent, oldest first */
+	int				pipeline_depth;	/* max commands in flight */
+	int				next_token;
+	char *			read_buf;	/* output from GDB not processed yet */
+	int				read_size;
+	int				read_start;
+	int				read_lines;
+	int				read_scan;
+	int				read_end;
 	char *			gdb_path;
 	char *			data_directory;
 	struct timeval	select_timeout;
@@ -56,6 +65,7 @@ extern MISession *MISessionNew(void);
 extern void MISessionFree(MISession *sess);
 extern void MISessionSetTimeout(MISession *sess, long sec, long usec);
 extern void MISessionSetDebug(int debug);
+extern void MISessionSetPipelineDepth(MISession *sess, int depth);
 extern int MISessionStartLocal(MISession *sess, char *);
 extern void MISessionRegisterEventCallback(MISession *sess, void (*callback)(MIEvent *));
 extern void MISessionRegisterCommandCallback(MISession *sess, void (*callback)(MIResultRecord *));
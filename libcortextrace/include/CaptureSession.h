@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+
+#include "EventLoop.h"
+#include "GdbConnection.h"
+#include "TraceEventListener.h"
+#include "TraceFileParser.h"
+#include "TraceSource.h"
+
+namespace lct {
+
+/**
+ * One debug target: a GDB connection to its gdbserver, and a FIFO with a
+ * parser for the trace data OpenOCD writes to it. The data is read through
+ * a TraceSource and decoded in the buffers it lends.
+ *
+ * SetArchivePath() has the raw data from the FIFO saved to a file as well,
+ * see FdTraceSource::SetArchive().
+ *
+ * With SetTracePort(), OpenOCD serves the trace data on a TCP port instead,
+ * and the session connects to it on the gdbserver host. A lost connection
+ * is retried from Maintain() about once a second.
+ *
+ * Parsed events are counted and passed on to the listener. The session is
+ * driven by an EventLoop, see SessionManager.
+ */
+class CaptureSession : public EventLoop::Handler, public TraceEventListener {
+public:
+    struct Stats {
+        Stats() : Bytes(0), Reads(0), Events(0), Overflows(0), Reconnects(0) {}
+        uint64_t Bytes;
+        uint64_t Reads;
+        uint64_t Events;
+        uint64_t Overflows;
+        uint64_t Reconnects;
+    };
+
+    CaptureSession(const std::string& name, TraceEventListener& listener);
+    virtual ~CaptureSession();
+
+    void SetTracePort(uint16_t port) { TracePort = port; }
+    void SetArchivePath(const std::string& path) { ArchivePath = path; }
+    static std::string TargetHost(const std::string& gdbTarget);
+
+    bool Open();
+    bool Start(const std::string& gdbPath, const std::string& gdbTarget,
+            const std::string& elfPath, size_t corefreq);
+    void Stop();
+    void Finish();
+    void Attach(EventLoop* loop);
+    void Detach();
+    void Maintain();
+
+    const std::string& GetName() const { return Name; }
+    GdbConnection& Gdb() { return Connection; }
+    int GetFd() const { return Source ? Source->GetFd() : -1; }
+    const Stats& GetStats() const { return Statistics; }
+
+    // interface EventLoop::Handler
+    void HandleEvents(uint32_t events);
+
+    // interface TraceEventListener
+    void HandleTraceEvent(const TraceEvent& event);
+
+protected:
+    std::string Name;
+    TraceEventListener& Listener;
+    GdbConnection Connection;
+    std::unique_ptr<TraceSource> Source;
+    std::string PipeName;
+    std::string ArchivePath;
+    uint16_t TracePort;
+    bool Ended;
+    EventLoop* Loop;
+    bool Attached;
+    time_t LastConnect;
+    TraceFileParser Parser;
+    Stats Statistics;
+    bool TpiuEnabled;
+
+    void Read();
+
+private:
+    CaptureSession(const CaptureSession&);
+    CaptureSession& operator=(const CaptureSession&);
+};
+
+} /* namespace lct */
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+#include "TraceEventListener.h"
+
+namespace lct {
+
+/**
+ * Accumulate DWT event counter packets (hardware source packets with
+ * discriminator 0) into 64-bit totals.
+ *
+ * The CPI, EXC, SLEEP, LSU and FOLD counters are 8 bits wide and emit a
+ * packet each time they wrap, so every overflow bit stands for 256 events.
+ * The cycle event (POSTCNT underflow) stands for a configurable number of
+ * cycles, see SetCycleEventPeriod().
+ *
+ * Rates are computed over windows between two Totals snapshots. The number
+ * of cycles in a window is taken from cycle events if they are enabled, and
+ * from the timestamp otherwise (which assumes an unscaled timestamp clock).
+ */
+class DwtCounters : public TraceEventListener {
+public:
+    enum Counter {
+        CPI, EXC, SLEEP, LSU, FOLD, CYC,
+        NUM_COUNTERS
+    };
+
+    struct Totals {
+        Totals() : Events(), Timestamp(0) {}
+        uint64_t Events[NUM_COUNTERS];
+        uint64_t Timestamp;
+    };
+
+    struct Rates {
+        Rates() :
+            Cycles(0), CpiOverhead(0), ExcOverhead(0), SleepFraction(0),
+            LsuStall(0), Folded(0) {}
+        uint64_t Cycles;
+        double CpiOverhead;   ///< Extra cycles for multi-cycle instructions
+        double ExcOverhead;   ///< Cycles spent on exception entry and exit
+        double SleepFraction; ///< Cycles spent sleeping
+        double LsuStall;      ///< Extra cycles for loads and stores
+        double Folded;        ///< Folded instructions per cycle
+    };
+
+    DwtCounters();
+    virtual ~DwtCounters();
+
+    static bool IsCounterEvent(const TraceEvent& event);
+    static const char* CounterName(Counter counter);
+    static uint32_t EnableBit(Counter counter);
+    static uint32_t CycleEventPeriod(uint32_t dwtctrl);
+
+    void SetCycleEventPeriod(uint32_t cycles) { CyclePeriod = cycles; }
+    const Totals& GetTotals() const { return Current; }
+    static Rates ComputeRates(const Totals& from, const Totals& to);
+    Rates TakeWindow();
+
+    void Report(std::ostream& out) const;
+    static void PrintRates(std::ostream& out, const Rates& rates);
+
+    // interface TraceEventListener
+    void HandleTraceEvent(const TraceEvent& event);
+
+protected:
+    uint32_t CyclePeriod;
+    Totals First;
+    Totals Current;
+    Totals WindowStart;
+    bool Started;
+};
+
+} /* namespace lct */
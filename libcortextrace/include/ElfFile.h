@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lct {
+
+/**
+ * Read-only view of a 32-bit little-endian ELF file, such as the firmware
+ * image running on the target.
+ *
+ * The file is mapped into memory with mmap() and section contents are
+ * referenced in place, so opening even a large debug build is cheap. Section
+ * data pointers stay valid until the ElfFile is closed or destroyed.
+ */
+class ElfFile {
+public:
+    struct Section {
+        Section() :
+            Name(), Type(0), Flags(0), Address(0), Link(0), EntrySize(0),
+            Data(NULL), Size(0) {}
+        Section(const Section&) = default;
+        Section& operator=(const Section&) = default;
+        std::string Name;
+        uint32_t Type;
+        uint32_t Flags;
+        uint32_t Address;
+        uint32_t Link;
+        uint32_t EntrySize;
+        const uint8_t* Data;
+        size_t Size;
+    };
+
+    static const uint32_t SHT_SYMTAB = 2;
+    static const uint32_t SHT_STRTAB = 3;
+    static const uint32_t SHT_NOTE = 7;
+    static const uint32_t SHT_NOBITS = 8;
+
+    ElfFile();
+    virtual ~ElfFile();
+
+    bool Open(const std::string& path);
+    void Close();
+    bool IsOpen() const { return Map != NULL; }
+
+    const std::vector<Section>& Sections() const { return SectionList; }
+    const Section* FindSection(const std::string& name) const;
+    std::string BuildId() const;
+    std::string ContentHash() const;
+
+    static uint16_t Read16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+    static uint32_t Read32(const uint8_t* p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+    }
+
+protected:
+    const uint8_t* Map;
+    size_t MapSize;
+    std::vector<Section> SectionList;
+
+    bool ParseHeaders();
+
+private:
+    ElfFile(const ElfFile&);
+    ElfFile& operator=(const ElfFile&);
+};
+
+} /* namespace lct */
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace lct {
+
+class OutputSink;
+class TraceEvent;
+
+/**
+ * Formats decoded trace events to an OutputSink. Create one with Create():
+ *  - "text": human readable lines, with ITM characters written as is,
+ *  - "json": one JSON object per line,
+ *  - "binary": one 16 byte little-endian record per event: timestamp (8),
+ *    value (4), event type (1), packet header (1) and source ID (2).
+ *
+ * When events from several targets share one sink, SetSource() tags the
+ * output of each formatter with the target it belongs to.
+ */
+class EventFormatter {
+public:
+    /** Where a PC sample or trace address belongs, as far as known */
+    struct Location {
+        Location() : Symbol(NULL), Offset(0), File(NULL), Line(0) {}
+        const char* Symbol;
+        uint32_t Offset;
+        const char* File;
+        uint32_t Line;
+    };
+
+    EventFormatter(OutputSink& sink);
+    virtual ~EventFormatter();
+
+    static EventFormatter* Create(const std::string& format, OutputSink& sink);
+    static bool IsFormat(const std::string& format);
+
+    void SetSource(uint16_t id, const std::string& name);
+    virtual void Format(const TraceEvent& event, const Location* location = NULL) = 0;
+
+protected:
+    OutputSink& Sink;
+    uint16_t SourceId;
+    std::string SourceName;
+
+private:
+    EventFormatter(const EventFormatter&);
+    EventFormatter& operator=(const EventFormatter&);
+};
+
+class TextEventFormatter : public EventFormatter {
+public:
+    TextEventFormatter(OutputSink& sink) : EventFormatter(sink), AtLineStart(true) {}
+    void Format(const TraceEvent& event, const Location* location = NULL);
+
+protected:
+    bool AtLineStart;
+
+    void FormatLocation(const Location* location);
+};
+
+class JsonEventFormatter : public EventFormatter {
+public:
+    JsonEventFormatter(OutputSink& sink) : EventFormatter(sink) {}
+    void Format(const TraceEvent& event, const Location* location = NULL);
+
+protected:
+    void String(const char* str);
+};
+
+class BinaryEventFormatter : public EventFormatter {
+public:
+    BinaryEventFormatter(OutputSink& sink) : EventFormatter(sink) {}
+    void Format(const TraceEvent& event, const Location* location = NULL);
+};
+
+} /* namespace lct */
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+namespace lct {
+
+/**
+ * Minimal epoll based event loop. File descriptors are registered once with
+ * a handler, and Poll() dispatches the ready ones without rebuilding any
+ * descriptor sets, so the cost of a wakeup does not depend on how many
+ * descriptors are registered.
+ */
+class EventLoop {
+public:
+    static const uint32_t READABLE;
+    static const uint32_t WRITABLE;
+
+    class Handler {
+    public:
+        virtual ~Handler();
+        virtual void HandleEvents(uint32_t events) = 0;
+    };
+
+    EventLoop();
+    virtual ~EventLoop();
+
+    bool Add(int fd, Handler* handler, uint32_t events = READABLE);
+    bool Modify(int fd, Handler* handler, uint32_t events);
+    bool Remove(int fd);
+    int Poll(int timeoutMs);
+
+protected:
+    int EpollFd;
+
+private:
+    EventLoop(const EventLoop&);
+    EventLoop& operator=(const EventLoop&);
+};
+
+} /* namespace lct */
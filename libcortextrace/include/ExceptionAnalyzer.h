@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Histogram.h"
+#include "TraceEventListener.h"
+
+namespace lct {
+
+/**
+ * Rebuild exception handler activity from DWT exception trace packets
+ * (hardware source packets with discriminator 1).
+ *
+ * The analyzer keeps a stack of active handlers to follow nesting, and counts
+ * preemptions and tail-chained entries per exception. For every completed
+ * handler it records:
+ *  - the duration from entry to exit, including time spent in nested
+ *    handlers,
+ *  - the latency added by preemption, i.e. the time the handler was held off
+ *    by higher priority handlers while active.
+ * The time spent in the handler itself is summed up for the CPU share.
+ *
+ * Exception trace carries no event for an exception becoming pending, so the
+ * latency from the interrupt request to handler entry can not be observed.
+ *
+ * All times are in timestamp ticks, as found in TraceEvent::Timestamp, so
+ * local timestamps must be enabled in the ITM for the numbers to make sense.
+ */
+class ExceptionAnalyzer : public TraceEventListener {
+public:
+    enum Function {
+        EXC_ENTER = 1,
+        EXC_EXIT = 2,
+        EXC_RETURN = 3,
+    };
+
+    struct Stats {
+        Stats() :
+            Count(0), Preempted(0), TailChained(0), SelfTime(0),
+            Duration(), Latency() {}
+        uint64_t Count;
+        uint64_t Preempted;
+        uint64_t TailChained;
+        uint64_t SelfTime;
+        Histogram Duration;
+        Histogram Latency;
+    };
+
+    ExceptionAnalyzer();
+    virtual ~ExceptionAnalyzer();
+
+    static bool IsExceptionEvent(const TraceEvent& event);
+    static std::string ExceptionName(unsigned exception);
+
+    const std::map<unsigned, Stats>& GetStats() const { return PerException; }
+    unsigned CurrentException() const;
+    void Report(std::ostream& out, double ticksPerSecond = 0) const;
+
+    // interface TraceEventListener
+    void HandleTraceEvent(const TraceEvent& event);
+
+protected:
+    struct Frame {
+        Frame(unsigned exception, uint64_t entry) :
+            Exception(exception), Entry(entry), Nested(0) {}
+        unsigned Exception;
+        uint64_t Entry;
+        uint64_t Nested;
+    };
+
+    std::map<unsigned, Stats> PerException;
+    std::vector<Frame> Active;
+    uint64_t FirstTime;
+    uint64_t LastTime;
+    bool Started;
+    bool LastWasExit;
+
+    void Enter(unsigned exception, uint64_t time);
+    void Exit(unsigned exception, uint64_t time);
+    void Return(unsigned exception);
+};
+
+} /* namespace lct */
@@ -1,12 +1,67 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <ostream>
 #include <string>
+#include <vector>
+
+#include "Histogram.h"
 
 namespace lct {
 
+class GdbConnection;
 class GdbConnectionState;
 
+/**
+ * Latency and traffic of one type of MI command. Latency runs from writing
+ * the command to GDB until its reply has been parsed, so it covers GDB, the
+ * debug server and the probe.
+ */
+struct GdbCommandStats {
+    GdbCommandStats() : Type(), Failures(0), BytesSent(0), BytesReceived(0), MemoryBytes(0),
+            LatencyUs() {}
+    std::string Type;       ///< MI command, or CLI command such as "monitor tpiu"
+    uint64_t Failures;
+    uint64_t BytesSent;     ///< Length of the commands written to GDB
+    uint64_t BytesReceived; ///< Length of the output GDB wrote for them
+    uint64_t MemoryBytes;   ///< Target memory read or written
+    Histogram LatencyUs;
+};
+
+/**
+ * Result of an asynchronous GdbConnection command. Get() and Wait() keep
+ * the connection going until the command has completed.
+ */
+template <typename T>
+class GdbFuture {
+public:
+    GdbFuture() : Connection(NULL), Token(-1), Shared() {}
+    GdbFuture(const GdbFuture&) = default;
+    GdbFuture& operator=(const GdbFuture&) = default;
+
+    bool Valid() const { return bool(Shared); }
+    bool Ready() const { return Shared && Shared->Done; }
+    bool Wait();
+    const T& Get() { Wait(); return Shared->Value; }
+
+private:
+    friend class GdbConnection;
+
+    struct State {
+        State() : Done(false), Ok(false), Value() {}
+        bool Done;
+        bool Ok;
+        T Value;
+    };
+
+    GdbConnection* Connection;
+    int Token;
+    std::shared_ptr<State> Shared;
+};
+
 class GdbConnection {
 public:
     GdbConnection();
@@ -17,15 +72,48 @@ public:
     void TargetSelect(std::string target);
     void DisableTpiu();
     void EnableTpiu(std::string logfile, size_t corefreq);
+    void EnableTpiu(uint16_t port, size_t corefreq);
     void Run();
     void Stop();
 
     uint32_t ReadWord(std::string expression, uint32_t* outAddress = NULL);
-    uint32_t ReadWord(uint32_t address);
+    bool ReadWord(uint32_t address, uint32_t* value);
+    bool ReadBlock(uint32_t address, void* buffer, size_t length);
     uint32_t ResolveAddress(std::string expression);
     bool WriteWord(uint32_t address, uint32_t value);
+    bool WriteBlock(uint32_t address, const void* data, size_t length);
     std::string Evaluate(std::string expression);
 
+    /** Read a struct or scalar; the target and host must have the same byte order */
+    template <typename T>
+    bool ReadObject(uint32_t address, T* out) { return ReadBlock(address, out, sizeof(T)); }
+
+    template <typename T>
+    bool ReadArray(uint32_t address, T* out, size_t count)
+    {
+        return ReadBlock(address, out, count * sizeof(T));
+    }
+
+    void SetPipelineDepth(unsigned depth);
+    GdbFuture<uint32_t> ReadWordAsync(uint32_t address,
+            std::function<void(bool, uint32_t)> done = nullptr);
+    GdbFuture<bool> WriteWordAsync(uint32_t address, uint32_t value,
+            std::function<void(bool)> done = nullptr);
+    GdbFuture<bool> ReadBlockAsync(uint32_t address, void* buffer, size_t length,
+            std::function<void(bool)> done = nullptr);
+    GdbFuture<bool> WriteBlockAsync(uint32_t address, const void* data, size_t length,
+            std::function<void(bool)> done = nullptr);
+    GdbFuture<uint32_t> ResolveAddressAsync(std::string expression,
+            std::function<void(bool, uint32_t)> done = nullptr);
+    GdbFuture<std::string> EvaluateAsync(std::string expression,
+            std::function<void(bool, const std::string&)> done = nullptr);
+    void Wait(int token);
+    void WaitAll();
+
+    std::vector<GdbCommandStats> CommandStats() const;
+    void ResetCommandStats();
+    void ReportCommandStats(std::ostream& out) const;
+
 protected:
     std::unique_ptr<GdbConnectionState> State;
 
@@ -34,4 +122,19 @@ private:
     GdbConnection& operator=(const GdbConnection&);
 };
 
+/**
+ * @return true if the command succeeded
+ */
+template <typename T>
+bool GdbFuture<T>::Wait()
+{
+    if (!Shared) {
+        return false;
+    }
+    if (!Shared->Done && Connection) {
+        Connection->Wait(Token);
+    }
+    return Shared->Ok;
+}
+
 } // namespace
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace lct {
+
+/**
+ * Log-linear histogram in the style of HdrHistogram.
+ *
+ * Values below 2^SubBucketBits are counted exactly. Above that, every power
+ * of two range is split into 2^(SubBucketBits-1) linear buckets, which bounds
+ * the relative error of reported values to 2^-(SubBucketBits-1). The bucket
+ * array covers the full 64-bit range and is allocated up front, so Record()
+ * is O(1) and never allocates.
+ */
+class Histogram {
+public:
+    Histogram(unsigned subBucketBits = 6);
+    virtual ~Histogram();
+
+    void Record(uint64_t value, uint64_t count = 1);
+    void Reset();
+
+    uint64_t Count() const { return TotalCount; }
+    uint64_t Sum() const { return TotalSum; }
+    uint64_t Min() const { return TotalCount ? MinValue : 0; }
+    uint64_t Max() const { return MaxValue; }
+    double Mean() const { return TotalCount ? double(TotalSum) / TotalCount : 0.0; }
+    uint64_t Percentile(double percentile) const;
+
+protected:
+    unsigned SubBucketBits;
+    std::vector<uint64_t> Counts;
+    uint64_t TotalCount;
+    uint64_t TotalSum;
+    uint64_t MinValue;
+    uint64_t MaxValue;
+
+    size_t IndexOf(uint64_t value) const;
+    uint64_t HighestValueAt(size_t index) const;
+};
+
+} /* namespace lct */
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+
+namespace lct {
+
+class LineTable;
+class SymbolTable;
+
+/**
+ * Statistical profile built from PC samples.
+ *
+ * Samples are only counted per address when they arrive; mapping to source
+ * lines and functions is deferred until a report is made, so the per-sample
+ * cost stays at one hash table update.
+ */
+class HotspotProfile {
+public:
+    HotspotProfile(LineTable* lines, const SymbolTable* symbols);
+    virtual ~HotspotProfile();
+
+    void AddSample(uint32_t pc) { Samples[pc]++; Total++; }
+    uint64_t TotalSamples() const { return Total; }
+
+    void ReportLines(std::ostream& out, size_t maxLines) const;
+    void ReportFunctions(std::ostream& out, size_t maxFunctions) const;
+
+protected:
+    LineTable* Lines;
+    const SymbolTable* Symbols;
+    std::unordered_map<uint32_t, uint64_t> Samples;
+    uint64_t Total;
+
+private:
+    HotspotProfile(const HotspotProfile&);
+    HotspotProfile& operator=(const HotspotProfile&);
+};
+
+} /* namespace lct */
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lct {
+
+class ElfFile;
+
+/**
+ * Address to source line lookup table, built from the DWARF .debug_line
+ * section of an ELF file.
+ *
+ * The line number programs are not run until the first lookup, and the
+ * result is kept as a compact array of rows sorted by address. Consecutive
+ * rows for the same line are merged. DWARF versions 2 to 5 are supported.
+ *
+ * The ElfFile must stay open until the table has been parsed.
+ */
+class LineTable {
+public:
+    LineTable(const ElfFile& elf);
+    virtual ~LineTable();
+
+    bool Lookup(uint32_t address, const char** file, uint32_t* line);
+    size_t Size();
+
+protected:
+    static const uint32_t NO_FILE = 0xffffffff;
+
+    struct Row {
+        Row(uint32_t address, uint32_t file, uint32_t line) :
+            Address(address), File(file), Line(line) {}
+        uint32_t Address;
+        uint32_t File;  ///< Index into FileNames, NO_FILE ends a sequence
+        uint32_t Line;
+    };
+
+    const ElfFile& Elf;
+    bool Parsed;
+    std::vector<Row> Rows;
+    std::vector<std::string> FileNames;
+    std::unordered_map<std::string, uint32_t> FileIndex;
+
+    void Parse();
+    const uint8_t* ParseUnit(const uint8_t* p, const uint8_t* end);
+    uint32_t AddFileName(const std::string& name);
+
+private:
+    LineTable(const LineTable&);
+    LineTable& operator=(const LineTable&);
+};
+
+} /* namespace lct */
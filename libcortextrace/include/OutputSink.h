@@ -0,0 +1,77 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lct {
+
+/**
+ * Buffered output for decoded events, with number formatting that does not
+ * go through iostreams.
+ *
+ * Output is collected in a buffer that is passed to Drain() when it is full,
+ * when Flush() is called, or from Tick() when the buffer has held data for
+ * longer than the flush interval. Calling Tick() regularly bounds the delay
+ * of interactive output without flushing once per event.
+ *
+ * Tick() only writes what the sink takes without blocking and keeps the
+ * rest; Flush() waits until everything is written. Only a hard error stops
+ * the output for good.
+ */
+class OutputSink {
+public:
+    OutputSink(size_t bufferSize = 1 << 20, unsigned flushIntervalMs = 100);
+    virtual ~OutputSink();
+
+    void Put(char c) { if (Used == Buffer.size()) { Flush(); } Buffer[Used++] = c; }
+    void Write(const char* data, size_t len);
+    void Write(const char* str);
+    void Write(const std::string& str) { Write(str.data(), str.size()); }
+    void Decimal(uint64_t value);
+    void Hex(uint32_t value);
+    void LittleEndian(uint64_t value, unsigned bytes);
+
+    bool Flush();
+    bool Tick();
+
+protected:
+    std::vector<char> Buffer;
+    size_t Used;
+    uint64_t FlushInterval;
+    uint64_t LastFlush;
+    bool Failed;
+
+    bool Push(bool wait);
+
+    /**
+     * Write out data.
+     *
+     * @return Number of bytes written, fewer than len or 0 if the sink
+     *         would block, or -1 on failure
+     */
+    virtual ssize_t Drain(const char* data, size_t len) = 0;
+    /** Wait until the sink takes more data, for sinks that can block */
+    virtual void Wait() {}
+
+    static uint64_t Now();
+};
+
+/**
+ * Sink writing to a file descriptor, such as standard output.
+ */
+class FdOutputSink : public OutputSink {
+public:
+    FdOutputSink(int fd, size_t bufferSize = 1 << 20, unsigned flushIntervalMs = 100);
+    virtual ~FdOutputSink();
+
+protected:
+    int Fd;
+
+    ssize_t Drain(const char* data, size_t len);
+    void Wait();
+};
+
+} /* namespace lct */
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "DwtCounters.h"
+#include "TraceEventListener.h"
+
+namespace lct {
+
+/**
+ * Convert decoded trace events to a Perfetto trace, in the protobuf format
+ * read by the Perfetto UI and trace processor.
+ *
+ * Every event becomes one TracePacket, which is encoded into a buffer that is
+ * written to the output stream whenever it grows past FLUSH_SIZE, so memory
+ * use stays bounded no matter how long the capture is. The following tracks
+ * are created as events for them show up:
+ *  - "Exceptions": one slice per exception handler activation, nested as
+ *    the handlers preempt each other,
+ *  - "Span N": one slice per span, see SpanAnalyzer,
+ *  - "ITM port N": one instant event per line of text written to a port,
+ *  - one counter track per DWT event counter and per data trace comparator.
+ *
+ * Timestamps are converted to nanoseconds with the given timestamp frequency,
+ * or passed on as is if it is 0.
+ */
+class PerfettoWriter : public TraceEventListener {
+public:
+    static const size_t FLUSH_SIZE = 64 * 1024;
+
+    PerfettoWriter(std::ostream& out, double ticksPerSecond = 0);
+    virtual ~PerfettoWriter();
+
+    void SetSpanPorts(unsigned begin, unsigned end);
+    void SetCycleEventPeriod(uint32_t cycles) { Counters.SetCycleEventPeriod(cycles); }
+    void Finish();
+    void Flush();
+
+    // interface TraceEventListener
+    void HandleTraceEvent(const TraceEvent& event);
+
+protected:
+    std::ostream& Out;
+    double TicksPerSecond;
+    int SpanBegin;
+    int SpanEnd;
+    DwtCounters Counters;
+    uint64_t LastTime;
+    std::unordered_set<uint64_t> Tracks;
+    std::vector<unsigned> ActiveExceptions;
+    std::vector<std::string> Lines;
+    std::string Buffer;
+    std::string Packet;
+    std::string Message;
+
+    uint64_t ToNanoseconds(uint64_t ticks) const;
+    void UseTrack(uint64_t uuid, const std::string& name, bool counter);
+    void Slice(uint64_t uuid, uint64_t time, int type, const std::string& name);
+    void Counter(uint64_t uuid, uint64_t time, int64_t value);
+    void WritePacket();
+
+    void HandleException(const TraceEvent& event);
+    void HandleText(unsigned port, const TraceEvent& event);
+
+private:
+    PerfettoWriter(const PerfettoWriter&);
+    PerfettoWriter& operator=(const PerfettoWriter&);
+};
+
+} /* namespace lct */
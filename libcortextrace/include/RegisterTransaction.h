@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lct {
+
+class GdbConnection;
+class RspConnection;
+
+/**
+ * A batch of register reads and writes that is sent to the target in one
+ * go. Accesses to consecutive words, in the order they were added, are
+ * merged into block transfers, and the blocks are pipelined, so programming
+ * a set of registers costs about one GDB round trip.
+ *
+ * Accesses happen in the order they were added, so registers that must be
+ * written in a particular order, such as a comparator function before its
+ * address, are simply added in that order. Words are transferred
+ * little-endian, whatever the byte order of the host.
+ *
+ * A transaction can go through GDB or straight to the debug server with an
+ * RspConnection.
+ */
+class RegisterTransaction {
+public:
+    struct Block {
+        Block() : Write(false), Address(0), Values(), Outputs() {}
+        bool Write;
+        uint32_t Address;
+        std::vector<uint32_t> Values; ///< Written words, or a placeholder per read
+        std::vector<uint32_t*> Outputs; ///< Where read words go
+    };
+
+    RegisterTransaction();
+
+    void Write(uint32_t address, uint32_t value);
+    void Read(uint32_t address, uint32_t* out);
+    bool Submit(GdbConnection& gdb);
+    bool Submit(RspConnection& rsp);
+    void Clear();
+
+    const std::vector<Block>& GetBlocks() const { return Blocks; }
+    size_t Accesses() const { return Count; }
+
+protected:
+    std::vector<Block> Blocks;
+    size_t Count;
+
+    Block& Extend(bool write, uint32_t address);
+    std::vector<std::vector<uint8_t> > Encode() const;
+    bool Decode(const std::vector<std::vector<uint8_t> >& data, const std::vector<bool>& ok);
+};
+
+} /* namespace lct */
@@ -18,10 +18,29 @@ public:
 
     static const RegisterAddress ITM_TER0 =   0xe0000e00;
     static const RegisterAddress ITM_TCR =    0xe0000e80;
+    static const RegisterAddress ICTR =       0xe000e004;
     static const RegisterAddress CPUID =      0xe000ed00;
     static const RegisterAddress DEMCR =      0xe000edfc;
 
     static const RegisterAddress DWT_CTRL =   0xe0001000;
+    static const uint32_t DWT_CTRL_CYCCNTENA =   1 << 0;
+    static const uint32_t DWT_CTRL_POSTPRESET_SHIFT = 1;
+    static const uint32_t DWT_CTRL_POSTPRESET_MASK = 0xf << 1;
+    static const uint32_t DWT_CTRL_CYCTAP =      1 << 9;
+    static const uint32_t DWT_CTRL_PCSAMPLENA =  1 << 12;
+    static const uint32_t DWT_CTRL_EXCTRCENA =   1 << 16;
+    static const uint32_t DWT_CTRL_CPIEVTENA =   1 << 17;
+    static const uint32_t DWT_CTRL_EXCEVTENA =   1 << 18;
+    static const uint32_t DWT_CTRL_SLEEPEVTENA = 1 << 19;
+    static const uint32_t DWT_CTRL_LSUEVTENA =   1 << 20;
+    static const uint32_t DWT_CTRL_FOLDEVTENA =  1 << 21;
+    static const uint32_t DWT_CTRL_CYCEVTENA =   1 << 22;
+    static const RegisterAddress DWT_CYCCNT = 0xe0001004;
+    static const RegisterAddress DWT_CPICNT = 0xe0001008;
+    static const RegisterAddress DWT_EXCCNT = 0xe000100c;
+    static const RegisterAddress DWT_SLEEPCNT = 0xe0001010;
+    static const RegisterAddress DWT_LSUCNT = 0xe0001014;
+    static const RegisterAddress DWT_FOLDCNT = 0xe0001018;
     const RegisterArray DWT_COMP =           {0xe0001020, 16};
     const RegisterArray DWT_MASK =           {0xe0001024, 16};
     const RegisterArray DWT_FUNCTION =       {0xe0001028, 16};
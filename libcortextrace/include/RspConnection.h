@@ -0,0 +1,83 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lct {
+
+/**
+ * Client for the GDB remote serial protocol, talking straight to the
+ * gdbserver port of OpenOCD or another debug server rather than through a
+ * GDB process and MI.
+ *
+ * Memory is read with hex "m" packets and written with binary "X" packets,
+ * split to fit the packet size the server reports in qSupported. Acks are
+ * turned off with QStartNoAckMode when the server supports it, and then
+ * all the packets of a Submit() are sent without waiting for replies,
+ * which the server answers in order, so a batch costs about one round
+ * trip. With acks, packets go one at a time, so that a rejected one can be
+ * sent again. Monitor commands go through qRcmd.
+ */
+class RspConnection {
+public:
+    /** A read or write of target memory */
+    struct Transfer {
+        Transfer() : Write(false), Address(0), Data(NULL), Length(0), Ok(false) {}
+        Transfer(bool write, uint32_t address, void* data, size_t length) :
+            Write(write), Address(address), Data(static_cast<uint8_t*>(data)),
+            Length(length), Ok(false) {}
+        bool Write;
+        uint32_t Address;
+        uint8_t* Data;
+        size_t Length;
+        bool Ok;            ///< Set by Submit()
+    };
+
+    RspConnection();
+    virtual ~RspConnection();
+
+    bool Connect(const std::string& host, uint16_t port);
+    void Close();
+    bool Connected() const { return Fd != -1; }
+
+    bool Submit(std::vector<Transfer>& transfers);
+    bool ReadBlock(uint32_t address, void* buffer, size_t length);
+    bool WriteBlock(uint32_t address, const void* data, size_t length);
+    bool ReadWord(uint32_t address, uint32_t* value);
+    bool WriteWord(uint32_t address, uint32_t value);
+    bool Monitor(const std::string& command, std::string* output = NULL);
+
+    void SetTimeout(int timeoutMs) { TimeoutMs = timeoutMs; }
+    size_t GetPacketSize() const { return PacketSize; }
+    bool GetAckMode() const { return AckMode; }
+
+    static std::string Frame(const std::string& payload);
+    static std::string Escape(const uint8_t* data, size_t length);
+    static bool Unframe(std::string& buffer, std::string* payload, bool* valid,
+            std::string* acks = NULL);
+
+protected:
+    int Fd;
+    std::string Host;
+    uint16_t Port;
+    int TimeoutMs;
+    size_t PacketSize;
+    bool AckMode;
+    std::string Input;
+
+    bool Exchange(const std::vector<std::string>& packets, std::vector<std::string>& replies,
+            std::string* console = NULL);
+    bool Transmit(const std::string& frames, size_t count, std::vector<std::string>& replies,
+            std::string* console);
+    bool Command(const std::string& packet, std::string* reply);
+    bool ConnectTo(int family, const sockaddr* address, socklen_t length);
+
+private:
+    RspConnection(const RspConnection&);
+    RspConnection& operator=(const RspConnection&);
+};
+
+} /* namespace lct */
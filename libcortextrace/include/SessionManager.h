@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "CaptureSession.h"
+#include "EventLoop.h"
+
+namespace lct {
+
+/**
+ * Run any number of capture sessions on one event loop in one thread.
+ */
+class SessionManager {
+public:
+    SessionManager();
+    virtual ~SessionManager();
+
+    bool Start(CaptureSession* session, const std::string& gdbPath,
+            const std::string& gdbTarget, const std::string& elfPath, size_t corefreq);
+    size_t Size() const { return Sessions.size(); }
+    CaptureSession& Get(size_t i) { return *Sessions[i]; }
+
+    int Poll(int timeoutMs);
+    void StopAll(unsigned drainMs = 1000);
+    void ReportStats(std::ostream& out) const;
+
+protected:
+    EventLoop Loop;
+    std::vector<std::unique_ptr<CaptureSession> > Sessions;
+};
+
+} /* namespace lct */
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Histogram.h"
+#include "TraceEventListener.h"
+
+namespace lct {
+
+/**
+ * Measure the duration of code regions marked up in the firmware with writes
+ * to two ITM stimulus ports: the span ID is written to the begin port on
+ * entry to the region, and to the end port on exit.
+ *
+ * Begin and end events are paired per span ID. Spans with different IDs may
+ * nest or overlap freely, and a span may nest inside itself, in which case
+ * an end event closes the most recent begin with the same ID.
+ *
+ * Durations are in timestamp ticks, as found in TraceEvent::Timestamp, and
+ * recorded both in a histogram for the whole session and one for the current
+ * window, which is restarted by ReportWindow().
+ *
+ * The statistics for span IDs 0 to spanIds-1 are allocated up front, as each
+ * takes some 30 KB. Events with other IDs are only counted as dropped.
+ * Nesting is tracked up to MAX_DEPTH spans per ID, beyond which the oldest
+ * open span is given up, so lost end events do not use up memory.
+ */
+class SpanAnalyzer : public TraceEventListener {
+public:
+    struct Stats {
+        Stats() : Unmatched(0), Abandoned(0), Duration(), Window() {}
+        uint64_t Unmatched;     ///< End events without a begin event
+        uint64_t Abandoned;     ///< Begin events given up before their end event
+        Histogram Duration;
+        Histogram Window;
+    };
+
+    static const uint32_t DEFAULT_SPAN_IDS = 32;
+    static const uint32_t MAX_SPAN_IDS = 1024;
+    static const uint32_t MAX_DEPTH = 16;
+
+    SpanAnalyzer(unsigned beginPort, unsigned endPort, uint32_t spanIds = DEFAULT_SPAN_IDS);
+    virtual ~SpanAnalyzer();
+
+    static bool ParsePorts(const std::string& arg, unsigned* begin, unsigned* end,
+            uint32_t* ids);
+
+    bool IsSpanEvent(const TraceEvent& event) const;
+    unsigned GetBeginPort() const { return BeginPort; }
+    unsigned GetEndPort() const { return EndPort; }
+
+    /** Statistics indexed by span ID */
+    const std::vector<Stats>& GetStats() const { return PerSpan; }
+    uint64_t GetDropped() const { return Dropped; }
+    size_t OpenSpans(uint32_t id) const;
+    void Report(std::ostream& out, double ticksPerSecond = 0) const;
+    void ReportWindow(std::ostream& out, double ticksPerSecond = 0);
+
+    // interface TraceEventListener
+    void HandleTraceEvent(const TraceEvent& event);
+
+protected:
+    unsigned BeginPort;
+    unsigned EndPort;
+    /** Open spans of one ID, kept in a ring of MAX_DEPTH begin times */
+    struct OpenRing {
+        OpenRing() : Next(0), Count(0) {}
+        uint32_t Next;      ///< Slot for the next begin time
+        uint32_t Count;
+    };
+
+    std::vector<Stats> PerSpan;
+    std::vector<OpenRing> Open;
+    std::vector<uint64_t> BeginTimes;   ///< MAX_DEPTH slots per span ID
+    uint64_t Dropped;   ///< Events with a span ID out of range
+
+    void Print(std::ostream& out, double ticksPerSecond, bool window) const;
+};
+
+} /* namespace lct */
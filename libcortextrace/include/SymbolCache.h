@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace lct {
+
+class ElfFile;
+
+/**
+ * Addresses, sizes and types of watched expressions, saved between runs on
+ * the same firmware so that they need not be looked up through GDB again.
+ *
+ * There is one file per firmware image, keyed by its build ID or, without
+ * one, by a hash of the ELF file. The file is mapped into memory when it is
+ * opened and searched in place. Entries added later are kept in memory
+ * until Save() writes them out together with the existing ones.
+ *
+ * Only expressions whose address is fixed at link time can be cached, see
+ * Cacheable().
+ */
+class SymbolCache {
+public:
+    struct Symbol {
+        Symbol() : Address(0), Size(0), Type() {}
+        uint32_t Address;
+        uint32_t Size;
+        std::string Type;   ///< Type of the expression as GDB prints it
+    };
+
+    SymbolCache();
+    virtual ~SymbolCache();
+
+    bool Open(const std::string& dir, const ElfFile& elf);
+    void Close();
+    bool Lookup(const std::string& expression, Symbol* out) const;
+    void Add(const std::string& expression, const Symbol& symbol);
+    bool Save();
+
+    size_t Size() const { return Count + Added.size(); }
+    bool Modified() const { return !Added.empty(); }
+
+    static std::string Key(const ElfFile& elf);
+    static std::string CachePath(const std::string& dir, const std::string& key);
+    static bool Cacheable(const std::string& expression);
+    static bool ParseAddressOf(const std::string& value, Symbol* out);
+
+protected:
+    std::string Path;
+    std::string CacheKey;
+    const uint8_t* Map;
+    size_t MapSize;
+    const uint8_t* Records;
+    size_t Count;
+    std::map<std::string, Symbol> Added;
+
+    bool MapFile(const std::string& path);
+    void Unmap();
+    bool Validate();
+    void Get(size_t index, std::string* expression, Symbol* out) const;
+
+private:
+    SymbolCache(const SymbolCache&);
+    SymbolCache& operator=(const SymbolCache&);
+};
+
+} /* namespace lct */
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lct {
+
+class ElfFile;
+
+/**
+ * Address to symbol lookup table, built from the .symtab section of an ELF
+ * file without involving GDB.
+ *
+ * Symbols are kept sorted by start address in separate arrays (struct of
+ * arrays), so that the binary search in Lookup() only touches the densely
+ * packed start addresses. The Thumb bit is stripped from function symbols.
+ * A second index, sorted by name, serves Find().
+ *
+ * Symbols can also be added by hand with Add(), after which Finalize() must be
+ * called before doing lookups.
+ */
+class SymbolTable {
+public:
+    SymbolTable();
+    virtual ~SymbolTable();
+
+    bool Load(const ElfFile& elf);
+    void Clear();
+
+    void Add(uint32_t address, uint32_t size, const std::string& name);
+    void Finalize();
+
+    const char* Lookup(uint32_t address, uint32_t* offset = NULL) const;
+    bool Find(const std::string& name, uint32_t* address, uint32_t* size = NULL) const;
+    size_t Size() const { return Start.size(); }
+
+protected:
+    std::vector<uint32_t> Start;
+    std::vector<uint32_t> End;
+    std::vector<uint32_t> NameOffset;
+    std::vector<uint32_t> ByName;   ///< Symbol indexes sorted by name
+    std::string Names;
+
+private:
+    SymbolTable(const SymbolTable&);
+    SymbolTable& operator=(const SymbolTable&);
+};
+
+} /* namespace lct */
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lct {
+
+class GdbConnection;
+
+/**
+ * The debug and trace hardware of a Cortex-M target, found by walking the
+ * CoreSight ROM table from 0xe00ff000 and decoding the feature registers
+ * of the components it lists.
+ *
+ * Probing takes a few pipelined rounds of block reads, one per level of ROM
+ * tables. The result can be cached on disk, keyed by CPUID and the build ID
+ * of the firmware, so that later sessions on the same target skip it.
+ */
+class TargetCapabilities {
+public:
+    enum ComponentType {
+        UNKNOWN,
+        ROM_TABLE,
+        SCS,
+        DWT,
+        FPB,
+        ITM,
+        TPIU,
+        ETM,
+        MTB,
+    };
+
+    struct Component {
+        Component() : Address(0), Type(UNKNOWN), Class(0), Designer(0), PartNumber(0) {}
+        uint32_t Address;
+        ComponentType Type;
+        uint8_t Class;       ///< Component class from CIDR1
+        uint16_t Designer;   ///< JEP106 continuation code << 7 | identity code
+        uint16_t PartNumber;
+    };
+
+    TargetCapabilities();
+
+    bool Probe(GdbConnection& gdb);
+    bool Load(const std::string& path);
+    bool Save(const std::string& path) const;
+    bool LoadCached(const std::string& dir, uint32_t cpuid, const std::string& buildId);
+    bool SaveCached(const std::string& dir, const std::string& buildId) const;
+
+    const Component* Find(ComponentType type) const;
+    bool Has(ComponentType type) const { return Find(type) != NULL; }
+
+    static const char* TypeName(ComponentType type);
+    static std::string DefaultCacheDir();
+    static std::string CachePath(const std::string& dir, uint32_t cpuid,
+            const std::string& buildId);
+
+    uint32_t Cpuid;
+    unsigned InterruptLines;
+    std::vector<Component> Components;
+
+    unsigned Comparators;   ///< DWT comparators
+    bool CycleCounter;
+    bool ProfilingCounters;
+    bool TracePackets;      ///< Exception trace and PC sampling
+    bool ExternalTrigger;
+    bool DataValueMatch;    ///< Comparator 1 can match data values
+
+    uint32_t TpiuPortSizes; ///< Bit n set if a port of n + 1 bits is supported
+    bool TpiuParallel;
+    bool TpiuManchester;
+    bool TpiuNrz;
+
+protected:
+    bool Identify(GdbConnection& gdb, const std::vector<uint32_t>& addresses,
+            std::vector<uint32_t>& tables);
+    void ReadFeatures(GdbConnection& gdb);
+};
+
+} /* namespace lct */
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lct {
+
+/**
+ * Bounded storage for a stream of timestamped values, such as a watched
+ * variable, with min/max decimation for fast queries over long ranges.
+ *
+ * Level 0 holds the raw samples in a ring of fixed capacity. Each higher
+ * level holds buckets aggregating Factor entries of the level below, in a
+ * ring of the same capacity, so level k covers Factor^k times as much
+ * history as level 0. All storage is allocated in the constructor and
+ * Append() is O(1) amortized.
+ *
+ * Query() picks the finest level that fits the requested number of points
+ * over the range, which makes it O(points) rather than O(samples).
+ */
+class TimeSeries {
+public:
+    struct Point {
+        Point() : Time(0), Min(0), Max(0) {}
+        Point(uint64_t time, double min, double max) :
+            Time(time), Min(min), Max(max) {}
+        uint64_t Time; ///< Time of the first sample in the bucket
+        double Min;
+        double Max;
+    };
+
+    TimeSeries(size_t capacity = 4096, unsigned levels = 6, unsigned factor = 8);
+    virtual ~TimeSeries();
+
+    void Append(uint64_t time, double value);
+    void Clear();
+
+    size_t Query(uint64_t from, uint64_t to, size_t maxPoints,
+            std::vector<Point>& out) const;
+    size_t QueryLast(uint64_t duration, size_t maxPoints,
+            std::vector<Point>& out) const;
+
+    uint64_t SampleCount() const { return Samples; }
+    bool Empty() const { return Samples == 0; }
+    const Point& Last() const { return LastPoint; }
+
+protected:
+    struct Level {
+        Level() : Entries(), Head(0), Count(0), Pending(), PendingCount(0) {}
+        std::vector<Point> Entries;
+        size_t Head;            ///< Index of the next entry to write
+        size_t Count;
+        Point Pending;          ///< Bucket being filled from the level below
+        unsigned PendingCount;
+
+        const Point& At(size_t i) const;
+        size_t LowerBound(uint64_t time) const;
+        size_t UpperBound(uint64_t time) const;
+    };
+
+    size_t Capacity;
+    unsigned Factor;
+    std::vector<Level> Levels;
+    uint64_t Samples;
+    Point LastPoint;
+
+    void Push(size_t level, const Point& p);
+};
+
+} /* namespace lct */
@@ -21,14 +21,33 @@ public:
         TRACE_EVENT_SYNC,
     };
 
-    TraceEvent(Type type, uint32_t code = 0, uint32_t value = 0) :
-        Type(type), Value(value), Code(code)
+    /// How the timestamp relates to the event, from the TC bits of the
+    /// local timestamp packet
+    enum TimeCode {
+        /// Exact
+        TIME_SYNC = 0,
+        /// The timestamp was delayed, the event happened earlier
+        TIME_TS_DELAYED = 1,
+        /// The packet was delayed relative to the event
+        TIME_EVENT_DELAYED = 2,
+        /// Both the timestamp and the packet were delayed
+        TIME_BOTH_DELAYED = 3,
+        /// No local timestamp followed, the time is that of the one before
+        TIME_UNSTAMPED = 4,
+    };
+
+    TraceEvent(Type type, uint32_t code = 0, uint32_t value = 0,
+            uint64_t timestamp = 0, enum TimeCode timeCode = TIME_SYNC) :
+        Type(type), Value(value), Code(code), Timestamp(timestamp), TimeCode(timeCode)
     { }
     virtual ~TraceEvent();
 
     const Type Type;
     const uint32_t Value;
     const uint32_t Code;
+    /// Absolute time in timestamp ticks, summed up from local timestamps
+    const uint64_t Timestamp;
+    const enum TimeCode TimeCode;
 };
 
 } /* namespace lct */
@@ -2,6 +2,9 @@
 
 #include <istream>
 #include <cstdint>
+#include <vector>
+
+#include "TraceEvent.h"
 
 namespace lct {
 
@@ -16,6 +19,13 @@ class TraceEventListener;
  *
  * To use this class, feed in raw binary data with the Feed() method and use
  * the TraceEventListener interface to receive the extracted events.
+ *
+ * Local timestamp packets carry the time since the previous timestamp; the
+ * parser sums them up and stamps every event with the absolute time. A
+ * timestamp packet follows the packets it refers to, so once timestamps
+ * have been seen, events are held back until the next one and then passed
+ * on with its time and TC bits. Flush() passes on the events still held
+ * back at the end of the input.
  */
 class TraceFileParser {
 public:
@@ -23,9 +33,21 @@ public:
     virtual ~TraceFileParser();
 
     void Feed(const uint8_t* data, size_t len);
+    void Flush();
+    uint64_t GetTimestamp() const { return Timestamp; }
 
 protected:
+    /** An event waiting for its timestamp */
+    struct PendingEvent {
+        enum TraceEvent::Type Type;
+        uint32_t Code;
+        uint32_t Value;
+    };
+
     TraceEventListener& Listener;
+    uint64_t Timestamp;
+    bool Stamping;      ///< Timestamps seen, events are held back
+    std::vector<PendingEvent> Pending;
 
     const uint8_t* CurrentData;
     size_t CurrentLen;
@@ -37,6 +59,8 @@ protected:
 
     bool GetData(uint8_t* out, size_t count);
     void PutBackData(size_t count);
+    void Emit(enum TraceEvent::Type type, uint32_t code, uint32_t value);
+    void EmitPending(enum TraceEvent::TimeCode timeCode);
 
     bool Parse();
     bool ParseSync();
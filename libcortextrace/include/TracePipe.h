@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+namespace lct {
+
+/**
+ * Named FIFO for receiving trace data from OpenOCD, which is told to write
+ * its TPIU output to the FIFO path.
+ *
+ * Each pipe is created in its own temporary directory, so any number of
+ * pipes can exist at once. The read end is opened non-blocking. The pipe also
+ * holds a write end of its own, so that the read end does not report end of
+ * file or hang-up while OpenOCD has the FIFO closed.
+ */
+class TracePipe {
+public:
+    TracePipe();
+    virtual ~TracePipe();
+
+    bool Create();
+    void Close();
+
+    const std::string& GetName() const { return Name; }
+    int GetFd() const { return Fd; }
+
+protected:
+    std::string Dir;
+    std::string Name;
+    int Fd;
+    int WriteFd;
+
+private:
+    TracePipe(const TracePipe&);
+    TracePipe& operator=(const TracePipe&);
+};
+
+} /* namespace lct */
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lct {
+
+/**
+ * TCP client for trace data served by OpenOCD, which listens for trace
+ * clients when its TPIU output is set to ":port".
+ *
+ * The socket is non-blocking, including the connect, so it can share an
+ * EventLoop with other sources. The receive buffer is enlarged with
+ * SO_RCVBUF to ride out bursts while the reader is busy, and TCP_NODELAY is
+ * set so the rare writes to the server go out at once.
+ *
+ * The host is resolved once by Connect(), so that reconnecting does not
+ * block on a lookup. Its addresses are tried in turn, starting with the
+ * one that last worked.
+ */
+class TraceSocket {
+public:
+    enum State {
+        CLOSED,
+        CONNECTING,
+        CONNECTED,
+    };
+
+    TraceSocket(int receiveBufferSize = 4 * 1024 * 1024);
+    virtual ~TraceSocket();
+
+    bool Connect(const std::string& host, uint16_t port);
+    bool Reconnect();
+    bool FinishConnect();
+    ssize_t Receive(uint8_t* buffer, size_t len);
+    void Close();
+
+    int GetFd() const { return Fd; }
+    State GetState() const { return CurrentState; }
+    uint64_t GetConnects() const { return Connects; }
+
+protected:
+    struct Address {
+        sockaddr_storage Addr;
+        socklen_t Length;
+        int Family;
+    };
+
+    int ReceiveBufferSize;
+    std::string Host;
+    uint16_t Port;
+    std::vector<Address> Addresses;
+    size_t Current;     ///< Index of the address being tried
+    int Fd;
+    State CurrentState;
+    uint64_t Connects;
+
+    bool ConnectTo(const Address& address);
+    void Failed();
+
+private:
+    TraceSocket(const TraceSocket&);
+    TraceSocket& operator=(const TraceSocket&);
+};
+
+} /* namespace lct */
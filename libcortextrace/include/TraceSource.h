@@ -0,0 +1,190 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TracePipe.h"
+#include "TraceSocket.h"
+
+namespace lct {
+
+/**
+ * Where raw trace data comes from. Open one by name with Open():
+ *  - "-": standard input,
+ *  - "tcp:HOST:PORT": a TCP server such as OpenOCD's trace output,
+ *  - "serial:PATH[@BAUD]": a UART receiving SWO data,
+ *  - "uring:PATH": a file or pipe read through io_uring if available, see
+ *    UringTraceSource,
+ *  - anything else: a file or FIFO path.
+ *
+ * Data is lent rather than copied: Acquire() hands out a filled buffer
+ * owned by the source, which the consumer decodes in place and gives back
+ * with Release(). Regular files are mapped into memory and lent directly
+ * from the mapping, so each byte is only touched by the decoder.
+ *
+ * Sources with a descriptor can be waited on with an EventLoop; GetFd()
+ * returns -1 for those that never need waiting on.
+ */
+class TraceSource {
+public:
+    enum Status {
+        DATA,   ///< A buffer was lent
+        AGAIN,  ///< Nothing to read right now, wait for the descriptor
+        END,    ///< No more data, or the connection was lost
+        FAILED, ///< Read error, already logged
+    };
+
+    struct Buffer {
+        Buffer() : Data(NULL), Length(0), Index(0) {}
+        const uint8_t* Data;
+        size_t Length;
+        size_t Index; ///< For use by the source
+    };
+
+    TraceSource();
+    virtual ~TraceSource();
+
+    static TraceSource* Open(const std::string& name);
+
+    virtual Status Acquire(Buffer& buffer) = 0;
+    virtual void Release(const Buffer& buffer);
+    virtual int GetFd() const { return -1; }
+    virtual bool Reopen() { return false; }
+
+    size_t Outstanding() const { return Lent; }
+
+protected:
+    size_t Lent; ///< Number of buffers not released yet
+
+private:
+    TraceSource(const TraceSource&);
+    TraceSource& operator=(const TraceSource&);
+};
+
+/**
+ * Lends slices of memory owned by the caller.
+ */
+class MemoryTraceSource : public TraceSource {
+public:
+    MemoryTraceSource(const uint8_t* data, size_t len, size_t chunkSize = SIZE_MAX);
+    Status Acquire(Buffer& buffer);
+
+protected:
+    const uint8_t* Data;
+    size_t Length;
+    size_t ChunkSize;
+    size_t Offset;
+
+private:
+    MemoryTraceSource(const MemoryTraceSource&);
+    MemoryTraceSource& operator=(const MemoryTraceSource&);
+};
+
+/**
+ * Lends a regular file straight from a read-only mapping, in chunks so that
+ * consumers get to do periodic work while going through a large file.
+ */
+class MappedTraceSource : public MemoryTraceSource {
+public:
+    MappedTraceSource(size_t chunkSize = 1024 * 1024);
+    virtual ~MappedTraceSource();
+
+    bool Map(int fd);
+    bool Map(const std::string& path);
+
+protected:
+    void* Mapping;
+    size_t MappingSize;
+
+private:
+    MappedTraceSource(const MappedTraceSource&);
+    MappedTraceSource& operator=(const MappedTraceSource&);
+};
+
+/**
+ * Reads from a file descriptor into a small pool of buffers it owns. A
+ * buffer goes back to the pool when released, and Acquire() returns AGAIN
+ * while all of them are lent out.
+ *
+ * When the descriptor is a pipe or FIFO, SetArchive() has the raw data
+ * copied to a file as well. The copy is made in the kernel: tee(2)
+ * duplicates the pipe contents into a private pipe without consuming them,
+ * and splice(2) moves them from there to the file.
+ */
+class FdTraceSource : public TraceSource {
+public:
+    FdTraceSource(int fd, bool ownFd, size_t bufferSize = 64 * 1024,
+            size_t buffers = 2);
+    virtual ~FdTraceSource();
+
+    bool SetArchive(const std::string& path);
+    uint64_t GetArchived() const { return Archived; }
+
+    Status Acquire(Buffer& buffer);
+    void Release(const Buffer& buffer);
+    int GetFd() const { return Fd; }
+
+protected:
+    int Fd;
+    bool OwnFd;
+    size_t BufferSize;
+    std::vector<std::vector<uint8_t> > Pool;
+    std::vector<size_t> Free;
+    int ArchiveFd;
+    int TeePipe[2];
+    unsigned TeeFlags;
+    uint64_t Archived;
+
+    virtual Status Fill(uint8_t* data, size_t size, size_t* len);
+    size_t Tee(size_t size);
+    void CloseArchive();
+};
+
+/**
+ * A FIFO of its own for OpenOCD to write to, see TracePipe.
+ */
+class FifoTraceSource : public FdTraceSource {
+public:
+    FifoTraceSource();
+
+    bool Create();
+    const std::string& GetName() const { return Pipe.GetName(); }
+
+protected:
+    TracePipe Pipe;
+};
+
+/**
+ * A serial port in raw mode, for SWO in UART mode through a USB adapter.
+ */
+class SerialTraceSource : public FdTraceSource {
+public:
+    SerialTraceSource();
+
+    bool Open(const std::string& path, unsigned baudrate);
+};
+
+/**
+ * A TCP connection, see TraceSocket. A lost connection ends the data, and
+ * can be retried with Reopen(). The source can be waited on for reading
+ * while it is still connecting; the connection is completed by Acquire().
+ */
+class TcpTraceSource : public FdTraceSource {
+public:
+    TcpTraceSource();
+
+    bool Connect(const std::string& host, uint16_t port);
+    bool Reopen();
+    int GetFd() const { return Socket.GetFd(); }
+    const TraceSocket& GetSocket() const { return Socket; }
+
+protected:
+    TraceSocket Socket;
+
+    Status Fill(uint8_t* data, size_t size, size_t* len);
+};
+
+} /* namespace lct */
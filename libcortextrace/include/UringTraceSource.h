@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "TraceSource.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace lct {
+
+/**
+ * Reads a file through io_uring, keeping several large reads in flight so
+ * that the disk does not sit idle while the data is decoded. Buffers are
+ * registered with the kernel once and lent out in file order, whatever
+ * order the reads complete in. The first short read ends the file.
+ *
+ * Only regular files are read this way. Reads from a pipe or socket could
+ * not be kept in flight together, and Acquire() would block until one
+ * completes, so Open() refuses them.
+ *
+ * The ring is set up with raw system calls. Open() fails if io_uring is not
+ * available, for example because of an old kernel or a seccomp filter, or
+ * the descriptor is not a regular file, and the caller should then fall
+ * back to another source.
+ */
+class UringTraceSource : public TraceSource {
+public:
+    UringTraceSource(size_t bufferSize = 256 * 1024, unsigned depth = 8);
+    virtual ~UringTraceSource();
+
+    static bool IsAvailable();
+
+    bool Open(int fd, bool ownFd);
+
+    Status Acquire(Buffer& buffer);
+    void Release(const Buffer& buffer);
+    int GetFd() const { return -1; }
+
+protected:
+    enum SlotState {
+        FREE,
+        IN_FLIGHT,
+        DONE,
+        LENT,
+    };
+
+    struct Slot {
+        Slot() : State(FREE), Result(0) {}
+        SlotState State;
+        int Result;
+    };
+
+    /** Pointers into the mapped ring */
+    struct Ring {
+        Ring() : Head(NULL), Tail(NULL), Mask(NULL), Array(NULL) {}
+        unsigned* Head;
+        unsigned* Tail;
+        unsigned* Mask;
+        unsigned* Array;
+    };
+
+    size_t BufferSize;
+    unsigned Depth;
+    int Fd;
+    bool OwnFd;
+    bool AtEnd;
+    uint64_t NextOffset;
+    int RingFd;
+    void* SqMapping;
+    size_t SqMappingSize;
+    void* CqMapping;
+    size_t CqMappingSize;
+    io_uring_sqe* Sqes;
+    size_t SqesSize;
+    io_uring_cqe* Cqes;
+    Ring Sq;
+    Ring Cq;
+    bool Registered;
+    std::vector<uint8_t> Memory;
+    std::vector<Slot> Slots;
+    std::deque<size_t> Order; ///< Slots in the order their reads were issued
+    unsigned InFlight;
+
+    bool Setup();
+    void Teardown();
+    bool Submit();
+    bool Reap(unsigned wait);
+    void DiscardRest();
+
+private:
+    UringTraceSource(const UringTraceSource&);
+    UringTraceSource& operator=(const UringTraceSource&);
+};
+
+} /* namespace lct */
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "TraceEventListener.h"
+
+namespace lct {
+
+/**
+ * Write decoded trace events as a Value Change Dump, for viewing in a
+ * waveform viewer such as GTKWave.
+ *
+ * The dump has one 32 bit signal per data trace comparator and per ITM
+ * stimulus port, one wire per exception that is high while the handler is
+ * active, and a vector holding the number of the running exception. Since
+ * VCD declares all signals up front, the header is written when the first
+ * event arrives, so watch names must be set before that.
+ *
+ * Timestamps are converted to nanoseconds with the given timestamp
+ * frequency, or written as is if it is 0.
+ *
+ * Only changed values are written, with a time marker only when the time has
+ * moved since the last change. Output is formatted into a buffer that is
+ * written to the stream whenever it grows past FLUSH_SIZE.
+ */
+class VcdWriter : public TraceEventListener {
+public:
+    static const size_t FLUSH_SIZE = 64 * 1024;
+    static const unsigned NUM_WATCHES = 4;
+    static const unsigned NUM_PORTS = 32;
+
+    VcdWriter(std::ostream& out, double ticksPerSecond = 0,
+            unsigned numExceptions = 16 + 32);
+    virtual ~VcdWriter();
+
+    void SetWatchName(unsigned comparator, const std::string& name);
+    void Finish();
+    void Flush();
+
+    // interface TraceEventListener
+    void HandleTraceEvent(const TraceEvent& event);
+
+protected:
+    struct Signal {
+        Signal(const std::string& scope, const std::string& name, unsigned width) :
+            Scope(scope), Name(name), Id(), Width(width), Value(0), Known(false) {}
+        std::string Scope;
+        std::string Name;
+        std::string Id;
+        unsigned Width;
+        uint32_t Value;
+        bool Known;
+    };
+
+    std::ostream& Out;
+    double TicksPerSecond;
+    std::vector<Signal> Signals;
+    std::vector<unsigned> ActiveExceptions;
+    bool HeaderDone;
+    bool TimeWritten;
+    uint64_t Time;
+    std::string Buffer;
+
+    unsigned WatchSignal(unsigned comparator) const { return comparator; }
+    unsigned PortSignal(unsigned port) const { return NUM_WATCHES + port; }
+    unsigned CurrentSignal() const { return NUM_WATCHES + NUM_PORTS; }
+    unsigned ExceptionSignal(unsigned exception) const { return CurrentSignal() + 1 + exception; }
+
+    void WriteHeader();
+    void Change(unsigned signal, uint32_t value);
+    void WriteValue(const Signal& s);
+    void WriteNumber(uint64_t value);
+    void HandleException(const TraceEvent& event);
+};
+
+} /* namespace lct */
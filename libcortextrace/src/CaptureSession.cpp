@@ -0,0 +1,187 @@
+#include "CaptureSession.h"
+#include "TraceEvent.h"
+
+#include "log.h"
+
+namespace lct {
+
+CaptureSession::CaptureSession(const std::string& name, TraceEventListener& listener) :
+        Name(name), Listener(listener), Connection(), Source(), PipeName(), ArchivePath(),
+        TracePort(0), Ended(false), Loop(NULL), Attached(false), LastConnect(0), Parser(*this),
+        Statistics(), TpiuEnabled(false)
+{
+}
+
+CaptureSession::~CaptureSession()
+{
+}
+
+/**
+ * Get the host of a gdbserver from a GDB target specifier such as
+ * "extended-remote 10.0.0.2:3333".
+ */
+std::string CaptureSession::TargetHost(const std::string& gdbTarget)
+{
+    const size_t start = gdbTarget.find_last_of(' ') + 1;
+    const size_t colon = gdbTarget.rfind(':');
+    if (colon == std::string::npos || colon < start || colon == start) {
+        return "localhost";
+    }
+    return gdbTarget.substr(start, colon - start);
+}
+
+/**
+ * Create the FIFO without touching the target. Nothing needs to be done
+ * ahead of time for a TCP port.
+ */
+bool CaptureSession::Open()
+{
+    if (TracePort || Source) {
+        if (TracePort && !ArchivePath.empty()) {
+            LOG_WARNING("%s: Trace data from TCP is not archived", Name.c_str());
+        }
+        return true;
+    }
+    FifoTraceSource* fifo = new FifoTraceSource();
+    Source.reset(fifo);
+    if (!fifo->Create() || (!ArchivePath.empty() && !fifo->SetArchive(ArchivePath))) {
+        Source.reset();
+        return false;
+    }
+    PipeName = fifo->GetName();
+    return true;
+}
+
+/**
+ * Connect to the target and have OpenOCD write trace data to the FIFO.
+ * The target is left halted, so that it can be set up through Gdb() before
+ * it is started.
+ */
+bool CaptureSession::Start(const std::string& gdbPath, const std::string& gdbTarget,
+        const std::string& elfPath, size_t corefreq)
+{
+    if (!Open()) {
+        return false;
+    }
+
+    Connection.Connect(gdbPath, elfPath);
+    Connection.TargetSelect(gdbTarget);
+    Connection.DisableTpiu();
+
+    if (TracePort) {
+        LOG_DEBUG("%s: Enable TPIU to port %u", Name.c_str(), TracePort);
+        Connection.EnableTpiu(TracePort, corefreq);
+        TpiuEnabled = true;
+        LastConnect = time(NULL);
+        TcpTraceSource* tcp = new TcpTraceSource();
+        Source.reset(tcp);
+        if (!tcp->Connect(TargetHost(gdbTarget), TracePort)) {
+            // Retried by Maintain(), the same as a lost connection
+            LOG_WARNING("%s: Cannot connect to trace port %u yet", Name.c_str(), TracePort);
+            Ended = true;
+        }
+        return true;
+    }
+
+    LOG_DEBUG("%s: Enable TPIU to %s", Name.c_str(), PipeName.c_str());
+    Connection.EnableTpiu(PipeName, corefreq);
+    TpiuEnabled = true;
+    return true;
+}
+
+/**
+ * Halt the target. Trace data may still arrive until Finish() is called.
+ */
+void CaptureSession::Stop()
+{
+    Connection.Stop();
+}
+
+void CaptureSession::Finish()
+{
+    if (TpiuEnabled) {
+        Connection.DisableTpiu();
+        TpiuEnabled = false;
+    }
+    Read();
+    Detach();
+    Loop = NULL;
+}
+
+/**
+ * Register the trace data descriptor with an event loop.
+ */
+void CaptureSession::Attach(EventLoop* loop)
+{
+    Loop = loop;
+    if (Loop && GetFd() != -1) {
+        Attached = Loop->Add(GetFd(), this, EventLoop::READABLE);
+    }
+}
+
+void CaptureSession::Detach()
+{
+    // A closed descriptor has already left the event loop
+    if (Attached && GetFd() != -1) {
+        Loop->Remove(GetFd());
+    }
+    Attached = false;
+}
+
+/**
+ * Retry a lost TCP connection. Should be called regularly, but attempts
+ * are at least a second apart so that a missing server is not hammered.
+ */
+void CaptureSession::Maintain()
+{
+    if (!Ended || !TpiuEnabled) {
+        return;
+    }
+    const time_t now = time(NULL);
+    if (now == LastConnect) {
+        return;
+    }
+    LastConnect = now;
+    Statistics.Reconnects++;
+    if (Source->Reopen()) {
+        Ended = false;
+        Attach(Loop);
+    }
+}
+
+void CaptureSession::HandleEvents(uint32_t)
+{
+    Read();
+}
+
+void CaptureSession::Read()
+{
+    if (!Source || Ended) {
+        return;
+    }
+
+    TraceSource::Buffer buffer;
+    TraceSource::Status status;
+    while ((status = Source->Acquire(buffer)) == TraceSource::DATA) {
+        Statistics.Bytes += buffer.Length;
+        Statistics.Reads++;
+        Parser.Feed(buffer.Data, buffer.Length);
+        Source->Release(buffer);
+    }
+    if (status == TraceSource::END || status == TraceSource::FAILED) {
+        Parser.Flush();
+        Ended = true;
+        Detach();
+    }
+}
+
+void CaptureSession::HandleTraceEvent(const TraceEvent& event)
+{
+    Statistics.Events++;
+    if (event.Type == TraceEvent::TRACE_EVENT_OVERFLOW) {
+        Statistics.Overflows++;
+    }
+    Listener.HandleTraceEvent(event);
+}
+
+} /* namespace lct */
@@ -0,0 +1,138 @@
+#include <cstdio>
+
+#include "DwtCounters.h"
+#include "Registers.h"
+#include "TraceEvent.h"
+
+namespace lct {
+
+DwtCounters::DwtCounters() :
+        CyclePeriod(1024), First(), Current(), WindowStart(), Started(false)
+{
+}
+
+DwtCounters::~DwtCounters()
+{
+}
+
+bool DwtCounters::IsCounterEvent(const TraceEvent& event)
+{
+    return event.Type == TraceEvent::TRACE_EVENT_HW && (event.Code >> 3) == 0;
+}
+
+const char* DwtCounters::CounterName(Counter counter)
+{
+    static const char* const names[NUM_COUNTERS] = {
+        "CPI", "EXC", "SLEEP", "LSU", "FOLD", "CYC"
+    };
+    return counter < NUM_COUNTERS ? names[counter] : "";
+}
+
+/**
+ * @return The DWT_CTRL bit that enables events from a counter
+ */
+uint32_t DwtCounters::EnableBit(Counter counter)
+{
+    static const uint32_t bits[NUM_COUNTERS] = {
+        Registers::DWT_CTRL_CPIEVTENA,
+        Registers::DWT_CTRL_EXCEVTENA,
+        Registers::DWT_CTRL_SLEEPEVTENA,
+        Registers::DWT_CTRL_LSUEVTENA,
+        Registers::DWT_CTRL_FOLDEVTENA,
+        Registers::DWT_CTRL_CYCEVTENA,
+    };
+    return counter < NUM_COUNTERS ? bits[counter] : 0;
+}
+
+/**
+ * @return Number of cycles between POSTCNT underflows with the given
+ *         DWT_CTRL setting
+ */
+uint32_t DwtCounters::CycleEventPeriod(uint32_t dwtctrl)
+{
+    const uint32_t preset = (dwtctrl & Registers::DWT_CTRL_POSTPRESET_MASK) >>
+            Registers::DWT_CTRL_POSTPRESET_SHIFT;
+    const uint32_t tap = (dwtctrl & Registers::DWT_CTRL_CYCTAP) ? 1024 : 64;
+    return (preset + 1) * tap;
+}
+
+void DwtCounters::HandleTraceEvent(const TraceEvent& event)
+{
+    if (!IsCounterEvent(event)) {
+        return;
+    }
+
+    if (!Started) {
+        Current.Timestamp = event.Timestamp;
+        First = Current;
+        WindowStart = Current;
+        Started = true;
+    }
+
+    Current.Timestamp = event.Timestamp;
+    for (unsigned c = 0; c < CYC; c++) {
+        if (event.Value & (1 << c)) {
+            Current.Events[c] += 256;
+        }
+    }
+    if (event.Value & (1 << CYC)) {
+        Current.Events[CYC] += CyclePeriod;
+    }
+}
+
+DwtCounters::Rates DwtCounters::ComputeRates(const Totals& from, const Totals& to)
+{
+    Rates r;
+    r.Cycles = to.Events[CYC] - from.Events[CYC];
+    if (r.Cycles == 0) {
+        r.Cycles = to.Timestamp - from.Timestamp;
+    }
+    if (r.Cycles == 0) {
+        return r;
+    }
+
+    const double cycles = r.Cycles;
+    r.CpiOverhead = (to.Events[CPI] - from.Events[CPI]) / cycles;
+    r.ExcOverhead = (to.Events[EXC] - from.Events[EXC]) / cycles;
+    r.SleepFraction = (to.Events[SLEEP] - from.Events[SLEEP]) / cycles;
+    r.LsuStall = (to.Events[LSU] - from.Events[LSU]) / cycles;
+    r.Folded = (to.Events[FOLD] - from.Events[FOLD]) / cycles;
+    return r;
+}
+
+/**
+ * @return Rates since the previous call
+ */
+DwtCounters::Rates DwtCounters::TakeWindow()
+{
+    const Rates r = ComputeRates(WindowStart, Current);
+    WindowStart = Current;
+    return r;
+}
+
+void DwtCounters::PrintRates(std::ostream& out, const Rates& rates)
+{
+    char buf[160];
+    snprintf(buf, sizeof(buf),
+            "cycles %lu: CPI %.2f%%, exceptions %.2f%%, sleep %.2f%%, LSU %.2f%%, folded %.2f%%",
+            rates.Cycles, 100.0 * rates.CpiOverhead, 100.0 * rates.ExcOverhead,
+            100.0 * rates.SleepFraction, 100.0 * rates.LsuStall,
+            100.0 * rates.Folded);
+    out << buf << std::endl;
+}
+
+void DwtCounters::Report(std::ostream& out) const
+{
+    if (!Started) {
+        return;
+    }
+
+    out << "DWT event counters:";
+    for (unsigned c = 0; c < NUM_COUNTERS; c++) {
+        out << " " << CounterName(Counter(c)) << " " << Current.Events[c];
+    }
+    out << std::endl;
+    PrintRates(out, ComputeRates(First, Current));
+}
+
+} /* namespace lct */
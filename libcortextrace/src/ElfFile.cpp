@@ -0,0 +1,210 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "ElfFile.h"
+
+#include "log.h"
+
+namespace lct {
+
+// Offsets into the ELF32 file header and section header
+static const size_t EHDR_SIZE = 52;
+static const size_t EH_SHOFF = 32;
+static const size_t EH_SHENTSIZE = 46;
+static const size_t EH_SHNUM = 48;
+static const size_t EH_SHSTRNDX = 50;
+
+static const size_t SHDR_SIZE = 40;
+static const size_t SH_NAME = 0;
+static const size_t SH_TYPE = 4;
+static const size_t SH_FLAGS = 8;
+static const size_t SH_ADDR = 12;
+static const size_t SH_OFFSET = 16;
+static const size_t SH_SIZE = 20;
+static const size_t SH_LINK = 24;
+static const size_t SH_ENTSIZE = 36;
+
+ElfFile::ElfFile() :
+        Map(NULL), MapSize(0), SectionList()
+{
+}
+
+ElfFile::~ElfFile()
+{
+    Close();
+}
+
+bool ElfFile::Open(const std::string& path)
+{
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        LOG_ERROR("Failed to open %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(EHDR_SIZE)) {
+        LOG_ERROR("%s is not an ELF file", path.c_str());
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("Failed to map %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    Map = static_cast<const uint8_t*>(map);
+    MapSize = st.st_size;
+
+    if (!ParseHeaders()) {
+        LOG_ERROR("%s is not a 32-bit little-endian ELF file", path.c_str());
+        Close();
+        return false;
+    }
+
+    LOG_DEBUG("Loaded %s: %lu sections", path.c_str(), SectionList.size());
+    return true;
+}
+
+void ElfFile::Close()
+{
+    SectionList.clear();
+    if (Map) {
+        munmap(const_cast<uint8_t*>(Map), MapSize);
+        Map = NULL;
+        MapSize = 0;
+    }
+}
+
+const ElfFile::Section* ElfFile::FindSection(const std::string& name) const
+{
+    for (const Section& s : SectionList) {
+        if (s.Name == name) {
+            return &s;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @return The GNU build ID as a hex string, or an empty string if the file
+ *         was linked without --build-id
+ */
+std::string ElfFile::BuildId() const
+{
+    static const uint32_t NT_GNU_BUILD_ID = 3;
+    static const char digits[] = "0123456789abcdef";
+
+    for (const Section& s : SectionList) {
+        if (s.Type != SHT_NOTE || !s.Data) {
+            continue;
+        }
+        // Notes are a name and a descriptor, each padded to 4 bytes
+        size_t pos = 0;
+        while (pos + 12 <= s.Size) {
+            const uint32_t namesz = Read32(&s.Data[pos]);
+            const uint32_t descsz = Read32(&s.Data[pos + 4]);
+            const uint32_t type = Read32(&s.Data[pos + 8]);
+            const size_t name = pos + 12;
+            const size_t desc = name + ((size_t(namesz) + 3) & ~3UL);
+            if (desc > s.Size || descsz > s.Size - desc) {
+                break;
+            }
+            if (type == NT_GNU_BUILD_ID && namesz == 4 &&
+                    memcmp(&s.Data[name], "GNU", 4) == 0) {
+                std::string id;
+                for (size_t i = 0; i < descsz; i++) {
+                    id += digits[s.Data[desc + i] >> 4];
+                    id += digits[s.Data[desc + i] & 0xf];
+                }
+                return id;
+            }
+            pos = desc + ((size_t(descsz) + 3) & ~3UL);
+        }
+    }
+    return "";
+}
+
+/**
+ * @return A 64-bit FNV-1a hash of the whole file as a hex string, to tell
+ *         files without a build ID apart
+ */
+std::string ElfFile::ContentHash() const
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < MapSize; i++) {
+        hash = (hash ^ Map[i]) * 0x100000001b3ULL;
+    }
+    char s[20];
+    snprintf(s, sizeof(s), "%016llx", static_cast<unsigned long long>(hash));
+    return s;
+}
+
+bool ElfFile::ParseHeaders()
+{
+    static const uint8_t ident[] = { 0x7f, 'E', 'L', 'F',
+            1 /* ELFCLASS32 */, 1 /* ELFDATA2LSB */ };
+    if (memcmp(Map, ident, sizeof(ident)) != 0) {
+        return false;
+    }
+
+    const uint32_t shoff = Read32(&Map[EH_SHOFF]);
+    const uint16_t shentsize = Read16(&Map[EH_SHENTSIZE]);
+    const uint16_t shnum = Read16(&Map[EH_SHNUM]);
+    const uint16_t shstrndx = Read16(&Map[EH_SHSTRNDX]);
+
+    if (shnum == 0) {
+        return true;
+    }
+    if (shentsize < SHDR_SIZE || shoff > MapSize ||
+            size_t(shnum) * shentsize > MapSize - shoff) {
+        return false;
+    }
+
+    SectionList.reserve(shnum);
+    for (size_t i = 0; i < shnum; i++) {
+        const uint8_t* sh = &Map[shoff + i * shentsize];
+        Section s;
+        s.Type = Read32(&sh[SH_TYPE]);
+        s.Flags = Read32(&sh[SH_FLAGS]);
+        s.Address = Read32(&sh[SH_ADDR]);
+        s.Link = Read32(&sh[SH_LINK]);
+        s.EntrySize = Read32(&sh[SH_ENTSIZE]);
+        s.Size = Read32(&sh[SH_SIZE]);
+
+        const uint32_t offset = Read32(&sh[SH_OFFSET]);
+        if (s.Type != SHT_NOBITS) {
+            if (offset > MapSize || s.Size > MapSize - offset) {
+                return false;
+            }
+            s.Data = &Map[offset];
+        }
+        SectionList.push_back(s);
+    }
+
+    // Resolve section names from the section header string table
+    if (shstrndx < SectionList.size()) {
+        const Section& strtab = SectionList[shstrndx];
+        for (size_t i = 0; i < shnum; i++) {
+            const uint32_t nameoff = Read32(&Map[shoff + i * shentsize + SH_NAME]);
+            if (strtab.Data && nameoff < strtab.Size) {
+                const char* name = reinterpret_cast<const char*>(&strtab.Data[nameoff]);
+                SectionList[i].Name.assign(name, strnlen(name, strtab.Size - nameoff));
+            }
+        }
+    }
+
+    return true;
+}
+
+} /* namespace lct */
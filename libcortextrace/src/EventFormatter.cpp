@@ -0,0 +1,212 @@
+#include "EventFormatter.h"
+#include "ExceptionAnalyzer.h"
+#include "OutputSink.h"
+#include "TraceEvent.h"
+
+namespace lct {
+
+static const char* const s_exceptionFunctions[] = { "?", "enter", "exit", "return" };
+
+EventFormatter::EventFormatter(OutputSink& sink) :
+        Sink(sink), SourceId(0), SourceName()
+{
+}
+
+void EventFormatter::SetSource(uint16_t id, const std::string& name)
+{
+    SourceId = id;
+    SourceName = name;
+}
+
+EventFormatter::~EventFormatter()
+{
+}
+
+/**
+ * @return A new formatter for the named format, or NULL if it is unknown
+ */
+EventFormatter* EventFormatter::Create(const std::string& format, OutputSink& sink)
+{
+    if (format == "text") {
+        return new TextEventFormatter(sink);
+    }
+    if (format == "json") {
+        return new JsonEventFormatter(sink);
+    }
+    if (format == "binary") {
+        return new BinaryEventFormatter(sink);
+    }
+    return NULL;
+}
+
+bool EventFormatter::IsFormat(const std::string& format)
+{
+    return format == "text" || format == "json" || format == "binary";
+}
+
+// -----------------------------------------------------------------
+
+void TextEventFormatter::FormatLocation(const Location* location)
+{
+    if (!location) {
+        return;
+    }
+    if (location->Symbol) {
+        Sink.Put(' ');
+        Sink.Write(location->Symbol);
+        Sink.Write("+0x");
+        Sink.Hex(location->Offset);
+    }
+    if (location->File) {
+        Sink.Put(' ');
+        Sink.Write(location->File);
+        Sink.Put(':');
+        Sink.Decimal(location->Line);
+    }
+}
+
+void TextEventFormatter::Format(const TraceEvent& event, const Location* location)
+{
+    if (AtLineStart && !SourceName.empty()) {
+        Sink.Write(SourceName);
+        Sink.Write(": ");
+    }
+
+    switch (event.Type) {
+    case TraceEvent::TRACE_EVENT_INSTR:
+        Sink.Put(static_cast<char>(event.Value));
+        AtLineStart = static_cast<char>(event.Value) == '\n';
+        return;
+    case TraceEvent::TRACE_EVENT_HW: {
+        const uint8_t discriminator = event.Code >> 3;
+        if (discriminator == 0x1) {
+            Sink.Write("Exception ");
+            Sink.Write(s_exceptionFunctions[(event.Value >> 12) & 0x3]);
+            Sink.Put(' ');
+            Sink.Write(ExceptionAnalyzer::ExceptionName(event.Value & 0x1ff));
+            Sink.Write(" @");
+            Sink.Decimal(event.Timestamp);
+        }
+        else if (discriminator == 0x2) {
+            Sink.Write("PC: ");
+            Sink.Hex(event.Value);
+            FormatLocation(location);
+        }
+        else if ((discriminator & 0x19) == 0x08) {
+            Sink.Write("PC trace: ");
+            Sink.Hex(event.Value);
+            FormatLocation(location);
+        }
+        else if ((discriminator & 0x18) == 0x10) {
+            Sink.Write((discriminator & 0x01) ? "data trace: W " : "data trace: R ");
+            Sink.Hex(event.Value);
+        }
+        else {
+            Sink.Write("HW event: ");
+            Sink.Hex(event.Code);
+            Sink.Put(':');
+            Sink.Hex(event.Value);
+        }
+        break;
+    }
+    case TraceEvent::TRACE_EVENT_OVERFLOW:
+        Sink.Write("Overflow");
+        break;
+    case TraceEvent::TRACE_EVENT_SYNC:
+        Sink.Write("Sync");
+        break;
+    default:
+        Sink.Write("Event ");
+        Sink.Decimal(event.Type);
+        Sink.Write(", ");
+        Sink.Decimal(event.Code);
+        Sink.Write(", ");
+        Sink.Decimal(event.Value);
+        break;
+    }
+    Sink.Put('\n');
+    AtLineStart = true;
+}
+
+// -----------------------------------------------------------------
+
+void JsonEventFormatter::String(const char* str)
+{
+    static const char digits[] = "0123456789abcdef";
+    Sink.Put('"');
+    for (; *str; str++) {
+        const unsigned char c = *str;
+        if (c == '"' || c == '\\') {
+            Sink.Put('\\');
+            Sink.Put(c);
+        }
+        else if (c < 0x20) {
+            Sink.Write("\\u00");
+            Sink.Put(digits[c >> 4]);
+            Sink.Put(digits[c & 0xf]);
+        }
+        else {
+            Sink.Put(c);
+        }
+    }
+    Sink.Put('"');
+}
+
+void JsonEventFormatter::Format(const TraceEvent& event, const Location* location)
+{
+    static const char* const types[] = {
+        "instr", "hw", "timestamp", "overflow", "sync"
+    };
+
+    Sink.Write("{\"time\":");
+    Sink.Decimal(event.Timestamp);
+    Sink.Write(",\"type\":\"");
+    Sink.Write(event.Type <= TraceEvent::TRACE_EVENT_SYNC ? types[event.Type] : "unknown");
+    Sink.Write("\",\"code\":");
+    Sink.Decimal(event.Code);
+    Sink.Write(",\"value\":");
+    Sink.Decimal(event.Value);
+
+    if (!SourceName.empty()) {
+        Sink.Write(",\"source\":");
+        String(SourceName.c_str());
+    }
+    if (event.Type == TraceEvent::TRACE_EVENT_INSTR) {
+        Sink.Write(",\"port\":");
+        Sink.Decimal(event.Code >> 3);
+    }
+    else if (ExceptionAnalyzer::IsExceptionEvent(event)) {
+        Sink.Write(",\"exception\":");
+        String(ExceptionAnalyzer::ExceptionName(event.Value & 0x1ff).c_str());
+        Sink.Write(",\"function\":\"");
+        Sink.Write(s_exceptionFunctions[(event.Value >> 12) & 0x3]);
+        Sink.Put('"');
+    }
+
+    if (location && location->Symbol) {
+        Sink.Write(",\"symbol\":");
+        String(location->Symbol);
+        Sink.Write(",\"offset\":");
+        Sink.Decimal(location->Offset);
+    }
+    if (location && location->File) {
+        Sink.Write(",\"file\":");
+        String(location->File);
+        Sink.Write(",\"line\":");
+        Sink.Decimal(location->Line);
+    }
+    Sink.Write("}\n");
+}
+
+// -----------------------------------------------------------------
+
+void BinaryEventFormatter::Format(const TraceEvent& event, const Location*)
+{
+    Sink.LittleEndian(event.Timestamp, 8);
+    Sink.LittleEndian(event.Value, 4);
+    Sink.LittleEndian(event.Type, 1);
+    Sink.LittleEndian(event.Code, 1);
+    Sink.LittleEndian(SourceId, 2);
+}
+
+} /* namespace lct */
@@ -0,0 +1,95 @@
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "EventLoop.h"
+
+#include "log.h"
+
+namespace lct {
+
+const uint32_t EventLoop::READABLE = EPOLLIN;
+const uint32_t EventLoop::WRITABLE = EPOLLOUT;
+
+EventLoop::Handler::~Handler()
+{
+}
+
+EventLoop::EventLoop() :
+        EpollFd(epoll_create1(EPOLL_CLOEXEC))
+{
+    if (EpollFd == -1) {
+        LOG_ERROR("Failed to create epoll instance: %s", strerror(errno));
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    if (EpollFd != -1) {
+        close(EpollFd);
+    }
+}
+
+bool EventLoop::Add(int fd, Handler* handler, uint32_t events)
+{
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = handler;
+    if (epoll_ctl(EpollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        LOG_ERROR("Failed to add fd %d to event loop: %s", fd, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool EventLoop::Modify(int fd, Handler* handler, uint32_t events)
+{
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = handler;
+    if (epoll_ctl(EpollFd, EPOLL_CTL_MOD, fd, &ev) != 0) {
+        LOG_ERROR("Failed to modify fd %d in event loop: %s", fd, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool EventLoop::Remove(int fd)
+{
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    if (epoll_ctl(EpollFd, EPOLL_CTL_DEL, fd, &ev) != 0) {
+        LOG_ERROR("Failed to remove fd %d from event loop: %s", fd, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Wait for events and dispatch them to the handlers.
+ *
+ * @param timeoutMs  Longest time to wait, or -1 to wait forever
+ * @return Number of handlers called, or -1 on error
+ */
+int EventLoop::Poll(int timeoutMs)
+{
+    epoll_event events[64];
+    const int n = epoll_wait(EpollFd, events, 64, timeoutMs);
+    if (n < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        LOG_ERROR("epoll_wait failed: %s", strerror(errno));
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        static_cast<Handler*>(events[i].data.ptr)->HandleEvents(events[i].events);
+    }
+    return n;
+}
+
+} /* namespace lct */
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "ExceptionAnalyzer.h"
+#include "TraceEvent.h"
+
+#include "log.h"
+
+namespace lct {
+
+ExceptionAnalyzer::ExceptionAnalyzer() :
+        PerException(), Active(), FirstTime(0), LastTime(0), Started(false),
+        LastWasExit(false)
+{
+    Active.reserve(16);
+}
+
+ExceptionAnalyzer::~ExceptionAnalyzer()
+{
+}
+
+bool ExceptionAnalyzer::IsExceptionEvent(const TraceEvent& event)
+{
+    return event.Type == TraceEvent::TRACE_EVENT_HW && (event.Code >> 3) == 1;
+}
+
+std::string ExceptionAnalyzer::ExceptionName(unsigned exception)
+{
+    static const char* const names[16] = {
+        "Thread", "Reset", "NMI", "HardFault", "MemManage", "BusFault",
+        "UsageFault", NULL, NULL, NULL, NULL, "SVCall", "DebugMon", NULL,
+        "PendSV", "SysTick"
+    };
+    if (exception < 16) {
+        return names[exception] ? names[exception] :
+                "Reserved" + std::to_string(exception);
+    }
+    return "IRQ" + std::to_string(exception - 16);
+}
+
+unsigned ExceptionAnalyzer::CurrentException() const
+{
+    return Active.empty() ? 0 : Active.back().Exception;
+}
+
+void ExceptionAnalyzer::HandleTraceEvent(const TraceEvent& event)
+{
+    if (event.Type == TraceEvent::TRACE_EVENT_OVERFLOW) {
+        // Packets were lost, so the nesting can't be trusted any more
+        Active.clear();
+        LastWasExit = false;
+        return;
+    }
+
+    if (!IsExceptionEvent(event)) {
+        return;
+    }
+
+    if (!Started) {
+        FirstTime = event.Timestamp;
+        Started = true;
+    }
+    LastTime = event.Timestamp;
+
+    const unsigned exception = event.Value & 0x1ff;
+    switch ((event.Value >> 12) & 0x3) {
+    case EXC_ENTER:
+        Enter(exception, event.Timestamp);
+        break;
+    case EXC_EXIT:
+        Exit(exception, event.Timestamp);
+        break;
+    case EXC_RETURN:
+        Return(exception);
+        break;
+    default:
+        break;
+    }
+}
+
+void ExceptionAnalyzer::Enter(unsigned exception, uint64_t time)
+{
+    Stats& stats = PerException[exception];
+    if (LastWasExit) {
+        // Entered straight from another handler without returning
+        stats.TailChained++;
+    }
+    else if (!Active.empty()) {
+        PerException[Active.back().Exception].Preempted++;
+    }
+    LastWasExit = false;
+
+    Active.push_back(Frame(exception, time));
+}
+
+void ExceptionAnalyzer::Exit(unsigned exception, uint64_t time)
+{
+    LastWasExit = true;
+
+    size_t i = Active.size();
+    while (i > 0 && Active[i - 1].Exception != exception) {
+        i--;
+    }
+    if (i == 0) {
+        // Entry was not seen
+        return;
+    }
+
+    // Anything above the exiting handler lost its exit packet
+    Active.resize(i, Frame(0, 0));
+
+    const Frame frame = Active.back();
+    Active.pop_back();
+
+    const uint64_t duration = time - frame.Entry;
+    const uint64_t nested = std::min(frame.Nested, duration);
+
+    Stats& stats = PerException[exception];
+    stats.Count++;
+    stats.SelfTime += duration - nested;
+    stats.Duration.Record(duration);
+    stats.Latency.Record(nested);
+
+    if (!Active.empty()) {
+        Active.back().Nested += duration;
+    }
+}
+
+void ExceptionAnalyzer::Return(unsigned exception)
+{
+    LastWasExit = false;
+
+    if (exception == 0) {
+        Active.clear();
+        return;
+    }
+    while (!Active.empty() && Active.back().Exception != exception) {
+        Active.pop_back();
+    }
+}
+
+/**
+ * Print a table with one line per exception.
+ *
+ * @param ticksPerSecond  Timestamp frequency for printing times in
+ *                        microseconds, or 0 to print ticks
+ */
+void ExceptionAnalyzer::Report(std::ostream& out, double ticksPerSecond) const
+{
+    if (PerException.empty()) {
+        return;
+    }
+
+    const double scale = ticksPerSecond > 0 ? 1e6 / ticksPerSecond : 1.0;
+    const uint64_t elapsed = LastTime - FirstTime;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%-12s %10s %8s %8s %10s %10s %10s %10s %10s %10s %7s",
+            "Exception", "Count", "Preempt", "Chained",
+            "Mean", "P50", "P99", "Max", "LatP99", "LatMax", "CPU%");
+    out << "Exception statistics (times in " <<
+            (ticksPerSecond > 0 ? "us" : "ticks") << "):" << std::endl;
+    out << buf << std::endl;
+
+    for (const auto& e : PerException) {
+        const Stats& s = e.second;
+        snprintf(buf, sizeof(buf),
+                "%-12s %10lu %8lu %8lu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %6.2f%%",
+                ExceptionName(e.first).c_str(), s.Count, s.Preempted, s.TailChained,
+                s.Duration.Mean() * scale,
+                s.Duration.Percentile(50) * scale,
+                s.Duration.Percentile(99) * scale,
+                s.Duration.Max() * scale,
+                s.Latency.Percentile(99) * scale,
+                s.Latency.Max() * scale,
+                elapsed ? 100.0 * s.SelfTime / elapsed : 0.0);
+        out << buf << std::endl;
+    }
+}
+
+} /* namespace lct */
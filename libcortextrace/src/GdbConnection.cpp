@@ -1,5 +1,8 @@
 #include <unistd.h>
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <cstring>
 
 #include "GdbConnection.h"
 
@@ -90,6 +93,8 @@ void GdbConnection::Connect(std::string gdb, std::string exec)
         GdbCommand cmd(MIGDBSet(const_cast<char*>("confirm"), const_cast<char*>("off")));
         State->SyncCommand(cmd);
     }
+
+    SetPipelineDepth(8);
 }
 
 void GdbConnection::TargetSelect(std::string target)
@@ -122,6 +127,14 @@ void GdbConnection::EnableTpiu(std::string logfile, size_t corefreq)
     }
 }
 
+/**
+ * Have OpenOCD serve trace data to TCP clients on a port.
+ */
+void GdbConnection::EnableTpiu(uint16_t port, size_t corefreq)
+{
+    EnableTpiu(":" + std::to_string(port), corefreq);
+}
+
 void GdbConnection::Run()
 {
     LOG_DEBUG("Run");
@@ -162,11 +175,99 @@ uint32_t GdbConnection::ResolveAddress(std::string expression)
     return addr;
 }
 
-uint32_t GdbConnection::ReadWord(uint32_t address)
+/**
+ * @return false if the memory cannot be read, in which case value is left
+ *         alone
+ */
+bool GdbConnection::ReadWord(uint32_t address, uint32_t* value)
+{
+    uint32_t word;
+    if (!ReadObject(address, &word)) {
+        return false;
+    }
+    *value = word;
+    return true;
+}
+
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * Decode the reply to -data-read-memory-bytes into a buffer.
+ */
+static bool decodeMemory(GdbCommand& cmd, uint32_t address, void* buffer, size_t length)
 {
+    // GDB leaves out unreadable parts, so there may be several blocks
+    const GdbResult memory = cmd.Result().Find("memory");
+    if (memory.GetType() != GdbResult::VALUES) {
+        LOG_ERROR("No memory in reply");
+        return false;
+    }
+
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    size_t done = 0;
+    for (const GdbResult block : memory) {
+        const GdbResult offset = block.Find("offset");
+        const GdbResult contents = block.Find("contents");
+        if (offset.GetType() != GdbResult::STRING || contents.GetType() != GdbResult::STRING) {
+            continue;
+        }
+
+        size_t pos = strtoul(offset.View().Data(), NULL, 0);
+        const StringRef hex = contents.View();
+        for (size_t c = 0; c + 1 < hex.Size() && pos < length; c += 2) {
+            const int hi = hexDigit(hex[c]);
+            const int lo = hexDigit(hex[c + 1]);
+            if (hi < 0 || lo < 0) {
+                LOG_ERROR("Invalid memory contents %s", hex.Data());
+                return false;
+            }
+            out[pos++] = (hi << 4) | lo;
+            done++;
+        }
+    }
+
+    if (done < length) {
+        LOG_WARNING("Read %lu of %lu bytes at %#x", done, length, address);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read a block of target memory with one command. The hex reply is decoded
+ * straight into the buffer.
+ *
+ * @return false if any part of the block could not be read
+ */
+bool GdbConnection::ReadBlock(uint32_t address, void* buffer, size_t length)
+{
+    if (length == 0) {
+        return true;
+    }
+    if (length > 0x7fffffff) {
+        LOG_ERROR("Block of %lu bytes is too large", length);
+        return false;
+    }
+
     char adrstring[16];
     sprintf(adrstring, "%#x", address);
-    return ReadWord(adrstring);
+    GdbCommand cmd(MIDataReadMemoryBytes(0, adrstring, length));
+    if (!State->SyncCommand(cmd)) {
+        return false;
+    }
+    return decodeMemory(cmd, address, buffer, length);
 }
 
 uint32_t GdbConnection::ReadWord(std::string expression, uint32_t* outAddress)
@@ -186,25 +287,289 @@ uint32_t GdbConnection::ReadWord(std::string expression, uint32_t* outAddress)
     GdbResult r(cmd.Result());
 
     if (outAddress) {
-        *outAddress = strtol(r["addr"].Str().c_str(), NULL, 0);
+        *outAddress = strtol(r["addr"].View().Data(), NULL, 0);
     }
-    const uint32_t value = atoi(r["memory"][0]["data"][0].Str().c_str());
+    const uint32_t value = atoi(r["memory"][0]["data"][0].View().Data());
     return value;
 }
 
-bool GdbConnection::WriteWord(uint32_t address, uint32_t value)
+static MICommand* writeBlockCommand(uint32_t address, const void* data, size_t length)
 {
+    static const char digits[] = "0123456789abcdef";
     char adrstring[16];
     sprintf(adrstring, "%#x", address);
-    char datastring[16];
-    uint32_t levalue = ((value >> 24) & 0xff) |
-            ((value >> 8) & 0xff00) |
-            ((value << 8) & 0xff0000) |
-            ((value << 24) & 0xff000000);
-    sprintf(datastring, "%08x", levalue);
-
-    GdbCommand cmd(MIDataWriteMemoryBytes(adrstring, datastring));
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    std::string contents(2 * length, '0');
+    for (size_t i = 0; i < length; i++) {
+        contents[2 * i] = digits[in[i] >> 4];
+        contents[2 * i + 1] = digits[in[i] & 0xf];
+    }
+    return MIDataWriteMemoryBytes(adrstring, const_cast<char*>(contents.c_str()));
+}
+
+static MICommand* writeWordCommand(uint32_t address, uint32_t value)
+{
+    const uint8_t bytes[4] = {
+        uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24)
+    };
+    return writeBlockCommand(address, bytes, sizeof(bytes));
+}
+
+bool GdbConnection::WriteWord(uint32_t address, uint32_t value)
+{
+    GdbCommand cmd(writeWordCommand(address, value));
     return State->SyncCommand(cmd);
 }
 
+/**
+ * Write a block of target memory with one command.
+ */
+bool GdbConnection::WriteBlock(uint32_t address, const void* data, size_t length)
+{
+    if (length == 0) {
+        return true;
+    }
+    GdbCommand cmd(writeBlockCommand(address, data, length));
+    return State->SyncCommand(cmd);
+}
+
+/**
+ * Set how many commands may be sent before their replies have arrived.
+ * Asynchronous commands beyond that are queued.
+ */
+void GdbConnection::SetPipelineDepth(unsigned depth)
+{
+    MISessionSetPipelineDepth(State->Gdb, depth);
+}
+
+/**
+ * Read a word without waiting for it. done, if given, is called with the
+ * result from within a later Wait() or WaitAll().
+ */
+GdbFuture<uint32_t> GdbConnection::ReadWordAsync(uint32_t address,
+        std::function<void(bool, uint32_t)> done)
+{
+    GdbFuture<uint32_t> future;
+    future.Connection = this;
+    future.Shared.reset(new GdbFuture<uint32_t>::State);
+    auto shared = future.Shared;
+
+    char adrstring[16];
+    sprintf(adrstring, "%#x", address);
+    future.Token = State->AsyncCommand(MIDataReadMemoryBytes(0, adrstring, 4),
+            [shared, address, done](bool ok, GdbCommand& cmd) {
+        ok = ok && decodeMemory(cmd, address, &shared->Value, sizeof(shared->Value));
+        shared->Ok = ok;
+        shared->Done = true;
+        if (done) {
+            done(ok, shared->Value);
+        }
+    });
+    return future;
+}
+
+GdbFuture<bool> GdbConnection::WriteWordAsync(uint32_t address, uint32_t value,
+        std::function<void(bool)> done)
+{
+    GdbFuture<bool> future;
+    future.Connection = this;
+    future.Shared.reset(new GdbFuture<bool>::State);
+    auto shared = future.Shared;
+
+    future.Token = State->AsyncCommand(writeWordCommand(address, value),
+            [shared, done](bool ok, GdbCommand&) {
+        shared->Ok = shared->Value = ok;
+        shared->Done = true;
+        if (done) {
+            done(ok);
+        }
+    });
+    return future;
+}
+
+/**
+ * Read a block without waiting for it. The buffer must stay valid until
+ * the command has completed. Like ReadBlock(), nothing is sent for an empty
+ * block or one that is too large, and the future is done at once.
+ */
+GdbFuture<bool> GdbConnection::ReadBlockAsync(uint32_t address, void* buffer,
+        size_t length, std::function<void(bool)> done)
+{
+    GdbFuture<bool> future;
+    future.Connection = this;
+    future.Shared.reset(new GdbFuture<bool>::State);
+    auto shared = future.Shared;
+
+    if (length == 0 || length > 0x7fffffff) {
+        if (length) {
+            LOG_ERROR("Block of %lu bytes is too large", length);
+        }
+        shared->Ok = shared->Value = length == 0;
+        shared->Done = true;
+        if (done) {
+            done(shared->Ok);
+        }
+        return future;
+    }
+
+    char adrstring[16];
+    sprintf(adrstring, "%#x", address);
+    future.Token = State->AsyncCommand(MIDataReadMemoryBytes(0, adrstring, length),
+            [shared, address, buffer, length, done](bool ok, GdbCommand& cmd) {
+        ok = ok && decodeMemory(cmd, address, buffer, length);
+        shared->Ok = shared->Value = ok;
+        shared->Done = true;
+        if (done) {
+            done(ok);
+        }
+    });
+    return future;
+}
+
+/**
+ * Write a block without waiting for it. The data is copied into the command
+ * right away.
+ */
+GdbFuture<bool> GdbConnection::WriteBlockAsync(uint32_t address, const void* data,
+        size_t length, std::function<void(bool)> done)
+{
+    GdbFuture<bool> future;
+    future.Connection = this;
+    future.Shared.reset(new GdbFuture<bool>::State);
+    auto shared = future.Shared;
+
+    future.Token = State->AsyncCommand(writeBlockCommand(address, data, length),
+            [shared, done](bool ok, GdbCommand&) {
+        shared->Ok = shared->Value = ok;
+        shared->Done = true;
+        if (done) {
+            done(ok);
+        }
+    });
+    return future;
+}
+
+GdbFuture<uint32_t> GdbConnection::ResolveAddressAsync(std::string expression,
+        std::function<void(bool, uint32_t)> done)
+{
+    GdbFuture<uint32_t> future;
+    future.Connection = this;
+    future.Shared.reset(new GdbFuture<uint32_t>::State);
+    auto shared = future.Shared;
+
+    future.Token = State->AsyncCommand(MIDataReadMemory(0,
+            const_cast<char*>(expression.c_str()), const_cast<char*>("u"), 4, 1, 1, NULL),
+            [shared, done](bool ok, GdbCommand& cmd) {
+        if (ok) {
+            try {
+                GdbResult r(cmd.Result());
+                shared->Value = strtoul(r["addr"].View().Data(), NULL, 0);
+            }
+            catch (std::out_of_range &e) {
+                LOG_ERROR("%s", e.what());
+                ok = false;
+            }
+        }
+        shared->Ok = ok;
+        shared->Done = true;
+        if (done) {
+            done(ok, shared->Value);
+        }
+    });
+    return future;
+}
+
+GdbFuture<std::string> GdbConnection::EvaluateAsync(std::string expression,
+        std::function<void(bool, const std::string&)> done)
+{
+    GdbFuture<std::string> future;
+    future.Connection = this;
+    future.Shared.reset(new GdbFuture<std::string>::State);
+    auto shared = future.Shared;
+
+    future.Token = State->AsyncCommand(
+            MIDataEvaluateExpression(const_cast<char*>(expression.c_str())),
+            [shared, done](bool ok, GdbCommand& cmd) {
+        if (ok) {
+            try {
+                GdbResult r(cmd.Result());
+                shared->Value = r["value"].Str();
+            }
+            catch (std::out_of_range &e) {
+                LOG_ERROR("%s", e.what());
+                ok = false;
+            }
+        }
+        shared->Ok = ok;
+        shared->Done = true;
+        if (done) {
+            done(ok, shared->Value);
+        }
+    });
+    return future;
+}
+
+/**
+ * Keep the connection going until the command with the given token has
+ * completed.
+ */
+void GdbConnection::Wait(int token)
+{
+    State->Wait(token);
+}
+
+void GdbConnection::WaitAll()
+{
+    State->WaitAll();
+}
+
+/**
+ * @return Statistics per command type, the ones that took the most time in
+ *         total first
+ */
+std::vector<GdbCommandStats> GdbConnection::CommandStats() const
+{
+    std::vector<GdbCommandStats> stats;
+    for (const auto& s : State->Stats) {
+        stats.push_back(s.second);
+    }
+    std::stable_sort(stats.begin(), stats.end(),
+            [](const GdbCommandStats& a, const GdbCommandStats& b) {
+                return a.LatencyUs.Sum() > b.LatencyUs.Sum();
+            });
+    return stats;
+}
+
+void GdbConnection::ResetCommandStats()
+{
+    State->Stats.clear();
+}
+
+/**
+ * Print a table with one line per command type.
+ */
+void GdbConnection::ReportCommandStats(std::ostream& out) const
+{
+    const std::vector<GdbCommandStats> stats = CommandStats();
+    if (stats.empty()) {
+        return;
+    }
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%-28s %8s %6s %10s %10s %10s %10s %12s %12s %12s",
+            "Command", "Count", "Failed", "Mean", "P50", "P99", "Max", "Sent", "Received",
+            "Memory");
+    out << "GDB command statistics (times in us, sizes in bytes):" << std::endl;
+    out << buf << std::endl;
+
+    for (const GdbCommandStats& s : stats) {
+        snprintf(buf, sizeof(buf),
+                "%-28s %8lu %6lu %10.1f %10lu %10lu %10lu %12lu %12lu %12lu",
+                s.Type.c_str(), s.LatencyUs.Count(), s.Failures, s.LatencyUs.Mean(),
+                s.LatencyUs.Percentile(50), s.LatencyUs.Percentile(99), s.LatencyUs.Max(),
+                s.BytesSent, s.BytesReceived, s.MemoryBytes);
+        out << buf << std::endl;
+    }
+}
+
 } // namespace
@@ -1,4 +1,8 @@
+#include <sys/select.h>
 #include <cassert>
+#include <cstring>
+#include <ctime>
+#include <sstream>
 #include <unistd.h>
 
 #include "log.h"
@@ -7,7 +11,8 @@
 namespace lct {
 
 GdbConnectionState::GdbConnectionState() :
-        Gdb(NULL)
+        Stats(), Gdb(NULL), Outstanding(), Timings(), Loop(), GdbOutput(this),
+        TargetOutput(this)
 {
 }
 
@@ -21,19 +26,245 @@ bool GdbConnectionState::SyncCommand(GdbCommand& cmd)
     // LOG_DEBUG("%s", MICommandToString(cmd));
 
     MISessionSendCommand(Gdb, cmd);
-    do {
-        MISessionProgress(Gdb);
-    } while (!MICommandCompleted(cmd));
+    Queued(cmd);
+    while (!MICommandCompleted(cmd) && Progress()) {
+    }
+    if (!MICommandCompleted(cmd)) {
+        LOG_ERROR("GDB is not running: %s", MICommandToString(cmd));
+        Timings.erase(cmd);
+        return false;
+    }
 
+    const bool ok = CheckResult(cmd);
+    Completed(cmd, ok);
+    return ok;
+}
+
+bool GdbConnectionState::CheckResult(GdbCommand& cmd)
+{
     if (!MICommandResultOK(cmd)) {
         LOG_WARNING("Command failed: %s: %s", MICommandToString(cmd),
                 MICommandResultErrorMessage(cmd));
         return false;
     }
-
     return true;
 }
 
+/**
+ * Send a command without waiting for it. The command is freed after done
+ * has been called.
+ *
+ * @return Token of the command, for Wait()
+ */
+int GdbConnectionState::AsyncCommand(MICommand* cmd, Completion done)
+{
+    Async a;
+    a.Cmd.reset(new GdbCommand(cmd));
+    a.Done = done;
+    if (MISessionSendCommand(Gdb, cmd) != 0) {
+        LOG_WARNING("Failed to send %s", MICommandToString(cmd));
+        if (a.Done) {
+            a.Done(false, *a.Cmd);
+        }
+        return -1;
+    }
+
+    Queued(cmd);
+    const int token = cmd->token;
+    Outstanding[token] = a;
+    return token;
+}
+
+/**
+ * Exchange data with GDB and complete any asynchronous commands that have
+ * received their replies. Waits for output only while commands are queued
+ * or in flight.
+ *
+ * @param timeoutMs  Longest time to wait for output, or -1 to wait until
+ *                   some arrives
+ * @return false if GDB is not running
+ */
+bool GdbConnectionState::Progress(int timeoutMs)
+{
+    if (!Running()) {
+        return false;
+    }
+
+    // Send what the pipeline has room for, replies come through the loop
+    fd_set none;
+    FD_ZERO(&none);
+    MISessionProcessCommandsAndResponses(Gdb, &none, NULL);
+    NoteSent();
+    if (MIListIsEmpty(Gdb->in_flight) && MIListIsEmpty(Gdb->send_queue)) {
+        timeoutMs = 0;
+    }
+
+    GdbOutput.Update(Gdb->out_fd);
+    TargetOutput.Update(Gdb->pty_fd);
+    Loop.Poll(timeoutMs);
+
+    // Completions may send new commands, so they are called after the scan
+    std::vector<Async> completed;
+    for (auto it = Outstanding.begin(); it != Outstanding.end();) {
+        if (MICommandCompleted(*it->second.Cmd)) {
+            completed.push_back(it->second);
+            it = Outstanding.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    for (Async& a : completed) {
+        const bool ok = CheckResult(*a.Cmd);
+        Completed(*a.Cmd, ok);
+        if (a.Done) {
+            a.Done(ok, *a.Cmd);
+        }
+    }
+    return Running();
+}
+
+/**
+ * Wait until the command with the given token has completed, or GDB has
+ * exited. Commands still in flight when GDB exits are no longer timed, as
+ * they will never complete.
+ */
+void GdbConnectionState::Wait(int token)
+{
+    while (Outstanding.count(token)) {
+        if (!Progress()) {
+            Timings.clear();
+            return;
+        }
+    }
+}
+
+void GdbConnectionState::WaitAll()
+{
+    while (!Outstanding.empty()) {
+        if (!Progress()) {
+            Timings.clear();
+            return;
+        }
+    }
+}
+
+void GdbConnectionState::Output::HandleEvents(uint32_t)
+{
+    fd_set ready;
+    FD_ZERO(&ready);
+    FD_SET(Fd, &ready);
+    MISessionProcessCommandsAndResponses(State->Gdb, &ready, NULL);
+    State->NoteSent();
+}
+
+/**
+ * Watch the descriptor libmi currently uses. It stops using one at EOF.
+ */
+void GdbConnectionState::Output::Update(int fd)
+{
+    if (fd == Fd) {
+        return;
+    }
+    if (Fd != -1) {
+        State->Loop.Remove(Fd);
+    }
+    Fd = fd;
+    if (Fd != -1 && !State->Loop.Add(Fd, this)) {
+        Fd = -1;
+    }
+}
+
+static uint64_t nowUs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Start timing a command that has been queued for sending.
+ */
+void GdbConnectionState::Queued(MICommand* cmd)
+{
+    Timing& t = Timings[cmd];
+    t.StartUs = nowUs();
+    t.Sent = false;
+
+    const std::string type = CommandType(cmd);
+    GdbCommandStats& s = Stats[type];
+    s.Type = type;
+    s.BytesSent += strlen(MICommandToString(cmd));
+    s.MemoryBytes += MemoryBytes(cmd);
+}
+
+/**
+ * Restart the timing of commands that libmi has written to GDB since the
+ * last call. They are the ones in flight.
+ */
+void GdbConnectionState::NoteSent()
+{
+    for (MIListElement* e = Gdb->in_flight->l_head; e; e = e->l_next) {
+        auto it = Timings.find(static_cast<MICommand*>(e->l_value));
+        if (it != Timings.end() && !it->second.Sent) {
+            it->second.StartUs = nowUs();
+            it->second.Sent = true;
+        }
+    }
+}
+
+void GdbConnectionState::Completed(MICommand* cmd, bool ok)
+{
+    auto it = Timings.find(cmd);
+    if (it == Timings.end()) {
+        return;
+    }
+    GdbCommandStats& s = Stats[CommandType(cmd)];
+    s.BytesReceived += cmd->reply_bytes;
+    s.LatencyUs.Record(nowUs() - it->second.StartUs);
+    s.Failures += !ok;
+    Timings.erase(it);
+}
+
+/**
+ * @return The MI command, or for CLI commands their first word, and the
+ *         second as well for monitor commands
+ */
+std::string GdbConnectionState::CommandType(MICommand* cmd)
+{
+    std::string type(cmd->command);
+    if (type == "-interpreter-exec" && cmd->num_options >= 2) {
+        std::istringstream in(cmd->options[1] + (cmd->options[1][0] == '"'));
+        std::string word;
+        if (in >> type && type == "monitor" && in >> word) {
+            type += " " + word;
+        }
+    }
+    return type;
+}
+
+/**
+ * @return The number of bytes of target memory a command reads or writes
+ */
+uint64_t GdbConnectionState::MemoryBytes(MICommand* cmd)
+{
+    // An offset comes first as "-o N"
+    const int n = cmd->num_options;
+    const int first = n > 0 && strcmp(cmd->options[0], "-o") == 0 ? 2 : 0;
+    if (strcmp(cmd->command, "-data-read-memory-bytes") == 0 && n >= first + 2) {
+        return strtoul(cmd->options[first + 1], NULL, 0);
+    }
+    if (strcmp(cmd->command, "-data-write-memory-bytes") == 0 && n >= 2) {
+        return strlen(cmd->options[1]) / 2;
+    }
+    if (strcmp(cmd->command, "-data-read-memory") == 0 && n >= first + 5) {
+        return strtoul(cmd->options[first + 2], NULL, 0) *
+                strtoul(cmd->options[first + 3], NULL, 0) *
+                strtoul(cmd->options[first + 4], NULL, 0);
+    }
+    return 0;
+}
+
 GdbCommand::GdbCommand(MICommand* cmd) :
         Cmd(cmd)
 {
@@ -54,118 +285,101 @@ GdbResult GdbCommand::Result()
     return GdbResult::FromResultRecord(MICommandResult(Cmd));
 }
 
-GdbResult::GdbResult() :
-        List(), Tuple(), String()
+GdbResult GdbResult::FromResultRecord(MIResultRecord* rr)
 {
+    return GdbResult(RESULTS, rr ? rr->results : NULL);
 }
 
-GdbResult::GdbResult(std::string s) :
-        List(), Tuple(), String(new std::string(s))
+GdbResult GdbResult::FromValue(MIValue* value)
 {
+    switch (value ? value->type : -1) {
+    case MIValueTypeConst: {
+        GdbResult out;
+        out.Kind = STRING;
+        out.String = value->cstring ? value->cstring : "";
+        return out;
+    }
+    case MIValueTypeList:
+        // The parser keeps lists of both kinds, only one of them is used
+        return value->results && !MIListIsEmpty(value->results) ?
+                GdbResult(RESULTS, value->results) : GdbResult(VALUES, value->values);
+    case MIValueTypeTuple:
+        return GdbResult(RESULTS, value->results);
+    default:
+        return GdbResult();
+    }
 }
 
-const GdbResult& GdbResult::operator[](std::string s) const throw(std::out_of_range)
+/**
+ * @return The first result with the given name, or an empty result
+ */
+GdbResult GdbResult::Find(StringRef name) const
 {
-    if (!Tuple) {
-        throw std::out_of_range("Not found");
+    if (Kind != RESULTS || !Items) {
+        return GdbResult();
     }
-    auto v = Tuple->find(s);
-    if (v == Tuple->end()) {
-        throw std::out_of_range("Not found");
+    for (MIListElement* e = Items->l_head; e; e = e->l_next) {
+        MIResult* r = static_cast<MIResult*>(e->l_value);
+        if (r->variable && name.Equals(r->variable)) {
+            return FromValue(r->value);
+        }
     }
-    return v->second;
+    return GdbResult();
 }
 
-const GdbResult& GdbResult::operator[](size_t n) const throw(std::out_of_range)
+/**
+ * @return The first result with the given name
+ * @throw std::out_of_range if there is none
+ */
+GdbResult GdbResult::operator[](StringRef name) const
 {
-    if (!List) {
+    GdbResult r = Find(name);
+    if (r.Empty()) {
         throw std::out_of_range("Not found");
     }
-    return List->at(n);
+    return r;
 }
 
-std::string GdbResult::Str() const throw(std::out_of_range)
+/**
+ * @return The value at position n, found by walking the list
+ * @throw std::out_of_range if the list is shorter
+ */
+GdbResult GdbResult::operator[](size_t n) const
 {
-    if (!String) {
-        throw std::out_of_range("Not found");
+    for (Iterator it = begin(); it != end(); ++it, n--) {
+        if (n == 0) {
+            return *it;
+        }
     }
-    return *String;
+    throw std::out_of_range("Not found");
 }
 
-GdbResult GdbResult::FromResultRecord(MIResultRecord* rr)
+GdbResult::Iterator GdbResult::begin() const
 {
-    assert(rr->results);
-    return GdbResult::FromTuple(rr->results);
+    return Iterator(Kind, (Kind == VALUES || Kind == RESULTS) && Items ? Items->l_head : NULL);
 }
 
-GdbResult GdbResult::FromList(MIList* list)
+GdbResult GdbResult::Iterator::operator*() const
 {
-    GdbResult out;
-    out.List.reset(new std::vector<GdbResult>);
-
-    // LOG_DEBUG("%u elements", list->l_nel);
-
-    MIValue* v;
-    for (MIListSet(list); (v = static_cast<MIValue*>(MIListGet(list)));) {
-        switch (v->type) {
-        case MIValueTypeConst: {
-            // LOG_DEBUG("String: %s", v->cstring);
-            out.List->push_back(std::move(GdbResult(v->cstring)));
-            break;
-        }
-        case MIValueTypeList: {
-            // LOG_DEBUG("List");
-            assert(v->values);
-            out.List->push_back(std::move(GdbResult::FromList(v->values)));
-            break;
-        }
-        case MIValueTypeTuple: {
-            // LOG_DEBUG("Tuple");
-            assert(v->results);
-            out.List->push_back(std::move(GdbResult::FromTuple(v->results)));
-            break;
-        }
-        }
-    }
-
-    return out;
+    return Kind == VALUES ? FromValue(static_cast<MIValue*>(Element->l_value)) :
+            FromValue(static_cast<MIResult*>(Element->l_value)->value);
 }
 
-GdbResult GdbResult::FromTuple(MIList* tuple)
+size_t GdbResult::Size() const
 {
-    GdbResult out;
-    out.Tuple.reset(new std::unordered_multimap<std::string, GdbResult>);
-
-    // LOG_DEBUG("%u elements", tuple->l_nel);
+    return (Kind == VALUES || Kind == RESULTS) && Items ? Items->l_nel : 0;
+}
 
-    MIResult* r;
-    for (MIListSet(tuple); (r = static_cast<MIResult*>(MIListGet(tuple)));) {
-        switch (r->value->type) {
-        case MIValueTypeConst: {
-            // LOG_DEBUG("String: %s = %s", r->variable, r->value->cstring);
-            assert(r->value->cstring);
-            std::pair<std::string, GdbResult> pair(r->variable, GdbResult(r->value->cstring));
-            out.Tuple->insert(std::move(pair));
-            break;
-        }
-        case MIValueTypeList: {
-            // LOG_DEBUG("List: %s = [...]", r->variable);
-            assert(r->value->values);
-            std::pair<std::string, GdbResult> pair(r->variable, GdbResult::FromList(r->value->values));
-            out.Tuple->insert(std::move(pair));
-            break;
-        }
-        case MIValueTypeTuple: {
-            // LOG_DEBUG("Tuple: %s = {...}", r->variable);
-            assert(r->value->results);
-            std::pair<std::string, GdbResult> pair(r->variable, GdbResult::FromTuple(r->value->results));
-            out.Tuple->insert(std::move(pair));
-            break;
-        }
-        }
+/**
+ * @return The string, which refers to the MI output of the command
+ * @throw std::out_of_range if the result is not a string
+ */
+StringRef GdbResult::View() const
+{
+    if (Kind != STRING) {
+        throw std::out_of_range("Not found");
     }
-
-    return out;
+    return StringRef(String);
 }
 
 } // namespace
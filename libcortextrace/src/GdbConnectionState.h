@@ -1,11 +1,16 @@
 #pragma once
 
+#include <functional>
+#include <map>
 #include <memory>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
+#include "EventLoop.h"
+#include "GdbConnection.h"
+#include "StringRef.h"
+
 extern "C" {
 #define class ClassRedefined
 #include "libmi/MI.h"
@@ -15,24 +20,64 @@ extern "C" {
 
 namespace lct {
 
+/**
+ * View of a value in an MI reply, such as the results of a command. It refers
+ * to the libmi parse tree rather than copying it, so it is only valid while
+ * the command it came from exists. Strings are NUL-terminated.
+ *
+ * Lists of results, like [frame={...},frame={...}], can be indexed both by
+ * name and by position. Indexing by position walks the list, so lists are
+ * best gone through with begin() and end().
+ */
 class GdbResult {
 public:
-    GdbResult(GdbResult&& o) = default;
+    enum Type {
+        NONE,
+        STRING,
+        VALUES,  ///< List of values
+        RESULTS, ///< Tuple, or list of results
+    };
+
+    /** Forward iterator over the values of a list or tuple */
+    class Iterator {
+    public:
+        Iterator(Type kind, MIListElement* element) : Kind(kind), Element(element) {}
+        GdbResult operator*() const;
+        Iterator& operator++() { Element = Element->l_next; return *this; }
+        bool operator!=(const Iterator& other) const { return Element != other.Element; }
+        bool operator==(const Iterator& other) const { return Element == other.Element; }
+
+    private:
+        Type Kind;
+        MIListElement* Element;
+    };
+
+    GdbResult() : Kind(NONE), Items(NULL), String(NULL) {}
+    GdbResult(const GdbResult&) = default;
+    GdbResult& operator=(const GdbResult&) = default;
+
     static GdbResult FromResultRecord(MIResultRecord* rr);
-    static GdbResult FromList(MIList* list);
-    static GdbResult FromTuple(MIList* tuple);
+    static GdbResult FromValue(MIValue* value);
 
-    const GdbResult& operator[](std::string) const throw(std::out_of_range);
-    const GdbResult& operator[](size_t) const throw(std::out_of_range);
-    std::string Str() const throw(std::out_of_range);
+    GdbResult operator[](StringRef name) const;
+    GdbResult operator[](size_t n) const;
+    GdbResult Find(StringRef name) const;
+    size_t Size() const;
+    Iterator begin() const;
+    Iterator end() const { return Iterator(Kind, NULL); }
+    Type GetType() const { return Kind; }
+    bool Empty() const { return Kind == NONE; }
+
+    StringRef View() const;
+    /** @throw std::out_of_range if the result is not a string */
+    std::string Str() const { return View().Str(); }
 
 private:
-    GdbResult(std::string);
-    GdbResult();
+    GdbResult(Type kind, MIList* items) : Kind(kind), Items(items), String(NULL) {}
 
-    std::unique_ptr<std::vector<GdbResult>> List;
-    std::unique_ptr<std::unordered_multimap<std::string, GdbResult>> Tuple;
-    std::unique_ptr<std::string> String;
+    Type Kind;
+    MIList* Items;
+    const char* String;
 };
 
 class GdbCommand {
@@ -50,15 +95,77 @@ private:
     GdbCommand& operator=(const GdbCommand&);
 };
 
+/**
+ * The MI session of a GdbConnection. Commands are either synchronous, or
+ * asynchronous with a completion called from Progress(). Up to the
+ * pipeline depth set on the session are sent before their replies arrive.
+ *
+ * Waiting for replies blocks in an event loop on the descriptors of the
+ * session, so a reply is handled as soon as it arrives and no time is
+ * spent polling.
+ *
+ * The latency of every command is recorded per command type.
+ */
 class GdbConnectionState {
 public:
+    typedef std::function<void(bool ok, GdbCommand& cmd)> Completion;
+
     GdbConnectionState();
     virtual ~GdbConnectionState();
 
     bool SyncCommand(GdbCommand& cmd);
-
+    int AsyncCommand(MICommand* cmd, Completion done);
+    bool Progress(int timeoutMs = -1);
+    void Wait(int token);
+    void WaitAll();
+    size_t Pending() const { return Outstanding.size(); }
+    bool Running() const { return Gdb && Gdb->out_fd != -1; }
+
+    std::map<std::string, GdbCommandStats> Stats;
     MISession* Gdb;
 
+protected:
+    /** Passes output on one descriptor of the session to libmi */
+    class Output : public EventLoop::Handler {
+    public:
+        Output(GdbConnectionState* state) : State(state), Fd(-1) {}
+        void HandleEvents(uint32_t events);
+        void Update(int fd);
+
+        GdbConnectionState* State;
+        int Fd;
+
+    private:
+        Output(const Output&);
+        Output& operator=(const Output&);
+    };
+
+    struct Async {
+        Async() : Cmd(), Done() {}
+        std::shared_ptr<GdbCommand> Cmd;
+        Completion Done;
+    };
+
+    /** When a command was sent, or queued if it has not been sent yet */
+    struct Timing {
+        Timing() : StartUs(0), Sent(false) {}
+        uint64_t StartUs;
+        bool Sent;
+    };
+
+    std::map<int, Async> Outstanding;
+    std::map<MICommand*, Timing> Timings;
+    EventLoop Loop;
+    Output GdbOutput;
+    Output TargetOutput;
+
+    static bool CheckResult(GdbCommand& cmd);
+    void Queued(MICommand* cmd);
+    void NoteSent();
+    void Completed(MICommand* cmd, bool ok);
+    static std::string CommandType(MICommand* cmd);
+    static uint64_t MemoryBytes(MICommand* cmd);
+
 private:
     GdbConnectionState(const GdbConnectionState&);
     GdbConnectionState& operator=(const GdbConnectionState&);
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Histogram.h"
+
+namespace lct {
+
+static unsigned msb(uint64_t v)
+{
+    return 63 - __builtin_clzll(v);
+}
+
+Histogram::Histogram(unsigned subBucketBits) :
+        SubBucketBits(std::max(2U, std::min(subBucketBits, 16U))),
+        Counts(), TotalCount(0), TotalSum(0), MinValue(UINT64_MAX), MaxValue(0)
+{
+    const size_t half = size_t(1) << (SubBucketBits - 1);
+    Counts.resize((size_t(1) << SubBucketBits) + (64 - SubBucketBits) * half);
+}
+
+Histogram::~Histogram()
+{
+}
+
+size_t Histogram::IndexOf(uint64_t value) const
+{
+    const uint64_t exact = uint64_t(1) << SubBucketBits;
+    if (value < exact) {
+        return value;
+    }
+    const unsigned shift = msb(value) - SubBucketBits + 1;
+    const uint64_t half = exact >> 1;
+    return exact + (shift - 1) * half + ((value >> shift) - half);
+}
+
+uint64_t Histogram::HighestValueAt(size_t index) const
+{
+    const uint64_t exact = uint64_t(1) << SubBucketBits;
+    if (index < exact) {
+        return index;
+    }
+    const uint64_t half = exact >> 1;
+    const unsigned shift = (index - exact) / half + 1;
+    const uint64_t top = half + (index - exact) % half;
+    return ((top + 1) << shift) - 1;
+}
+
+void Histogram::Record(uint64_t value, uint64_t count)
+{
+    Counts[IndexOf(value)] += count;
+    TotalCount += count;
+    TotalSum += value * count;
+    MinValue = std::min(MinValue, value);
+    MaxValue = std::max(MaxValue, value);
+}
+
+void Histogram::Reset()
+{
+    std::fill(Counts.begin(), Counts.end(), 0);
+    TotalCount = 0;
+    TotalSum = 0;
+    MinValue = UINT64_MAX;
+    MaxValue = 0;
+}
+
+/**
+ * @param percentile  0.0 to 100.0
+ * @return The highest value equivalent to the value at the percentile,
+ *         clamped to the recorded min and max
+ */
+uint64_t Histogram::Percentile(double percentile) const
+{
+    if (TotalCount == 0) {
+        return 0;
+    }
+
+    const double p = std::max(0.0, std::min(percentile, 100.0));
+    const uint64_t target = std::max<uint64_t>(1, std::ceil(p / 100.0 * TotalCount));
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < Counts.size(); i++) {
+        seen += Counts[i];
+        if (seen >= target) {
+            return std::max(MinValue, std::min(HighestValueAt(i), MaxValue));
+        }
+    }
+    return MaxValue;
+}
+
+} /* namespace lct */
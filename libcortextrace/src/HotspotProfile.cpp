@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "HotspotProfile.h"
+#include "LineTable.h"
+#include "SymbolTable.h"
+
+namespace lct {
+
+typedef std::pair<std::string, uint64_t> NamedCount;
+typedef std::pair<std::string, uint32_t> SourceLine;
+typedef std::pair<SourceLine, uint64_t> LineCount;
+
+template<typename T>
+static void sortByCount(std::vector<T>& v)
+{
+    std::sort(v.begin(), v.end(), [](const T& a, const T& b) {
+        return a.second > b.second;
+    });
+}
+
+/**
+ * Read one line from a source file, for annotating the report.
+ * Returns an empty string if the file can't be read.
+ */
+static std::string sourceLine(const std::string& file, uint32_t line)
+{
+    std::ifstream in(file);
+    std::string text;
+    for (uint32_t i = 0; i < line && std::getline(in, text); i++)
+        ;
+    if (!in) {
+        return "";
+    }
+    const size_t first = text.find_first_not_of(" \t");
+    return first == std::string::npos ? "" : text.substr(first);
+}
+
+HotspotProfile::HotspotProfile(LineTable* lines, const SymbolTable* symbols) :
+        Lines(lines), Symbols(symbols), Samples(), Total(0)
+{
+}
+
+HotspotProfile::~HotspotProfile()
+{
+}
+
+void HotspotProfile::ReportLines(std::ostream& out, size_t maxLines) const
+{
+    if (!Lines || Total == 0) {
+        return;
+    }
+
+    std::map<SourceLine, uint64_t> perLine;
+    uint64_t unknown = 0;
+    for (const auto& s : Samples) {
+        const char* file;
+        uint32_t line;
+        if (Lines->Lookup(s.first, &file, &line)) {
+            perLine[std::make_pair(std::string(file), line)] += s.second;
+        }
+        else {
+            unknown += s.second;
+        }
+    }
+
+    std::vector<LineCount> sorted(perLine.begin(), perLine.end());
+    sortByCount(sorted);
+
+    out << "Line hotspots (" << Total << " samples):" << std::endl;
+    char buf[64];
+    for (size_t i = 0; i < sorted.size() && i < maxLines; i++) {
+        const std::string& file = sorted[i].first.first;
+        const uint32_t line = sorted[i].first.second;
+        snprintf(buf, sizeof(buf), "%6.2f%% %10lu  ",
+                100.0 * sorted[i].second / Total, sorted[i].second);
+        out << buf << file << ":" << line;
+        const std::string text = sourceLine(file, line);
+        if (!text.empty()) {
+            out << "  | " << text;
+        }
+        out << std::endl;
+    }
+    if (unknown) {
+        snprintf(buf, sizeof(buf), "%6.2f%% %10lu  ", 100.0 * unknown / Total, unknown);
+        out << buf << "(no line information)" << std::endl;
+    }
+}
+
+void HotspotProfile::ReportFunctions(std::ostream& out, size_t maxFunctions) const
+{
+    if (!Symbols || Total == 0) {
+        return;
+    }
+
+    std::unordered_map<std::string, uint64_t> perFunction;
+    for (const auto& s : Samples) {
+        const char* name = Symbols->Lookup(s.first);
+        perFunction[name ? name : "(unknown)"] += s.second;
+    }
+
+    std::vector<NamedCount> sorted(perFunction.begin(), perFunction.end());
+    sortByCount(sorted);
+
+    out << "Function hotspots (" << Total << " samples):" << std::endl;
+    char buf[64];
+    for (size_t i = 0; i < sorted.size() && i < maxFunctions; i++) {
+        snprintf(buf, sizeof(buf), "%6.2f%% %10lu  ",
+                100.0 * sorted[i].second / Total, sorted[i].second);
+        out << buf << sorted[i].first << std::endl;
+    }
+}
+
+} /* namespace lct */
@@ -0,0 +1,490 @@
+#include <algorithm>
+
+#include "ElfFile.h"
+#include "LineTable.h"
+
+#include "log.h"
+
+namespace lct {
+
+// Standard opcodes
+enum {
+    DW_LNS_copy = 1,
+    DW_LNS_advance_pc = 2,
+    DW_LNS_advance_line = 3,
+    DW_LNS_set_file = 4,
+    DW_LNS_const_add_pc = 8,
+    DW_LNS_fixed_advance_pc = 9,
+};
+
+// Extended opcodes
+enum {
+    DW_LNE_end_sequence = 1,
+    DW_LNE_set_address = 2,
+    DW_LNE_define_file = 3,
+};
+
+// DWARF 5 entry formats
+enum {
+    DW_LNCT_path = 1,
+    DW_LNCT_directory_index = 2,
+};
+
+enum {
+    DW_FORM_block2 = 0x03,
+    DW_FORM_block4 = 0x04,
+    DW_FORM_data2 = 0x05,
+    DW_FORM_data4 = 0x06,
+    DW_FORM_data8 = 0x07,
+    DW_FORM_string = 0x08,
+    DW_FORM_block = 0x09,
+    DW_FORM_block1 = 0x0a,
+    DW_FORM_data1 = 0x0b,
+    DW_FORM_udata = 0x0f,
+    DW_FORM_strp = 0x0e,
+    DW_FORM_data16 = 0x1e,
+    DW_FORM_line_strp = 0x1f,
+};
+
+/**
+ * Bounds checked reader for DWARF data. Reading past the end sets the
+ * error flag and returns zeroes.
+ */
+class DwarfReader {
+public:
+    DwarfReader(const uint8_t* p, const uint8_t* end) :
+        P(p), End(end), Error(false) {}
+    DwarfReader(const DwarfReader&) = default;
+    DwarfReader& operator=(const DwarfReader&) = default;
+
+    const uint8_t* P;
+    const uint8_t* End;
+    bool Error;
+
+    bool Check(size_t n)
+    {
+        if (Error || size_t(End - P) < n) {
+            Error = true;
+            P = End;
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t Fixed(size_t n)
+    {
+        if (!Check(n)) {
+            return 0;
+        }
+        uint64_t v = 0;
+        for (size_t i = 0; i < n; i++) {
+            v |= uint64_t(P[i]) << (8 * i);
+        }
+        P += n;
+        return v;
+    }
+
+    uint64_t ULeb()
+    {
+        uint64_t v = 0;
+        unsigned shift = 0;
+        while (Check(1)) {
+            const uint8_t b = *P++;
+            if (shift < 64) {
+                v |= uint64_t(b & 0x7f) << shift;
+            }
+            shift += 7;
+            if (!(b & 0x80)) {
+                break;
+            }
+        }
+        return v;
+    }
+
+    int64_t SLeb()
+    {
+        int64_t v = 0;
+        unsigned shift = 0;
+        uint8_t b = 0;
+        while (Check(1)) {
+            b = *P++;
+            if (shift < 64) {
+                v |= int64_t(b & 0x7f) << shift;
+            }
+            shift += 7;
+            if (!(b & 0x80)) {
+                break;
+            }
+        }
+        if (shift < 64 && (b & 0x40)) {
+            v |= -(int64_t(1) << shift);
+        }
+        return v;
+    }
+
+    const char* String()
+    {
+        const uint8_t* s = P;
+        while (P < End && *P) {
+            P++;
+        }
+        if (!Check(1)) {
+            return "";
+        }
+        P++;
+        return reinterpret_cast<const char*>(s);
+    }
+
+    void Skip(size_t n)
+    {
+        if (Check(n)) {
+            P += n;
+        }
+    }
+};
+
+static const char* sectionString(const ElfFile::Section* s, uint64_t offset)
+{
+    if (!s || !s->Data || offset >= s->Size) {
+        return "";
+    }
+    return reinterpret_cast<const char*>(&s->Data[offset]);
+}
+
+static std::string joinPath(const std::string& dir, const char* file)
+{
+    if (dir.empty() || file[0] == '/') {
+        return file;
+    }
+    return dir + "/" + file;
+}
+
+const uint32_t LineTable::NO_FILE;
+
+LineTable::LineTable(const ElfFile& elf) :
+        Elf(elf), Parsed(false), Rows(), FileNames(), FileIndex()
+{
+}
+
+LineTable::~LineTable()
+{
+}
+
+size_t LineTable::Size()
+{
+    if (!Parsed) {
+        Parse();
+    }
+    return Rows.size();
+}
+
+/**
+ * Find the source line an address belongs to.
+ *
+ * @return false if the address is not covered by the line table
+ */
+bool LineTable::Lookup(uint32_t address, const char** file, uint32_t* line)
+{
+    if (!Parsed) {
+        Parse();
+    }
+
+    auto it = std::upper_bound(Rows.begin(), Rows.end(), address,
+            [](uint32_t a, const Row& r) { return a < r.Address; });
+    if (it == Rows.begin()) {
+        return false;
+    }
+    --it;
+    if (it->File == NO_FILE) {
+        return false;
+    }
+    *file = FileNames[it->File].c_str();
+    *line = it->Line;
+    return true;
+}
+
+uint32_t LineTable::AddFileName(const std::string& name)
+{
+    auto it = FileIndex.find(name);
+    if (it != FileIndex.end()) {
+        return it->second;
+    }
+    const uint32_t index = FileNames.size();
+    FileNames.push_back(name);
+    FileIndex.insert(std::make_pair(name, index));
+    return index;
+}
+
+void LineTable::Parse()
+{
+    Parsed = true;
+
+    const ElfFile::Section* debugLine = Elf.FindSection(".debug_line");
+    if (!debugLine || !debugLine->Data) {
+        LOG_WARNING("No .debug_line section in ELF file");
+        return;
+    }
+
+    const uint8_t* p = debugLine->Data;
+    const uint8_t* end = p + debugLine->Size;
+    while (p && p < end) {
+        p = ParseUnit(p, end);
+    }
+
+    // End-of-sequence markers sort before rows starting at the same address
+    std::stable_sort(Rows.begin(), Rows.end(), [](const Row& a, const Row& b) {
+        if (a.Address != b.Address) {
+            return a.Address < b.Address;
+        }
+        return a.File == NO_FILE && b.File != NO_FILE;
+    });
+
+    size_t out = 0;
+    for (size_t i = 0; i < Rows.size(); i++) {
+        const Row& r = Rows[i];
+        if (out > 0 && Rows[out - 1].Address == r.Address) {
+            Rows[out - 1] = r;
+            continue;
+        }
+        if (out > 0 && Rows[out - 1].File == r.File && Rows[out - 1].Line == r.Line) {
+            continue;
+        }
+        Rows[out++] = r;
+    }
+    Rows.resize(out, Row(0, 0, 0));
+    Rows.shrink_to_fit();
+    FileIndex.clear();
+
+    LOG_DEBUG("Parsed line table: %lu rows, %lu files", Rows.size(), FileNames.size());
+}
+
+/**
+ * Run the line number program of one unit and append its rows.
+ *
+ * @return Pointer to the next unit, or NULL on error
+ */
+const uint8_t* LineTable::ParseUnit(const uint8_t* p, const uint8_t* end)
+{
+    DwarfReader r(p, end);
+
+    uint64_t unitLength = r.Fixed(4);
+    size_t offsetSize = 4;
+    if (unitLength == 0xffffffff) {
+        unitLength = r.Fixed(8);
+        offsetSize = 8;
+    }
+    if (r.Error || unitLength > size_t(end - r.P)) {
+        LOG_WARNING("Truncated line table unit");
+        return NULL;
+    }
+    const uint8_t* unitEnd = r.P + unitLength;
+    r.End = unitEnd;
+
+    const uint16_t version = r.Fixed(2);
+    if (version < 2 || version > 5) {
+        LOG_WARNING("Unsupported line table version %u", version);
+        return unitEnd;
+    }
+    if (version >= 5) {
+        r.Skip(2); // address_size, segment_selector_size
+    }
+    const uint64_t headerLength = r.Fixed(offsetSize);
+    const uint8_t* program = r.P + headerLength;
+    const uint8_t minInstLength = r.Fixed(1);
+    if (version >= 4) {
+        r.Skip(1); // maximum_operations_per_instruction
+    }
+    r.Skip(1); // default_is_stmt
+    const int8_t lineBase = r.Fixed(1);
+    const uint8_t lineRange = r.Fixed(1);
+    const uint8_t opcodeBase = r.Fixed(1);
+    std::vector<uint8_t> opcodeLengths(opcodeBase);
+    for (size_t i = 1; i < opcodeBase; i++) {
+        opcodeLengths[i] = r.Fixed(1);
+    }
+
+    if (r.Error || lineRange == 0 || program > unitEnd) {
+        LOG_WARNING("Bad line table header");
+        return unitEnd;
+    }
+
+    std::vector<std::string> dirs;
+    std::vector<uint32_t> files;
+
+    if (version < 5) {
+        dirs.push_back("");
+        for (;;) {
+            const char* dir = r.String();
+            if (r.Error || !*dir) {
+                break;
+            }
+            dirs.push_back(dir);
+        }
+        // File numbering starts at 1, entry 0 is unused
+        files.push_back(NO_FILE);
+        for (;;) {
+            const char* name = r.String();
+            if (r.Error || !*name) {
+                break;
+            }
+            const uint64_t dir = r.ULeb();
+            r.ULeb(); // mtime
+            r.ULeb(); // length
+            files.push_back(AddFileName(joinPath(dir < dirs.size() ? dirs[dir] : "", name)));
+        }
+    }
+    else {
+        const ElfFile::Section* lineStr = Elf.FindSection(".debug_line_str");
+        const ElfFile::Section* str = Elf.FindSection(".debug_str");
+
+        // Directory table, then file name table, in the same format
+        for (int table = 0; table < 2 && !r.Error; table++) {
+            std::vector<std::pair<uint64_t, uint64_t>> format(r.Fixed(1));
+            for (auto& f : format) {
+                f.first = r.ULeb();
+                f.second = r.ULeb();
+            }
+
+            const uint64_t count = r.ULeb();
+            for (uint64_t i = 0; i < count && !r.Error; i++) {
+                const char* path = "";
+                uint64_t dir = 0;
+                for (const auto& f : format) {
+                    uint64_t value = 0;
+                    const char* s = NULL;
+                    switch (f.second) {
+                    case DW_FORM_string: s = r.String(); break;
+                    case DW_FORM_line_strp: s = sectionString(lineStr, r.Fixed(offsetSize)); break;
+                    case DW_FORM_strp: s = sectionString(str, r.Fixed(offsetSize)); break;
+                    case DW_FORM_data1: value = r.Fixed(1); break;
+                    case DW_FORM_data2: value = r.Fixed(2); break;
+                    case DW_FORM_data4: value = r.Fixed(4); break;
+                    case DW_FORM_data8: value = r.Fixed(8); break;
+                    case DW_FORM_data16: r.Skip(16); break;
+                    case DW_FORM_udata: value = r.ULeb(); break;
+                    case DW_FORM_block: r.Skip(r.ULeb()); break;
+                    case DW_FORM_block1: r.Skip(r.Fixed(1)); break;
+                    case DW_FORM_block2: r.Skip(r.Fixed(2)); break;
+                    case DW_FORM_block4: r.Skip(r.Fixed(4)); break;
+                    default:
+                        LOG_WARNING("Unsupported form %#lx in line table", f.second);
+                        return unitEnd;
+                    }
+                    if (f.first == DW_LNCT_path && s) {
+                        path = s;
+                    }
+                    else if (f.first == DW_LNCT_directory_index) {
+                        dir = value;
+                    }
+                }
+
+                if (table == 0) {
+                    dirs.push_back(path);
+                }
+                else {
+                    files.push_back(AddFileName(joinPath(dir < dirs.size() ? dirs[dir] : "", path)));
+                }
+            }
+        }
+    }
+
+    if (r.Error) {
+        LOG_WARNING("Bad line table file names");
+        return unitEnd;
+    }
+
+    // Run the line number program
+    r.P = program;
+
+    uint64_t address = 0;
+    uint64_t file = 1;
+    int64_t line = 1;
+
+    auto emit = [&](bool endSequence) {
+        uint32_t f = NO_FILE;
+        if (!endSequence) {
+            if (file >= files.size()) {
+                return;
+            }
+            f = files[file];
+        }
+        Rows.push_back(Row(address, f, line));
+    };
+
+    while (r.P < unitEnd && !r.Error) {
+        const uint8_t opcode = r.Fixed(1);
+
+        if (opcode >= opcodeBase) {
+            const uint8_t adjusted = opcode - opcodeBase;
+            address += (adjusted / lineRange) * minInstLength;
+            line += lineBase + (adjusted % lineRange);
+            emit(false);
+            continue;
+        }
+
+        switch (opcode) {
+        case 0: { // Extended opcode
+            const uint64_t len = r.ULeb();
+            const uint8_t* next = r.P + len;
+            if (len == 0 || len > size_t(unitEnd - r.P)) {
+                r.Error = true;
+                break;
+            }
+            const uint8_t sub = r.Fixed(1);
+            switch (sub) {
+            case DW_LNE_end_sequence:
+                emit(true);
+                address = 0;
+                file = 1;
+                line = 1;
+                break;
+            case DW_LNE_set_address:
+                address = r.Fixed(std::min<uint64_t>(len - 1, 8));
+                break;
+            case DW_LNE_define_file: {
+                const char* name = r.String();
+                const uint64_t dir = r.ULeb();
+                files.push_back(AddFileName(joinPath(dir < dirs.size() ? dirs[dir] : "", name)));
+                break;
+            }
+            default:
+                break;
+            }
+            r.P = next;
+            break;
+        }
+        case DW_LNS_copy:
+            emit(false);
+            break;
+        case DW_LNS_advance_pc:
+            address += r.ULeb() * minInstLength;
+            break;
+        case DW_LNS_advance_line:
+            line += r.SLeb();
+            break;
+        case DW_LNS_set_file:
+            file = r.ULeb();
+            break;
+        case DW_LNS_const_add_pc:
+            address += ((255 - opcodeBase) / lineRange) * minInstLength;
+            break;
+        case DW_LNS_fixed_advance_pc:
+            address += r.Fixed(2);
+            break;
+        default:
+            // Skip operands of opcodes we don't care about
+            for (size_t i = 0; i < opcodeLengths[opcode]; i++) {
+                r.ULeb();
+            }
+            break;
+        }
+    }
+
+    if (r.Error) {
+        LOG_WARNING("Bad line number program");
+    }
+
+    return unitEnd;
+}
+
+} /* namespace lct */
@@ -0,0 +1,191 @@
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include "OutputSink.h"
+
+#include "log.h"
+
+namespace lct {
+
+OutputSink::OutputSink(size_t bufferSize, unsigned flushIntervalMs) :
+        Buffer(bufferSize < 64 ? 64 : bufferSize), Used(0),
+        FlushInterval(flushIntervalMs * 1000000ULL), LastFlush(Now()), Failed(false)
+{
+}
+
+OutputSink::~OutputSink()
+{
+}
+
+/**
+ * @return Monotonic time in nanoseconds
+ */
+uint64_t OutputSink::Now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void OutputSink::Write(const char* data, size_t len)
+{
+    while (len) {
+        if (Used == Buffer.size()) {
+            Flush();
+        }
+        const size_t n = std::min(len, Buffer.size() - Used);
+        memcpy(&Buffer[Used], data, n);
+        Used += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void OutputSink::Write(const char* str)
+{
+    Write(str, strlen(str));
+}
+
+void OutputSink::Decimal(uint64_t value)
+{
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[n++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    if (Buffer.size() - Used < n) {
+        Flush();
+    }
+    while (n) {
+        Buffer[Used++] = digits[--n];
+    }
+}
+
+/**
+ * Write a number in lowercase hexadecimal without leading zeros or prefix.
+ */
+void OutputSink::Hex(uint32_t value)
+{
+    static const char digits[] = "0123456789abcdef";
+    int shift = 28;
+    while (shift > 0 && !(value >> shift)) {
+        shift -= 4;
+    }
+
+    if (Buffer.size() - Used < 8) {
+        Flush();
+    }
+    for (; shift >= 0; shift -= 4) {
+        Buffer[Used++] = digits[(value >> shift) & 0xf];
+    }
+}
+
+void OutputSink::LittleEndian(uint64_t value, unsigned bytes)
+{
+    if (Buffer.size() - Used < bytes) {
+        Flush();
+    }
+    for (unsigned i = 0; i < bytes; i++) {
+        Buffer[Used++] = static_cast<char>(value >> (8 * i));
+    }
+}
+
+/**
+ * Write out all buffered data, waiting for the sink if it would block.
+ */
+bool OutputSink::Flush()
+{
+    return Push(true);
+}
+
+/**
+ * Pass the buffered data to Drain() and keep what it did not take.
+ *
+ * @param wait  Wait for the sink until all data is written
+ */
+bool OutputSink::Push(bool wait)
+{
+    LastFlush = Now();
+    size_t done = 0;
+    while (done < Used && !Failed) {
+        const ssize_t res = Drain(&Buffer[done], Used - done);
+        if (res < 0) {
+            // Keep going so that reports still get printed
+            Failed = true;
+        }
+        else if (res > 0) {
+            done += res;
+        }
+        else if (wait) {
+            Wait();
+        }
+        else {
+            break;
+        }
+    }
+    if (Failed) {
+        Used = 0;
+        return false;
+    }
+    memmove(Buffer.data(), &Buffer[done], Used - done);
+    Used -= done;
+    return true;
+}
+
+/**
+ * Write out what the sink takes without blocking, if the flush interval has
+ * passed since the last flush.
+ */
+bool OutputSink::Tick()
+{
+    if (Used && Now() - LastFlush >= FlushInterval) {
+        return Push(false);
+    }
+    return !Failed;
+}
+
+// -----------------------------------------------------------------
+
+FdOutputSink::FdOutputSink(int fd, size_t bufferSize, unsigned flushIntervalMs) :
+        OutputSink(bufferSize, flushIntervalMs), Fd(fd)
+{
+}
+
+FdOutputSink::~FdOutputSink()
+{
+    Flush();
+}
+
+ssize_t FdOutputSink::Drain(const char* data, size_t len)
+{
+    size_t written = 0;
+    while (written < len) {
+        const ssize_t res = write(Fd, data + written, len - written);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            LOG_ERROR("Failed to write output: %s", strerror(errno));
+            return -1;
+        }
+        written += res;
+    }
+    return written;
+}
+
+void FdOutputSink::Wait()
+{
+    pollfd pfd = { Fd, POLLOUT, 0 };
+    poll(&pfd, 1, -1);
+}
+
+} /* namespace lct */
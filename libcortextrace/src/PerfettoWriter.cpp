@@ -0,0 +1,306 @@
+#include "ExceptionAnalyzer.h"
+#include "PerfettoWriter.h"
+#include "TraceEvent.h"
+
+namespace lct {
+
+// Field numbers from perfetto/protos/perfetto/trace
+enum {
+    TRACE_PACKET = 1,
+
+    PACKET_TIMESTAMP = 8,
+    PACKET_SEQUENCE_ID = 10,
+    PACKET_TRACK_EVENT = 11,
+    PACKET_SEQUENCE_FLAGS = 13,
+    PACKET_TRACK_DESCRIPTOR = 60,
+
+    TRACK_UUID = 1,
+    TRACK_NAME = 2,
+    TRACK_COUNTER = 8,
+
+    EVENT_TYPE = 9,
+    EVENT_TRACK_UUID = 11,
+    EVENT_NAME = 23,
+    EVENT_COUNTER_VALUE = 30,
+};
+
+enum {
+    SEQ_INCREMENTAL_STATE_CLEARED = 1,
+    SEQ_NEEDS_INCREMENTAL_STATE = 2,
+};
+
+enum {
+    TYPE_SLICE_BEGIN = 1,
+    TYPE_SLICE_END = 2,
+    TYPE_INSTANT = 3,
+    TYPE_COUNTER = 4,
+};
+
+// Track UUIDs
+static const uint64_t TRACK_EXCEPTIONS = 1;
+static const uint64_t TRACK_COUNTERS = 0x100;
+static const uint64_t TRACK_WATCHES = 0x200;
+static const uint64_t TRACK_PORTS = 0x300;
+static const uint64_t TRACK_SPANS = 1ULL << 32;
+
+static const uint32_t SEQUENCE_ID = 1;
+static const size_t MAX_LINE = 256;
+
+const size_t PerfettoWriter::FLUSH_SIZE;
+
+// -----------------------------------------------------------------
+// Minimal protobuf encoding, appending to a string
+
+static void putVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static void putUInt(std::string& out, unsigned field, uint64_t value)
+{
+    putVarint(out, field << 3);
+    putVarint(out, value);
+}
+
+static void putBytes(std::string& out, unsigned field, const char* data, size_t len)
+{
+    putVarint(out, (field << 3) | 2);
+    putVarint(out, len);
+    out.append(data, len);
+}
+
+static void putBytes(std::string& out, unsigned field, const std::string& data)
+{
+    putBytes(out, field, data.data(), data.size());
+}
+
+// -----------------------------------------------------------------
+
+PerfettoWriter::PerfettoWriter(std::ostream& out, double ticksPerSecond) :
+        Out(out), TicksPerSecond(ticksPerSecond), SpanBegin(-1), SpanEnd(-1),
+        Counters(), LastTime(0), Tracks(), ActiveExceptions(), Lines(32),
+        Buffer(), Packet(), Message()
+{
+    Buffer.reserve(FLUSH_SIZE + 1024);
+
+    // Start the packet sequence, so that the events below can refer to it
+    putUInt(Packet, PACKET_SEQUENCE_ID, SEQUENCE_ID);
+    putUInt(Packet, PACKET_SEQUENCE_FLAGS, SEQ_INCREMENTAL_STATE_CLEARED);
+    WritePacket();
+}
+
+PerfettoWriter::~PerfettoWriter()
+{
+    Flush();
+}
+
+void PerfettoWriter::SetSpanPorts(unsigned begin, unsigned end)
+{
+    SpanBegin = begin;
+    SpanEnd = end;
+}
+
+uint64_t PerfettoWriter::ToNanoseconds(uint64_t ticks) const
+{
+    if (TicksPerSecond <= 0) {
+        return ticks;
+    }
+    return static_cast<uint64_t>(ticks * (1e9 / TicksPerSecond));
+}
+
+/**
+ * Write a descriptor for a track the first time it is used.
+ */
+void PerfettoWriter::UseTrack(uint64_t uuid, const std::string& name, bool counter)
+{
+    if (!Tracks.insert(uuid).second) {
+        return;
+    }
+
+    Message.clear();
+    putUInt(Message, TRACK_UUID, uuid);
+    putBytes(Message, TRACK_NAME, name);
+    if (counter) {
+        putBytes(Message, TRACK_COUNTER, "", 0);
+    }
+    putUInt(Packet, PACKET_SEQUENCE_ID, SEQUENCE_ID);
+    putBytes(Packet, PACKET_TRACK_DESCRIPTOR, Message);
+    WritePacket();
+}
+
+void PerfettoWriter::Slice(uint64_t uuid, uint64_t time, int type, const std::string& name)
+{
+    Message.clear();
+    putUInt(Message, EVENT_TYPE, type);
+    putUInt(Message, EVENT_TRACK_UUID, uuid);
+    if (!name.empty()) {
+        putBytes(Message, EVENT_NAME, name);
+    }
+    putUInt(Packet, PACKET_TIMESTAMP, ToNanoseconds(time));
+    putUInt(Packet, PACKET_SEQUENCE_ID, SEQUENCE_ID);
+    putUInt(Packet, PACKET_SEQUENCE_FLAGS, SEQ_NEEDS_INCREMENTAL_STATE);
+    putBytes(Packet, PACKET_TRACK_EVENT, Message);
+    WritePacket();
+}
+
+void PerfettoWriter::Counter(uint64_t uuid, uint64_t time, int64_t value)
+{
+    Message.clear();
+    putUInt(Message, EVENT_TYPE, TYPE_COUNTER);
+    putUInt(Message, EVENT_TRACK_UUID, uuid);
+    putUInt(Message, EVENT_COUNTER_VALUE, value);
+    putUInt(Packet, PACKET_TIMESTAMP, ToNanoseconds(time));
+    putUInt(Packet, PACKET_SEQUENCE_ID, SEQUENCE_ID);
+    putUInt(Packet, PACKET_SEQUENCE_FLAGS, SEQ_NEEDS_INCREMENTAL_STATE);
+    putBytes(Packet, PACKET_TRACK_EVENT, Message);
+    WritePacket();
+}
+
+/**
+ * Move the packet under construction to the output buffer.
+ */
+void PerfettoWriter::WritePacket()
+{
+    putBytes(Buffer, TRACE_PACKET, Packet);
+    Packet.clear();
+    if (Buffer.size() >= FLUSH_SIZE) {
+        Flush();
+    }
+}
+
+void PerfettoWriter::Flush()
+{
+    Out.write(Buffer.data(), Buffer.size());
+    Out.flush();
+    Buffer.clear();
+}
+
+/**
+ * Close all open slices and write out any partial lines of text.
+ */
+void PerfettoWriter::Finish()
+{
+    while (!ActiveExceptions.empty()) {
+        Slice(TRACK_EXCEPTIONS, LastTime, TYPE_SLICE_END, "");
+        ActiveExceptions.pop_back();
+    }
+    for (unsigned port = 0; port < Lines.size(); port++) {
+        if (!Lines[port].empty()) {
+            Slice(TRACK_PORTS + port, LastTime, TYPE_INSTANT, Lines[port]);
+            Lines[port].clear();
+        }
+    }
+    Flush();
+}
+
+void PerfettoWriter::HandleTraceEvent(const TraceEvent& event)
+{
+    LastTime = event.Timestamp;
+
+    switch (event.Type) {
+    case TraceEvent::TRACE_EVENT_INSTR: {
+        const unsigned port = event.Code >> 3;
+        if (int(port) == SpanBegin || int(port) == SpanEnd) {
+            const uint64_t uuid = TRACK_SPANS + event.Value;
+            UseTrack(uuid, "Span " + std::to_string(event.Value), false);
+            if (int(port) == SpanBegin) {
+                Slice(uuid, event.Timestamp, TYPE_SLICE_BEGIN, std::to_string(event.Value));
+            }
+            else {
+                Slice(uuid, event.Timestamp, TYPE_SLICE_END, "");
+            }
+        }
+        else {
+            HandleText(port, event);
+        }
+        break;
+    }
+    case TraceEvent::TRACE_EVENT_HW: {
+        const uint8_t discriminator = event.Code >> 3;
+        if (ExceptionAnalyzer::IsExceptionEvent(event)) {
+            HandleException(event);
+        }
+        else if (DwtCounters::IsCounterEvent(event)) {
+            Counters.HandleTraceEvent(event);
+            for (unsigned c = 0; c < DwtCounters::NUM_COUNTERS; c++) {
+                if (event.Value & (1 << c)) {
+                    const DwtCounters::Counter counter = DwtCounters::Counter(c);
+                    UseTrack(TRACK_COUNTERS + c, DwtCounters::CounterName(counter), true);
+                    Counter(TRACK_COUNTERS + c, event.Timestamp,
+                            Counters.GetTotals().Events[c]);
+                }
+            }
+        }
+        else if ((discriminator & 0x18) == 0x10) { // data trace value
+            const unsigned comp = (discriminator >> 1) & 0x3;
+            UseTrack(TRACK_WATCHES + comp, "Watch " + std::to_string(comp), true);
+            Counter(TRACK_WATCHES + comp, event.Timestamp, event.Value);
+        }
+        break;
+    }
+    case TraceEvent::TRACE_EVENT_OVERFLOW:
+        UseTrack(TRACK_EXCEPTIONS, "Exceptions", false);
+        Slice(TRACK_EXCEPTIONS, event.Timestamp, TYPE_INSTANT, "Overflow");
+        break;
+    default:
+        break;
+    }
+}
+
+void PerfettoWriter::HandleException(const TraceEvent& event)
+{
+    const unsigned exception = event.Value & 0x1ff;
+    UseTrack(TRACK_EXCEPTIONS, "Exceptions", false);
+
+    switch ((event.Value >> 12) & 0x3) {
+    case ExceptionAnalyzer::EXC_ENTER:
+        ActiveExceptions.push_back(exception);
+        Slice(TRACK_EXCEPTIONS, event.Timestamp, TYPE_SLICE_BEGIN,
+                ExceptionAnalyzer::ExceptionName(exception));
+        break;
+    case ExceptionAnalyzer::EXC_EXIT: {
+        size_t i = ActiveExceptions.size();
+        while (i > 0 && ActiveExceptions[i - 1] != exception) {
+            i--;
+        }
+        if (i == 0) {
+            // Entry was not seen
+            break;
+        }
+        // Also end the slices of handlers that lost their exit packet
+        while (ActiveExceptions.size() >= i) {
+            Slice(TRACK_EXCEPTIONS, event.Timestamp, TYPE_SLICE_END, "");
+            ActiveExceptions.pop_back();
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+ * Collect text written to a stimulus port, one instant event per line.
+ */
+void PerfettoWriter::HandleText(unsigned port, const TraceEvent& event)
+{
+    std::string& line = Lines[port];
+    const size_t len = 1 << ((event.Code & 0x03) - 1);
+    for (size_t i = 0; i < len; i++) {
+        const char c = static_cast<char>(event.Value >> (8 * i));
+        if (c == '\n' || line.size() >= MAX_LINE) {
+            UseTrack(TRACK_PORTS + port, "ITM port " + std::to_string(port), false);
+            Slice(TRACK_PORTS + port, event.Timestamp, TYPE_INSTANT, line);
+            line.clear();
+        }
+        if (c != '\n' && c != '\r' && c != '\0') {
+            line.push_back(c);
+        }
+    }
+}
+
+} /* namespace lct */
@@ -0,0 +1,148 @@
+#include "RegisterTransaction.h"
+
+#include "GdbConnection.h"
+#include "RspConnection.h"
+#include "log.h"
+
+namespace lct {
+
+RegisterTransaction::RegisterTransaction() :
+        Blocks(), Count(0)
+{
+}
+
+/**
+ * @return The last block if the access continues it, otherwise a new one
+ */
+RegisterTransaction::Block& RegisterTransaction::Extend(bool write, uint32_t address)
+{
+    Count++;
+    if (!Blocks.empty()) {
+        Block& last = Blocks.back();
+        if (last.Write == write && last.Address + 4 * last.Values.size() == address) {
+            return last;
+        }
+    }
+    Blocks.push_back(Block());
+    Blocks.back().Write = write;
+    Blocks.back().Address = address;
+    return Blocks.back();
+}
+
+void RegisterTransaction::Write(uint32_t address, uint32_t value)
+{
+    Extend(true, address).Values.push_back(value);
+}
+
+/**
+ * Read a word into out when the transaction is submitted. out is left alone
+ * if the read fails.
+ */
+void RegisterTransaction::Read(uint32_t address, uint32_t* out)
+{
+    Block& block = Extend(false, address);
+    block.Values.push_back(0);
+    block.Outputs.push_back(out);
+}
+
+/**
+ * Send all accesses and wait for them to complete. The transaction is
+ * empty afterwards, ready to be reused.
+ *
+ * @return false if any access failed
+ */
+bool RegisterTransaction::Submit(GdbConnection& gdb)
+{
+    // Reads are decoded in place, written data is copied when sent
+    std::vector<std::vector<uint8_t> > data = Encode();
+    std::vector<GdbFuture<bool> > replies;
+    for (size_t i = 0; i < Blocks.size(); i++) {
+        const Block& block = Blocks[i];
+        if (block.Write) {
+            replies.push_back(gdb.WriteBlockAsync(block.Address, data[i].data(), data[i].size()));
+        }
+        else {
+            replies.push_back(gdb.ReadBlockAsync(block.Address, data[i].data(), data[i].size()));
+        }
+    }
+    gdb.WaitAll();
+
+    std::vector<bool> ok(Blocks.size());
+    for (size_t i = 0; i < Blocks.size(); i++) {
+        ok[i] = replies[i].Wait();
+    }
+    return Decode(data, ok);
+}
+
+bool RegisterTransaction::Submit(RspConnection& rsp)
+{
+    std::vector<std::vector<uint8_t> > data = Encode();
+    std::vector<RspConnection::Transfer> transfers;
+    for (size_t i = 0; i < Blocks.size(); i++) {
+        transfers.push_back(RspConnection::Transfer(Blocks[i].Write, Blocks[i].Address,
+                data[i].data(), data[i].size()));
+    }
+    rsp.Submit(transfers);
+
+    std::vector<bool> ok(Blocks.size());
+    for (size_t i = 0; i < Blocks.size(); i++) {
+        ok[i] = transfers[i].Ok;
+    }
+    return Decode(data, ok);
+}
+
+/**
+ * @return A buffer per block, holding the words to write, or room for the
+ *         words read
+ */
+std::vector<std::vector<uint8_t> > RegisterTransaction::Encode() const
+{
+    std::vector<std::vector<uint8_t> > data(Blocks.size());
+    for (size_t i = 0; i < Blocks.size(); i++) {
+        const Block& block = Blocks[i];
+        data[i].resize(4 * block.Values.size());
+        if (block.Write) {
+            for (size_t w = 0; w < block.Values.size(); w++) {
+                for (size_t b = 0; b < 4; b++) {
+                    data[i][4 * w + b] = block.Values[w] >> (8 * b);
+                }
+            }
+        }
+    }
+    return data;
+}
+
+/**
+ * Store the words read by the blocks that succeeded, and clear the
+ * transaction.
+ */
+bool RegisterTransaction::Decode(const std::vector<std::vector<uint8_t> >& data,
+        const std::vector<bool>& ok)
+{
+    bool allOk = true;
+    for (size_t i = 0; i < Blocks.size(); i++) {
+        const Block& block = Blocks[i];
+        if (!ok[i]) {
+            LOG_WARNING("Failed to %s %lu registers at %#x", block.Write ? "write" : "read",
+                    block.Values.size(), block.Address);
+            allOk = false;
+            continue;
+        }
+        for (size_t w = 0; w < block.Outputs.size(); w++) {
+            const uint8_t* bytes = &data[i][4 * w];
+            *block.Outputs[w] = bytes[0] | bytes[1] << 8 | bytes[2] << 16 |
+                    uint32_t(bytes[3]) << 24;
+        }
+    }
+
+    Clear();
+    return allOk;
+}
+
+void RegisterTransaction::Clear()
+{
+    Blocks.clear();
+    Count = 0;
+}
+
+} /* namespace lct */
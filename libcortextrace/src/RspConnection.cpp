@@ -0,0 +1,556 @@
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "RspConnection.h"
+
+#include "log.h"
+
+namespace lct {
+
+static const char digits[] = "0123456789abcdef";
+
+/** Times a packet is sent again before the connection is given up */
+static const size_t MAX_RETRIES = 3;
+
+static std::string toHex(const uint8_t* data, size_t length)
+{
+    std::string hex;
+    hex.reserve(2 * length);
+    for (size_t i = 0; i < length; i++) {
+        hex += digits[data[i] >> 4];
+        hex += digits[data[i] & 0xf];
+    }
+    return hex;
+}
+
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @return false unless hex is exactly length bytes of hex digits
+ */
+static bool fromHex(const std::string& hex, size_t pos, uint8_t* out, size_t length)
+{
+    if (hex.size() - pos != 2 * length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        const int high = hexDigit(hex[pos + 2 * i]);
+        const int low = hexDigit(hex[pos + 2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        out[i] = high << 4 | low;
+    }
+    return true;
+}
+
+/** @return true for console output sent while a qRcmd runs */
+static bool isOutput(const std::string& payload)
+{
+    return payload.size() > 1 && payload[0] == 'O' && payload != "OK" &&
+            hexDigit(payload[1]) >= 0;
+}
+
+RspConnection::RspConnection() :
+        Fd(-1), Host(), Port(0), TimeoutMs(5000), PacketSize(400), AckMode(true), Input()
+{
+}
+
+RspConnection::~RspConnection()
+{
+    Close();
+}
+
+/**
+ * Connect to a debug server and negotiate the packet size and ack mode.
+ * Each address of the host is tried in turn, for up to the timeout each.
+ */
+bool RspConnection::Connect(const std::string& host, uint16_t port)
+{
+    Close();
+    Host = host;
+    Port = port;
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = NULL;
+    const int gai = getaddrinfo(Host.c_str(), std::to_string(Port).c_str(), &hints, &res);
+    if (gai != 0) {
+        LOG_ERROR("Failed to resolve %s: %s", Host.c_str(), gai_strerror(gai));
+        return false;
+    }
+    for (addrinfo* ai = res; ai && !Connected(); ai = ai->ai_next) {
+        ConnectTo(ai->ai_family, ai->ai_addr, ai->ai_addrlen);
+    }
+    freeaddrinfo(res);
+    if (!Connected()) {
+        LOG_ERROR("Failed to connect to %s:%u", Host.c_str(), Port);
+        return false;
+    }
+
+    // Small packets must go out at once
+    const int one = 1;
+    setsockopt(Fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    std::string reply;
+    if (!Command("qSupported", &reply)) {
+        Close();
+        return false;
+    }
+    bool noAck = false;
+    for (size_t pos = 0; pos < reply.size(); ) {
+        size_t end = reply.find(';', pos);
+        if (end == std::string::npos) {
+            end = reply.size();
+        }
+        const std::string feature = reply.substr(pos, end - pos);
+        if (feature.compare(0, 11, "PacketSize=") == 0) {
+            PacketSize = strtoul(feature.c_str() + 11, NULL, 16);
+        }
+        else if (feature == "QStartNoAckMode+") {
+            noAck = true;
+        }
+        pos = end + 1;
+    }
+    if (PacketSize < 64) {
+        LOG_WARNING("Packet size %lu is too small, using 64", PacketSize);
+        PacketSize = 64;
+    }
+    if (noAck && Command("QStartNoAckMode", &reply) && reply == "OK") {
+        AckMode = false;
+    }
+    LOG_DEBUG("Connected to %s:%u, packet size %lu%s", Host.c_str(), Port, PacketSize,
+            AckMode ? ", with acks" : "");
+    return Connected();
+}
+
+/**
+ * Connect to one address, waiting for the connection with poll() like for
+ * replies.
+ */
+bool RspConnection::ConnectTo(int family, const sockaddr* address, socklen_t length)
+{
+    Fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (Fd == -1) {
+        LOG_WARNING("Failed to create socket: %s", strerror(errno));
+        return false;
+    }
+    int error = 0;
+    if (connect(Fd, address, length) != 0) {
+        error = errno;
+    }
+    if (error == EINPROGRESS) {
+        pollfd pfd = { Fd, POLLOUT, 0 };
+        int n;
+        while ((n = poll(&pfd, 1, TimeoutMs)) < 0 && errno == EINTR) {
+        }
+        socklen_t len = sizeof(error);
+        if (n == 0) {
+            error = ETIMEDOUT;
+        }
+        else if (n < 0) {
+            error = errno;
+        }
+        else if (getsockopt(Fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0) {
+            error = errno;
+        }
+    }
+    if (error != 0) {
+        LOG_WARNING("Failed to connect to %s:%u: %s", Host.c_str(), Port, strerror(error));
+        close(Fd);
+        Fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void RspConnection::Close()
+{
+    if (Fd != -1) {
+        close(Fd);
+        Fd = -1;
+    }
+    PacketSize = 400;
+    AckMode = true;
+    Input.clear();
+}
+
+/**
+ * Read and write target memory. A transfer that fails does not stop the
+ * others.
+ *
+ * @return true if all transfers succeeded
+ */
+bool RspConnection::Submit(std::vector<Transfer>& transfers)
+{
+    // Each transfer is split into packets that fit the server's buffer.
+    // A read reply has two hex digits per byte, and written bytes take up
+    // to two bytes each once escaped.
+    struct Piece {
+        size_t Index;
+        size_t Offset;
+        size_t Length;
+    };
+    const size_t room = PacketSize - 32;
+    std::vector<std::string> packets;
+    std::vector<Piece> pieces;
+    char header[32];
+    for (size_t i = 0; i < transfers.size(); i++) {
+        Transfer& t = transfers[i];
+        size_t offset = 0;
+        while (offset < t.Length) {
+            Piece p = { i, offset, 0 };
+            std::string escaped;
+            if (t.Write) {
+                while (offset + p.Length < t.Length && escaped.size() + 2 <= room) {
+                    escaped += Escape(t.Data + offset + p.Length, 1);
+                    p.Length++;
+                }
+                snprintf(header, sizeof(header), "X%x,%lx:", t.Address + unsigned(offset),
+                        p.Length);
+            }
+            else {
+                p.Length = std::min(t.Length - offset, room / 2);
+                snprintf(header, sizeof(header), "m%x,%lx", t.Address + unsigned(offset),
+                        p.Length);
+            }
+            packets.push_back(header + escaped);
+            pieces.push_back(p);
+            offset += p.Length;
+        }
+    }
+
+    std::vector<std::string> replies;
+    if (!Exchange(packets, replies)) {
+        return false;
+    }
+
+    std::vector<bool> failed(transfers.size());
+    for (size_t i = 0; i < pieces.size(); i++) {
+        const Piece& p = pieces[i];
+        Transfer& t = transfers[p.Index];
+        const bool ok = t.Write ? replies[i] == "OK" :
+                fromHex(replies[i], 0, t.Data + p.Offset, p.Length);
+        if (!ok) {
+            failed[p.Index] = true;
+            if (replies[i].empty()) {
+                LOG_ERROR("The server does not support %c packets", packets[i][0]);
+            }
+        }
+    }
+    bool ok = true;
+    for (size_t i = 0; i < transfers.size(); i++) {
+        Transfer& t = transfers[i];
+        t.Ok = !failed[i];
+        if (!t.Ok) {
+            LOG_WARNING("Failed to %s %lu bytes at %#x", t.Write ? "write" : "read",
+                    t.Length, t.Address);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool RspConnection::ReadBlock(uint32_t address, void* buffer, size_t length)
+{
+    std::vector<Transfer> t(1, { false, address, buffer, length });
+    return Submit(t);
+}
+
+bool RspConnection::WriteBlock(uint32_t address, const void* data, size_t length)
+{
+    std::vector<Transfer> t(1, { true, address, const_cast<void*>(data), length });
+    return Submit(t);
+}
+
+/**
+ * Words are transferred little-endian, whatever the byte order of the host.
+ */
+bool RspConnection::ReadWord(uint32_t address, uint32_t* value)
+{
+    uint8_t bytes[4];
+    if (!ReadBlock(address, bytes, sizeof(bytes))) {
+        return false;
+    }
+    *value = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | uint32_t(bytes[3]) << 24;
+    return true;
+}
+
+bool RspConnection::WriteWord(uint32_t address, uint32_t value)
+{
+    const uint8_t bytes[] = {
+        uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24),
+    };
+    return WriteBlock(address, bytes, sizeof(bytes));
+}
+
+/**
+ * Run a command of the debug server, like GDB's "monitor" command.
+ *
+ * @param output  Where to put what the command printed, or NULL
+ */
+bool RspConnection::Monitor(const std::string& command, std::string* output)
+{
+    std::vector<std::string> packets(1, "qRcmd," +
+            toHex(reinterpret_cast<const uint8_t*>(command.data()), command.size()));
+    std::vector<std::string> replies;
+    std::string console;
+    if (!Exchange(packets, replies, &console)) {
+        return false;
+    }
+    if (output) {
+        *output = console;
+    }
+    if (replies[0] != "OK") {
+        LOG_WARNING("monitor %s failed: %s", command.c_str(),
+                replies[0].empty() ? "not supported" : replies[0].c_str());
+        return false;
+    }
+    return true;
+}
+
+bool RspConnection::Command(const std::string& packet, std::string* reply)
+{
+    std::vector<std::string> replies;
+    if (!Exchange(std::vector<std::string>(1, packet), replies)) {
+        return false;
+    }
+    *reply = replies[0];
+    return true;
+}
+
+/**
+ * Send the packets and wait for a reply to each. Without acks they are all
+ * sent at once. With acks, a packet is sent only once the one before has
+ * been answered, so that a packet either side asks for again is sent again
+ * in order.
+ *
+ * @param console  Where to put console output, which does not count as a
+ *                 reply, or NULL
+ * @return false if the connection was lost or timed out, in which case it
+ *         is closed
+ */
+bool RspConnection::Exchange(const std::vector<std::string>& packets,
+        std::vector<std::string>& replies, std::string* console)
+{
+    replies.clear();
+    if (!Connected()) {
+        LOG_ERROR("Not connected");
+        return false;
+    }
+
+    const size_t group = AckMode ? 1 : packets.size();
+    for (size_t first = 0; first < packets.size(); first += group) {
+        std::string frames;
+        for (size_t i = first; i < first + group; i++) {
+            frames += Frame(packets[i]);
+        }
+        if (!Transmit(frames, first + group, replies, console)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Send framed packets and collect replies until there are count of them.
+ * Writing and reading overlap, so a large batch cannot deadlock with the
+ * server blocked on sending replies that are not being read.
+ *
+ * In ack mode the frames are sent again when the server rejects them, and
+ * a reply with a bad checksum is asked for again.
+ */
+bool RspConnection::Transmit(const std::string& frames, size_t count,
+        std::vector<std::string>& replies, std::string* console)
+{
+    std::string out = frames;
+    size_t sent = 0;
+    size_t retries = 0;
+    char buf[0x4000];
+    while (replies.size() < count || sent < out.size()) {
+        pollfd pfd = { Fd, short(POLLIN | (sent < out.size() ? POLLOUT : 0)), 0 };
+        const int n = poll(&pfd, 1, TimeoutMs);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            LOG_ERROR("No reply from %s:%u: %s", Host.c_str(), Port,
+                    n == 0 ? "timed out" : strerror(errno));
+            Close();
+            return false;
+        }
+
+        if (pfd.revents & POLLOUT) {
+            const ssize_t res = send(Fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+            if (res < 0 && errno != EAGAIN && errno != EINTR) {
+                LOG_ERROR("Connection to %s:%u lost: %s", Host.c_str(), Port, strerror(errno));
+                Close();
+                return false;
+            }
+            sent += res > 0 ? res : 0;
+        }
+        if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+            continue;
+        }
+
+        const ssize_t res = recv(Fd, buf, sizeof(buf), 0);
+        if (res < 0 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        }
+        if (res <= 0) {
+            LOG_ERROR("Connection to %s:%u %s", Host.c_str(), Port,
+                    res ? strerror(errno) : "closed");
+            Close();
+            return false;
+        }
+        Input.append(buf, res);
+
+        std::string payload;
+        bool valid = false;
+        std::string acks;
+        while (Unframe(Input, &payload, &valid, &acks)) {
+            if (!valid) {
+                if (!AckMode) {
+                    LOG_ERROR("Bad checksum from %s:%u", Host.c_str(), Port);
+                    Close();
+                    return false;
+                }
+                // Ask for it again
+                out += '-';
+                retries++;
+                continue;
+            }
+            if (AckMode) {
+                out += '+';
+            }
+            if (console && isOutput(payload)) {
+                std::string text((payload.size() - 1) / 2, '\0');
+                fromHex(payload.substr(0, 2 * text.size() + 1), 1,
+                        reinterpret_cast<uint8_t*>(&text[0]), text.size());
+                *console += text;
+                continue;
+            }
+            replies.push_back(payload);
+        }
+        if (AckMode && acks.find('-') != std::string::npos && replies.size() < count) {
+            out += frames;
+            retries++;
+        }
+        if (retries > MAX_RETRIES) {
+            LOG_ERROR("Too many garbled packets on %s:%u", Host.c_str(), Port);
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @return The payload wrapped in a packet with its checksum
+ */
+std::string RspConnection::Frame(const std::string& payload)
+{
+    uint8_t sum = 0;
+    for (char c : payload) {
+        sum += c;
+    }
+    std::string packet;
+    packet.reserve(payload.size() + 4);
+    packet += '$';
+    packet += payload;
+    packet += '#';
+    packet += digits[sum >> 4];
+    packet += digits[sum & 0xf];
+    return packet;
+}
+
+/**
+ * @return Binary data with the characters that have a meaning in packets
+ *         escaped
+ */
+std::string RspConnection::Escape(const uint8_t* data, size_t length)
+{
+    std::string escaped;
+    for (size_t i = 0; i < length; i++) {
+        const char c = data[i];
+        if (c == '#' || c == '$' || c == '}' || c == '*') {
+            escaped += '}';
+            escaped += char(c ^ 0x20);
+        }
+        else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * Take the first complete packet out of the buffer, expanding run-length
+ * encoding. Anything before it is dropped, apart from acks, which are
+ * passed on.
+ *
+ * @param valid  Set to false if the checksum is wrong
+ * @param acks   Where to append the + and - found before the packet, or NULL
+ * @return false if there is no complete packet yet
+ */
+bool RspConnection::Unframe(std::string& buffer, std::string* payload, bool* valid,
+        std::string* acks)
+{
+    const size_t start = std::min(buffer.find('$'), buffer.size());
+    for (size_t i = 0; acks && i < start; i++) {
+        if (buffer[i] == '+' || buffer[i] == '-') {
+            *acks += buffer[i];
+        }
+    }
+    buffer.erase(0, start);
+    if (buffer.empty()) {
+        return false;
+    }
+    const size_t end = buffer.find('#');
+    if (end == std::string::npos || end + 3 > buffer.size()) {
+        return false;
+    }
+
+    uint8_t sum = 0;
+    payload->clear();
+    for (size_t i = 1; i < end; i++) {
+        const char c = buffer[i];
+        sum += c;
+        if (c == '*' && i + 1 < end && !payload->empty()) {
+            sum += buffer[i + 1];
+            payload->append(buffer[i + 1] - 29, payload->back());
+            i++;
+        }
+        else {
+            *payload += c;
+        }
+    }
+    *valid = hexDigit(buffer[end + 1]) == sum >> 4 && hexDigit(buffer[end + 2]) == (sum & 0xf);
+    buffer.erase(0, end + 3);
+    return true;
+}
+
+} /* namespace lct */
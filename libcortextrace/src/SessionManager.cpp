@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+#include "SessionManager.h"
+
+namespace lct {
+
+SessionManager::SessionManager() :
+        Loop(), Sessions()
+{
+}
+
+SessionManager::~SessionManager()
+{
+}
+
+/**
+ * Take ownership of a session, start it and start reading from it. The
+ * session is kept even if it fails to start, so that StopAll() undoes
+ * whatever it got as far as doing.
+ */
+bool SessionManager::Start(CaptureSession* session, const std::string& gdbPath,
+        const std::string& gdbTarget, const std::string& elfPath, size_t corefreq)
+{
+    Sessions.push_back(std::unique_ptr<CaptureSession>(session));
+    if (!session->Start(gdbPath, gdbTarget, elfPath, corefreq)) {
+        return false;
+    }
+    // A trace port that is not connected yet is attached once it is
+    session->Attach(&Loop);
+    return true;
+}
+
+int SessionManager::Poll(int timeoutMs)
+{
+    for (auto& s : Sessions) {
+        s->Maintain();
+    }
+    return Loop.Poll(timeoutMs);
+}
+
+/**
+ * Halt all targets, keep reading trace data for a while, and then turn
+ * off tracing.
+ */
+void SessionManager::StopAll(unsigned drainMs)
+{
+    for (auto& s : Sessions) {
+        s->Stop();
+    }
+
+    timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const long elapsed = (now.tv_sec - start.tv_sec) * 1000 +
+                (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (elapsed >= long(drainMs)) {
+            break;
+        }
+        Poll(std::min<long>(drainMs - elapsed, 100));
+    }
+
+    for (auto& s : Sessions) {
+        s->Detach();
+        s->Finish();
+    }
+}
+
+void SessionManager::ReportStats(std::ostream& out) const
+{
+    char buf[256];
+    for (const auto& s : Sessions) {
+        const CaptureSession::Stats& st = s->GetStats();
+        snprintf(buf, sizeof(buf), "%s: %lu bytes in %lu reads, %lu events, %lu overflows, %lu reconnects",
+                s->GetName().c_str(), st.Bytes, st.Reads, st.Events, st.Overflows, st.Reconnects);
+        out << buf << std::endl;
+    }
+}
+
+} /* namespace lct */
@@ -0,0 +1,171 @@
+#include <cstdio>
+#include <sstream>
+
+#include "SpanAnalyzer.h"
+#include "TraceEvent.h"
+
+#include "log.h"
+
+namespace lct {
+
+SpanAnalyzer::SpanAnalyzer(unsigned beginPort, unsigned endPort, uint32_t spanIds) :
+        BeginPort(beginPort), EndPort(endPort), PerSpan(spanIds), Open(spanIds),
+        BeginTimes(size_t(spanIds) * MAX_DEPTH), Dropped(0)
+{
+}
+
+SpanAnalyzer::~SpanAnalyzer()
+{
+}
+
+/**
+ * Parse span marker ports given on the command line as BEGIN:END[:IDS].
+ *
+ * @param ids   Set to the number of span IDs, DEFAULT_SPAN_IDS if not given
+ */
+bool SpanAnalyzer::ParsePorts(const std::string& arg, unsigned* begin, unsigned* end,
+        uint32_t* ids)
+{
+    char sep;
+    std::istringstream in(arg);
+    *ids = DEFAULT_SPAN_IDS;
+    if (!(in >> *begin >> sep >> *end) || sep != ':' || *begin > 31 || *end > 31 ||
+            *begin == *end) {
+        LOG_ERROR("Invalid span ports %s", arg.c_str());
+        return false;
+    }
+    if (!in.eof() && (!(in >> sep >> *ids) || sep != ':' || !in.eof() || *ids == 0 ||
+            *ids > MAX_SPAN_IDS)) {
+        LOG_ERROR("Invalid span ID count in %s", arg.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SpanAnalyzer::IsSpanEvent(const TraceEvent& event) const
+{
+    if (event.Type != TraceEvent::TRACE_EVENT_INSTR) {
+        return false;
+    }
+    const unsigned port = event.Code >> 3;
+    return port == BeginPort || port == EndPort;
+}
+
+/**
+ * @return Number of spans with the given ID that have begun but not ended
+ */
+size_t SpanAnalyzer::OpenSpans(uint32_t id) const
+{
+    return id < Open.size() ? Open[id].Count : 0;
+}
+
+void SpanAnalyzer::HandleTraceEvent(const TraceEvent& event)
+{
+    if (event.Type == TraceEvent::TRACE_EVENT_OVERFLOW) {
+        // End events may have been lost, don't pair across the gap
+        for (size_t id = 0; id < Open.size(); id++) {
+            PerSpan[id].Abandoned += Open[id].Count;
+            Open[id].Count = 0;
+        }
+        return;
+    }
+
+    if (!IsSpanEvent(event)) {
+        return;
+    }
+
+    const uint32_t id = event.Value;
+    if (id >= Open.size()) {
+        Dropped++;
+        return;
+    }
+    OpenRing& open = Open[id];
+    uint64_t* times = &BeginTimes[size_t(id) * MAX_DEPTH];
+    Stats& stats = PerSpan[id];
+
+    if (event.Code >> 3 == BeginPort) {
+        // When the ring is full, the oldest begin is overwritten
+        times[open.Next] = event.Timestamp;
+        open.Next = (open.Next + 1) % MAX_DEPTH;
+        if (open.Count == MAX_DEPTH) {
+            stats.Abandoned++;
+        }
+        else {
+            open.Count++;
+        }
+        return;
+    }
+
+    if (open.Count == 0) {
+        stats.Unmatched++;
+        return;
+    }
+
+    open.Next = (open.Next + MAX_DEPTH - 1) % MAX_DEPTH;
+    open.Count--;
+    const uint64_t duration = event.Timestamp - times[open.Next];
+    stats.Duration.Record(duration);
+    stats.Window.Record(duration);
+}
+
+/**
+ * Print a table with one line per span ID, covering the whole session.
+ *
+ * @param ticksPerSecond  Timestamp frequency for printing times in
+ *                        microseconds, or 0 to print ticks
+ */
+void SpanAnalyzer::Report(std::ostream& out, double ticksPerSecond) const
+{
+    Print(out, ticksPerSecond, false);
+}
+
+/**
+ * Print the spans that ended since the previous call, and start a new window.
+ */
+void SpanAnalyzer::ReportWindow(std::ostream& out, double ticksPerSecond)
+{
+    Print(out, ticksPerSecond, true);
+    for (auto& s : PerSpan) {
+        s.Window.Reset();
+    }
+}
+
+void SpanAnalyzer::Print(std::ostream& out, double ticksPerSecond, bool window) const
+{
+    bool header = false;
+    const double scale = ticksPerSecond > 0 ? 1e6 / ticksPerSecond : 1.0;
+
+    char buf[256];
+    for (uint32_t id = 0; id < PerSpan.size(); id++) {
+        const Stats& s = PerSpan[id];
+        const Histogram& h = window ? s.Window : s.Duration;
+        if (h.Count() == 0) {
+            continue;
+        }
+        if (!header) {
+            snprintf(buf, sizeof(buf), "%-10s %10s %10s %10s %10s %10s %10s %8s %8s",
+                    "Span", "Count", "Mean", "P50", "P99", "P99.9", "Max", "Unpaired",
+                    "Lost");
+            out << (window ? "Span statistics since last report" : "Span statistics") <<
+                    " (times in " << (ticksPerSecond > 0 ? "us" : "ticks") << "):" << std::endl;
+            out << buf << std::endl;
+            header = true;
+        }
+        snprintf(buf, sizeof(buf),
+                "%-10u %10lu %10.1f %10.1f %10.1f %10.1f %10.1f %8lu %8lu",
+                id, h.Count(),
+                h.Mean() * scale,
+                h.Percentile(50) * scale,
+                h.Percentile(99) * scale,
+                h.Percentile(99.9) * scale,
+                h.Max() * scale,
+                s.Unmatched, s.Abandoned);
+        out << buf << std::endl;
+    }
+    if (header && Dropped) {
+        out << Dropped << " events with span IDs from " << PerSpan.size() << " up dropped" <<
+                std::endl;
+    }
+}
+
+} /* namespace lct */
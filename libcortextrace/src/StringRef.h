@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+namespace lct {
+
+/**
+ * A string that is referenced rather than copied, like C++17's
+ * std::string_view. The referenced characters must outlive it.
+ */
+class StringRef {
+public:
+    StringRef() : Ptr(""), Len(0) {}
+    StringRef(const char* s) : Ptr(s ? s : ""), Len(s ? strlen(s) : 0) {}
+    StringRef(const char* s, size_t len) : Ptr(s), Len(len) {}
+    StringRef(const std::string& s) : Ptr(s.data()), Len(s.size()) {}
+    StringRef(const StringRef&) = default;
+    StringRef& operator=(const StringRef&) = default;
+
+    const char* Data() const { return Ptr; }
+    size_t Size() const { return Len; }
+    bool Empty() const { return Len == 0; }
+    char operator[](size_t i) const { return Ptr[i]; }
+    const char* begin() const { return Ptr; }
+    const char* end() const { return Ptr + Len; }
+    std::string Str() const { return std::string(Ptr, Len); }
+
+    /** @return true if s is a NUL-terminated string equal to this one */
+    bool Equals(const char* s) const { return strncmp(s, Ptr, Len) == 0 && s[Len] == '\0'; }
+
+    bool operator==(const StringRef& o) const
+    {
+        return Len == o.Len && memcmp(Ptr, o.Ptr, Len) == 0;
+    }
+    bool operator!=(const StringRef& o) const { return !(*this == o); }
+
+private:
+    const char* Ptr;
+    size_t Len;
+};
+
+} /* namespace lct */
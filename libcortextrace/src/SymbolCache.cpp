@@ -0,0 +1,396 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include "ElfFile.h"
+#include "SymbolCache.h"
+
+#include "log.h"
+
+namespace lct {
+
+/*
+ * File layout, all numbers little-endian 32-bit:
+ *
+ *  0   magic "LCTSYMS1"
+ *  8   number of records
+ *  12  length of the key, followed by the key
+ *      records, 4-byte aligned, sorted by expression
+ *      strings
+ *
+ * A record is the address, the size, and the offset and length of the
+ * expression and of the type. Offsets are from the start of the file.
+ */
+static const char MAGIC[] = "LCTSYMS1";
+static const size_t HEADER_SIZE = 16;
+static const size_t RECORD_SIZE = 24;
+static const size_t R_ADDRESS = 0;
+static const size_t R_SIZE = 4;
+static const size_t R_EXPRESSION = 8;
+static const size_t R_EXPRESSION_LENGTH = 12;
+static const size_t R_TYPE = 16;
+static const size_t R_TYPE_LENGTH = 20;
+
+static void put32(std::string& s, uint32_t x)
+{
+    for (size_t i = 0; i < 4; i++) {
+        s += char(x >> (8 * i));
+    }
+}
+
+/**
+ * Create the directory and its parents.
+ */
+static bool createDirectory(const std::string& dir)
+{
+    for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+        const std::string sub = dir.substr(0, pos);
+        if (mkdir(sub.c_str(), 0755) != 0 && errno != EEXIST) {
+            LOG_WARNING("Failed to create %s: %s", sub.c_str(), strerror(errno));
+            return false;
+        }
+        if (pos == std::string::npos) {
+            return true;
+        }
+    }
+}
+
+SymbolCache::SymbolCache() :
+        Path(), CacheKey(), Map(NULL), MapSize(0), Records(NULL), Count(0), Added()
+{
+}
+
+SymbolCache::~SymbolCache()
+{
+    Close();
+}
+
+/**
+ * Map the cache for the given ELF file, if there is one. A cache that is
+ * missing, damaged or was written for another build is ignored and will be
+ * replaced by Save().
+ *
+ * @return false if the ELF file cannot be cached at all
+ */
+bool SymbolCache::Open(const std::string& dir, const ElfFile& elf)
+{
+    Close();
+    if (dir.empty() || !elf.IsOpen()) {
+        return false;
+    }
+    CacheKey = Key(elf);
+    Path = CachePath(dir, CacheKey);
+
+    if (MapFile(Path) && !Validate()) {
+        LOG_WARNING("Ignoring symbol cache %s", Path.c_str());
+        Unmap();
+    }
+    LOG_DEBUG("Symbol cache %s has %lu entries", Path.c_str(), Count);
+    return true;
+}
+
+void SymbolCache::Close()
+{
+    Unmap();
+    Added.clear();
+    Path.clear();
+    CacheKey.clear();
+}
+
+bool SymbolCache::MapFile(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(HEADER_SIZE)) {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_WARNING("Failed to map %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    Map = static_cast<const uint8_t*>(map);
+    MapSize = st.st_size;
+    return true;
+}
+
+void SymbolCache::Unmap()
+{
+    if (Map) {
+        munmap(const_cast<uint8_t*>(Map), MapSize);
+    }
+    Map = NULL;
+    MapSize = 0;
+    Records = NULL;
+    Count = 0;
+}
+
+/**
+ * Check the header against the ELF file and every record against the size
+ * of the file, so that lookups need no further checks.
+ */
+bool SymbolCache::Validate()
+{
+    if (memcmp(Map, MAGIC, 8) != 0) {
+        return false;
+    }
+    const size_t count = ElfFile::Read32(Map + 8);
+    const size_t keyLength = ElfFile::Read32(Map + 12);
+    if (keyLength != CacheKey.size() || keyLength > MapSize - HEADER_SIZE ||
+            memcmp(Map + HEADER_SIZE, CacheKey.data(), keyLength) != 0) {
+        return false;
+    }
+    const size_t records = (HEADER_SIZE + keyLength + 3) & ~3UL;
+    if (records > MapSize || count > (MapSize - records) / RECORD_SIZE) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* r = Map + records + i * RECORD_SIZE;
+        for (size_t field : { R_EXPRESSION, R_TYPE }) {
+            const size_t offset = ElfFile::Read32(r + field);
+            const size_t length = ElfFile::Read32(r + field + 4);
+            if (offset > MapSize || length > MapSize - offset) {
+                return false;
+            }
+        }
+    }
+
+    Records = Map + records;
+    Count = count;
+    return true;
+}
+
+void SymbolCache::Get(size_t index, std::string* expression, Symbol* out) const
+{
+    const uint8_t* r = Records + index * RECORD_SIZE;
+    if (expression) {
+        expression->assign(reinterpret_cast<const char*>(Map + ElfFile::Read32(r + R_EXPRESSION)),
+                ElfFile::Read32(r + R_EXPRESSION_LENGTH));
+    }
+    if (out) {
+        out->Address = ElfFile::Read32(r + R_ADDRESS);
+        out->Size = ElfFile::Read32(r + R_SIZE);
+        out->Type.assign(reinterpret_cast<const char*>(Map + ElfFile::Read32(r + R_TYPE)),
+                ElfFile::Read32(r + R_TYPE_LENGTH));
+    }
+}
+
+/**
+ * @return false if the expression is not in the cache
+ */
+bool SymbolCache::Lookup(const std::string& expression, Symbol* out) const
+{
+    auto it = Added.find(expression);
+    if (it != Added.end()) {
+        *out = it->second;
+        return true;
+    }
+
+    // Binary search of the mapped records
+    size_t low = 0;
+    size_t high = Count;
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        const uint8_t* r = Records + mid * RECORD_SIZE;
+        const char* s = reinterpret_cast<const char*>(Map + ElfFile::Read32(r + R_EXPRESSION));
+        const size_t len = ElfFile::Read32(r + R_EXPRESSION_LENGTH);
+        int cmp = memcmp(s, expression.data(), std::min(len, expression.size()));
+        if (cmp == 0) {
+            cmp = len < expression.size() ? -1 : len > expression.size();
+        }
+        if (cmp == 0) {
+            Get(mid, NULL, out);
+            return true;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return false;
+}
+
+void SymbolCache::Add(const std::string& expression, const Symbol& symbol)
+{
+    Added[expression] = symbol;
+}
+
+/**
+ * Write the mapped entries and the added ones to a new file, which replaces
+ * the old one.
+ */
+bool SymbolCache::Save()
+{
+    if (Path.empty()) {
+        return false;
+    }
+    std::map<std::string, Symbol> all;
+    for (size_t i = 0; i < Count; i++) {
+        std::string expression;
+        Symbol symbol;
+        Get(i, &expression, &symbol);
+        all[expression] = symbol;
+    }
+    for (const auto& a : Added) {
+        all[a.first] = a.second;
+    }
+
+    std::string header(MAGIC, 8);
+    put32(header, all.size());
+    put32(header, CacheKey.size());
+    header += CacheKey;
+    header.resize((header.size() + 3) & ~3UL, '\0');
+
+    std::string records;
+    std::string strings;
+    const size_t base = header.size() + all.size() * RECORD_SIZE;
+    for (const auto& a : all) {
+        put32(records, a.second.Address);
+        put32(records, a.second.Size);
+        put32(records, base + strings.size());
+        put32(records, a.first.size());
+        strings += a.first;
+        put32(records, base + strings.size());
+        put32(records, a.second.Type.size());
+        strings += a.second.Type;
+    }
+
+    const std::string dir = Path.substr(0, Path.find_last_of('/'));
+    if (!createDirectory(dir)) {
+        return false;
+    }
+    const std::string tmp = Path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary);
+        if (!file) {
+            LOG_WARNING("Failed to create %s", tmp.c_str());
+            return false;
+        }
+        file << header << records << strings;
+        if (!file.flush()) {
+            LOG_WARNING("Failed to write %s", tmp.c_str());
+            return false;
+        }
+    }
+    // The mapping stays valid: it refers to the old file, not the name
+    if (rename(tmp.c_str(), Path.c_str()) != 0) {
+        LOG_WARNING("Failed to rename %s: %s", tmp.c_str(), strerror(errno));
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @return The build ID of the ELF file, or a hash of its contents if it
+ *         has none
+ */
+std::string SymbolCache::Key(const ElfFile& elf)
+{
+    const std::string id = elf.BuildId();
+    return id.empty() ? "hash-" + elf.ContentHash() : id;
+}
+
+std::string SymbolCache::CachePath(const std::string& dir, const std::string& key)
+{
+    return dir + "/symbols-" + key;
+}
+
+/**
+ * Only expressions that name a variable or a member of one, or a cast of a
+ * constant address such as *(uint32_t*)0x20000000 have the same address
+ * every time. Anything that follows a pointer has not, and that includes
+ * an index, as ptr[3] cannot be told apart from an array by its text.
+ */
+bool SymbolCache::Cacheable(const std::string& expression)
+{
+    std::string e;
+    for (char c : expression) {
+        if (!isspace(static_cast<unsigned char>(c))) {
+            e += c;
+        }
+    }
+    if (e.empty()) {
+        return false;
+    }
+
+    if (e.compare(0, 2, "*(") == 0) {
+        const size_t close = e.find(')');
+        if (close == std::string::npos || e[close - 1] != '*' ||
+                e.find('(', 2) < close) {
+            return false;
+        }
+        char* end = NULL;
+        strtoul(e.c_str() + close + 1, &end, 0);
+        return end != e.c_str() + close + 1 && *end == '\0';
+    }
+
+    if (!isalpha(static_cast<unsigned char>(e[0])) && e[0] != '_') {
+        return false;
+    }
+    for (char c : e) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '.' && c != ':') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Parse the value GDB prints for the address of an expression, such as
+ * "(uint32_t *) 0x20000000 <counter>". The size is left alone.
+ */
+bool SymbolCache::ParseAddressOf(const std::string& value, Symbol* out)
+{
+    if (value.empty() || value[0] != '(') {
+        return false;
+    }
+    size_t close = 1;
+    for (int depth = 1; close < value.size(); close++) {
+        depth += value[close] == '(';
+        depth -= value[close] == ')';
+        if (depth == 0) {
+            break;
+        }
+    }
+    if (close >= value.size()) {
+        return false;
+    }
+
+    const char* start = value.c_str() + close + 1;
+    char* end = NULL;
+    const unsigned long address = strtoul(start, &end, 16);
+    if (end == start || address > 0xffffffffUL) {
+        return false;
+    }
+    out->Address = address;
+
+    // The type of the expression itself, unless it is a pointer to a
+    // function or array, where the * is not at the end
+    std::string type = value.substr(1, close - 1);
+    if (!type.empty() && type.back() == '*') {
+        type.pop_back();
+        while (!type.empty() && type.back() == ' ') {
+            type.pop_back();
+        }
+    }
+    out->Type = type;
+    return true;
+}
+
+} /* namespace lct */
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#include "ElfFile.h"
+#include "SymbolTable.h"
+
+#include "log.h"
+
+namespace lct {
+
+// Elf32_Sym layout
+static const size_t SYM_SIZE = 16;
+static const size_t ST_NAME = 0;
+static const size_t ST_VALUE = 4;
+static const size_t ST_SIZE = 8;
+static const size_t ST_INFO = 12;
+static const size_t ST_SHNDX = 14;
+
+static const uint8_t STT_OBJECT = 1;
+static const uint8_t STT_FUNC = 2;
+static const uint16_t SHN_UNDEF = 0;
+static const uint16_t SHN_LORESERVE = 0xff00;
+
+SymbolTable::SymbolTable() :
+        Start(), End(), NameOffset(), ByName(), Names()
+{
+}
+
+SymbolTable::~SymbolTable()
+{
+}
+
+void SymbolTable::Clear()
+{
+    Start.clear();
+    End.clear();
+    NameOffset.clear();
+    ByName.clear();
+    Names.clear();
+}
+
+bool SymbolTable::Load(const ElfFile& elf)
+{
+    const ElfFile::Section* symtab = elf.FindSection(".symtab");
+    if (!symtab || symtab->Type != ElfFile::SHT_SYMTAB || !symtab->Data) {
+        LOG_WARNING("No symbol table in ELF file");
+        return false;
+    }
+    if (symtab->Link >= elf.Sections().size()) {
+        LOG_WARNING("Symbol table has no string table");
+        return false;
+    }
+    const ElfFile::Section& strtab = elf.Sections()[symtab->Link];
+    if (!strtab.Data) {
+        return false;
+    }
+
+    const size_t count = symtab->Size / SYM_SIZE;
+    Start.reserve(Start.size() + count);
+    End.reserve(End.size() + count);
+    NameOffset.reserve(NameOffset.size() + count);
+
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* sym = &symtab->Data[i * SYM_SIZE];
+        const uint8_t type = sym[ST_INFO] & 0x0f;
+        const uint16_t shndx = ElfFile::Read16(&sym[ST_SHNDX]);
+
+        if ((type != STT_FUNC && type != STT_OBJECT) ||
+                shndx == SHN_UNDEF || shndx >= SHN_LORESERVE) {
+            continue;
+        }
+
+        const uint32_t nameoff = ElfFile::Read32(&sym[ST_NAME]);
+        if (nameoff >= strtab.Size) {
+            continue;
+        }
+        const char* name = reinterpret_cast<const char*>(&strtab.Data[nameoff]);
+        const size_t length = strnlen(name, strtab.Size - nameoff);
+
+        uint32_t address = ElfFile::Read32(&sym[ST_VALUE]);
+        if (type == STT_FUNC) {
+            // Thumb functions have bit 0 set in the symbol value
+            address &= ~1U;
+        }
+        Add(address, ElfFile::Read32(&sym[ST_SIZE]), std::string(name, length));
+    }
+
+    Finalize();
+    LOG_DEBUG("Loaded %lu symbols", Start.size());
+    return true;
+}
+
+void SymbolTable::Add(uint32_t address, uint32_t size, const std::string& name)
+{
+    Start.push_back(address);
+    End.push_back(address + size);
+    NameOffset.push_back(Names.size());
+    Names.append(name);
+    Names.push_back('\0');
+}
+
+/**
+ * Sort the symbols by address and drop aliases. Symbols without a size are
+ * assumed to extend up to the next symbol. Then index them by name, the
+ * lowest address first among symbols with the same name.
+ */
+void SymbolTable::Finalize()
+{
+    std::vector<uint32_t> order(Start.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        if (Start[a] != Start[b]) {
+            return Start[a] < Start[b];
+        }
+        // Prefer the symbol with the larger extent among aliases
+        return (End[a] - Start[a]) > (End[b] - Start[b]);
+    });
+
+    std::vector<uint32_t> start;
+    std::vector<uint32_t> end;
+    std::vector<uint32_t> nameOffset;
+    start.reserve(order.size());
+    end.reserve(order.size());
+    nameOffset.reserve(order.size());
+
+    for (uint32_t i : order) {
+        if (!start.empty() && start.back() == Start[i]) {
+            continue;
+        }
+        start.push_back(Start[i]);
+        end.push_back(End[i]);
+        nameOffset.push_back(NameOffset[i]);
+    }
+
+    for (size_t i = 0; i < start.size(); i++) {
+        if (end[i] == start[i]) {
+            end[i] = (i + 1 < start.size()) ? start[i + 1] : start[i] + 1;
+        }
+    }
+
+    Start.swap(start);
+    End.swap(end);
+    NameOffset.swap(nameOffset);
+
+    ByName.resize(Start.size());
+    std::iota(ByName.begin(), ByName.end(), 0);
+    std::stable_sort(ByName.begin(), ByName.end(), [this](uint32_t a, uint32_t b) {
+        return strcmp(&Names[NameOffset[a]], &Names[NameOffset[b]]) < 0;
+    });
+}
+
+/**
+ * Find the symbol covering an address.
+ *
+ * @param offset  If not NULL, set to the offset of address into the symbol
+ * @return Symbol name, or NULL if no symbol covers the address
+ */
+const char* SymbolTable::Lookup(uint32_t address, uint32_t* offset) const
+{
+    auto it = std::upper_bound(Start.begin(), Start.end(), address);
+    if (it == Start.begin()) {
+        return NULL;
+    }
+    const size_t i = (it - Start.begin()) - 1;
+    if (address >= End[i]) {
+        return NULL;
+    }
+    if (offset) {
+        *offset = address - Start[i];
+    }
+    return &Names[NameOffset[i]];
+}
+
+/**
+ * Find a symbol by name, with a binary search of the name index.
+ *
+ * @return false if there is no symbol with that name
+ */
+bool SymbolTable::Find(const std::string& name, uint32_t* address, uint32_t* size) const
+{
+    auto it = std::lower_bound(ByName.begin(), ByName.end(), name,
+            [this](uint32_t i, const std::string& n) {
+                return strcmp(&Names[NameOffset[i]], n.c_str()) < 0;
+            });
+    if (it == ByName.end() || name != &Names[NameOffset[*it]]) {
+        return false;
+    }
+    *address = Start[*it];
+    if (size) {
+        *size = End[*it] - Start[*it];
+    }
+    return true;
+}
+
+} /* namespace lct */
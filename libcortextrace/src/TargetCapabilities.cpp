@@ -0,0 +1,471 @@
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include "TargetCapabilities.h"
+
+#include "GdbConnection.h"
+#include "log.h"
+#include "Registers.h"
+#include "RegisterTransaction.h"
+
+namespace lct {
+
+static const uint32_t ROM_TABLE_BASE = 0xe00ff000;
+static const size_t ROM_TABLE_ENTRIES = 960;
+static const size_t ROM_TABLE_CHUNK = 32;
+static const int ROM_TABLE_DEPTH = 4;
+
+// Words of a component's ID block, read from DEVARCH at offset 0xfbc
+static const uint32_t ID_BLOCK_OFFSET = 0xfbc;
+static const size_t ID_BLOCK_WORDS = 17;
+static const size_t ID_DEVARCH = 0;
+static const size_t ID_DEVID = 3;
+static const size_t ID_DEVTYPE = 4;
+static const size_t ID_PIDR4 = 5;
+static const size_t ID_PIDR0 = 9;
+static const size_t ID_CIDR0 = 13;
+
+static const uint16_t DESIGNER_ARM = 4 << 7 | 0x3b;
+
+static const char* const typeNames[] = {
+    "unknown", "ROM", "SCS", "DWT", "FPB", "ITM", "TPIU", "ETM", "MTB",
+};
+
+TargetCapabilities::TargetCapabilities() :
+        Cpuid(0), InterruptLines(0), Components(), Comparators(0), CycleCounter(false),
+        ProfilingCounters(false), TracePackets(false), ExternalTrigger(false),
+        DataValueMatch(false), TpiuPortSizes(0), TpiuParallel(false),
+        TpiuManchester(false), TpiuNrz(false)
+{
+}
+
+const char* TargetCapabilities::TypeName(ComponentType type)
+{
+    return size_t(type) < sizeof(typeNames) / sizeof(typeNames[0]) ?
+            typeNames[type] : typeNames[UNKNOWN];
+}
+
+const TargetCapabilities::Component* TargetCapabilities::Find(ComponentType type) const
+{
+    for (const Component& c : Components) {
+        if (c.Type == type) {
+            return &c;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Components of the Cortex-M cores, which predate DEVARCH.
+ */
+static TargetCapabilities::ComponentType armPart(uint16_t part)
+{
+    switch (part) {
+    case 0x000: case 0x008: case 0x00c:
+        return TargetCapabilities::SCS;
+    case 0x001:
+        return TargetCapabilities::ITM;
+    case 0x002: case 0x00a:
+        return TargetCapabilities::DWT;
+    case 0x003: case 0x00b: case 0x00e:
+        return TargetCapabilities::FPB;
+    case 0x923: case 0x9a1: case 0x9a9:
+        return TargetCapabilities::TPIU;
+    case 0x924: case 0x925: case 0x975:
+        return TargetCapabilities::ETM;
+    case 0x932:
+        return TargetCapabilities::MTB;
+    default:
+        return TargetCapabilities::UNKNOWN;
+    }
+}
+
+/**
+ * CoreSight components identify their architecture, or at least their type.
+ */
+static TargetCapabilities::ComponentType coreSightType(uint32_t devarch, uint32_t devtype)
+{
+    if (devarch & (1 << 20)) {
+        switch (devarch & 0xffff) {
+        case 0x1a01: return TargetCapabilities::ITM;
+        case 0x1a02: return TargetCapabilities::DWT;
+        case 0x1a03: return TargetCapabilities::FPB;
+        case 0x2a04: return TargetCapabilities::SCS;
+        case 0x4a13: return TargetCapabilities::ETM;
+        default: break;
+        }
+    }
+    switch (devtype & 0xff) {
+    case 0x11: return TargetCapabilities::TPIU;
+    case 0x13: return TargetCapabilities::ETM;
+    case 0x43: return TargetCapabilities::ITM;
+    default: return TargetCapabilities::UNKNOWN;
+    }
+}
+
+/**
+ * Read the ROM table and all components it lists, and decode their
+ * feature registers.
+ *
+ * @return false if the target could not be read at all
+ */
+bool TargetCapabilities::Probe(GdbConnection& gdb)
+{
+    *this = TargetCapabilities();
+
+    Registers regs;
+    RegisterTransaction t;
+    uint32_t ictr = 0;
+    t.Read(regs.CPUID, &Cpuid);
+    t.Read(regs.ICTR, &ictr);
+    if (!t.Submit(gdb)) {
+        LOG_ERROR("Failed to read CPUID");
+        return false;
+    }
+    InterruptLines = 32 * ((ictr & 0xf) + 1);
+
+    // Each level of ROM tables is read in one round of pipelined reads
+    std::set<uint32_t> seen;
+    std::vector<uint32_t> tables(1, ROM_TABLE_BASE);
+    for (int depth = 0; depth < ROM_TABLE_DEPTH && !tables.empty(); depth++) {
+        std::vector<uint32_t> addresses;
+        std::vector<uint32_t> entries(tables.size() * ROM_TABLE_ENTRIES);
+        std::vector<size_t> pending(tables.size());
+        for (size_t chunk = 0; chunk < ROM_TABLE_ENTRIES; chunk += ROM_TABLE_CHUNK) {
+            bool more = false;
+            for (size_t i = 0; i < tables.size(); i++) {
+                if (pending[i] != chunk) {
+                    continue;
+                }
+                for (size_t e = chunk; e < chunk + ROM_TABLE_CHUNK; e++) {
+                    t.Read(tables[i] + 4 * e, &entries[i * ROM_TABLE_ENTRIES + e]);
+                }
+                more = true;
+            }
+            if (!more) {
+                break;
+            }
+            if (!t.Submit(gdb)) {
+                LOG_WARNING("Failed to read a ROM table");
+            }
+
+            // Collect the components, and go on with tables that have not ended
+            for (size_t i = 0; i < tables.size(); i++) {
+                if (pending[i] != chunk) {
+                    continue;
+                }
+                pending[i] = ROM_TABLE_ENTRIES;
+                for (size_t e = chunk; e < chunk + ROM_TABLE_CHUNK; e++) {
+                    const uint32_t entry = entries[i * ROM_TABLE_ENTRIES + e];
+                    if (entry == 0) {
+                        break;
+                    }
+                    if (e == chunk + ROM_TABLE_CHUNK - 1) {
+                        pending[i] = chunk + ROM_TABLE_CHUNK;
+                    }
+                    if ((entry & 0x3) == 0x3) {
+                        const uint32_t address = tables[i] + (entry & 0xfffff000);
+                        if (seen.insert(address).second) {
+                            addresses.push_back(address);
+                        }
+                    }
+                }
+            }
+        }
+
+        tables.clear();
+        Identify(gdb, addresses, tables);
+    }
+
+    if (Components.empty()) {
+        LOG_WARNING("No debug components found in the ROM table");
+    }
+    ReadFeatures(gdb);
+    return true;
+}
+
+/**
+ * Read the ID registers of components, and add those with valid ones.
+ *
+ * @param tables  Gets the addresses of nested ROM tables
+ */
+bool TargetCapabilities::Identify(GdbConnection& gdb, const std::vector<uint32_t>& addresses,
+        std::vector<uint32_t>& tables)
+{
+    RegisterTransaction t;
+    std::vector<uint32_t> ids(addresses.size() * ID_BLOCK_WORDS);
+    for (size_t i = 0; i < addresses.size(); i++) {
+        for (size_t w = 0; w < ID_BLOCK_WORDS; w++) {
+            t.Read(addresses[i] + ID_BLOCK_OFFSET + 4 * w, &ids[i * ID_BLOCK_WORDS + w]);
+        }
+    }
+    const bool ok = t.Submit(gdb);
+
+    for (size_t i = 0; i < addresses.size(); i++) {
+        const uint32_t* id = &ids[i * ID_BLOCK_WORDS];
+        const uint32_t* cidr = &id[ID_CIDR0];
+        const uint32_t* pidr = &id[ID_PIDR0];
+        if ((cidr[0] & 0xff) != 0x0d || (cidr[1] & 0x0f) != 0 ||
+                (cidr[2] & 0xff) != 0x05 || (cidr[3] & 0xff) != 0xb1) {
+            LOG_DEBUG("No valid component at %#x", addresses[i]);
+            continue;
+        }
+
+        Component c;
+        c.Address = addresses[i];
+        c.Class = (cidr[1] >> 4) & 0xf;
+        c.PartNumber = (pidr[0] & 0xff) | (pidr[1] & 0xf) << 8;
+        if (pidr[2] & 0x8) {
+            c.Designer = (id[ID_PIDR4] & 0xf) << 7 | (pidr[1] >> 4 & 0xf) | (pidr[2] & 0x7) << 4;
+        }
+
+        if (c.Class == 0x1) {
+            c.Type = ROM_TABLE;
+            tables.push_back(c.Address);
+        }
+        else if (c.Designer == DESIGNER_ARM && armPart(c.PartNumber) != UNKNOWN) {
+            c.Type = armPart(c.PartNumber);
+        }
+        else if (c.Class == 0x9) {
+            c.Type = coreSightType(id[ID_DEVARCH], id[ID_DEVTYPE]);
+        }
+
+        if (c.Type == TPIU) {
+            const uint32_t devid = id[ID_DEVID];
+            TpiuParallel = !(devid & (1 << 9));
+            TpiuManchester = devid & (1 << 10);
+            TpiuNrz = devid & (1 << 11);
+        }
+
+        LOG_DEBUG("%s at %#x: class %#x, designer %#x, part %#x", TypeName(c.Type),
+                c.Address, c.Class, c.Designer, c.PartNumber);
+        Components.push_back(c);
+    }
+    return ok;
+}
+
+void TargetCapabilities::ReadFeatures(GdbConnection& gdb)
+{
+    RegisterTransaction t;
+    uint32_t dwtCtrl = 0;
+    uint32_t tpiuSspsr = 0;
+    const Component* dwt = Find(DWT);
+    const Component* tpiu = Find(TPIU);
+    if (dwt) {
+        t.Read(dwt->Address, &dwtCtrl);
+    }
+    if (tpiu) {
+        t.Read(tpiu->Address, &tpiuSspsr);
+    }
+    t.Submit(gdb);
+
+    // ARMv6-M only has the comparators, the other fields are reserved
+    const bool v6m = ((Cpuid >> 16) & 0xf) == 0xc;
+    Comparators = dwtCtrl >> 28;
+    TracePackets = !v6m && !(dwtCtrl & (1 << 27));
+    ExternalTrigger = !v6m && !(dwtCtrl & (1 << 26));
+    CycleCounter = !v6m && !(dwtCtrl & (1 << 25));
+    ProfilingCounters = !v6m && !(dwtCtrl & (1 << 24));
+
+    // Only known for ARMv7-M, where comparator 1 is the one that can
+    const uint32_t partno = (Cpuid >> 4) & 0xfff;
+    DataValueMatch = Comparators >= 2 &&
+            (partno == 0xc23 || partno == 0xc24 || partno == 0xc27);
+
+    TpiuPortSizes = tpiuSspsr;
+}
+
+static bool flag(std::istringstream& in)
+{
+    int value = 0;
+    in >> value;
+    return value != 0;
+}
+
+/**
+ * Read capabilities saved with Save().
+ */
+bool TargetCapabilities::Load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    *this = TargetCapabilities();
+    bool haveCpuid = false;
+    for (std::string line; std::getline(file, line);) {
+        std::istringstream in(line);
+        std::string key;
+        in >> key >> std::hex;
+        if (key == "cpuid") {
+            haveCpuid = bool(in >> Cpuid);
+        }
+        else if (key == "interrupts") {
+            in >> std::dec >> InterruptLines;
+        }
+        else if (key == "comparators") {
+            in >> std::dec >> Comparators;
+        }
+        else if (key == "cyclecounter") {
+            CycleCounter = flag(in);
+        }
+        else if (key == "profiling") {
+            ProfilingCounters = flag(in);
+        }
+        else if (key == "tracepackets") {
+            TracePackets = flag(in);
+        }
+        else if (key == "exttrigger") {
+            ExternalTrigger = flag(in);
+        }
+        else if (key == "datavalue") {
+            DataValueMatch = flag(in);
+        }
+        else if (key == "tpiuports") {
+            in >> TpiuPortSizes;
+        }
+        else if (key == "tpiuparallel") {
+            TpiuParallel = flag(in);
+        }
+        else if (key == "tpiumanchester") {
+            TpiuManchester = flag(in);
+        }
+        else if (key == "tpiunrz") {
+            TpiuNrz = flag(in);
+        }
+        else if (key == "component") {
+            Component c;
+            std::string type;
+            unsigned cls = 0;
+            if (!(in >> c.Address >> type >> cls >> c.Designer >> c.PartNumber)) {
+                LOG_WARNING("Invalid component in %s: %s", path.c_str(), line.c_str());
+                return false;
+            }
+            c.Class = cls;
+            for (size_t i = 0; i < sizeof(typeNames) / sizeof(typeNames[0]); i++) {
+                if (type == typeNames[i]) {
+                    c.Type = ComponentType(i);
+                }
+            }
+            Components.push_back(c);
+        }
+    }
+    return haveCpuid;
+}
+
+/**
+ * Write the capabilities to a file, replacing it atomically.
+ */
+bool TargetCapabilities::Save(const std::string& path) const
+{
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp);
+        if (!file) {
+            LOG_WARNING("Failed to create %s", tmp.c_str());
+            return false;
+        }
+        file << std::hex << std::showbase;
+        file << "cpuid " << Cpuid << "\n";
+        file << std::dec;
+        file << "interrupts " << InterruptLines << "\n";
+        file << "comparators " << Comparators << "\n";
+        file << "cyclecounter " << CycleCounter << "\n";
+        file << "profiling " << ProfilingCounters << "\n";
+        file << "tracepackets " << TracePackets << "\n";
+        file << "exttrigger " << ExternalTrigger << "\n";
+        file << "datavalue " << DataValueMatch << "\n";
+        file << "tpiuports " << std::hex << TpiuPortSizes << std::dec << "\n";
+        file << "tpiuparallel " << TpiuParallel << "\n";
+        file << "tpiumanchester " << TpiuManchester << "\n";
+        file << "tpiunrz " << TpiuNrz << "\n";
+        for (const Component& c : Components) {
+            file << "component " << std::hex << c.Address << " " << TypeName(c.Type) << " "
+                    << unsigned(c.Class) << " " << c.Designer << " " << c.PartNumber
+                    << std::dec << "\n";
+        }
+        if (!file.flush()) {
+            LOG_WARNING("Failed to write %s", tmp.c_str());
+            return false;
+        }
+    }
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        LOG_WARNING("Failed to rename %s: %s", tmp.c_str(), strerror(errno));
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @return $XDG_CACHE_HOME/cortextrace or ~/.cache/cortextrace, or an empty
+ *         string if neither is set
+ */
+std::string TargetCapabilities::DefaultCacheDir()
+{
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) {
+        return std::string(xdg) + "/cortextrace";
+    }
+    const char* home = getenv("HOME");
+    if (home && *home) {
+        return std::string(home) + "/.cache/cortextrace";
+    }
+    return "";
+}
+
+std::string TargetCapabilities::CachePath(const std::string& dir, uint32_t cpuid,
+        const std::string& buildId)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "%08x-", cpuid);
+    return dir + "/" + name + buildId;
+}
+
+/**
+ * Use capabilities probed in an earlier session. Without a build ID there
+ * is no way to tell the target apart from others with the same core.
+ *
+ * @return false if there are none for this target
+ */
+bool TargetCapabilities::LoadCached(const std::string& dir, uint32_t cpuid,
+        const std::string& buildId)
+{
+    if (dir.empty() || buildId.empty()) {
+        return false;
+    }
+    if (!Load(CachePath(dir, cpuid, buildId)) || Cpuid != cpuid) {
+        *this = TargetCapabilities();
+        return false;
+    }
+    LOG_DEBUG("Using cached capabilities for CPUID %#x, build %s", cpuid, buildId.c_str());
+    return true;
+}
+
+bool TargetCapabilities::SaveCached(const std::string& dir, const std::string& buildId) const
+{
+    if (dir.empty() || buildId.empty()) {
+        return false;
+    }
+    // Create the directory and its parents
+    for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+        const std::string sub = dir.substr(0, pos);
+        if (mkdir(sub.c_str(), 0755) != 0 && errno != EEXIST) {
+            LOG_WARNING("Failed to create %s: %s", sub.c_str(), strerror(errno));
+            return false;
+        }
+        if (pos == std::string::npos) {
+            break;
+        }
+    }
+    return Save(CachePath(dir, Cpuid, buildId));
+}
+
+} /* namespace lct */
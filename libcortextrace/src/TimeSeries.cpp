@@ -0,0 +1,182 @@
+#include <algorithm>
+
+#include "TimeSeries.h"
+
+namespace lct {
+
+static void merge(TimeSeries::Point& into, const TimeSeries::Point& p, bool first)
+{
+    if (first) {
+        into = p;
+        return;
+    }
+    into.Time = std::min(into.Time, p.Time);
+    into.Min = std::min(into.Min, p.Min);
+    into.Max = std::max(into.Max, p.Max);
+}
+
+const TimeSeries::Point& TimeSeries::Level::At(size_t i) const
+{
+    const size_t capacity = Entries.size();
+    return Entries[(Head + capacity - Count + i) % capacity];
+}
+
+/// @return Index of the first entry with Time >= time
+size_t TimeSeries::Level::LowerBound(uint64_t time) const
+{
+    size_t lo = 0;
+    size_t hi = Count;
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (At(mid).Time < time) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/// @return Index of the first entry with Time > time
+size_t TimeSeries::Level::UpperBound(uint64_t time) const
+{
+    size_t lo = 0;
+    size_t hi = Count;
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (At(mid).Time <= time) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+TimeSeries::TimeSeries(size_t capacity, unsigned levels, unsigned factor) :
+        Capacity(std::max<size_t>(capacity, 1)), Factor(std::max(factor, 2U)),
+        Levels(std::max(levels, 1U)), Samples(0), LastPoint()
+{
+    for (Level& l : Levels) {
+        l.Entries.resize(Capacity);
+    }
+}
+
+TimeSeries::~TimeSeries()
+{
+}
+
+void TimeSeries::Clear()
+{
+    for (Level& l : Levels) {
+        l.Head = 0;
+        l.Count = 0;
+        l.PendingCount = 0;
+    }
+    Samples = 0;
+    LastPoint = Point();
+}
+
+void TimeSeries::Append(uint64_t time, double value)
+{
+    LastPoint = Point(time, value, value);
+    Samples++;
+    Push(0, LastPoint);
+}
+
+void TimeSeries::Push(size_t level, const Point& p)
+{
+    Level& l = Levels[level];
+    l.Entries[l.Head] = p;
+    l.Head = (l.Head + 1) % Capacity;
+    l.Count = std::min(l.Count + 1, Capacity);
+
+    if (level + 1 < Levels.size()) {
+        Level& up = Levels[level + 1];
+        merge(up.Pending, p, up.PendingCount == 0);
+        if (++up.PendingCount == Factor) {
+            up.PendingCount = 0;
+            Push(level + 1, up.Pending);
+        }
+    }
+}
+
+/**
+ * Get min/max points covering a time range.
+ *
+ * The most recent samples that have not been aggregated into a complete
+ * bucket at the chosen level are returned as one extra point at the end.
+ *
+ * @param maxPoints  Upper bound on the number of points returned
+ * @return Number of points appended to out
+ */
+size_t TimeSeries::Query(uint64_t from, uint64_t to, size_t maxPoints,
+        std::vector<Point>& out) const
+{
+    if (Samples == 0 || maxPoints == 0 || from > to) {
+        return 0;
+    }
+
+    size_t k;
+    size_t lo = 0;
+    size_t hi = 0;
+    for (k = 0; k < Levels.size(); k++) {
+        const Level& l = Levels[k];
+        // A level that has dropped entries may not reach back far enough
+        const bool covers = l.Count < Capacity || l.At(0).Time <= from;
+        lo = l.LowerBound(from);
+        hi = l.UpperBound(to);
+        if ((covers || k + 1 == Levels.size()) && hi - lo + (k > 0) <= maxPoints) {
+            break;
+        }
+    }
+    if (k == Levels.size()) {
+        k--;
+    }
+
+    // Newest samples not yet in a complete bucket at this level
+    Point tail;
+    bool haveTail = false;
+    for (size_t i = 1; i <= k; i++) {
+        if (Levels[i].PendingCount) {
+            merge(tail, Levels[i].Pending, !haveTail);
+            haveTail = true;
+        }
+    }
+    haveTail = haveTail && tail.Time >= from && tail.Time <= to;
+
+    const Level& l = Levels[k];
+    const size_t n = hi - lo;
+    const size_t room = maxPoints - (haveTail ? 1 : 0);
+    const size_t stride = room ? (n + room - 1) / room : n + 1;
+    const size_t before = out.size();
+
+    // If even the coarsest level has too many entries, merge them further
+    for (size_t i = lo; i < hi && room; i += stride) {
+        Point p;
+        for (size_t j = i; j < std::min(i + stride, hi); j++) {
+            merge(p, l.At(j), j == i);
+        }
+        out.push_back(p);
+    }
+    if (haveTail) {
+        out.push_back(tail);
+    }
+
+    return out.size() - before;
+}
+
+/**
+ * Query the most recent part of the series, ending at the last sample.
+ */
+size_t TimeSeries::QueryLast(uint64_t duration, size_t maxPoints,
+        std::vector<Point>& out) const
+{
+    const uint64_t to = LastPoint.Time;
+    const uint64_t from = to > duration ? to - duration : 0;
+    return Query(from, to, maxPoints, out);
+}
+
+} /* namespace lct */
@@ -9,9 +9,11 @@
 
 namespace lct {
 
+/// Events held back without a timestamp before they are passed on anyway
+static const size_t MAX_PENDING = 1024;
 
 TraceFileParser::TraceFileParser(TraceEventListener& listener) :
-        Listener(listener),
+        Listener(listener), Timestamp(0), Stamping(false), Pending(),
         CurrentData(NULL), CurrentLen(0), CurrentPtr(0),
         OldLen(0), OldPtr(0)
 {
@@ -55,6 +57,42 @@ void TraceFileParser::Feed(const uint8_t* data, size_t len)
     assert(CurrentPtr == CurrentLen);
 }
 
+/**
+ * Pass on the events held back for a timestamp that has not arrived, with
+ * the time of the last one.
+ */
+void TraceFileParser::Flush()
+{
+    EmitPending(TraceEvent::TIME_UNSTAMPED);
+}
+
+/**
+ * Pass on an event, or hold it back until the timestamp that follows it.
+ */
+void TraceFileParser::Emit(enum TraceEvent::Type type, uint32_t code, uint32_t value)
+{
+    if (!Stamping) {
+        TraceEvent e(type, code, value, Timestamp, TraceEvent::TIME_UNSTAMPED);
+        Listener.HandleTraceEvent(e);
+        return;
+    }
+    if (Pending.size() >= MAX_PENDING) {
+        LOG_DEBUG("No timestamp for %lu events", Pending.size());
+        EmitPending(TraceEvent::TIME_UNSTAMPED);
+    }
+    const PendingEvent p = { type, code, value };
+    Pending.push_back(p);
+}
+
+void TraceFileParser::EmitPending(enum TraceEvent::TimeCode timeCode)
+{
+    for (const PendingEvent& p : Pending) {
+        TraceEvent e(p.Type, p.Code, p.Value, Timestamp, timeCode);
+        Listener.HandleTraceEvent(e);
+    }
+    Pending.clear();
+}
+
 bool TraceFileParser::GetData(uint8_t* out, size_t count)
 {
     const size_t have = (OldLen - OldPtr) + (CurrentLen - CurrentPtr);
@@ -111,8 +149,7 @@ bool TraceFileParser::Parse()
     }
     else if (b == 0x70) {
         // LOG_DEBUG("Overflow");
-        TraceEvent e(TraceEvent::TRACE_EVENT_OVERFLOW);
-        Listener.HandleTraceEvent(e);
+        Emit(TraceEvent::TRACE_EVENT_OVERFLOW, 0, 0);
     }
     else {
         switch (b & 0x0f) {
@@ -166,7 +203,9 @@ bool TraceFileParser::ParseSync()
         return true;
     }
 
-    TraceEvent e(TraceEvent::TRACE_EVENT_SYNC);
+    // Nothing before a sync is stamped by a timestamp after it
+    Flush();
+    TraceEvent e(TraceEvent::TRACE_EVENT_SYNC, 0, 0, Timestamp);
     Listener.HandleTraceEvent(e);
 
     return true;
@@ -179,7 +218,10 @@ bool TraceFileParser::ParseTimeStamp(uint8_t b)
         uint32_t value = (b >> 4) & 0x07;
 
         // LOG_DEBUG("Timestamp short: %#x", value);
-        TraceEvent e(TraceEvent::TRACE_EVENT_TIMESTAMP, 0, value);
+        Timestamp += value;
+        Stamping = true;
+        EmitPending(TraceEvent::TIME_SYNC);
+        TraceEvent e(TraceEvent::TRACE_EVENT_TIMESTAMP, 0, value, Timestamp);
         Listener.HandleTraceEvent(e);
 
         return true;
@@ -209,7 +251,10 @@ bool TraceFileParser::ParseTimeStamp(uint8_t b)
             ((data[1] & 0x7f));
 
     // LOG_DEBUG("Timestamp %luB code %#x: %#x", i, code, value);
-    TraceEvent e(TraceEvent::TRACE_EVENT_TIMESTAMP, code, value);
+    Timestamp += value;
+    Stamping = true;
+    EmitPending(static_cast<enum TraceEvent::TimeCode>(code));
+    TraceEvent e(TraceEvent::TRACE_EVENT_TIMESTAMP, code, value, Timestamp);
     Listener.HandleTraceEvent(e);
 
     return true;
@@ -231,8 +276,7 @@ bool TraceFileParser::ParseInstrumentation(uint8_t b)
             (data[0]);
 
     // LOG_DEBUG("Stim len %lu on port %u: %#x", len, b >> 3, intvalue);
-    TraceEvent e(TraceEvent::TRACE_EVENT_INSTR, b, intvalue);
-    Listener.HandleTraceEvent(e);
+    Emit(TraceEvent::TRACE_EVENT_INSTR, b, intvalue);
 
     return true;
 }
@@ -252,8 +296,7 @@ bool TraceFileParser::ParseHardwareSource(uint8_t b)
             (data[1] << 8) |
             (data[0]);
 
-    TraceEvent e(TraceEvent::TRACE_EVENT_HW, b, intvalue);
-    Listener.HandleTraceEvent(e);
+    Emit(TraceEvent::TRACE_EVENT_HW, b, intvalue);
 
     return true;
 }
@@ -0,0 +1,82 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "TracePipe.h"
+
+#include "log.h"
+
+namespace lct {
+
+TracePipe::TracePipe() :
+        Dir(), Name(), Fd(-1), WriteFd(-1)
+{
+}
+
+TracePipe::~TracePipe()
+{
+    Close();
+}
+
+/**
+ * Create the FIFO and open it for reading.
+ */
+bool TracePipe::Create()
+{
+    if (Fd != -1) {
+        return true;
+    }
+
+    char dir[] = "/tmp/lct-XXXXXX";
+    if (!mkdtemp(dir)) {
+        LOG_ERROR("Failed to create directory for FIFO: %s", strerror(errno));
+        return false;
+    }
+    Dir = dir;
+    Name = Dir + "/tpiu";
+
+    if (mkfifo(Name.c_str(), 0600) != 0) {
+        LOG_ERROR("Failed to create FIFO: %s", strerror(errno));
+        Close();
+        return false;
+    }
+
+    // Opening the read end first lets the write end open without blocking
+    Fd = open(Name.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (Fd != -1) {
+        WriteFd = open(Name.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+    if (Fd == -1 || WriteFd == -1) {
+        LOG_ERROR("Failed to open FIFO: %s", strerror(errno));
+        Close();
+        return false;
+    }
+
+    LOG_DEBUG("Created FIFO %s", Name.c_str());
+    return true;
+}
+
+void TracePipe::Close()
+{
+    if (WriteFd != -1) {
+        close(WriteFd);
+        WriteFd = -1;
+    }
+    if (Fd != -1) {
+        close(Fd);
+        Fd = -1;
+    }
+    if (!Name.empty() && unlink(Name.c_str()) != 0 && errno != ENOENT) {
+        LOG_WARNING("Failed to remove FIFO %s: %s", Name.c_str(), strerror(errno));
+    }
+    if (!Dir.empty() && rmdir(Dir.c_str()) != 0) {
+        LOG_WARNING("Failed to remove %s: %s", Dir.c_str(), strerror(errno));
+    }
+    Name.clear();
+    Dir.clear();
+}
+
+} /* namespace lct */
@@ -0,0 +1,205 @@
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "TraceSocket.h"
+
+#include "log.h"
+
+namespace lct {
+
+TraceSocket::TraceSocket(int receiveBufferSize) :
+        ReceiveBufferSize(receiveBufferSize), Host(), Port(0), Addresses(), Current(0),
+        Fd(-1), CurrentState(CLOSED), Connects(0)
+{
+}
+
+TraceSocket::~TraceSocket()
+{
+    Close();
+}
+
+/**
+ * Resolve a server and start connecting to it. The socket becomes writable
+ * when the connection attempt has finished, and FinishConnect() must then
+ * be called.
+ *
+ * @return false if the host cannot be resolved or every address failed
+ *         right away
+ */
+bool TraceSocket::Connect(const std::string& host, uint16_t port)
+{
+    Close();
+    Host = host;
+    Port = port;
+    Addresses.clear();
+    Current = 0;
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = NULL;
+    const int gai = getaddrinfo(Host.c_str(), std::to_string(Port).c_str(), &hints, &res);
+    if (gai != 0) {
+        LOG_ERROR("Failed to resolve %s: %s", Host.c_str(), gai_strerror(gai));
+        return false;
+    }
+    for (addrinfo* ai = res; ai; ai = ai->ai_next) {
+        Address a;
+        memset(&a, 0, sizeof(a));
+        memcpy(&a.Addr, ai->ai_addr, ai->ai_addrlen);
+        a.Length = ai->ai_addrlen;
+        a.Family = ai->ai_family;
+        Addresses.push_back(a);
+    }
+    freeaddrinfo(res);
+    return Reconnect();
+}
+
+/**
+ * Start a new connection attempt to the server given to Connect(), trying
+ * its addresses until one does not fail right away.
+ */
+bool TraceSocket::Reconnect()
+{
+    Close();
+    for (size_t i = 0; i < Addresses.size(); i++) {
+        if (ConnectTo(Addresses[Current])) {
+            return true;
+        }
+        Current = (Current + 1) % Addresses.size();
+    }
+    LOG_ERROR("Failed to connect to %s:%u", Host.c_str(), Port);
+    return false;
+}
+
+bool TraceSocket::ConnectTo(const Address& address)
+{
+    Fd = socket(address.Family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (Fd == -1) {
+        LOG_WARNING("Failed to create socket: %s", strerror(errno));
+        return false;
+    }
+
+    // The receive buffer size must be set before connecting to affect the
+    // TCP window scale
+    if (setsockopt(Fd, SOL_SOCKET, SO_RCVBUF, &ReceiveBufferSize,
+            sizeof(ReceiveBufferSize)) != 0) {
+        LOG_WARNING("Failed to set receive buffer size: %s", strerror(errno));
+    }
+    const int one = 1;
+    setsockopt(Fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // Even a connection made at once is completed by FinishConnect(), as the
+    // socket is writable right away
+    if (connect(Fd, reinterpret_cast<const sockaddr*>(&address.Addr), address.Length) != 0 &&
+            errno != EINPROGRESS) {
+        LOG_WARNING("Failed to connect to %s:%u: %s", Host.c_str(), Port, strerror(errno));
+        Close();
+        return false;
+    }
+    CurrentState = CONNECTING;
+    return true;
+}
+
+/**
+ * Give up the attempt in progress. The next one starts with the next
+ * address.
+ */
+void TraceSocket::Failed()
+{
+    Close();
+    if (!Addresses.empty()) {
+        Current = (Current + 1) % Addresses.size();
+    }
+}
+
+/**
+ * Check on a connection attempt. SO_ERROR is also 0 while the attempt is
+ * still in progress, which getpeername() tells apart.
+ *
+ * @return true if the connection attempt succeeded, false if it failed, in
+ *         which case the socket is closed, or if it is still in progress, in
+ *         which case the state stays CONNECTING
+ */
+bool TraceSocket::FinishConnect()
+{
+    if (CurrentState != CONNECTING) {
+        return CurrentState == CONNECTED;
+    }
+
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(Fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0) {
+        LOG_WARNING("Failed to connect to %s:%u: %s", Host.c_str(), Port,
+                strerror(error ? error : errno));
+        Failed();
+        return false;
+    }
+    sockaddr_storage peer;
+    len = sizeof(peer);
+    if (getpeername(Fd, reinterpret_cast<sockaddr*>(&peer), &len) != 0) {
+        if (errno == ENOTCONN) {
+            return false;
+        }
+        LOG_WARNING("Failed to connect to %s:%u: %s", Host.c_str(), Port, strerror(errno));
+        Failed();
+        return false;
+    }
+
+    CurrentState = CONNECTED;
+    Connects++;
+    LOG_DEBUG("Connected to %s:%u", Host.c_str(), Port);
+    return true;
+}
+
+/**
+ * Read what is available, up to len bytes.
+ *
+ * @return Number of bytes read, 0 if there is nothing to read right now, or
+ *         -1 if the connection was lost, in which case the socket is closed
+ */
+ssize_t TraceSocket::Receive(uint8_t* buffer, size_t len)
+{
+    if (CurrentState != CONNECTED) {
+        return CurrentState == CLOSED ? -1 : 0;
+    }
+
+    for (;;) {
+        const ssize_t res = recv(Fd, buffer, len, 0);
+        if (res > 0) {
+            return res;
+        }
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        if (res < 0) {
+            LOG_WARNING("Connection to %s:%u lost: %s", Host.c_str(), Port, strerror(errno));
+        }
+        else {
+            LOG_WARNING("Connection to %s:%u closed", Host.c_str(), Port);
+        }
+        Close();
+        return -1;
+    }
+}
+
+void TraceSocket::Close()
+{
+    if (Fd != -1) {
+        close(Fd);
+        Fd = -1;
+    }
+    CurrentState = CLOSED;
+}
+
+} /* namespace lct */
@@ -0,0 +1,487 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "TraceSource.h"
+#include "UringTraceSource.h"
+
+#include "log.h"
+
+namespace lct {
+
+TraceSource::TraceSource() :
+        Lent(0)
+{
+}
+
+TraceSource::~TraceSource()
+{
+}
+
+/**
+ * Parse a decimal number that makes up all of the string.
+ */
+static bool parseNumber(const std::string& s, unsigned long max, unsigned long* out)
+{
+    char* end = NULL;
+    errno = 0;
+    *out = strtoul(s.c_str(), &end, 10);
+    return !s.empty() && isdigit(static_cast<unsigned char>(s[0])) && *end == '\0' &&
+            errno == 0 && *out <= max;
+}
+
+/**
+ * Open a source by name, see the class description.
+ *
+ * @return The new source, or NULL if it could not be opened
+ */
+TraceSource* TraceSource::Open(const std::string& name)
+{
+    if (name.compare(0, 4, "tcp:") == 0) {
+        const size_t colon = name.rfind(':');
+        unsigned long port = 0;
+        if (colon == 3 || !parseNumber(name.substr(colon + 1), 65535, &port) || port == 0) {
+            LOG_ERROR("Invalid trace source %s, expected tcp:HOST:PORT", name.c_str());
+            return NULL;
+        }
+        TcpTraceSource* source = new TcpTraceSource();
+        if (!source->Connect(name.substr(4, colon - 4), port)) {
+            LOG_ERROR("Failed to open %s", name.c_str());
+            delete source;
+            return NULL;
+        }
+        return source;
+    }
+
+    if (name.compare(0, 7, "serial:") == 0) {
+        const size_t at = name.find('@');
+        unsigned long baudrate = 115200;
+        if (at != std::string::npos && (!parseNumber(name.substr(at + 1), 0xffffffffUL,
+                &baudrate) || baudrate == 0)) {
+            LOG_ERROR("Invalid trace source %s, expected serial:DEV[@BAUD]", name.c_str());
+            return NULL;
+        }
+        SerialTraceSource* source = new SerialTraceSource();
+        if (!source->Open(name.substr(7, at == std::string::npos ? at : at - 7), baudrate)) {
+            delete source;
+            return NULL;
+        }
+        return source;
+    }
+
+    if (name.compare(0, 6, "uring:") == 0) {
+        const std::string path = name.substr(6);
+        const int fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            LOG_ERROR("Failed to open %s: %s", path.c_str(), strerror(errno));
+            return NULL;
+        }
+        UringTraceSource* source = new UringTraceSource();
+        if (source->Open(fd, fd != STDIN_FILENO)) {
+            return source;
+        }
+        delete source;
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+        LOG_INFO("Reading %s without io_uring", path.c_str());
+        return Open(path);
+    }
+
+    int fd = STDIN_FILENO;
+    if (name != "-") {
+        fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            LOG_ERROR("Failed to open %s: %s", name.c_str(), strerror(errno));
+            return NULL;
+        }
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        MappedTraceSource* source = new MappedTraceSource();
+        const bool mapped = source->Map(fd);
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+        if (!mapped) {
+            delete source;
+            return NULL;
+        }
+        return source;
+    }
+
+    return new FdTraceSource(fd, fd != STDIN_FILENO);
+}
+
+void TraceSource::Release(const Buffer&)
+{
+    if (Lent == 0) {
+        LOG_ERROR("Released a buffer that was not lent");
+        return;
+    }
+    Lent--;
+}
+
+// -----------------------------------------------------------------
+
+MemoryTraceSource::MemoryTraceSource(const uint8_t* data, size_t len, size_t chunkSize) :
+        Data(data), Length(len), ChunkSize(std::max<size_t>(chunkSize, 1)), Offset(0)
+{
+}
+
+TraceSource::Status MemoryTraceSource::Acquire(Buffer& buffer)
+{
+    if (Offset >= Length) {
+        return END;
+    }
+    buffer.Data = Data + Offset;
+    buffer.Length = std::min(ChunkSize, Length - Offset);
+    Offset += buffer.Length;
+    Lent++;
+    return DATA;
+}
+
+// -----------------------------------------------------------------
+
+MappedTraceSource::MappedTraceSource(size_t chunkSize) :
+        MemoryTraceSource(NULL, 0, chunkSize), Mapping(NULL), MappingSize(0)
+{
+}
+
+MappedTraceSource::~MappedTraceSource()
+{
+    if (Mapping) {
+        munmap(Mapping, MappingSize);
+    }
+}
+
+/**
+ * Map a regular file. The descriptor may be closed afterwards.
+ */
+bool MappedTraceSource::Map(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        LOG_ERROR("Failed to stat trace file: %s", strerror(errno));
+        return false;
+    }
+    if (st.st_size == 0) {
+        return true;
+    }
+
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        LOG_ERROR("Failed to map trace file: %s", strerror(errno));
+        return false;
+    }
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+    if (Mapping) {
+        munmap(Mapping, MappingSize);
+    }
+    Mapping = p;
+    MappingSize = st.st_size;
+    Data = static_cast<const uint8_t*>(p);
+    Length = MappingSize;
+    Offset = 0;
+    return true;
+}
+
+bool MappedTraceSource::Map(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        LOG_ERROR("Failed to open %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    const bool res = Map(fd);
+    close(fd);
+    return res;
+}
+
+// -----------------------------------------------------------------
+
+FdTraceSource::FdTraceSource(int fd, bool ownFd, size_t bufferSize, size_t buffers) :
+        Fd(fd), OwnFd(ownFd), BufferSize(bufferSize),
+        Pool(std::max<size_t>(buffers, 1)), Free(), ArchiveFd(-1), TeePipe(),
+        TeeFlags(0), Archived(0)
+{
+    TeePipe[0] = TeePipe[1] = -1;
+    for (size_t i = Pool.size(); i > 0; i--) {
+        Free.push_back(i - 1);
+    }
+}
+
+FdTraceSource::~FdTraceSource()
+{
+    CloseArchive();
+    if (OwnFd && Fd != -1) {
+        close(Fd);
+    }
+}
+
+TraceSource::Status FdTraceSource::Acquire(Buffer& buffer)
+{
+    if (Free.empty()) {
+        return AGAIN;
+    }
+
+    const size_t index = Free.back();
+    std::vector<uint8_t>& data = Pool[index];
+    // Buffers are allocated when first needed
+    data.resize(BufferSize);
+
+    size_t len = 0;
+    const Status status = Fill(data.data(), data.size(), &len);
+    if (status != DATA) {
+        return status;
+    }
+
+    Free.pop_back();
+    buffer.Data = data.data();
+    buffer.Length = len;
+    buffer.Index = index;
+    Lent++;
+    return DATA;
+}
+
+void FdTraceSource::Release(const Buffer& buffer)
+{
+    TraceSource::Release(buffer);
+    Free.push_back(buffer.Index);
+}
+
+/**
+ * Copy all data read from now on to a file, which is created or truncated.
+ * Only works for pipes and FIFOs.
+ */
+bool FdTraceSource::SetArchive(const std::string& path)
+{
+    struct stat st;
+    if (Fd == -1 || fstat(Fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+        LOG_ERROR("Trace data can only be archived from a pipe");
+        return false;
+    }
+
+    CloseArchive();
+    ArchiveFd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (ArchiveFd == -1) {
+        LOG_ERROR("Failed to open %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    if (pipe2(TeePipe, O_CLOEXEC) != 0) {
+        LOG_ERROR("Failed to create pipe: %s", strerror(errno));
+        CloseArchive();
+        return false;
+    }
+    // Each tee is drained right away, so the private pipe only needs to
+    // hold one buffer
+    fcntl(TeePipe[1], F_SETPIPE_SZ, int(BufferSize));
+
+    // Only wait in tee() if a read would wait as well
+    TeeFlags = (fcntl(Fd, F_GETFL) & O_NONBLOCK) ? SPLICE_F_NONBLOCK : 0;
+    Archived = 0;
+    return true;
+}
+
+void FdTraceSource::CloseArchive()
+{
+    for (int& fd : TeePipe) {
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (ArchiveFd != -1) {
+        close(ArchiveFd);
+        ArchiveFd = -1;
+    }
+}
+
+/**
+ * Duplicate up to size bytes of pending input into the archive.
+ *
+ * @return Number of bytes archived, which are then read from Fd, or 0 to
+ *         read from Fd as if there was no archive
+ */
+size_t FdTraceSource::Tee(size_t size)
+{
+    ssize_t res;
+    do {
+        res = tee(Fd, TeePipe[1], size, TeeFlags);
+    } while (res < 0 && errno == EINTR);
+    if (res <= 0) {
+        // End of input and errors are left for read() to report
+        if (res < 0 && errno != EAGAIN) {
+            LOG_WARNING("Failed to archive trace data: %s", strerror(errno));
+            CloseArchive();
+        }
+        return 0;
+    }
+
+    size_t left = res;
+    while (left) {
+        const ssize_t moved = splice(TeePipe[0], NULL, ArchiveFd, NULL, left, SPLICE_F_MOVE);
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        }
+        if (moved <= 0) {
+            LOG_WARNING("Failed to write trace archive: %s", strerror(errno));
+            CloseArchive();
+            break;
+        }
+        left -= moved;
+    }
+    Archived += res - left;
+    return res;
+}
+
+TraceSource::Status FdTraceSource::Fill(uint8_t* data, size_t size, size_t* len)
+{
+    // Read exactly what was archived, so that both copies stay in step
+    if (ArchiveFd != -1) {
+        const size_t teed = Tee(size);
+        if (teed) {
+            size = teed;
+        }
+    }
+
+    for (;;) {
+        const ssize_t res = read(Fd, data, size);
+        if (res > 0) {
+            *len = res;
+            return DATA;
+        }
+        if (res == 0) {
+            return END;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return AGAIN;
+        }
+        if (errno != EINTR) {
+            LOG_ERROR("Error when reading trace data: %s", strerror(errno));
+            return FAILED;
+        }
+    }
+}
+
+// -----------------------------------------------------------------
+
+FifoTraceSource::FifoTraceSource() :
+        FdTraceSource(-1, false), Pipe()
+{
+}
+
+bool FifoTraceSource::Create()
+{
+    if (!Pipe.Create()) {
+        return false;
+    }
+    Fd = Pipe.GetFd();
+    return true;
+}
+
+// -----------------------------------------------------------------
+
+SerialTraceSource::SerialTraceSource() :
+        FdTraceSource(-1, true)
+{
+}
+
+static speed_t baudrateConstant(unsigned baudrate)
+{
+    static const struct {
+        unsigned Rate;
+        speed_t Constant;
+    } rates[] = {
+        { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 },
+        { 57600, B57600 }, { 115200, B115200 }, { 230400, B230400 },
+        { 460800, B460800 }, { 921600, B921600 }, { 1000000, B1000000 },
+        { 2000000, B2000000 }, { 3000000, B3000000 }, { 4000000, B4000000 },
+    };
+    for (const auto& r : rates) {
+        if (r.Rate == baudrate) {
+            return r.Constant;
+        }
+    }
+    return B0;
+}
+
+bool SerialTraceSource::Open(const std::string& path, unsigned baudrate)
+{
+    const speed_t speed = baudrateConstant(baudrate);
+    if (speed == B0) {
+        LOG_ERROR("Unsupported baud rate %u", baudrate);
+        return false;
+    }
+
+    const int fd = open(path.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1) {
+        LOG_ERROR("Failed to open %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        LOG_ERROR("%s is not a serial port: %s", path.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        LOG_ERROR("Failed to configure %s: %s", path.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+    tcflush(fd, TCIFLUSH);
+
+    if (Fd != -1) {
+        close(Fd);
+    }
+    Fd = fd;
+    return true;
+}
+
+// -----------------------------------------------------------------
+
+TcpTraceSource::TcpTraceSource() :
+        FdTraceSource(-1, false), Socket()
+{
+}
+
+bool TcpTraceSource::Connect(const std::string& host, uint16_t port)
+{
+    return Socket.Connect(host, port);
+}
+
+bool TcpTraceSource::Reopen()
+{
+    return Socket.Reconnect();
+}
+
+TraceSource::Status TcpTraceSource::Fill(uint8_t* data, size_t size, size_t* len)
+{
+    if (Socket.GetState() == TraceSocket::CONNECTING && !Socket.FinishConnect()) {
+        return Socket.GetState() == TraceSocket::CONNECTING ? AGAIN : END;
+    }
+
+    const ssize_t res = Socket.Receive(data, size);
+    if (res > 0) {
+        *len = res;
+        return DATA;
+    }
+    return res == 0 ? AGAIN : END;
+}
+
+} /* namespace lct */
@@ -0,0 +1,366 @@
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "UringTraceSource.h"
+
+#include "log.h"
+
+namespace lct {
+
+static int uringSetup(unsigned entries, io_uring_params* params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int uringRegister(int fd, unsigned opcode, const void* arg, unsigned args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, args);
+}
+
+static unsigned* ringField(void* mapping, uint32_t offset)
+{
+    return reinterpret_cast<unsigned*>(static_cast<uint8_t*>(mapping) + offset);
+}
+
+UringTraceSource::UringTraceSource(size_t bufferSize, unsigned depth) :
+        BufferSize(bufferSize), Depth(std::max(depth, 1U)), Fd(-1), OwnFd(false),
+        AtEnd(false), NextOffset(0), RingFd(-1), SqMapping(NULL),
+        SqMappingSize(0), CqMapping(NULL), CqMappingSize(0), Sqes(NULL), SqesSize(0),
+        Cqes(NULL), Sq(), Cq(), Registered(false), Memory(), Slots(), Order(),
+        InFlight(0)
+{
+}
+
+UringTraceSource::~UringTraceSource()
+{
+    Teardown();
+    if (OwnFd && Fd != -1) {
+        close(Fd);
+    }
+}
+
+/**
+ * @return true if io_uring can be used in this process
+ */
+bool UringTraceSource::IsAvailable()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    const int fd = uringSetup(1, &params);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+/**
+ * Start reading from a file.
+ *
+ * @return false if the descriptor is not a regular file or io_uring could
+ *         not be set up, in which case the descriptor is left alone
+ */
+bool UringTraceSource::Open(int fd, bool ownFd)
+{
+    Teardown();
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        LOG_DEBUG("Not reading a pipe or device with io_uring");
+        return false;
+    }
+    if (!Setup()) {
+        Teardown();
+        return false;
+    }
+
+    if (OwnFd && Fd != -1) {
+        close(Fd);
+    }
+    Fd = fd;
+    OwnFd = ownFd;
+    AtEnd = false;
+    NextOffset = 0;
+    return true;
+}
+
+bool UringTraceSource::Setup()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    RingFd = uringSetup(Depth, &params);
+    if (RingFd < 0) {
+        LOG_DEBUG("io_uring is not available: %s", strerror(errno));
+        RingFd = -1;
+        return false;
+    }
+
+    SqMappingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    CqMappingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        SqMappingSize = CqMappingSize = std::max(SqMappingSize, CqMappingSize);
+    }
+
+    SqMapping = mmap(NULL, SqMappingSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, RingFd, IORING_OFF_SQ_RING);
+    if (SqMapping == MAP_FAILED) {
+        SqMapping = NULL;
+        LOG_ERROR("Failed to map io_uring: %s", strerror(errno));
+        return false;
+    }
+    if (single) {
+        CqMapping = SqMapping;
+    }
+    else {
+        CqMapping = mmap(NULL, CqMappingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, RingFd, IORING_OFF_CQ_RING);
+        if (CqMapping == MAP_FAILED) {
+            CqMapping = NULL;
+            LOG_ERROR("Failed to map io_uring: %s", strerror(errno));
+            return false;
+        }
+    }
+
+    SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(NULL, SqesSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, RingFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        LOG_ERROR("Failed to map io_uring: %s", strerror(errno));
+        return false;
+    }
+    Sqes = static_cast<io_uring_sqe*>(sqes);
+
+    Sq.Head = ringField(SqMapping, params.sq_off.head);
+    Sq.Tail = ringField(SqMapping, params.sq_off.tail);
+    Sq.Mask = ringField(SqMapping, params.sq_off.ring_mask);
+    Sq.Array = ringField(SqMapping, params.sq_off.array);
+    Cq.Head = ringField(CqMapping, params.cq_off.head);
+    Cq.Tail = ringField(CqMapping, params.cq_off.tail);
+    Cq.Mask = ringField(CqMapping, params.cq_off.ring_mask);
+    Cqes = reinterpret_cast<io_uring_cqe*>(ringField(CqMapping, params.cq_off.cqes));
+
+    Memory.resize(Depth * BufferSize);
+    Slots.assign(Depth, Slot());
+    Order.clear();
+    InFlight = 0;
+
+    // Registered buffers save mapping the pages on every read. This can
+    // fail with a low RLIMIT_MEMLOCK, and plain reads work just as well.
+    std::vector<iovec> iov(Depth);
+    for (unsigned i = 0; i < Depth; i++) {
+        iov[i].iov_base = Memory.data() + i * BufferSize;
+        iov[i].iov_len = BufferSize;
+    }
+    Registered = uringRegister(RingFd, IORING_REGISTER_BUFFERS, iov.data(), Depth) == 0;
+    if (!Registered) {
+        LOG_DEBUG("Failed to register io_uring buffers: %s", strerror(errno));
+    }
+    return true;
+}
+
+void UringTraceSource::Teardown()
+{
+    // The kernel may still write to buffers of reads in flight
+    while (InFlight && Reap(1)) {
+    }
+
+    if (Sqes) {
+        munmap(Sqes, SqesSize);
+        Sqes = NULL;
+    }
+    if (CqMapping && CqMapping != SqMapping) {
+        munmap(CqMapping, CqMappingSize);
+    }
+    CqMapping = NULL;
+    if (SqMapping) {
+        munmap(SqMapping, SqMappingSize);
+        SqMapping = NULL;
+    }
+    if (RingFd != -1) {
+        close(RingFd);
+        RingFd = -1;
+    }
+    Registered = false;
+    Slots.clear();
+    Order.clear();
+    InFlight = 0;
+}
+
+/**
+ * Issue reads into all free buffers.
+ *
+ * @return false if the kernel did not take the reads, which are then
+ *         taken back
+ */
+bool UringTraceSource::Submit()
+{
+    unsigned count = 0;
+    const unsigned oldTail = *Sq.Tail;
+    unsigned tail = oldTail;
+    const unsigned mask = *Sq.Mask;
+
+    for (size_t i = 0; i < Slots.size() && !AtEnd; i++) {
+        if (Slots[i].State != FREE) {
+            continue;
+        }
+
+        io_uring_sqe* sqe = &Sqes[tail & mask];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = Registered ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = Fd;
+        sqe->addr = reinterpret_cast<uint64_t>(Memory.data() + i * BufferSize);
+        sqe->len = BufferSize;
+        sqe->off = NextOffset;
+        sqe->buf_index = Registered ? i : 0;
+        sqe->user_data = i;
+        Sq.Array[tail & mask] = tail & mask;
+        tail++;
+
+        NextOffset += BufferSize;
+        Slots[i].State = IN_FLIGHT;
+        Order.push_back(i);
+        count++;
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    __atomic_store_n(Sq.Tail, tail, __ATOMIC_RELEASE);
+    int res;
+    do {
+        res = uringEnter(RingFd, count, 0, 0);
+    } while (res < 0 && errno == EINTR);
+    if (res < 0) {
+        LOG_ERROR("Failed to submit reads: %s", strerror(errno));
+        res = 0;
+    }
+
+    // The kernel has not looked at entries it did not take, so they can
+    // be removed from the ring again, last first
+    const unsigned submitted = res;
+    for (unsigned i = submitted; i < count; i++) {
+        Slots[Order.back()].State = FREE;
+        Order.pop_back();
+        NextOffset -= BufferSize;
+    }
+    if (submitted < count) {
+        __atomic_store_n(Sq.Tail, oldTail + submitted, __ATOMIC_RELEASE);
+    }
+    InFlight += submitted;
+    return submitted == count;
+}
+
+/**
+ * Collect completed reads.
+ *
+ * @param wait  Number of completions to wait for
+ */
+bool UringTraceSource::Reap(unsigned wait)
+{
+    if (wait) {
+        const int res = uringEnter(RingFd, 0, wait, IORING_ENTER_GETEVENTS);
+        if (res < 0 && errno != EINTR) {
+            LOG_ERROR("Failed to wait for reads: %s", strerror(errno));
+            return false;
+        }
+    }
+
+    unsigned head = *Cq.Head;
+    const unsigned tail = __atomic_load_n(Cq.Tail, __ATOMIC_ACQUIRE);
+    const unsigned mask = *Cq.Mask;
+    for (; head != tail; head++) {
+        const io_uring_cqe& cqe = Cqes[head & mask];
+        Slot& slot = Slots[cqe.user_data];
+        slot.State = DONE;
+        slot.Result = cqe.res;
+        InFlight--;
+    }
+    __atomic_store_n(Cq.Head, head, __ATOMIC_RELEASE);
+    return true;
+}
+
+TraceSource::Status UringTraceSource::Acquire(Buffer& buffer)
+{
+    if (RingFd == -1) {
+        return FAILED;
+    }
+
+    for (;;) {
+        const bool submitted = Submit();
+        if (Order.empty()) {
+            return submitted ? END : FAILED;
+        }
+
+        const size_t i = Order.front();
+        Slot& slot = Slots[i];
+        while (slot.State == IN_FLIGHT) {
+            if (!Reap(1)) {
+                return FAILED;
+            }
+        }
+        Order.pop_front();
+
+        if (slot.Result > 0) {
+            // Regular files only come up short at the end
+            if (size_t(slot.Result) < BufferSize) {
+                AtEnd = true;
+                DiscardRest();
+            }
+            slot.State = LENT;
+            buffer.Data = Memory.data() + i * BufferSize;
+            buffer.Length = slot.Result;
+            buffer.Index = i;
+            Lent++;
+            return DATA;
+        }
+
+        slot.State = FREE;
+        if (slot.Result == -EAGAIN) {
+            return AGAIN;
+        }
+        if (slot.Result < 0) {
+            LOG_ERROR("Error when reading trace data: %s", strerror(-slot.Result));
+            return FAILED;
+        }
+        AtEnd = true;
+        DiscardRest();
+    }
+}
+
+/**
+ * Drop the reads issued after the one that found the end of the file. If
+ * the file has grown meanwhile they may have read data, which is not used
+ * as it would follow a gap. They are waited for, since the kernel may
+ * still write to their buffers.
+ */
+void UringTraceSource::DiscardRest()
+{
+    while (InFlight && Reap(1)) {
+    }
+    for (size_t i : Order) {
+        Slots[i].State = FREE;
+    }
+    Order.clear();
+}
+
+void UringTraceSource::Release(const Buffer& buffer)
+{
+    TraceSource::Release(buffer);
+    if (buffer.Index < Slots.size()) {
+        Slots[buffer.Index].State = FREE;
+    }
+}
+
+} /* namespace lct */
@@ -0,0 +1,241 @@
+#include <cctype>
+
+#include "ExceptionAnalyzer.h"
+#include "TraceEvent.h"
+#include "VcdWriter.h"
+
+namespace lct {
+
+const size_t VcdWriter::FLUSH_SIZE;
+const unsigned VcdWriter::NUM_WATCHES;
+const unsigned VcdWriter::NUM_PORTS;
+
+/**
+ * @return Signal name with characters VCD readers don't like replaced
+ */
+static std::string sanitize(const std::string& name)
+{
+    std::string s = name;
+    for (char& c : s) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '[' && c != ']') {
+            c = '_';
+        }
+    }
+    return s;
+}
+
+VcdWriter::VcdWriter(std::ostream& out, double ticksPerSecond, unsigned numExceptions) :
+        Out(out), TicksPerSecond(ticksPerSecond), Signals(), ActiveExceptions(),
+        HeaderDone(false), TimeWritten(false), Time(0), Buffer()
+{
+    Buffer.reserve(FLUSH_SIZE + 256);
+
+    for (unsigned c = 0; c < NUM_WATCHES; c++) {
+        Signals.push_back(Signal("watch", "comp" + std::to_string(c), 32));
+    }
+    for (unsigned p = 0; p < NUM_PORTS; p++) {
+        Signals.push_back(Signal("itm", "port" + std::to_string(p), 32));
+    }
+    Signals.push_back(Signal("exceptions", "current", 9));
+    for (unsigned e = 0; e < numExceptions; e++) {
+        Signals.push_back(Signal("exceptions", ExceptionAnalyzer::ExceptionName(e), 1));
+    }
+
+    // Short identifiers made from the printable characters
+    for (size_t i = 0; i < Signals.size(); i++) {
+        size_t n = i;
+        do {
+            Signals[i].Id.push_back(static_cast<char>('!' + n % 94));
+            n /= 94;
+        } while (n);
+    }
+}
+
+VcdWriter::~VcdWriter()
+{
+    Flush();
+}
+
+void VcdWriter::SetWatchName(unsigned comparator, const std::string& name)
+{
+    if (comparator < NUM_WATCHES) {
+        Signals[WatchSignal(comparator)].Name = sanitize(name);
+    }
+}
+
+void VcdWriter::WriteHeader()
+{
+    Buffer += "$version libcortextrace $end\n";
+    Buffer += "$timescale 1 ns $end\n";
+    Buffer += "$scope module trace $end\n";
+
+    std::string scope;
+    for (const Signal& s : Signals) {
+        if (s.Scope != scope) {
+            if (!scope.empty()) {
+                Buffer += "$upscope $end\n";
+            }
+            scope = s.Scope;
+            Buffer += "$scope module " + scope + " $end\n";
+        }
+        Buffer += "$var wire " + std::to_string(s.Width) + " " + s.Id + " " +
+                s.Name + " $end\n";
+    }
+    Buffer += "$upscope $end\n$upscope $end\n$enddefinitions $end\n";
+
+    // Exceptions are known to be inactive, everything else is unknown
+    Buffer += "#0\n$dumpvars\n";
+    for (size_t i = 0; i < Signals.size(); i++) {
+        Signal& s = Signals[i];
+        if (i >= CurrentSignal()) {
+            s.Known = true;
+            WriteValue(s);
+        }
+        else if (s.Width == 1) {
+            Buffer += "x" + s.Id + "\n";
+        }
+        else {
+            Buffer += "bx " + s.Id + "\n";
+        }
+    }
+    Buffer += "$end\n";
+    HeaderDone = true;
+}
+
+void VcdWriter::WriteNumber(uint64_t value)
+{
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[n++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (n) {
+        Buffer.push_back(digits[--n]);
+    }
+}
+
+void VcdWriter::WriteValue(const Signal& s)
+{
+    if (s.Width == 1) {
+        Buffer.push_back(s.Value ? '1' : '0');
+    }
+    else {
+        Buffer.push_back('b');
+        int bit = 31;
+        while (bit > 0 && !(s.Value & (1U << bit))) {
+            bit--;
+        }
+        for (; bit >= 0; bit--) {
+            Buffer.push_back((s.Value & (1U << bit)) ? '1' : '0');
+        }
+        Buffer.push_back(' ');
+    }
+    Buffer += s.Id;
+    Buffer.push_back('\n');
+}
+
+void VcdWriter::Change(unsigned signal, uint32_t value)
+{
+    if (signal >= Signals.size()) {
+        return;
+    }
+    Signal& s = Signals[signal];
+    if (s.Known && s.Value == value) {
+        return;
+    }
+    s.Value = value;
+    s.Known = true;
+
+    if (!TimeWritten) {
+        Buffer.push_back('#');
+        WriteNumber(Time);
+        Buffer.push_back('\n');
+        TimeWritten = true;
+    }
+    WriteValue(s);
+
+    if (Buffer.size() >= FLUSH_SIZE) {
+        Flush();
+    }
+}
+
+void VcdWriter::Flush()
+{
+    Out.write(Buffer.data(), Buffer.size());
+    Out.flush();
+    Buffer.clear();
+}
+
+void VcdWriter::Finish()
+{
+    if (!HeaderDone) {
+        WriteHeader();
+    }
+    Flush();
+}
+
+void VcdWriter::HandleTraceEvent(const TraceEvent& event)
+{
+    if (!HeaderDone) {
+        WriteHeader();
+    }
+
+    const uint64_t time = TicksPerSecond > 0 ?
+            static_cast<uint64_t>(event.Timestamp * (1e9 / TicksPerSecond)) :
+            event.Timestamp;
+    if (time != Time) {
+        Time = time;
+        TimeWritten = false;
+    }
+
+    switch (event.Type) {
+    case TraceEvent::TRACE_EVENT_INSTR:
+        Change(PortSignal(event.Code >> 3), event.Value);
+        break;
+    case TraceEvent::TRACE_EVENT_HW: {
+        const uint8_t discriminator = event.Code >> 3;
+        if (ExceptionAnalyzer::IsExceptionEvent(event)) {
+            HandleException(event);
+        }
+        else if ((discriminator & 0x18) == 0x10) { // data trace value
+            Change(WatchSignal((discriminator >> 1) & 0x3), event.Value);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void VcdWriter::HandleException(const TraceEvent& event)
+{
+    const unsigned exception = event.Value & 0x1ff;
+
+    switch ((event.Value >> 12) & 0x3) {
+    case ExceptionAnalyzer::EXC_ENTER:
+        ActiveExceptions.push_back(exception);
+        Change(ExceptionSignal(exception), 1);
+        break;
+    case ExceptionAnalyzer::EXC_EXIT: {
+        size_t i = ActiveExceptions.size();
+        while (i > 0 && ActiveExceptions[i - 1] != exception) {
+            i--;
+        }
+        if (i == 0) {
+            break;
+        }
+        // Handlers above the exiting one lost their exit packet
+        while (ActiveExceptions.size() >= i) {
+            Change(ExceptionSignal(ActiveExceptions.back()), 0);
+            ActiveExceptions.pop_back();
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    Change(CurrentSignal(), ActiveExceptions.empty() ? 0 : ActiveExceptions.back());
+}
+
+} /* namespace lct */
@@ -0,0 +1,81 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "log.h"
+#include "GdbConnectionState.h"
+
+/**
+ * Time parsing and freeing of large MI replies, the way GdbConnection
+ * receives them for block reads and disassembly.
+ */
+class Bench {
+public:
+    Bench() { }
+    virtual ~Bench();
+    int Run();
+    void Measure(const char* name, const std::string& reply, size_t repeat);
+};
+
+Bench::~Bench()
+{
+}
+
+static std::string memoryReply(size_t bytes)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string reply("12^done,memory=[{begin=\"0x20000000\",offset=\"0x00000000\","
+            "end=\"0x20040000\",contents=\"");
+    for (size_t i = 0; i < bytes; i++) {
+        reply += digits[(i * 7) >> 4 & 0xf];
+        reply += digits[(i * 7) & 0xf];
+    }
+    reply += "\"}]\n(gdb) \n";
+    return reply;
+}
+
+static std::string disassembleReply(size_t count)
+{
+    std::string reply("13^done,asm_insns=[");
+    char insn[256];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(insn, sizeof(insn), "%s{address=\"0x%08zx\",func-name=\"main\","
+                "offset=\"%zu\",opcodes=\"4b 03\",inst=\"ldr\\tr3, [pc, #12]\\t"
+                "; (0x%08zx <main+%zu>) \\\"x\\\"\"}",
+                i ? "," : "", 0x08000100 + 2 * i, 2 * i, 0x08000110 + 2 * i, 2 * i + 16);
+        reply += insn;
+    }
+    reply += "]\n(gdb) \n";
+    return reply;
+}
+
+void Bench::Measure(const char* name, const std::string& reply, size_t repeat)
+{
+    std::chrono::steady_clock::duration total(0);
+    for (size_t i = 0; i < repeat; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        MIOutput* output = MIOutputNew();
+        MIParse(const_cast<char*>(reply.c_str()), output);
+        MIOutputFree(output);
+        total += std::chrono::steady_clock::now() - start;
+    }
+    const double us = std::chrono::duration<double, std::micro>(total).count() / repeat;
+    LOG_INFO("%s: %lu bytes in %.1f us, %.1f MB/s", name, reply.size(), us,
+            reply.size() / us);
+}
+
+int Bench::Run()
+{
+    LOG_INFO("Running MI parser benchmark");
+    Measure("read-memory-bytes 4 KB", memoryReply(0x1000), 2000);
+    Measure("read-memory-bytes 256 KB", memoryReply(0x40000), 100);
+    Measure("disassemble 100 insns", disassembleReply(100), 2000);
+    Measure("disassemble 20000 insns", disassembleReply(20000), 20);
+    return 0;
+}
+
+int main()
+{
+    Bench b;
+    return b.Run();
+}
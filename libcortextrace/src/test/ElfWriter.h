@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * Helper for the tests: writes a minimal 32-bit little-endian ELF file with
+ * the given sections. Section 0 is the null section and the last section is
+ * always .shstrtab.
+ */
+class ElfWriter {
+public:
+    ElfWriter() : Sections() { }
+
+    static void Put16(std::vector<uint8_t>& v, size_t pos, uint16_t x)
+    {
+        v[pos] = x;
+        v[pos + 1] = x >> 8;
+    }
+
+    static void Put32(std::vector<uint8_t>& v, size_t pos, uint32_t x)
+    {
+        Put16(v, pos, x);
+        Put16(v, pos + 2, x >> 16);
+    }
+
+    /// @return Index of the new section
+    size_t AddSection(std::string name, uint32_t type, const void* data,
+            size_t len, uint32_t link = 0, uint32_t entsize = 0)
+    {
+        Section s;
+        s.Name = name;
+        s.Type = type;
+        s.Data.assign(static_cast<const uint8_t*>(data),
+                static_cast<const uint8_t*>(data) + len);
+        s.Link = link;
+        s.EntrySize = entsize;
+        Sections.push_back(s);
+        return Sections.size();
+    }
+
+    bool Write(std::string path)
+    {
+        std::vector<Section> all(Sections);
+        Section shstr;
+        shstr.Name = ".shstrtab";
+        shstr.Type = 3;
+        all.push_back(shstr);
+
+        std::vector<uint8_t> shstrtab(1, 0);
+        std::vector<uint32_t> nameoff;
+        for (const Section& s : all) {
+            nameoff.push_back(shstrtab.size());
+            shstrtab.insert(shstrtab.end(), s.Name.begin(), s.Name.end());
+            shstrtab.push_back(0);
+        }
+        all.back().Data = shstrtab;
+
+        std::vector<uint8_t> elf(52);
+        const uint8_t ident[] = { 0x7f, 'E', 'L', 'F', 1, 1, 1 };
+        memcpy(&elf[0], ident, sizeof(ident));
+
+        std::vector<uint32_t> offsets;
+        for (const Section& s : all) {
+            while (elf.size() % 4) {
+                elf.push_back(0);
+            }
+            offsets.push_back(elf.size());
+            elf.insert(elf.end(), s.Data.begin(), s.Data.end());
+        }
+        while (elf.size() % 4) {
+            elf.push_back(0);
+        }
+
+        const size_t shoff = elf.size();
+        const size_t shnum = all.size() + 1;
+        elf.resize(shoff + shnum * 40);
+        Put32(elf, 32, shoff);
+        Put16(elf, 46, 40);
+        Put16(elf, 48, shnum);
+        Put16(elf, 50, shnum - 1);
+
+        for (size_t i = 0; i < all.size(); i++) {
+            const size_t p = shoff + (i + 1) * 40;
+            Put32(elf, p, nameoff[i]);
+            Put32(elf, p + 4, all[i].Type);
+            Put32(elf, p + 16, offsets[i]);
+            Put32(elf, p + 20, all[i].Data.size());
+            Put32(elf, p + 24, all[i].Link);
+            Put32(elf, p + 36, all[i].EntrySize);
+        }
+
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f) {
+            return false;
+        }
+        const bool ok = fwrite(&elf[0], 1, elf.size(), f) == elf.size();
+        fclose(f);
+        return ok;
+    }
+
+protected:
+    struct Section {
+        Section() : Name(), Type(0), Data(), Link(0), EntrySize(0) { }
+        std::string Name;
+        uint32_t Type;
+        std::vector<uint8_t> Data;
+        uint32_t Link;
+        uint32_t EntrySize;
+    };
+
+    std::vector<Section> Sections;
+};
@@ -0,0 +1,194 @@
+/*
+ * Stand-in for GDB in MI mode, for testing GdbConnection without a target.
+ * Memory reads and writes go to a simulated memory, where addresses from
+ * 0xf0000000 up cannot be accessed.
+ *
+ * Commands that arrive together are answered in reverse order, to check
+ * that replies are matched by their tokens. The expression $batch
+ * evaluates to the largest number of commands received together so far.
+ */
+#include <poll.h>
+#include <unistd.h>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::map<uint32_t, uint8_t> memory;
+static size_t maxBatch = 0;
+
+static bool accessible(uint32_t address, size_t count)
+{
+    return address < 0xf0000000 && count <= 0xf0000000 - address;
+}
+
+static std::string hexByte(uint8_t byte)
+{
+    char s[3];
+    snprintf(s, sizeof(s), "%02x", byte);
+    return s;
+}
+
+static std::string hexAddress(uint32_t address)
+{
+    char s[16];
+    snprintf(s, sizeof(s), "0x%08x", address);
+    return s;
+}
+
+static std::string error(const std::string& msg)
+{
+    return "^error,msg=\"" + msg + "\"";
+}
+
+static std::string readMemoryBytes(const std::vector<std::string>& args)
+{
+    if (args.size() != 2) {
+        return error("Usage: ADDR COUNT");
+    }
+    const uint32_t address = strtoul(args[0].c_str(), NULL, 0);
+    const size_t count = strtoul(args[1].c_str(), NULL, 0);
+    if (!accessible(address, count)) {
+        return error("Unable to read memory.");
+    }
+    std::string contents;
+    for (size_t i = 0; i < count; i++) {
+        contents += hexByte(memory[address + i]);
+    }
+    return "^done,memory=[{begin=\"" + hexAddress(address) +
+            "\",offset=\"0x0000000000000000\",end=\"" + hexAddress(address + count) +
+            "\",contents=\"" + contents + "\"}]";
+}
+
+static std::string writeMemoryBytes(const std::vector<std::string>& args)
+{
+    if (args.size() != 2 || args[1].size() % 2) {
+        return error("Usage: ADDR DATA");
+    }
+    const uint32_t address = strtoul(args[0].c_str(), NULL, 0);
+    const size_t count = args[1].size() / 2;
+    if (!accessible(address, count)) {
+        return error("Cannot access memory at address " + hexAddress(address));
+    }
+    for (size_t i = 0; i < count; i++) {
+        memory[address + i] = strtoul(args[1].substr(2 * i, 2).c_str(), NULL, 16);
+    }
+    return "^done";
+}
+
+static std::string evaluate(const std::vector<std::string>& args)
+{
+    if (args.size() != 1) {
+        return error("Usage: EXPR");
+    }
+    if (args[0] == "$batch") {
+        return "^done,value=\"" + std::to_string(maxBatch) + "\"";
+    }
+    if (args[0].compare(0, 7, "sizeof(") == 0) {
+        return "^done,value=\"4\"";
+    }
+    return error("No symbol in current context.");
+}
+
+/** Symbols are all at the start of RAM */
+static std::string readMemory(const std::vector<std::string>& args)
+{
+    if (args.empty() || args[0].compare(0, 2, "&(") != 0) {
+        return error("No symbol in current context.");
+    }
+    const uint32_t address = 0x20000000;
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        value |= memory[address + i] << (8 * i);
+    }
+    return "^done,addr=\"" + hexAddress(address) +
+            "\",nr-bytes=\"4\",total-bytes=\"4\",memory=[{addr=\"" + hexAddress(address) +
+            "\",data=[\"" + std::to_string(value) + "\"]}]";
+}
+
+static std::string execute(const std::string& line)
+{
+    // Split off the token
+    size_t pos = 0;
+    while (pos < line.size() && isdigit(line[pos])) {
+        pos++;
+    }
+    const std::string token = line.substr(0, pos);
+
+    std::istringstream in(line.substr(pos));
+    std::string command;
+    in >> command;
+    std::vector<std::string> args;
+    for (std::string arg; in >> arg;) {
+        args.push_back(arg);
+    }
+
+    std::string reply;
+    if (command == "-data-read-memory-bytes") {
+        reply = readMemoryBytes(args);
+    }
+    else if (command == "-data-write-memory-bytes") {
+        reply = writeMemoryBytes(args);
+    }
+    else if (command == "-data-evaluate-expression") {
+        reply = evaluate(args);
+    }
+    else if (command == "-data-read-memory") {
+        reply = readMemory(args);
+    }
+    else if (command == "-gdb-set") {
+        reply = "^done";
+    }
+    else if (command == "-target-select") {
+        reply = "^connected";
+    }
+    else if (command == "-gdb-exit") {
+        printf("%s^exit\n", token.c_str());
+        fflush(stdout);
+        exit(0);
+    }
+    else {
+        reply = error("Undefined MI command: " + command.substr(1));
+    }
+    return token + reply + "\n(gdb) \n";
+}
+
+int main()
+{
+    printf("(gdb) \n");
+    fflush(stdout);
+
+    std::string input;
+    char buf[4096];
+    for (;;) {
+        ssize_t n = read(0, buf, sizeof(buf));
+        if (n <= 0) {
+            return 0;
+        }
+        input.append(buf, n);
+
+        // Give pipelined commands a moment to arrive together
+        pollfd pfd = { 0, POLLIN, 0 };
+        while (poll(&pfd, 1, 10) > 0 && (n = read(0, buf, sizeof(buf))) > 0) {
+            input.append(buf, n);
+        }
+
+        std::vector<std::string> replies;
+        size_t end;
+        while ((end = input.find('\n')) != std::string::npos) {
+            replies.push_back(execute(input.substr(0, end)));
+            input.erase(0, end + 1);
+        }
+        if (replies.size() > maxBatch) {
+            maxBatch = replies.size();
+        }
+        for (auto it = replies.rbegin(); it != replies.rend(); ++it) {
+            fputs(it->c_str(), stdout);
+        }
+        fflush(stdout);
+    }
+}
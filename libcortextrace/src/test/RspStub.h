@@ -0,0 +1,208 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "RspConnection.h"
+
+/**
+ * Helper for the tests: a stand-in for the gdbserver of OpenOCD, listening
+ * on a loopback port and serving one client from a thread. Memory from
+ * 0xf0000000 up cannot be accessed. "monitor hang" is never answered. In ack mode, every Nth
+ * packet received is rejected and every Nth one sent is garbled, if a
+ * fault interval N is given.
+ */
+class RspStub {
+public:
+    RspStub(size_t packetSize, bool noAck, size_t faults = 0) :
+        PacketSize(packetSize), NoAck(noAck), Acks(true), Faults(faults), Listen(-1),
+        Port(0), Thread(), Memory(), Last(), Received(0), Sent(0), MaxBatch(0),
+        Packets(0), Naks(0), Garbled(0) { }
+
+    virtual ~RspStub()
+    {
+        if (Thread.joinable()) {
+            Thread.join();
+        }
+        if (Listen != -1) {
+            close(Listen);
+        }
+    }
+
+    bool Start()
+    {
+        Listen = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = sockaddr_in();
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (Listen == -1 || bind(Listen, (sockaddr*)&addr, len) != 0 ||
+                listen(Listen, 1) != 0 || getsockname(Listen, (sockaddr*)&addr, &len) != 0) {
+            return false;
+        }
+        Port = ntohs(addr.sin_port);
+        Thread = std::thread(&RspStub::Serve, this);
+        return true;
+    }
+
+    void Serve()
+    {
+        const int client = accept(Listen, NULL, NULL);
+        const int one = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::string input;
+        char buf[0x10000];
+        ssize_t n;
+        while ((n = recv(client, buf, sizeof(buf), 0)) > 0) {
+            input.append(buf, n);
+            std::string packet;
+            bool valid = false;
+            std::string acks;
+            size_t batch = 0;
+            while (lct::RspConnection::Unframe(input, &packet, &valid, &acks)) {
+                Received++;
+                if (Acks && (!valid || (Faults && Received % Faults == 0))) {
+                    Naks++;
+                    send(client, "-", 1, 0);
+                    continue;
+                }
+                batch++;
+                Packets++;
+                if (Acks) {
+                    send(client, "+", 1, 0);
+                }
+                const std::string reply = Reply(packet, client);
+                if (packet != "qRcmd,68616e67") {
+                    Send(client, reply);
+                }
+                if (packet == "QStartNoAckMode") {
+                    Acks = false;
+                }
+            }
+            if (Acks && acks.find('-') != std::string::npos) {
+                send(client, Last.data(), Last.size(), 0);
+            }
+            MaxBatch = std::max(MaxBatch, batch);
+        }
+        close(client);
+    }
+
+    /**
+     * Send a reply, with runs of the same character run-length encoded.
+     */
+    void Send(int client, const std::string& payload)
+    {
+        std::string encoded;
+        for (size_t i = 0; i < payload.size(); ) {
+            size_t run = 1;
+            while (i + run < payload.size() && payload[i + run] == payload[i] && run < 98) {
+                run++;
+            }
+            // Counts that would be '#' or '$' are not allowed
+            if (run >= 4 && run != 7 && run != 8) {
+                encoded += payload[i];
+                encoded += '*';
+                encoded += char(run - 1 + 29);
+                i += run;
+            }
+            else {
+                encoded += payload[i++];
+            }
+        }
+        // The checksum covers the encoded payload, so Frame() can be used
+        Last = lct::RspConnection::Frame(encoded);
+        std::string packet = Last;
+        if (Acks && Faults && ++Sent % Faults == 0) {
+            Garbled++;
+            packet[packet.size() - 1] ^= 1;
+        }
+        send(client, packet.data(), packet.size(), 0);
+    }
+
+    static std::string Hex(const std::string& s)
+    {
+        std::string h;
+        char d[4];
+        for (unsigned char c : s) {
+            snprintf(d, sizeof(d), "%02x", c);
+            h += d;
+        }
+        return h;
+    }
+
+    std::string Reply(const std::string& packet, int client)
+    {
+        if (packet.compare(0, 10, "qSupported") == 0) {
+            char reply[64];
+            snprintf(reply, sizeof(reply), "PacketSize=%lx%s", PacketSize,
+                    NoAck ? ";QStartNoAckMode+" : "");
+            return reply;
+        }
+        if (packet == "QStartNoAckMode") {
+            return "OK";
+        }
+        if (packet[0] == 'm' || packet[0] == 'X') {
+            char* end = NULL;
+            const uint32_t address = strtoul(packet.c_str() + 1, &end, 16);
+            const size_t length = strtoul(end + 1, &end, 16);
+            if (address >= 0xf0000000 || packet.size() > PacketSize) {
+                return "E01";
+            }
+            if (packet[0] == 'm') {
+                std::string reply;
+                for (size_t i = 0; i < length; i++) {
+                    char d[4];
+                    snprintf(d, sizeof(d), "%02x", Memory[address + i]);
+                    reply += d;
+                }
+                return reply;
+            }
+            std::string data;
+            for (const char* p = end + 1; p < packet.c_str() + packet.size(); p++) {
+                data += *p == '}' ? *++p ^ 0x20 : *p;
+            }
+            if (data.size() != length) {
+                return "E02";
+            }
+            for (size_t i = 0; i < length; i++) {
+                Memory[address + i] = data[i];
+            }
+            return "OK";
+        }
+        if (packet == "qRcmd," + Hex("tpiu config disable")) {
+            Send(client, "O" + Hex("Trace "));
+            Send(client, "O" + Hex("disabled\n"));
+            return "OK";
+        }
+        if (packet.compare(0, 6, "qRcmd,") == 0) {
+            return "E01";
+        }
+        return "";
+    }
+
+    size_t PacketSize;
+    bool NoAck;
+    bool Acks;
+    size_t Faults;
+    int Listen;
+    uint16_t Port;
+    std::thread Thread;
+    std::map<uint32_t, uint8_t> Memory;
+    std::string Last;   ///< Packet sent last, to send again when asked
+    size_t Received;
+    size_t Sent;
+    size_t MaxBatch;    ///< Most packets received in one read
+    size_t Packets;     ///< Packets accepted
+    size_t Naks;
+    size_t Garbled;
+};
@@ -0,0 +1,84 @@
+#include <cmath>
+
+#include "log.h"
+#include "DwtCounters.h"
+#include "Registers.h"
+#include "TraceEvent.h"
+
+class Test {
+public:
+    Test() : Counters() { }
+    virtual ~Test();
+    int Run();
+
+protected:
+    lct::DwtCounters Counters;
+
+    void Counter(uint8_t bits, uint64_t time);
+};
+
+Test::~Test()
+{
+}
+
+void Test::Counter(uint8_t bits, uint64_t time)
+{
+    // Hardware source packet, discriminator 0, 1 byte payload
+    lct::TraceEvent e(lct::TraceEvent::TRACE_EVENT_HW, 0x05, bits, time);
+    Counters.HandleTraceEvent(e);
+}
+
+static bool near(double a, double b)
+{
+    return std::fabs(a - b) < 1e-9;
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running DwtCounters test");
+    bool ok = true;
+
+    lct::Registers regs;
+    const uint32_t ctrl = regs.DWT_CTRL_CYCTAP | (3 << regs.DWT_CTRL_POSTPRESET_SHIFT);
+    ok &= lct::DwtCounters::CycleEventPeriod(ctrl) == 4096;
+    ok &= lct::DwtCounters::CycleEventPeriod(0) == 64;
+    Counters.SetCycleEventPeriod(1024);
+
+    // Rates from timestamps when there are no cycle events. The overflow in
+    // the first packet is counted even though it happened before it.
+    Counter(0x01, 0);
+    Counter(0x01 | 0x04, 1024);
+    Counter(0x08, 2048);
+    lct::DwtCounters::Rates r = Counters.TakeWindow();
+    ok &= r.Cycles == 2048;
+    ok &= near(r.CpiOverhead, 512.0 / 2048) && near(r.SleepFraction, 256.0 / 2048);
+    ok &= near(r.LsuStall, 256.0 / 2048) && near(r.ExcOverhead, 0);
+
+    // Cycle events take precedence
+    Counter(0x20 | 0x02, 5000);
+    Counter(0x20 | 0x10, 6000);
+    r = Counters.TakeWindow();
+    ok &= r.Cycles == 2048;
+    ok &= near(r.ExcOverhead, 256.0 / 2048) && near(r.Folded, 256.0 / 2048);
+    ok &= near(r.CpiOverhead, 0);
+
+    const lct::DwtCounters::Totals& t = Counters.GetTotals();
+    ok &= t.Events[lct::DwtCounters::CPI] == 512;
+    ok &= t.Events[lct::DwtCounters::CYC] == 2048;
+
+    // Other hardware packets are ignored
+    lct::TraceEvent pc(lct::TraceEvent::TRACE_EVENT_HW, 0x17, 0xff, 7000);
+    Counters.HandleTraceEvent(pc);
+    ok &= Counters.GetTotals().Timestamp == 6000;
+
+    if (!ok) {
+        LOG_ERROR("Unexpected counter totals or rates");
+    }
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
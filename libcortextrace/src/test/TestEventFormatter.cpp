@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "log.h"
+#include "EventFormatter.h"
+#include "OutputSink.h"
+#include "TraceEvent.h"
+
+class StringSink : public lct::OutputSink {
+public:
+    StringSink(unsigned flushIntervalMs = 100) :
+        lct::OutputSink(64, flushIntervalMs), Data(), Drains(0), Accept(~0UL), Broken(false) { }
+    virtual ~StringSink();
+    std::string Data;
+    unsigned Drains;
+    size_t Accept;      ///< Bytes taken before the sink would block
+    bool Broken;
+
+protected:
+    ssize_t Drain(const char* data, size_t len)
+    {
+        if (Broken) {
+            return -1;
+        }
+        len = std::min(len, Accept);
+        Data.append(data, len);
+        Accept -= len;
+        Drains++;
+        return len;
+    }
+    void Wait()
+    {
+        Accept = ~0UL;
+    }
+};
+
+StringSink::~StringSink()
+{
+}
+
+class Test {
+public:
+    Test() { }
+    virtual ~Test();
+    int Run();
+};
+
+Test::~Test()
+{
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running EventFormatter test");
+    bool ok = true;
+
+    const lct::TraceEvent pc(lct::TraceEvent::TRACE_EVENT_HW, 0x17, 0x8000abc, 1234);
+    const lct::TraceEvent exception(lct::TraceEvent::TRACE_EVENT_HW, 0x0e, 0x1000 | 15, 99);
+    const lct::TraceEvent instr(lct::TraceEvent::TRACE_EVENT_INSTR, 0x09, 'A', 5);
+    lct::EventFormatter::Location location;
+    location.Symbol = "main";
+    location.Offset = 0x1c;
+    location.File = "a \"b\".c";
+    location.Line = 42;
+
+    // Number formatting, and flushing when the small buffer fills up
+    {
+        StringSink sink;
+        for (unsigned i = 0; i < 20; i++) {
+            sink.Decimal(18446744073709551615ULL);
+            sink.Put(' ');
+            sink.Hex(0);
+            sink.Put(' ');
+        }
+        ok &= sink.Drains > 0;
+        sink.Flush();
+        ok &= sink.Data.size() == 20 * 23;
+        ok &= sink.Data.compare(0, 23, "18446744073709551615 0 ") == 0;
+        if (!ok) {
+            LOG_ERROR("Unexpected number formatting: %s", sink.Data.c_str());
+        }
+    }
+
+    // A sink that would block keeps the rest for later, only an error stops
+    // the output
+    {
+        StringSink sink(0);
+        sink.Accept = 3;
+        sink.Write("abcdef");
+        bool good = sink.Tick() && sink.Data == "abc";
+        good &= sink.Tick() && sink.Data == "abc";
+        sink.Write("gh");
+        good &= sink.Flush() && sink.Data == "abcdefgh";
+        sink.Broken = true;
+        sink.Write("ij");
+        good &= !sink.Tick() && !sink.Flush();
+        sink.Broken = false;
+        sink.Write("kl");
+        good &= !sink.Flush() && sink.Data == "abcdefgh";
+        if (!good) {
+            LOG_ERROR("Unexpected output after blocking: %s", sink.Data.c_str());
+        }
+        ok &= good;
+    }
+
+    {
+        StringSink sink;
+        std::unique_ptr<lct::EventFormatter> f(lct::EventFormatter::Create("text", sink));
+        f->Format(pc, &location);
+        f->Format(exception);
+        f->Format(instr);
+        f->SetSource(1, "board1");
+        f->Format(exception);
+        sink.Flush();
+        const bool good = sink.Data ==
+                "PC: 8000abc main+0x1c a \"b\".c:42\n"
+                "Exception enter SysTick @99\n"
+                "AException enter SysTick @99\n";
+        if (!good) {
+            LOG_ERROR("Unexpected text output: %s", sink.Data.c_str());
+        }
+        ok &= good;
+    }
+
+    {
+        StringSink sink;
+        std::unique_ptr<lct::EventFormatter> f(lct::EventFormatter::Create("json", sink));
+        f->Format(pc, &location);
+        f->Format(exception);
+        sink.Flush();
+        const bool good = sink.Data ==
+                "{\"time\":1234,\"type\":\"hw\",\"code\":23,\"value\":134220476,"
+                "\"symbol\":\"main\",\"offset\":28,\"file\":\"a \\\"b\\\".c\",\"line\":42}\n"
+                "{\"time\":99,\"type\":\"hw\",\"code\":14,\"value\":4111,"
+                "\"exception\":\"SysTick\",\"function\":\"enter\"}\n";
+        if (!good) {
+            LOG_ERROR("Unexpected JSON output: %s", sink.Data.c_str());
+        }
+        ok &= good;
+    }
+
+    {
+        StringSink sink;
+        std::unique_ptr<lct::EventFormatter> f(lct::EventFormatter::Create("binary", sink));
+        f->Format(pc, &location);
+        sink.Flush();
+        const std::string expected("\xd2\x04\0\0\0\0\0\0\xbc\x0a\0\x08\x01\x17\0\0", 16);
+        if (sink.Data != expected) {
+            LOG_ERROR("Unexpected binary output");
+            ok = false;
+        }
+    }
+
+    {
+        StringSink sink;
+        ok &= lct::EventFormatter::Create("xml", sink) == NULL;
+    }
+
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
@@ -0,0 +1,91 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+
+#include "log.h"
+#include "EventLoop.h"
+#include "TracePipe.h"
+
+class Reader : public lct::EventLoop::Handler {
+public:
+    Reader(int fd) : Fd(fd), Data() { }
+    virtual ~Reader();
+    void HandleEvents(uint32_t events);
+
+    int Fd;
+    std::string Data;
+};
+
+Reader::~Reader()
+{
+}
+
+void Reader::HandleEvents(uint32_t)
+{
+    char buf[64];
+    ssize_t res;
+    while ((res = read(Fd, buf, sizeof(buf))) > 0) {
+        Data.append(buf, res);
+    }
+}
+
+class Test {
+public:
+    Test() { }
+    virtual ~Test();
+    int Run();
+};
+
+Test::~Test()
+{
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running EventLoop test");
+    bool ok = true;
+
+    lct::TracePipe a;
+    lct::TracePipe b;
+    ok &= a.Create() && b.Create();
+    ok &= a.GetName() != b.GetName();
+    if (!ok) {
+        LOG_ERROR("Failed to create pipes");
+        return 1;
+    }
+
+    lct::EventLoop loop;
+    Reader ra(a.GetFd());
+    Reader rb(b.GetFd());
+    ok &= loop.Add(a.GetFd(), &ra) && loop.Add(b.GetFd(), &rb);
+
+    // Nothing to read, and no hang-up without a writer
+    ok &= loop.Poll(0) == 0;
+
+    // A writer coming and going, like OpenOCD does
+    int fd = open(b.GetName().c_str(), O_WRONLY);
+    ok &= fd != -1 && write(fd, "hello", 5) == 5;
+    close(fd);
+    ok &= loop.Poll(100) == 1;
+    ok &= ra.Data.empty() && rb.Data == "hello";
+    ok &= loop.Poll(0) == 0;
+
+    ok &= loop.Remove(b.GetFd());
+    const std::string name = b.GetName();
+    b.Close();
+    struct stat st;
+    ok &= stat(name.c_str(), &st) != 0;
+
+    if (!ok) {
+        LOG_ERROR("Unexpected event loop behaviour");
+    }
+
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
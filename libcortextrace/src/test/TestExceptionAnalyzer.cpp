@@ -0,0 +1,109 @@
+#include "log.h"
+#include "ExceptionAnalyzer.h"
+#include "Histogram.h"
+#include "TraceEvent.h"
+
+class Test {
+public:
+    Test() : Analyzer() { }
+    virtual ~Test();
+    int Run();
+
+protected:
+    lct::ExceptionAnalyzer Analyzer;
+
+    void Exception(unsigned function, unsigned exception, uint64_t time);
+    bool Expect(unsigned exception, uint64_t count, uint64_t maxDuration,
+            uint64_t maxLatency, uint64_t selfTime);
+};
+
+Test::~Test()
+{
+}
+
+void Test::Exception(unsigned function, unsigned exception, uint64_t time)
+{
+    // Hardware source packet, discriminator 1, 2 byte payload
+    lct::TraceEvent e(lct::TraceEvent::TRACE_EVENT_HW, 0x0e,
+            (function << 12) | exception, time);
+    Analyzer.HandleTraceEvent(e);
+}
+
+bool Test::Expect(unsigned exception, uint64_t count, uint64_t maxDuration,
+        uint64_t maxLatency, uint64_t selfTime)
+{
+    auto it = Analyzer.GetStats().find(exception);
+    if (it == Analyzer.GetStats().end()) {
+        LOG_ERROR("No statistics for exception %u", exception);
+        return false;
+    }
+    const lct::ExceptionAnalyzer::Stats& s = it->second;
+    if (s.Count != count || s.Duration.Max() != maxDuration ||
+            s.Latency.Max() != maxLatency || s.SelfTime != selfTime) {
+        LOG_ERROR("Exception %u: count %lu, max %lu, latency %lu, self %lu", exception,
+                s.Count, s.Duration.Max(), s.Latency.Max(), s.SelfTime);
+        return false;
+    }
+    return true;
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running ExceptionAnalyzer test");
+    bool ok = true;
+
+    // Histogram precision: values below 64 are exact, above that within 1/32
+    {
+        lct::Histogram h;
+        for (uint64_t v = 1; v <= 1000; v++) {
+            h.Record(v);
+        }
+        ok &= h.Count() == 1000 && h.Min() == 1 && h.Max() == 1000;
+        ok &= h.Percentile(5) == 50;
+        const uint64_t p99 = h.Percentile(99);
+        ok &= p99 >= 990 && p99 <= 990 + 990 / 32;
+        ok &= h.Percentile(100) == 1000;
+        if (!ok) {
+            LOG_ERROR("Histogram p5 %lu p99 %lu", h.Percentile(5), p99);
+        }
+    }
+
+    using lct::ExceptionAnalyzer;
+
+    // SysTick runs, gets preempted by IRQ0, which tail-chains into IRQ1
+    Exception(ExceptionAnalyzer::EXC_ENTER, 15, 100);
+    Exception(ExceptionAnalyzer::EXC_ENTER, 16, 110);
+    Exception(ExceptionAnalyzer::EXC_EXIT, 16, 130);
+    Exception(ExceptionAnalyzer::EXC_ENTER, 17, 135);
+    Exception(ExceptionAnalyzer::EXC_EXIT, 17, 140);
+    Exception(ExceptionAnalyzer::EXC_RETURN, 15, 141);
+    ok &= Analyzer.CurrentException() == 15;
+    Exception(ExceptionAnalyzer::EXC_EXIT, 15, 150);
+    Exception(ExceptionAnalyzer::EXC_RETURN, 0, 151);
+    ok &= Analyzer.CurrentException() == 0;
+
+    // Second, undisturbed SysTick
+    Exception(ExceptionAnalyzer::EXC_ENTER, 15, 200);
+    Exception(ExceptionAnalyzer::EXC_EXIT, 15, 210);
+    Exception(ExceptionAnalyzer::EXC_RETURN, 0, 211);
+
+    ok &= Expect(15, 2, 50, 25, 25 + 10);
+    ok &= Expect(16, 1, 20, 0, 20);
+    ok &= Expect(17, 1, 5, 0, 5);
+    ok &= Analyzer.GetStats().at(15).Preempted == 1;
+    ok &= Analyzer.GetStats().at(17).TailChained == 1;
+
+    // Lost exit packet for IRQ2 is recovered from the return packet
+    Exception(ExceptionAnalyzer::EXC_ENTER, 15, 300);
+    Exception(ExceptionAnalyzer::EXC_ENTER, 18, 310);
+    Exception(ExceptionAnalyzer::EXC_RETURN, 15, 320);
+    ok &= Analyzer.CurrentException() == 15;
+
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
@@ -0,0 +1,188 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "log.h"
+#include "GdbConnection.h"
+
+class Test {
+public:
+    Test(const std::string& gdb) : Gdb(gdb) { }
+    virtual ~Test();
+    int Run();
+
+    std::string Gdb;
+};
+
+Test::~Test()
+{
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running GdbConnection test");
+    bool ok = true;
+
+    lct::GdbConnection gdb;
+    gdb.Connect(Gdb, "");
+
+    // Synchronous access
+    ok &= gdb.WriteWord(0x20000000, 0x12345678);
+    uint32_t word = 0;
+    ok &= gdb.ReadWord(0x20000000, &word) && word == 0x12345678;
+    ok &= !gdb.ReadWord(0xf0000000, &word) && word == 0x12345678;
+    ok &= gdb.ResolveAddress("&(x)") == 0x20000000;
+    if (!ok) {
+        LOG_ERROR("Synchronous access failed");
+        return 1;
+    }
+
+    // Pipelined writes, then reads of the same words
+    const size_t count = 32;
+    size_t written = 0;
+    for (size_t i = 0; i < count; i++) {
+        gdb.WriteWordAsync(0x20001000 + 4 * i, 0x1000 + i, [&written](bool res) {
+            written += res;
+        });
+    }
+    std::vector<lct::GdbFuture<uint32_t> > reads;
+    size_t correct = 0;
+    for (size_t i = 0; i < count; i++) {
+        reads.push_back(gdb.ReadWordAsync(0x20001000 + 4 * i,
+                [&correct, i](bool res, uint32_t value) {
+            correct += res && value == 0x1000 + i;
+        }));
+    }
+    gdb.WaitAll();
+    ok &= written == count && correct == count;
+    for (size_t i = 0; i < count; i++) {
+        ok &= reads[i].Ready() && reads[i].Wait() && reads[i].Get() == 0x1000 + i;
+    }
+    if (!ok) {
+        LOG_ERROR("Pipelined access failed: %lu written, %lu read back", written, correct);
+        return 1;
+    }
+
+    // The replies were matched even though GDB got several commands at once
+    const std::string batch = gdb.Evaluate("$batch");
+    ok &= !batch.empty() && std::stoul(batch) > 1;
+    if (!ok) {
+        LOG_ERROR("Commands were not pipelined, largest batch %s", batch.c_str());
+        return 1;
+    }
+
+    // Failures are reported to the future and the callback alike
+    bool failed = false;
+    auto bad = gdb.ReadWordAsync(0xf0000000, [&failed](bool res, uint32_t) {
+        failed = !res;
+    });
+    ok &= !bad.Wait() && failed;
+    ok &= !gdb.WriteWordAsync(0xf0000000, 0).Wait();
+
+    // Futures of other types
+    auto size = gdb.EvaluateAsync("sizeof(x)");
+    auto addr = gdb.ResolveAddressAsync("&(x)");
+    auto unknown = gdb.EvaluateAsync("y");
+    ok &= size.Get() == "4" && addr.Get() == 0x20000000;
+    ok &= !unknown.Wait() && unknown.Get().empty();
+    if (!ok) {
+        LOG_ERROR("Futures failed");
+        return 1;
+    }
+
+    uint32_t block[count];
+    ok &= gdb.ReadArray(0x20001000, block, count);
+    for (size_t i = 0; i < count; i++) {
+        ok &= block[i] == 0x1000 + i;
+    }
+    ok &= !gdb.ReadArray(0xeffffff0, block, count);
+
+    // The hex reply is decoded in memory order, also when unaligned
+    uint8_t bytes[6] = {};
+    const uint8_t expected[6] = { 0x00, 0x01, 0x10, 0x00, 0x00, 0x02 };
+    ok &= gdb.ReadBlock(0x20001003, bytes, sizeof(bytes));
+    ok &= memcmp(bytes, expected, sizeof(bytes)) == 0;
+    struct { uint32_t First; uint16_t Second; } object = { 0, 0 };
+    ok &= gdb.ReadObject(0x20001004, &object) && object.First == 0x1001 && object.Second == 0x1002;
+
+    // Empty blocks need no command, too large and unreadable ones fail
+    ok &= gdb.ReadBlock(0xf0000000, bytes, 0);
+    ok &= !gdb.ReadBlock(0x20001000, bytes, 0x80000000UL);
+    ok &= !gdb.ReadBlock(0xf0000000, bytes, 1);
+    ok &= !gdb.ReadBlock(0xeffffffe, bytes, 4);
+
+    // Blocks that cannot be read with one command are done without GDB
+    bool tooLarge = true;
+    auto none = gdb.ReadBlockAsync(0x20001000, block, 0);
+    auto huge = gdb.ReadBlockAsync(0x20001000, block, 0x80000000UL,
+            [&tooLarge](bool res) { tooLarge = res; });
+    ok &= none.Ready() && none.Wait() && huge.Ready() && !huge.Wait() && !tooLarge;
+
+    // Commands stay below the pipe size, but the reply to the read is larger
+    // and arrives over several reads
+    std::vector<uint32_t> large(0x8000);
+    for (size_t i = 0; i < large.size(); i++) {
+        large[i] = i * 0x9e3779b9;
+    }
+    for (size_t i = 0; i < large.size(); i += 0x1000) {
+        ok &= gdb.WriteBlock(0x20010000 + i * 4, &large[i], 0x4000);
+    }
+    std::vector<uint32_t> readBack(large.size());
+    ok &= gdb.ReadArray(0x20010000, readBack.data(), readBack.size());
+    ok &= readBack == large;
+
+    if (!ok) {
+        LOG_ERROR("Block reads failed");
+        return 1;
+    }
+
+    // Every command has been timed, including the failed ones
+    const std::vector<lct::GdbCommandStats> stats = gdb.CommandStats();
+    const lct::GdbCommandStats* writes = NULL;
+    const lct::GdbCommandStats* blockReads = NULL;
+    uint64_t failures = 0;
+    for (const lct::GdbCommandStats& s : stats) {
+        if (s.Type == "-data-write-memory-bytes") {
+            writes = &s;
+        }
+        if (s.Type == "-data-read-memory-bytes") {
+            blockReads = &s;
+        }
+        failures += s.Failures;
+    }
+    ok &= writes && writes->LatencyUs.Count() >= count + 8 &&
+            writes->MemoryBytes >= large.size() * 4 && writes->BytesSent > writes->MemoryBytes * 2;
+    ok &= writes && writes->BytesReceived < writes->BytesSent;
+    ok &= blockReads && blockReads->BytesReceived > blockReads->MemoryBytes * 2 &&
+            blockReads->BytesSent < blockReads->MemoryBytes;
+    ok &= failures >= 4;
+    gdb.ResetCommandStats();
+    ok &= gdb.CommandStats().empty();
+    if (!ok) {
+        LOG_ERROR("Command statistics are wrong");
+        gdb.ReportCommandStats(std::cout);
+        return 1;
+    }
+
+    // Commands fail rather than wait forever when GDB is gone, and writing
+    // to it does not raise SIGPIPE
+    lct::GdbConnection dead;
+    dead.Connect(Gdb + "-missing", "");
+    ok &= !dead.WriteWord(0x20000000, 0) && !dead.ReadWordAsync(0x20000000).Wait();
+    if (!ok) {
+        LOG_ERROR("Commands succeeded without GDB");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int, char* argv[])
+{
+    // The fake GDB is built next to the test
+    std::string dir(argv[0]);
+    dir = dir.substr(0, dir.find_last_of('/') + 1);
+    Test t(dir + "fakegdb");
+    return t.Run();
+}
@@ -0,0 +1,126 @@
+#include <string>
+
+#include "log.h"
+#include "GdbConnectionState.h"
+
+class Test {
+public:
+    Test() { }
+    virtual ~Test();
+    int Run();
+};
+
+Test::~Test()
+{
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running GdbResult test");
+    bool ok = true;
+
+    char reply[] = "12^done,value=\"42\",empty=[],"
+            "memory=[{begin=\"0x20000000\",contents=\"0102\"},{begin=\"0x20000010\",contents=\"03\"}],"
+            "stack=[frame={level=\"0\",func=\"main\"},frame={level=\"1\",func=\"start\"}],"
+            "data=[\"7\",\"8\",\"9\"]\n(gdb) \n";
+    MIOutput* output = MIOutputNew();
+    MIParse(reply, output);
+    if (!output->rr) {
+        LOG_ERROR("Reply not parsed");
+        MIOutputFree(output);
+        return 1;
+    }
+
+    using lct::GdbResult;
+    const GdbResult r = GdbResult::FromResultRecord(output->rr);
+    try {
+        ok &= r.GetType() == GdbResult::RESULTS && r.Size() == 5;
+        ok &= r["value"].Str() == "42" && r["value"].View() == "42";
+        ok &= r["empty"].GetType() == GdbResult::VALUES && r["empty"].Size() == 0;
+
+        const GdbResult memory = r["memory"];
+        ok &= memory.Size() == 2;
+        ok &= memory[1]["begin"].View() == "0x20000010";
+        ok &= memory[0]["contents"].View() == "0102";
+
+        // Lists of results can be indexed by position and by name
+        const GdbResult stack = r[std::string("stack")];
+        ok &= stack.GetType() == GdbResult::RESULTS && stack.Size() == 2;
+        ok &= stack[1]["func"].View() == "start";
+        ok &= stack["frame"]["level"].View() == "0";
+
+        ok &= r["data"].Size() == 3 && r["data"][2].View() == "9";
+
+        // Iteration gives the same values as indexing
+        std::string data;
+        for (const GdbResult d : r["data"]) {
+            data += d.Str();
+        }
+        ok &= data == "789";
+        std::string funcs;
+        for (const GdbResult frame : stack) {
+            funcs += frame["func"].Str() + " ";
+        }
+        ok &= funcs == "main start ";
+        ok &= r["empty"].begin() == r["empty"].end() && r["value"].begin() == r["value"].end();
+        ok &= r[0].View() == "42";
+    }
+    catch (std::out_of_range& e) {
+        LOG_ERROR("Lookup failed: %s", e.what());
+        ok = false;
+    }
+
+    // Missing values
+    ok &= r.Find("missing").Empty();
+    ok &= r["value"].Find("x").Empty();
+    size_t thrown = 0;
+    try {
+        r["missing"];
+    }
+    catch (std::out_of_range&) {
+        thrown++;
+    }
+    try {
+        r["data"][3];
+    }
+    catch (std::out_of_range&) {
+        thrown++;
+    }
+    try {
+        r["memory"].View();
+    }
+    catch (std::out_of_range&) {
+        thrown++;
+    }
+    ok &= thrown == 3;
+    ok &= GdbResult::FromResultRecord(NULL).Size() == 0;
+
+    MIOutputFree(output);
+
+    // Strings are unescaped, and a record outlives the output it came from
+    const char stream[] = "~\"console\"\n"
+            "^done,value=\"say \\\"hi\\\" \\\\ \\t\",rest=\"c\"\n";
+    output = MIOutputNew();
+    MIParse(const_cast<char*>(stream), output);
+    MIResultRecord* rr = output->rr;
+    output->rr = NULL;
+    ok &= output->oobs && MIListSize(output->oobs) == 1;
+    MIOutputFree(output);
+    ok &= rr && GdbResult::FromResultRecord(rr).Find("value").View() == "say \"hi\" \\ \\t" &&
+            GdbResult::FromResultRecord(rr).Find("rest").View() == "c";
+    if (rr) {
+        MIResultRecordFree(rr);
+    }
+
+    if (!ok) {
+        LOG_ERROR("Unexpected results");
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
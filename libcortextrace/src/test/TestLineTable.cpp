@@ -0,0 +1,166 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "log.h"
+#include "ElfFile.h"
+#include "LineTable.h"
+
+#include "test/ElfWriter.h"
+
+class Test {
+public:
+    Test() : Path("/tmp/lct-test-linetable.elf") { }
+    virtual ~Test();
+    int Run();
+
+protected:
+    std::string Path;
+    bool WriteElf();
+};
+
+Test::~Test()
+{
+    remove(Path.c_str());
+}
+
+class Bytes : public std::vector<uint8_t> {
+public:
+    Bytes& u8(uint8_t x) { push_back(x); return *this; }
+    Bytes& u16(uint16_t x) { return u8(x).u8(x >> 8); }
+    Bytes& u32(uint32_t x) { return u16(x).u16(x >> 16); }
+    Bytes& str(const char* s) { insert(end(), s, s + strlen(s) + 1); return *this; }
+    Bytes& append(const Bytes& b) { insert(end(), b.begin(), b.end()); return *this; }
+};
+
+/**
+ * Wrap a line table header tail and program into a unit. The header starts
+ * with minimum_instruction_length.
+ */
+static Bytes unit(uint16_t version, const Bytes& header, const Bytes& program)
+{
+    Bytes body;
+    body.u16(version);
+    if (version >= 5) {
+        body.u8(4).u8(0);
+    }
+    body.u32(header.size()).append(header).append(program);
+
+    Bytes out;
+    out.u32(body.size()).append(body);
+    return out;
+}
+
+static Bytes commonHeader(uint16_t version)
+{
+    Bytes h;
+    h.u8(2); // minimum_instruction_length
+    if (version >= 4) {
+        h.u8(1);
+    }
+    h.u8(1).u8(uint8_t(-5)).u8(14).u8(13);
+    const uint8_t lengths[] = { 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1 };
+    h.insert(h.end(), lengths, lengths + sizeof(lengths));
+    return h;
+}
+
+bool Test::WriteElf()
+{
+    // DWARF 4: include_directories and file_names as strings
+    Bytes h4 = commonHeader(4);
+    h4.str("src").u8(0);
+    h4.str("main.c").u8(1).u8(0).u8(0);
+    h4.str("util.h").u8(0).u8(0).u8(0);
+    h4.u8(0);
+
+    Bytes p4;
+    p4.u8(0).u8(5).u8(2).u32(0x08000100);  // set_address
+    p4.u8(3).u8(9);                         // advance_line 9 -> 10
+    p4.u8(1);                               // copy
+    p4.u8(47);                              // addr += 4, line += 1
+    p4.u8(4).u8(2);                         // set_file util.h
+    p4.u8(3).u8(0x7a);                      // advance_line -6 -> 5
+    p4.u8(32);                              // addr += 2
+    p4.u8(2).u8(5);                         // advance_pc 10
+    p4.u8(0).u8(1).u8(1);                   // end_sequence
+
+    // DWARF 5: entry formats, directories from .debug_line_str
+    Bytes h5 = commonHeader(5);
+    h5.u8(1).u8(1).u8(0x1f);                // path, line_strp
+    h5.u8(2).u32(0).u32(6);
+    h5.u8(2).u8(1).u8(0x08).u8(2).u8(0x0b); // path string, dir index data1
+    h5.u8(2).str("a.c").u8(0).str("b.c").u8(1);
+
+    Bytes p5;
+    p5.u8(0).u8(5).u8(2).u32(0x08000200);
+    p5.u8(3).u8(19);                        // line 20
+    p5.u8(1);                               // copy, file 1 = lib/b.c
+    p5.u8(4).u8(0);                         // set_file /work/a.c
+    p5.u8(47);
+    p5.u8(2).u8(2);
+    p5.u8(0).u8(1).u8(1);
+
+    Bytes debugLine;
+    debugLine.append(unit(4, h4, p4)).append(unit(5, h5, p5));
+
+    const char lineStr[] = "/work\0lib";
+
+    ElfWriter w;
+    w.AddSection(".debug_line", 1, &debugLine[0], debugLine.size());
+    w.AddSection(".debug_line_str", 1, lineStr, sizeof(lineStr));
+    return w.Write(Path);
+}
+
+static bool expect(lct::LineTable& lt, uint32_t address,
+        const char* file, uint32_t line)
+{
+    const char* foundFile = NULL;
+    uint32_t foundLine = 0;
+    const bool found = lt.Lookup(address, &foundFile, &foundLine);
+    if (found != (file != NULL) ||
+            (file && (strcmp(foundFile, file) != 0 || foundLine != line))) {
+        LOG_ERROR("Lookup %#x: got %s:%u, expected %s:%u", address,
+                found ? foundFile : "(none)", foundLine, file ? file : "(none)", line);
+        return false;
+    }
+    return true;
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running LineTable test");
+
+    if (!WriteElf()) {
+        LOG_ERROR("Failed to write test ELF");
+        return 1;
+    }
+
+    lct::ElfFile elf;
+    if (!elf.Open(Path)) {
+        return 1;
+    }
+
+    lct::LineTable lt(elf);
+
+    bool ok = true;
+    ok &= expect(lt, 0x080000ff, NULL, 0);
+    ok &= expect(lt, 0x08000100, "src/main.c", 10);
+    ok &= expect(lt, 0x08000103, "src/main.c", 10);
+    ok &= expect(lt, 0x08000104, "src/main.c", 11);
+    ok &= expect(lt, 0x08000106, "util.h", 5);
+    ok &= expect(lt, 0x0800010f, "util.h", 5);
+    ok &= expect(lt, 0x08000110, NULL, 0);
+    ok &= expect(lt, 0x08000200, "lib/b.c", 20);
+    ok &= expect(lt, 0x08000204, "/work/a.c", 21);
+    ok &= expect(lt, 0x08000207, "/work/a.c", 21);
+    ok &= expect(lt, 0x08000208, NULL, 0);
+
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
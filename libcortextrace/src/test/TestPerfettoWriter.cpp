@@ -0,0 +1,157 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "log.h"
+#include "PerfettoWriter.h"
+#include "TraceEvent.h"
+
+/**
+ * Just enough protobuf decoding to check the packets.
+ */
+struct Field {
+    Field() : Number(0), Value(0), Data() {}
+    unsigned Number;
+    uint64_t Value;
+    std::string Data;
+};
+
+static bool getVarint(const std::string& in, size_t& pos, uint64_t& value)
+{
+    value = 0;
+    for (unsigned shift = 0; pos < in.size() && shift < 64; shift += 7) {
+        const uint8_t b = in[pos++];
+        value |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool decode(const std::string& in, std::vector<Field>& fields)
+{
+    size_t pos = 0;
+    while (pos < in.size()) {
+        Field f;
+        uint64_t tag;
+        if (!getVarint(in, pos, tag)) {
+            return false;
+        }
+        f.Number = tag >> 3;
+        if ((tag & 7) == 0) {
+            if (!getVarint(in, pos, f.Value)) {
+                return false;
+            }
+        }
+        else if ((tag & 7) == 2) {
+            if (!getVarint(in, pos, f.Value) || pos + f.Value > in.size()) {
+                return false;
+            }
+            f.Data = in.substr(pos, f.Value);
+            pos += f.Value;
+        }
+        else {
+            return false;
+        }
+        fields.push_back(f);
+    }
+    return true;
+}
+
+static const Field* find(const std::vector<Field>& fields, unsigned number)
+{
+    for (const Field& f : fields) {
+        if (f.Number == number) {
+            return &f;
+        }
+    }
+    return NULL;
+}
+
+class Test {
+public:
+    Test() : Out(), Writer(Out, 1e6) { }
+    virtual ~Test();
+    int Run();
+
+protected:
+    std::ostringstream Out;
+    lct::PerfettoWriter Writer;
+
+    void Event(enum lct::TraceEvent::Type type, uint32_t code, uint32_t value, uint64_t timestamp);
+};
+
+Test::~Test()
+{
+}
+
+void Test::Event(enum lct::TraceEvent::Type type, uint32_t code, uint32_t value, uint64_t timestamp)
+{
+    lct::TraceEvent e(type, code, value, timestamp);
+    Writer.HandleTraceEvent(e);
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running PerfettoWriter test");
+    bool ok = true;
+
+    Writer.SetSpanPorts(30, 31);
+
+    // SysTick preempted by IRQ0, span 7 and a line of text, one counter
+    Event(lct::TraceEvent::TRACE_EVENT_HW, 0x0e, 0x1000 | 15, 100);
+    Event(lct::TraceEvent::TRACE_EVENT_HW, 0x0e, 0x1000 | 16, 110);
+    Event(lct::TraceEvent::TRACE_EVENT_HW, 0x0e, 0x2000 | 16, 120);
+    Event(lct::TraceEvent::TRACE_EVENT_HW, 0x0e, 0x2000 | 15, 130);
+    Event(lct::TraceEvent::TRACE_EVENT_INSTR, (30 << 3) | 0x3, 7, 200);
+    Event(lct::TraceEvent::TRACE_EVENT_INSTR, (31 << 3) | 0x3, 7, 250);
+    Event(lct::TraceEvent::TRACE_EVENT_INSTR, 0x03, 0x0a6968, 300);
+    Event(lct::TraceEvent::TRACE_EVENT_HW, 0x05, 0x01, 400);
+    Writer.Finish();
+
+    std::vector<Field> packets;
+    ok &= decode(Out.str(), packets);
+
+    unsigned descriptors = 0;
+    std::vector<uint64_t> times;
+    std::vector<std::string> names;
+    for (const Field& p : packets) {
+        std::vector<Field> fields;
+        ok &= p.Number == 1 && decode(p.Data, fields);
+        ok &= find(fields, 10) && find(fields, 10)->Value == 1;
+        if (find(fields, 60)) {
+            descriptors++;
+        }
+        const Field* event = find(fields, 11);
+        if (event) {
+            std::vector<Field> eventFields;
+            ok &= decode(event->Data, eventFields);
+            const Field* name = find(eventFields, 23);
+            names.push_back(name ? name->Data : "");
+            times.push_back(find(fields, 8) ? find(fields, 8)->Value : 0);
+        }
+    }
+
+    // Exceptions, span 7, ITM port 0 and the CPI counter
+    ok &= descriptors == 4;
+    const char* const expected[] = { "SysTick", "IRQ0", "", "", "7", "", "hi", "" };
+    ok &= names.size() == 8;
+    for (size_t i = 0; i < names.size() && i < 8; i++) {
+        ok &= names[i] == expected[i];
+    }
+    ok &= times.size() == 8 && times[0] == 100000 && times[7] == 400000;
+
+    if (!ok) {
+        LOG_ERROR("Unexpected Perfetto output, %lu packets, %u descriptors",
+                packets.size(), descriptors);
+    }
+
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
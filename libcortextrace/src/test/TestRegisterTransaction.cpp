@@ -0,0 +1,156 @@
+#include <cstdint>
+#include <string>
+
+#include "log.h"
+#include "GdbConnection.h"
+#include "Registers.h"
+#include "RegisterTransaction.h"
+#include "RspConnection.h"
+#include "test/RspStub.h"
+
+class Test {
+public:
+    Test(const std::string& gdb) : Gdb(gdb) { }
+    virtual ~Test();
+    int Run();
+    bool TestMerge();
+    bool TestSubmit();
+    bool TestSubmitRsp();
+
+    std::string Gdb;
+};
+
+Test::~Test()
+{
+}
+
+bool Test::TestMerge()
+{
+    bool ok = true;
+    lct::Registers regs;
+    lct::RegisterTransaction t;
+    uint32_t a;
+    uint32_t b;
+
+    // Each comparator is one block, the gap before the next one splits them
+    for (size_t comp = 0; comp < 2; comp++) {
+        t.Write(regs.DWT_COMP[comp], 0);
+        t.Write(regs.DWT_MASK[comp], 0);
+        t.Write(regs.DWT_FUNCTION[comp], 0);
+    }
+    // Reads do not merge with writes, and only in increasing order
+    t.Read(regs.DWT_FUNCTION[1] + 4, &a);
+    t.Read(regs.DWT_FUNCTION[1] + 8, &b);
+    t.Read(regs.DWT_FUNCTION[1] + 4, &b);
+
+    const auto& blocks = t.GetBlocks();
+    ok &= t.Accesses() == 9 && blocks.size() == 4;
+    if (!ok) {
+        LOG_ERROR("Got %lu blocks for %lu accesses", blocks.size(), t.Accesses());
+        return false;
+    }
+    ok &= blocks[0].Write && blocks[0].Address == regs.DWT_COMP[0] && blocks[0].Values.size() == 3;
+    ok &= blocks[1].Write && blocks[1].Address == regs.DWT_COMP[1] && blocks[1].Values.size() == 3;
+    ok &= !blocks[2].Write && blocks[2].Outputs.size() == 2 && blocks[2].Outputs[1] == &b;
+    ok &= !blocks[3].Write && blocks[3].Outputs.size() == 1;
+
+    t.Clear();
+    ok &= t.Accesses() == 0 && t.GetBlocks().empty();
+    if (!ok) {
+        LOG_ERROR("Blocks not merged as expected");
+    }
+    return ok;
+}
+
+bool Test::TestSubmit()
+{
+    bool ok = true;
+    lct::GdbConnection gdb;
+    gdb.Connect(Gdb, "");
+
+    lct::RegisterTransaction t;
+    for (uint32_t i = 0; i < 8; i++) {
+        t.Write(0x20000000 + 4 * i, 0x11223344 * (i + 1));
+    }
+    t.Write(0x20000100, 0xdeadbeef);
+    ok &= t.Submit(gdb) && t.Accesses() == 0;
+
+    // Reads see the writes made earlier in the same transaction
+    uint32_t values[8] = {};
+    uint32_t single = 0;
+    uint32_t overwritten = 0;
+    t.Write(0x20000200, 0xcafef00d);
+    for (uint32_t i = 0; i < 8; i++) {
+        t.Read(0x20000000 + 4 * i, &values[i]);
+    }
+    t.Read(0x20000100, &single);
+    t.Read(0x20000200, &overwritten);
+    ok &= t.Submit(gdb);
+    for (uint32_t i = 0; i < 8; i++) {
+        ok &= values[i] == 0x11223344 * (i + 1);
+    }
+    ok &= single == 0xdeadbeef && overwritten == 0xcafef00d;
+    uint32_t word = 0;
+    ok &= gdb.ReadWord(0x20000004, &word) && word == 0x11223344 * 2;
+    if (!ok) {
+        LOG_ERROR("Values not read back");
+        return false;
+    }
+
+    // A failed block does not keep the others from being done
+    uint32_t unreadable = 0x5555;
+    t.Read(0xf0000000, &unreadable);
+    t.Write(0x20000300, 42);
+    ok &= !t.Submit(gdb);
+    ok &= unreadable == 0x5555 && gdb.ReadWord(0x20000300, &word) && word == 42;
+    if (!ok) {
+        LOG_ERROR("Failure not reported");
+    }
+    return ok;
+}
+
+bool Test::TestSubmitRsp()
+{
+    bool ok = true;
+    RspStub stub(0x100, true);
+    lct::RspConnection rsp;
+    ok &= stub.Start() && rsp.Connect("127.0.0.1", stub.Port);
+
+    // Transactions work the same as through GDB
+    lct::RegisterTransaction t;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    t.Write(0x20002000, 1);
+    t.Write(0x20002004, 2);
+    t.Read(0x20002000, &a);
+    t.Read(0x20002004, &b);
+    ok &= t.Submit(rsp) && a == 1 && b == 2;
+    uint32_t unreadable = 0x5555;
+    t.Read(0xf0000000, &unreadable);
+    t.Write(0x20002008, 3);
+    ok &= !t.Submit(rsp) && unreadable == 0x5555 && rsp.ReadWord(0x20002008, &a) && a == 3;
+    rsp.Close();
+    if (!ok) {
+        LOG_ERROR("Transaction over the remote protocol failed");
+    }
+    return ok;
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running RegisterTransaction test");
+    bool ok = true;
+    ok &= TestMerge();
+    ok &= TestSubmit();
+    ok &= TestSubmitRsp();
+    return ok ? 0 : 1;
+}
+
+int main(int, char* argv[])
+{
+    // The fake GDB is built next to the test
+    std::string dir(argv[0]);
+    dir = dir.substr(0, dir.find_last_of('/') + 1);
+    Test t(dir + "fakegdb");
+    return t.Run();
+}
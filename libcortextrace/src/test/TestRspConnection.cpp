@@ -0,0 +1,161 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "log.h"
+#include "RspConnection.h"
+#include "test/RspStub.h"
+
+class Test {
+public:
+    Test() { }
+    virtual ~Test();
+    int Run();
+    bool TestPackets();
+    bool TestMemory(bool noAck);
+    bool TestTimeout();
+};
+
+Test::~Test()
+{
+}
+
+bool Test::TestPackets()
+{
+    bool ok = true;
+    typedef lct::RspConnection Rsp;
+    ok &= Rsp::Frame("OK") == "$OK#9a";
+    const uint8_t special[] = { '#', 'a', '$', '}', '*', 0 };
+    ok &= Rsp::Escape(special, sizeof(special)) == std::string("}\x03" "a}\x04}]}\x0a\0", 10);
+
+    // Noise before a packet is dropped and acks are passed on, a partial
+    // packet is kept
+    std::string buffer = "+x+$0* 1#";
+    std::string payload;
+    bool valid = false;
+    std::string acks;
+    ok &= !Rsp::Unframe(buffer, &payload, &valid, &acks) && buffer == "$0* 1#" && acks == "++";
+    buffer += "ab-$E0";
+    ok &= Rsp::Unframe(buffer, &payload, &valid, &acks) && valid && payload == "00001";
+    ok &= buffer == "-$E0" && !Rsp::Unframe(buffer, &payload, &valid, &acks);
+    ok &= acks == "++-" && buffer == "$E0";
+    buffer += "1#00";
+    ok &= Rsp::Unframe(buffer, &payload, &valid) && !valid && buffer.empty();
+    buffer = "-";
+    ok &= !Rsp::Unframe(buffer, &payload, &valid, &acks) && buffer.empty() && acks == "++--";
+    if (!ok) {
+        LOG_ERROR("Packets not framed correctly");
+    }
+    return ok;
+}
+
+bool Test::TestMemory(bool noAck)
+{
+    bool ok = true;
+    // With acks, rejected and garbled packets are sent again in order
+    RspStub stub(0x100, noAck, noAck ? 0 : 5);
+    lct::RspConnection rsp;
+    ok &= stub.Start() && rsp.Connect("127.0.0.1", stub.Port);
+    ok &= rsp.GetPacketSize() == 0x100 && rsp.GetAckMode() == !noAck;
+
+    ok &= rsp.WriteWord(0x20000000, 0x12345678);
+    uint32_t word = 0;
+    ok &= rsp.ReadWord(0x20000000, &word) && word == 0x12345678;
+    ok &= !rsp.ReadWord(0xf0000000, &word) && word == 0x12345678;
+    ok &= !rsp.WriteWord(0xf0000000, 0);
+
+    // Every byte value, which needs escaping, in more than one packet, and
+    // runs of zeroes, which the stub run-length encodes
+    std::vector<uint8_t> block(0x1000);
+    for (size_t i = 0; i < block.size(); i++) {
+        block[i] = i & 0x100 ? 0 : i;
+    }
+    ok &= rsp.WriteBlock(0x20001000, block.data(), block.size());
+    std::vector<uint8_t> readBack(block.size());
+    ok &= rsp.ReadBlock(0x20001000, readBack.data(), readBack.size()) && readBack == block;
+
+    // Without acks a batch goes out together, and a failure affects only its
+    // transfer
+    const size_t before = stub.Packets;
+    uint32_t words[8] = { 0 };
+    std::vector<lct::RspConnection::Transfer> transfers;
+    for (size_t i = 0; i < 8; i++) {
+        transfers.push_back(lct::RspConnection::Transfer(false, 0x20001000 + 4 * i,
+                &words[i], 4));
+    }
+    transfers.push_back(lct::RspConnection::Transfer(false, 0xf0000000, &word, 4));
+    ok &= !rsp.Submit(transfers);
+    ok &= transfers[7].Ok && !transfers[8].Ok && words[7] == 0x1f1e1d1c;
+    ok &= stub.Packets == before + 9;
+
+    std::string output;
+    ok &= rsp.Monitor("tpiu config disable", &output) && output == "Trace disabled\n";
+    ok &= !rsp.Monitor("reset halt");
+    ok &= rsp.Connected();
+    rsp.Close();
+    stub.Thread.join();
+    ok &= noAck ? stub.MaxBatch >= 9 : stub.MaxBatch == 1 && stub.Naks > 0 && stub.Garbled > 0;
+    if (!ok) {
+        LOG_ERROR("Memory access failed%s, largest batch %lu, %lu rejected, %lu garbled",
+                noAck ? "" : " with acks", stub.MaxBatch, stub.Naks, stub.Garbled);
+    }
+    return ok;
+}
+
+bool Test::TestTimeout()
+{
+    bool ok = true;
+    RspStub stub(0x4000, true);
+    lct::RspConnection rsp;
+    ok &= stub.Start() && rsp.Connect("127.0.0.1", stub.Port);
+    rsp.SetTimeout(50);
+    ok &= !rsp.Monitor("hang") && !rsp.Connected();
+    uint32_t word;
+    ok &= !rsp.ReadWord(0x20000000, &word);
+
+    lct::RspConnection refused;
+    ok &= !refused.Connect("127.0.0.1", 1);
+
+    // A server that does not take the connection, as its backlog is full,
+    // is given up after the timeout
+    const int busy = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = sockaddr_in();
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ok &= bind(busy, (sockaddr*)&addr, len) == 0 && listen(busy, 0) == 0 &&
+            getsockname(busy, (sockaddr*)&addr, &len) == 0;
+    const int first = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    connect(first, (sockaddr*)&addr, len);
+    usleep(10000);
+    lct::RspConnection unanswered;
+    unanswered.SetTimeout(100);
+    ok &= !unanswered.Connect("127.0.0.1", ntohs(addr.sin_port));
+    close(first);
+    close(busy);
+    if (!ok) {
+        LOG_ERROR("Lost connection not detected");
+    }
+    return ok;
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running RspConnection test");
+    bool ok = true;
+    ok &= TestPackets();
+    ok &= TestMemory(true);
+    ok &= TestMemory(false);
+    ok &= TestTimeout();
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
@@ -0,0 +1,137 @@
+#include <sstream>
+
+#include "log.h"
+#include "SpanAnalyzer.h"
+#include "TraceEvent.h"
+
+#define BEGIN_PORT 30
+#define END_PORT 31
+
+class Test {
+public:
+    Test() : Analyzer(BEGIN_PORT, END_PORT, 8) { }
+    virtual ~Test();
+    int Run();
+    bool TestParse();
+
+protected:
+    lct::SpanAnalyzer Analyzer;
+
+    void Stimulus(unsigned port, uint32_t id, uint64_t time);
+    bool Expect(uint32_t id, uint64_t count, uint64_t max, uint64_t unmatched);
+};
+
+Test::~Test()
+{
+}
+
+void Test::Stimulus(unsigned port, uint32_t id, uint64_t time)
+{
+    // Instrumentation packet, 4 byte payload
+    lct::TraceEvent e(lct::TraceEvent::TRACE_EVENT_INSTR, (port << 3) | 0x3, id, time);
+    Analyzer.HandleTraceEvent(e);
+}
+
+bool Test::Expect(uint32_t id, uint64_t count, uint64_t max, uint64_t unmatched)
+{
+    if (id >= Analyzer.GetStats().size()) {
+        LOG_ERROR("No statistics for span %u", id);
+        return false;
+    }
+    const lct::SpanAnalyzer::Stats& s = Analyzer.GetStats()[id];
+    if (s.Duration.Count() != count || s.Duration.Max() != max ||
+            s.Unmatched != unmatched) {
+        LOG_ERROR("Span %u: count %lu, max %lu, unmatched %lu", id,
+                s.Duration.Count(), s.Duration.Max(), s.Unmatched);
+        return false;
+    }
+    return true;
+}
+
+bool Test::TestParse()
+{
+    typedef lct::SpanAnalyzer A;
+    bool ok = true;
+    unsigned begin = 0;
+    unsigned end = 0;
+    uint32_t ids = 0;
+    ok &= A::ParsePorts("30:31", &begin, &end, &ids) && begin == 30 && end == 31 &&
+            ids == A::DEFAULT_SPAN_IDS;
+    ok &= A::ParsePorts("0:5:100", &begin, &end, &ids) && begin == 0 && end == 5 && ids == 100;
+    ok &= !A::ParsePorts("30", &begin, &end, &ids) && !A::ParsePorts("30-31", &begin, &end, &ids);
+    ok &= !A::ParsePorts("31:31", &begin, &end, &ids) && !A::ParsePorts("30:32", &begin, &end, &ids);
+    ok &= !A::ParsePorts("30:31:0", &begin, &end, &ids) &&
+            !A::ParsePorts("30:31:5000", &begin, &end, &ids) &&
+            !A::ParsePorts("30:31:8x", &begin, &end, &ids) &&
+            !A::ParsePorts("30:31x", &begin, &end, &ids);
+    if (!ok) {
+        LOG_ERROR("Span ports not parsed");
+    }
+    return ok;
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running SpanAnalyzer test");
+    bool ok = true;
+
+    // Span 1 contains span 2, which recurses once. Span 3 overlaps span 1.
+    Stimulus(BEGIN_PORT, 1, 100);
+    Stimulus(BEGIN_PORT, 2, 110);
+    Stimulus(BEGIN_PORT, 2, 120);
+    Stimulus(BEGIN_PORT, 3, 125);
+    ok &= Analyzer.OpenSpans(2) == 2;
+    Stimulus(END_PORT, 2, 130);
+    Stimulus(END_PORT, 2, 150);
+    Stimulus(END_PORT, 1, 200);
+    Stimulus(END_PORT, 3, 225);
+    ok &= Expect(1, 1, 100, 0);
+    ok &= Expect(2, 2, 40, 0);
+    ok &= Expect(3, 1, 100, 0);
+
+    // Other ports are ignored
+    Stimulus(0, 1, 300);
+    ok &= Analyzer.OpenSpans(1) == 0;
+
+    // The window is restarted by a report, the session totals are not
+    std::ostringstream out;
+    Analyzer.ReportWindow(out);
+    ok &= out.str().find("Span statistics since last report") == 0;
+    ok &= Analyzer.GetStats().at(2).Window.Count() == 0;
+    ok &= Analyzer.GetStats().at(2).Duration.Count() == 2;
+
+    // An overflow drops open spans, so the end after it is unpaired
+    Stimulus(BEGIN_PORT, 1, 400);
+    lct::TraceEvent overflow(lct::TraceEvent::TRACE_EVENT_OVERFLOW, 0, 0, 410);
+    Analyzer.HandleTraceEvent(overflow);
+    Stimulus(END_PORT, 1, 500);
+    ok &= Expect(1, 1, 100, 1) && Analyzer.GetStats().at(1).Abandoned == 1;
+
+    // Too deep nesting gives up the oldest spans, an end closes the newest
+    const uint32_t depth = lct::SpanAnalyzer::MAX_DEPTH;
+    for (uint32_t i = 0; i < depth + 2; i++) {
+        Stimulus(BEGIN_PORT, 4, 1000 + i);
+    }
+    ok &= Analyzer.OpenSpans(4) == depth && Analyzer.GetStats().at(4).Abandoned == 2;
+    Stimulus(END_PORT, 4, 1100);
+    ok &= Expect(4, 1, 1100 - (1000 + depth + 1), 0) && Analyzer.OpenSpans(4) == depth - 1;
+    for (uint32_t i = 0; i < depth; i++) {
+        Stimulus(END_PORT, 4, 1200);
+    }
+    ok &= Expect(4, depth, 1200 - 1002, 1) && Analyzer.OpenSpans(4) == 0;
+
+    // IDs out of range are dropped without allocating anything
+    Stimulus(BEGIN_PORT, 8, 600);
+    Stimulus(END_PORT, 0xffffffff, 700);
+    ok &= Analyzer.GetDropped() == 2 && Analyzer.GetStats().size() == 8;
+    ok &= Analyzer.OpenSpans(8) == 0;
+
+    ok &= TestParse();
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
@@ -0,0 +1,164 @@
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "log.h"
+#include "ElfFile.h"
+#include "SymbolCache.h"
+#include "test/ElfWriter.h"
+
+class Test {
+public:
+    Test() : ElfPath("/tmp/lct-test-symbols.elf"), CacheDir("/tmp/lct-test-symbols") { }
+    virtual ~Test();
+    int Run();
+    bool WriteElf(uint8_t id);
+    bool TestCache();
+    bool TestParse();
+
+    std::string ElfPath;
+    std::string CacheDir;
+};
+
+Test::~Test()
+{
+    remove(ElfPath.c_str());
+    remove(lct::SymbolCache::CachePath(CacheDir, "0123abcd").c_str());
+    remove(lct::SymbolCache::CachePath(CacheDir, "0123abce").c_str());
+    rmdir(CacheDir.c_str());
+}
+
+bool Test::WriteElf(uint8_t id)
+{
+    const uint8_t note[] = {
+        4, 0, 0, 0,  4, 0, 0, 0,  3, 0, 0, 0,  'G', 'N', 'U', 0,  0x01, 0x23, 0xab, id,
+    };
+    ElfWriter w;
+    w.AddSection(".note.gnu.build-id", 7, note, sizeof(note));
+    return w.Write(ElfPath);
+}
+
+bool Test::TestCache()
+{
+    bool ok = true;
+    typedef lct::SymbolCache::Symbol Symbol;
+    lct::ElfFile elf;
+    ok &= WriteElf(0xcd) && elf.Open(ElfPath);
+    ok &= lct::SymbolCache::Key(elf) == "0123abcd";
+
+    lct::SymbolCache cache;
+    Symbol s;
+    ok &= !cache.Open("", elf);
+    ok &= cache.Open(CacheDir, elf) && cache.Size() == 0;
+    ok &= !cache.Lookup("counter", &s);
+
+    const char* names[] = { "counter", "state.mode", "buffer", "a", "counter2" };
+    for (uint32_t i = 0; i < 5; i++) {
+        s.Address = 0x20000000 + 16 * i;
+        s.Size = 1 << i;
+        s.Type = i == 1 ? "enum mode" : "uint32_t";
+        cache.Add(names[i], s);
+    }
+    ok &= cache.Lookup("a", &s) && s.Size == 8;
+    ok &= cache.Modified() && cache.Save();
+
+    // A new cache finds the entries in the file, and adds to them
+    lct::SymbolCache mapped;
+    ok &= mapped.Open(CacheDir, elf) && mapped.Size() == 5 && !mapped.Modified();
+    for (uint32_t i = 0; i < 5; i++) {
+        ok &= mapped.Lookup(names[i], &s) && s.Address == 0x20000000 + 16 * i &&
+                s.Size == 1U << i;
+    }
+    ok &= mapped.Lookup("state.mode", &s) && s.Type == "enum mode";
+    ok &= !mapped.Lookup("count", &s) && !mapped.Lookup("counter3", &s) &&
+            !mapped.Lookup("", &s);
+    s = Symbol();
+    s.Address = 0x20001000;
+    s.Size = 2;
+    mapped.Add("b", s);
+    mapped.Add("counter", s);
+    ok &= mapped.Save();
+    ok &= mapped.Open(CacheDir, elf) && mapped.Size() == 6;
+    ok &= mapped.Lookup("b", &s) && s.Address == 0x20001000 && s.Type.empty();
+    ok &= mapped.Lookup("counter", &s) && s.Size == 2;
+    ok &= mapped.Lookup("counter2", &s) && s.Size == 16;
+    if (!ok) {
+        LOG_ERROR("Cached symbols not found");
+        return false;
+    }
+
+    // Another build does not see them
+    ok &= WriteElf(0xce) && elf.Open(ElfPath);
+    ok &= mapped.Open(CacheDir, elf) && mapped.Size() == 0;
+
+    // A damaged file is ignored
+    const std::string path = lct::SymbolCache::CachePath(CacheDir, "0123abcd");
+    ok &= truncate(path.c_str(), 60) == 0;
+    ok &= WriteElf(0xcd) && elf.Open(ElfPath);
+    ok &= mapped.Open(CacheDir, elf) && mapped.Size() == 0;
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "LCTSYMS1" << std::string(8, '\xff');
+    }
+    ok &= mapped.Open(CacheDir, elf) && mapped.Size() == 0;
+
+    // Files without a build ID are told apart by their contents
+    ElfWriter w;
+    ok &= w.Write(ElfPath) && elf.Open(ElfPath);
+    const std::string key = lct::SymbolCache::Key(elf);
+    ok &= key.compare(0, 5, "hash-") == 0 && key.size() == 21;
+    w.AddSection(".data", 1, "x", 1);
+    ok &= w.Write(ElfPath) && elf.Open(ElfPath);
+    ok &= lct::SymbolCache::Key(elf) != key;
+    if (!ok) {
+        LOG_ERROR("Cache not checked against the ELF file");
+    }
+    return ok;
+}
+
+bool Test::TestParse()
+{
+    bool ok = true;
+    typedef lct::SymbolCache Cache;
+    ok &= Cache::Cacheable("counter") && Cache::Cacheable("state.mode") &&
+            Cache::Cacheable("ns::value");
+    ok &= Cache::Cacheable("*(uint64_t*)0x20000000") &&
+            Cache::Cacheable("*(volatile uint32_t *) 536870912");
+    ok &= !Cache::Cacheable("*ptr") && !Cache::Cacheable("ptr->x") &&
+            !Cache::Cacheable("buffer[i]") && !Cache::Cacheable("buffer[]") &&
+            !Cache::Cacheable("ptr[3]") && !Cache::Cacheable("s.p[1]") &&
+            !Cache::Cacheable("*(uint32_t*)base") && !Cache::Cacheable("*(uint32_t)0x20") &&
+            !Cache::Cacheable("f()") && !Cache::Cacheable("") && !Cache::Cacheable("1");
+
+    Cache::Symbol s;
+    ok &= Cache::ParseAddressOf("(volatile uint32_t *) 0x20000010 <counter>", &s) &&
+            s.Address == 0x20000010 && s.Type == "volatile uint32_t";
+    ok &= Cache::ParseAddressOf("(struct state *) 0x20000100 <state>", &s) &&
+            s.Type == "struct state";
+    ok &= Cache::ParseAddressOf("(int (*)[4]) 0x20000200 <table>", &s) &&
+            s.Address == 0x20000200 && s.Type == "int (*)[4]";
+    ok &= Cache::ParseAddressOf("(uint64_t *) 0x20000000", &s) && s.Type == "uint64_t";
+    ok &= !Cache::ParseAddressOf("0x20000000", &s) && !Cache::ParseAddressOf("(int *", &s) &&
+            !Cache::ParseAddressOf("(int *) <x>", &s);
+    if (!ok) {
+        LOG_ERROR("Expressions not parsed");
+    }
+    return ok;
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running SymbolCache test");
+    bool ok = true;
+    ok &= TestCache();
+    ok &= TestParse();
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
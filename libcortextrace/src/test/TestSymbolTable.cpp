@@ -0,0 +1,122 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "log.h"
+#include "ElfFile.h"
+#include "SymbolTable.h"
+
+#include "test/ElfWriter.h"
+
+class Test {
+public:
+    Test() : Path("/tmp/lct-test-symtab.elf") { }
+    virtual ~Test();
+    int Run();
+
+protected:
+    std::string Path;
+    bool WriteElf();
+};
+
+Test::~Test()
+{
+    remove(Path.c_str());
+}
+
+/**
+ * Write a minimal ELF file with a symbol table.
+ */
+bool Test::WriteElf()
+{
+    // The last name is not terminated
+    const char strtab[] = "\0main\0irq_handler\0counter\0alias\0asm_label";
+
+    struct { uint32_t name, value, size; uint8_t info; uint16_t shndx; } syms[] = {
+            { 0, 0, 0, 0, 0 },
+            { 1, 0x08000101, 0x40, 0x12, 1 },   // main, Thumb FUNC
+            { 6, 0x08000141, 0x10, 0x12, 1 },   // irq_handler
+            { 18, 0x20000000, 4, 0x11, 2 },     // counter, OBJECT
+            { 32, 0x08000200, 0, 0x02, 1 },     // asm_label, no size
+            { 26, 0x08000101, 0, 0x22, 1 },     // alias of main, weak
+            { 0, 0x08000300, 0, 0x03, 1 },      // SECTION symbol, ignored
+    };
+    const size_t nsyms = sizeof(syms) / sizeof(syms[0]);
+
+    std::vector<uint8_t> symtab(nsyms * 16);
+    for (size_t i = 0; i < nsyms; i++) {
+        const size_t p = i * 16;
+        ElfWriter::Put32(symtab, p, syms[i].name);
+        ElfWriter::Put32(symtab, p + 4, syms[i].value);
+        ElfWriter::Put32(symtab, p + 8, syms[i].size);
+        symtab[p + 12] = syms[i].info;
+        ElfWriter::Put16(symtab, p + 14, syms[i].shndx);
+    }
+
+    ElfWriter w;
+    w.AddSection(".symtab", 2, &symtab[0], symtab.size(), 2, 16);
+    w.AddSection(".strtab", 3, strtab, sizeof(strtab) - 1);
+    return w.Write(Path);
+}
+
+static bool expect(const lct::SymbolTable& st, uint32_t address,
+        const char* name, uint32_t offset)
+{
+    uint32_t off = 0;
+    const char* found = st.Lookup(address, &off);
+    if ((found == NULL) != (name == NULL) ||
+            (name && (strcmp(found, name) != 0 || off != offset))) {
+        LOG_ERROR("Lookup %#x: got %s+%#x, expected %s+%#x", address,
+                found ? found : "(none)", off, name ? name : "(none)", offset);
+        return false;
+    }
+    return true;
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running SymbolTable test");
+
+    if (!WriteElf()) {
+        LOG_ERROR("Failed to write test ELF");
+        return 1;
+    }
+
+    lct::ElfFile elf;
+    if (!elf.Open(Path)) {
+        return 1;
+    }
+
+    lct::SymbolTable st;
+    if (!st.Load(elf)) {
+        return 1;
+    }
+    elf.Close();
+
+    bool ok = st.Size() == 4;
+    ok &= expect(st, 0x080000ff, NULL, 0);
+    ok &= expect(st, 0x08000100, "main", 0);
+    ok &= expect(st, 0x08000123, "main", 0x23);
+    ok &= expect(st, 0x08000140, "irq_handler", 0);
+    ok &= expect(st, 0x0800014f, "irq_handler", 0xf);
+    ok &= expect(st, 0x08000150, NULL, 0);
+    ok &= expect(st, 0x08000200, "asm_label", 0);
+    ok &= expect(st, 0x20000003, "counter", 3);
+    ok &= expect(st, 0x20000004, NULL, 0);
+
+    uint32_t addr = 0;
+    uint32_t size = 0;
+    ok &= st.Find("counter", &addr, &size) && addr == 0x20000000 && size == 4;
+    ok &= st.Find("asm_label", &addr) && addr == 0x08000200;
+    ok &= st.Find("main", &addr, &size) && addr == 0x08000100 && size == 0x40;
+    ok &= !st.Find("count", &addr) && !st.Find("zzz", &addr) && !st.Find("", &addr);
+
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
@@ -0,0 +1,170 @@
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "log.h"
+#include "ElfFile.h"
+#include "GdbConnection.h"
+#include "TargetCapabilities.h"
+#include "test/ElfWriter.h"
+
+class Test {
+public:
+    Test(const std::string& gdb) :
+        Gdb(gdb), ElfPath("/tmp/lct-test-buildid.elf"), CacheDir("/tmp/lct-test-caps") { }
+    virtual ~Test();
+    int Run();
+    bool TestBuildId();
+    bool WriteTarget(lct::GdbConnection& gdb);
+    bool TestProbe();
+
+    std::string Gdb;
+    std::string ElfPath;
+    std::string CacheDir;
+};
+
+Test::~Test()
+{
+    remove(ElfPath.c_str());
+    remove(lct::TargetCapabilities::CachePath(CacheDir, 0x410fc241, "0123abcd").c_str());
+    rmdir(CacheDir.c_str());
+}
+
+bool Test::TestBuildId()
+{
+    bool ok = true;
+    // An unrelated note first, then the build ID
+    const uint8_t notes[] = {
+        4, 0, 0, 0,  4, 0, 0, 0,  1, 0, 0, 0,  'G', 'N', 'U', 0,  1, 2, 3, 4,
+        4, 0, 0, 0,  4, 0, 0, 0,  3, 0, 0, 0,  'G', 'N', 'U', 0,  0x01, 0x23, 0xab, 0xcd,
+    };
+    ElfWriter w;
+    w.AddSection(".note.gnu.build-id", 7, notes, sizeof(notes));
+    lct::ElfFile elf;
+    ok &= w.Write(ElfPath) && elf.Open(ElfPath);
+    ok &= elf.BuildId() == "0123abcd";
+    elf.Close();
+
+    // A truncated note is ignored
+    ElfWriter bad;
+    bad.AddSection(".note.gnu.build-id", 7, notes + 20, sizeof(notes) - 22);
+    ok &= bad.Write(ElfPath) && elf.Open(ElfPath);
+    ok &= elf.BuildId().empty();
+
+    if (!ok) {
+        LOG_ERROR("Build ID not found");
+    }
+    return ok;
+}
+
+/**
+ * Fill the fake GDB's memory with the debug components of a Cortex-M4.
+ */
+bool Test::WriteTarget(lct::GdbConnection& gdb)
+{
+    bool ok = true;
+    ok &= gdb.WriteWord(0xe000ed00, 0x410fc241);    // CPUID
+    ok &= gdb.WriteWord(0xe000e004, 0x2);           // ICTR: 96 interrupts
+    ok &= gdb.WriteWord(0xe0001000, 0x40000000);    // DWT_CTRL: 4 comparators
+    ok &= gdb.WriteWord(0xe0040000, 0xb);           // TPIU_SSPSR: 1, 2 and 4 bits
+
+    // ROM table: SCS, DWT, FPB, ITM, TPIU, no ETM, and an empty nested table
+    const uint32_t rom[] = {
+        0xfff0f003, 0xfff02003, 0xfff03003, 0xfff01003, 0xfff41003, 0xfff42002,
+        0x00001003, 0,
+    };
+    ok &= gdb.WriteBlock(0xe00ff000, rom, sizeof(rom));
+
+    struct { uint32_t base; uint16_t part; uint8_t cls; uint32_t devid; } parts[] = {
+        { 0xe00ff000, 0x4c4, 0x1, 0 },
+        { 0xe000e000, 0x00c, 0xe, 0 },
+        { 0xe0001000, 0x002, 0xe, 0 },
+        { 0xe0002000, 0x003, 0xe, 0 },
+        { 0xe0000000, 0x001, 0xe, 0 },
+        { 0xe0040000, 0x9a1, 0x9, 0xca1 },
+        { 0xe0100000, 0x4c4, 0x1, 0 },
+    };
+    for (const auto& p : parts) {
+        ok &= gdb.WriteWord(p.base + 0xfc8, p.devid);
+        ok &= gdb.WriteWord(p.base + 0xfd0, 0x04);             // PIDR4: ARM continuation
+        ok &= gdb.WriteWord(p.base + 0xfe0, p.part & 0xff);    // PIDR0
+        ok &= gdb.WriteWord(p.base + 0xfe4, 0xb0 | p.part >> 8);
+        ok &= gdb.WriteWord(p.base + 0xfe8, 0x0b);             // PIDR2: JEDEC, ARM
+        ok &= gdb.WriteWord(p.base + 0xff0, 0x0d);
+        ok &= gdb.WriteWord(p.base + 0xff4, p.cls << 4);
+        ok &= gdb.WriteWord(p.base + 0xff8, 0x05);
+        ok &= gdb.WriteWord(p.base + 0xffc, 0xb1);
+    }
+    return ok;
+}
+
+bool Test::TestProbe()
+{
+    bool ok = true;
+    lct::GdbConnection gdb;
+    gdb.Connect(Gdb, "");
+    if (!WriteTarget(gdb)) {
+        LOG_ERROR("Failed to set up the target");
+        return false;
+    }
+
+    typedef lct::TargetCapabilities Caps;
+    Caps caps;
+    ok &= caps.Probe(gdb);
+    ok &= caps.Cpuid == 0x410fc241 && caps.InterruptLines == 96;
+    ok &= caps.Components.size() == 6;
+    ok &= caps.Has(Caps::SCS) && caps.Has(Caps::DWT) && caps.Has(Caps::FPB) &&
+            caps.Has(Caps::ITM) && caps.Has(Caps::TPIU) && !caps.Has(Caps::ETM);
+    ok &= caps.Find(Caps::TPIU) && caps.Find(Caps::TPIU)->Address == 0xe0040000;
+    ok &= caps.Comparators == 4 && caps.CycleCounter && caps.ProfilingCounters &&
+            caps.TracePackets && caps.ExternalTrigger && caps.DataValueMatch;
+    ok &= caps.TpiuPortSizes == 0xb && caps.TpiuParallel && caps.TpiuManchester &&
+            caps.TpiuNrz;
+    if (!ok) {
+        LOG_ERROR("Probe found %lu components, %u comparators", caps.Components.size(),
+                caps.Comparators);
+        return false;
+    }
+
+    // The cache is keyed by CPUID and build ID
+    Caps cached;
+    ok &= !cached.LoadCached(CacheDir, caps.Cpuid, "0123abcd");
+    ok &= caps.SaveCached(CacheDir, "0123abcd");
+    ok &= !cached.LoadCached(CacheDir, caps.Cpuid, "4567");
+    ok &= !cached.LoadCached(CacheDir, 0x410fc240, "0123abcd");
+    ok &= !cached.LoadCached(CacheDir, caps.Cpuid, "");
+    ok &= cached.LoadCached(CacheDir, caps.Cpuid, "0123abcd");
+    ok &= cached.Cpuid == caps.Cpuid && cached.InterruptLines == caps.InterruptLines;
+    ok &= cached.Components.size() == caps.Components.size();
+    for (size_t i = 0; ok && i < caps.Components.size(); i++) {
+        const Caps::Component& a = caps.Components[i];
+        const Caps::Component& b = cached.Components[i];
+        ok &= a.Address == b.Address && a.Type == b.Type && a.Class == b.Class &&
+                a.Designer == b.Designer && a.PartNumber == b.PartNumber;
+    }
+    ok &= cached.Comparators == 4 && cached.CycleCounter && cached.DataValueMatch;
+    ok &= cached.TpiuPortSizes == 0xb && cached.TpiuNrz;
+    if (!ok) {
+        LOG_ERROR("Cached capabilities differ");
+    }
+    return ok;
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running TargetCapabilities test");
+    bool ok = true;
+    ok &= TestBuildId();
+    ok &= TestProbe();
+    return ok ? 0 : 1;
+}
+
+int main(int, char* argv[])
+{
+    // The fake GDB is built next to the test
+    std::string dir(argv[0]);
+    dir = dir.substr(0, dir.find_last_of('/') + 1);
+    Test t(dir + "fakegdb");
+    return t.Run();
+}
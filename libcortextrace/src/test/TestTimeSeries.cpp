@@ -0,0 +1,79 @@
+#include <vector>
+
+#include "log.h"
+#include "TimeSeries.h"
+
+class Test {
+public:
+    Test() { }
+    virtual ~Test();
+    int Run();
+};
+
+Test::~Test()
+{
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running TimeSeries test");
+    bool ok = true;
+
+    std::vector<lct::TimeSeries::Point> points;
+
+    // Raw samples when the range is short
+    {
+        lct::TimeSeries ts(16, 3, 4);
+        for (uint64_t t = 0; t < 1000; t++) {
+            ts.Append(t, t % 100);
+        }
+        ok &= ts.SampleCount() == 1000;
+
+        points.clear();
+        ok &= ts.QueryLast(10, 20, points) == 11;
+        ok &= points.front().Time == 989 && points.front().Min == 89;
+        ok &= points.back().Time == 999 && points.back().Max == 99;
+
+        // Whole history only fits at the coarsest level, buckets of 16
+        points.clear();
+        const size_t n = ts.Query(0, 999, 20, points);
+        ok &= n > 0 && n <= 20;
+        for (size_t i = 0; i + 1 < n; i++) {
+            ok &= points[i].Max - points[i].Min == 15 || points[i].Time % 100 > 84;
+            ok &= points[i].Time < points[i + 1].Time;
+        }
+        // The tail holds the samples not yet in a complete bucket
+        ok &= points.back().Time == 992 && points.back().Max == 99;
+
+        if (!ok) {
+            LOG_ERROR("Unexpected points from multi-level series");
+        }
+    }
+
+    // Merging at the top level when there are too many buckets
+    {
+        lct::TimeSeries ts(16, 1, 4);
+        for (uint64_t t = 0; t < 16; t++) {
+            ts.Append(t * 10, t & 1 ? -1.0 * t : t);
+        }
+        points.clear();
+        ok &= ts.Query(0, 150, 4, points) == 4;
+        ok &= points[0].Time == 0 && points[0].Min == -3 && points[0].Max == 2;
+        ok &= points[3].Time == 120 && points[3].Min == -15 && points[3].Max == 14;
+
+        points.clear();
+        ok &= ts.Query(200, 300, 4, points) == 0;
+
+        if (!ok) {
+            LOG_ERROR("Unexpected points from single-level series");
+        }
+    }
+
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
@@ -1,3 +1,5 @@
+#include <vector>
+
 #include "log.h"
 #include "TraceEvent.h"
 #include "TraceEventListener.h"
@@ -5,12 +7,17 @@
 
 class Test : public lct::TraceEventListener {
 public:
-    Test() { }
+    Test() : Events() { }
     virtual ~Test();
     int Run();
+    bool TestTimes();
+    bool Check(size_t index, enum lct::TraceEvent::Type type, uint32_t value, uint64_t time,
+            enum lct::TraceEvent::TimeCode timeCode);
 
     // interface TraceEventListener
     void HandleTraceEvent(const lct::TraceEvent& event);
+
+    std::vector<lct::TraceEvent> Events;
 };
 
 Test::~Test()
@@ -20,6 +27,73 @@ Test::~Test()
 void Test::HandleTraceEvent(const lct::TraceEvent& event)
 {
     LOG_DEBUG("Got event");
+    Events.push_back(event);
+}
+
+bool Test::Check(size_t index, enum lct::TraceEvent::Type type, uint32_t value, uint64_t time,
+        enum lct::TraceEvent::TimeCode timeCode)
+{
+    if (index >= Events.size()) {
+        LOG_ERROR("Event %lu missing", index);
+        return false;
+    }
+    const lct::TraceEvent& e = Events[index];
+    if (e.Type != type || e.Value != value || e.Timestamp != time || e.TimeCode != timeCode) {
+        LOG_ERROR("Event %lu: type %d value %#x at %lu (%d), expected %d %#x at %lu (%d)",
+                index, e.Type, e.Value, e.Timestamp, e.TimeCode, type, value, time, timeCode);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Events get the time of the local timestamp that follows them.
+ */
+bool Test::TestTimes()
+{
+    typedef lct::TraceEvent E;
+    bool ok = true;
+    Events.clear();
+    lct::TraceFileParser tfp(*this);
+
+    // Before the first timestamp nothing is held back
+    const uint8_t buf1[] = {
+            0x01, 0x40,                 // port 0: 0x40
+            0xc0, 0x05,                 // timestamp +5, in sync
+            0x01, 0x41,                 // port 0: 0x41
+            0x09, 0x42,                 // port 1: 0x42
+            0x20,                       // short timestamp +2
+            0x01, 0x43,                 // port 0: 0x43
+            0xd0, 0x83 };               // timestamp, delayed, split
+    tfp.Feed(buf1, sizeof(buf1));
+    ok &= Events.size() == 5;
+    ok &= Check(0, E::TRACE_EVENT_INSTR, 0x40, 0, E::TIME_UNSTAMPED);
+    ok &= Check(1, E::TRACE_EVENT_TIMESTAMP, 5, 5, E::TIME_SYNC);
+    ok &= Check(2, E::TRACE_EVENT_INSTR, 0x41, 7, E::TIME_SYNC);
+    ok &= Check(3, E::TRACE_EVENT_INSTR, 0x42, 7, E::TIME_SYNC);
+    ok &= Check(4, E::TRACE_EVENT_TIMESTAMP, 2, 7, E::TIME_SYNC);
+
+    const uint8_t buf2[] = {
+            0x01,                       // +131, delayed timestamp
+            0x01, 0x44,                 // port 0: 0x44
+            0x70,                       // overflow
+            0xe0, 0x0a,                 // timestamp +10, delayed packets
+            0x01, 0x45 };               // port 0: 0x45, never stamped
+    tfp.Feed(buf2, sizeof(buf2));
+    ok &= Events.size() == 10;
+    ok &= Check(5, E::TRACE_EVENT_INSTR, 0x43, 138, E::TIME_TS_DELAYED);
+    ok &= Check(6, E::TRACE_EVENT_TIMESTAMP, 131, 138, E::TIME_SYNC);
+    ok &= Check(7, E::TRACE_EVENT_INSTR, 0x44, 148, E::TIME_EVENT_DELAYED);
+    ok &= Check(8, E::TRACE_EVENT_OVERFLOW, 0, 148, E::TIME_EVENT_DELAYED);
+    ok &= Check(9, E::TRACE_EVENT_TIMESTAMP, 10, 148, E::TIME_SYNC);
+
+    tfp.Flush();
+    ok &= Check(10, E::TRACE_EVENT_INSTR, 0x45, 148, E::TIME_UNSTAMPED);
+    ok &= Events.size() == 11;
+    if (!ok) {
+        LOG_ERROR("Events not stamped with the following timestamp");
+    }
+    return ok;
 }
 
 int Test::Run()
@@ -56,7 +130,7 @@ int Test::Run()
         tfp.Feed(buf2, sizeof(buf2));
     }
 
-    return 0;
+    return TestTimes() ? 0 : 1;
 }
 
 int main()
@@ -0,0 +1,267 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+
+#include "log.h"
+#include "EventLoop.h"
+#include "TraceSocket.h"
+
+/**
+ * Stand-in for the OpenOCD trace server, listening on a loopback port.
+ */
+class Server {
+public:
+    Server() : Listen(-1), Client(-1), Port(0) { }
+    virtual ~Server();
+    bool Start();
+    bool Accept();
+    void Drop();
+
+    int Listen;
+    int Client;
+    uint16_t Port;
+};
+
+Server::~Server()
+{
+    Drop();
+    if (Listen != -1) {
+        close(Listen);
+    }
+}
+
+bool Server::Start()
+{
+    Listen = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = sockaddr_in();
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (Listen == -1 || bind(Listen, (sockaddr*)&addr, len) != 0 ||
+            listen(Listen, 1) != 0 || getsockname(Listen, (sockaddr*)&addr, &len) != 0) {
+        return false;
+    }
+    Port = ntohs(addr.sin_port);
+    return true;
+}
+
+bool Server::Accept()
+{
+    Client = accept(Listen, NULL, NULL);
+    return Client != -1;
+}
+
+void Server::Drop()
+{
+    if (Client != -1) {
+        close(Client);
+        Client = -1;
+    }
+}
+
+class Reader : public lct::EventLoop::Handler {
+public:
+    Reader(lct::TraceSocket& socket) : Socket(socket), Data(), Lost(0) { }
+    virtual ~Reader();
+    void HandleEvents(uint32_t events);
+
+    lct::TraceSocket& Socket;
+    std::string Data;
+    unsigned Lost;
+
+private:
+    Reader(const Reader&);
+    Reader& operator=(const Reader&);
+};
+
+Reader::~Reader()
+{
+}
+
+void Reader::HandleEvents(uint32_t)
+{
+    if (Socket.GetState() == lct::TraceSocket::CONNECTING) {
+        Socket.FinishConnect();
+        return;
+    }
+    uint8_t buf[4];
+    ssize_t res;
+    while ((res = Socket.Receive(buf, sizeof(buf))) > 0) {
+        Data.append((const char*)buf, res);
+    }
+    if (res < 0) {
+        Lost++;
+    }
+}
+
+/**
+ * Socket whose server has a dead address in front of the real one, like
+ * "localhost" resolving to ::1 with the server only listening on 127.0.0.1.
+ */
+class TwoAddressSocket : public lct::TraceSocket {
+public:
+    void AddDeadAddress(uint16_t port)
+    {
+        Address dead = Addresses.at(0);
+        reinterpret_cast<sockaddr_in*>(&dead.Addr)->sin_port = htons(port);
+        Addresses.insert(Addresses.begin(), dead);
+        Current = 0;
+    }
+
+    /** Wait for the attempt in progress, or start a new one */
+    void Step()
+    {
+        if (GetState() == CLOSED) {
+            Reconnect();
+            return;
+        }
+        pollfd pfd = { GetFd(), POLLOUT, 0 };
+        poll(&pfd, 1, 1000);
+        FinishConnect();
+    }
+};
+
+class Test {
+public:
+    Test() { }
+    virtual ~Test();
+    int Run();
+};
+
+Test::~Test()
+{
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running TraceSocket test");
+    bool ok = true;
+
+    Server server;
+    if (!server.Start()) {
+        LOG_ERROR("Failed to start server");
+        return 1;
+    }
+
+    lct::EventLoop loop;
+    lct::TraceSocket socket;
+    Reader reader(socket);
+
+    // Connect, and switch from waiting for the connection to reading
+    ok &= socket.Connect("127.0.0.1", server.Port);
+    ok &= socket.GetState() != lct::TraceSocket::CLOSED;
+    ok &= loop.Add(socket.GetFd(), &reader, lct::EventLoop::WRITABLE);
+    ok &= server.Accept();
+    ok &= loop.Poll(1000) == 1;
+    ok &= socket.GetState() == lct::TraceSocket::CONNECTED;
+    ok &= socket.GetConnects() == 1;
+    ok &= loop.Modify(socket.GetFd(), &reader, lct::EventLoop::READABLE);
+    ok &= loop.Poll(0) == 0;
+
+    // Data larger than the receive buffer is read in several batches
+    ok &= write(server.Client, "0123456789", 10) == 10;
+    ok &= loop.Poll(1000) == 1;
+    ok &= reader.Data == "0123456789";
+    if (!ok) {
+        LOG_ERROR("Failed to receive");
+    }
+
+    // The server going away closes the socket
+    server.Drop();
+    ok &= loop.Poll(1000) == 1;
+    ok &= reader.Lost == 1;
+    ok &= socket.GetState() == lct::TraceSocket::CLOSED;
+    ok &= socket.GetFd() == -1;
+    ok &= socket.Receive(NULL, 0) == -1;
+    if (!ok) {
+        LOG_ERROR("Failed to detect lost connection");
+    }
+
+    // And it can come back
+    ok &= socket.Reconnect();
+    ok &= loop.Add(socket.GetFd(), &reader, lct::EventLoop::WRITABLE);
+    ok &= server.Accept();
+    ok &= loop.Poll(1000) == 1;
+    ok &= socket.GetState() == lct::TraceSocket::CONNECTED;
+    ok &= socket.GetConnects() == 2;
+    ok &= loop.Modify(socket.GetFd(), &reader, lct::EventLoop::READABLE);
+    ok &= write(server.Client, "abc", 3) == 3;
+    ok &= loop.Poll(1000) == 1;
+    ok &= reader.Data == "0123456789abc";
+    if (!ok) {
+        LOG_ERROR("Failed to reconnect");
+    }
+
+    // A connection that the server has not accepted yet is not taken for
+    // an established one. With the backlog full, the SYN goes unanswered.
+    {
+        Server busy;
+        ok &= busy.Start() && listen(busy.Listen, 0) == 0;
+        const int first = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        sockaddr_in addr = sockaddr_in();
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(busy.Port);
+        connect(first, (sockaddr*)&addr, sizeof(addr));
+        usleep(10000);
+        lct::TraceSocket pending;
+        ok &= pending.Connect("127.0.0.1", busy.Port);
+        usleep(10000);
+        ok &= !pending.FinishConnect();
+        ok &= pending.GetState() == lct::TraceSocket::CONNECTING;
+        close(first);
+        if (!ok) {
+            LOG_ERROR("Connection in progress taken for connected");
+        }
+    }
+
+    // The next address is tried after one fails, from the addresses found
+    // by Connect()
+    {
+        Server other;
+        Server dead;
+        ok &= other.Start() && dead.Start();
+        close(dead.Listen);
+        dead.Listen = -1;
+        TwoAddressSocket two;
+        ok &= two.Connect("127.0.0.1", other.Port);
+        two.Close();
+        two.AddDeadAddress(dead.Port);
+        ok &= two.Reconnect() || two.GetState() == lct::TraceSocket::CLOSED;
+        for (int i = 0; i < 4 && two.GetState() != lct::TraceSocket::CONNECTED; i++) {
+            two.Step();
+        }
+        ok &= two.GetState() == lct::TraceSocket::CONNECTED && other.Accept();
+        if (!ok) {
+            LOG_ERROR("Second address not tried");
+        }
+    }
+
+    // Nobody listening
+    const uint16_t port = server.Port;
+    server.Drop();
+    close(server.Listen);
+    server.Listen = -1;
+    lct::TraceSocket refused;
+    if (refused.Connect("127.0.0.1", port)) {
+        lct::EventLoop loop2;
+        Reader r2(refused);
+        ok &= loop2.Add(refused.GetFd(), &r2, lct::EventLoop::WRITABLE);
+        ok &= loop2.Poll(1000) == 1;
+    }
+    ok &= refused.GetState() == lct::TraceSocket::CLOSED;
+    if (!ok) {
+        LOG_ERROR("Failed to handle refused connection");
+    }
+
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
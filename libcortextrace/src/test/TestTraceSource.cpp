@@ -0,0 +1,334 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "log.h"
+#include "TraceSource.h"
+#include "UringTraceSource.h"
+
+class Test {
+public:
+    Test() { }
+    virtual ~Test();
+    int Run();
+
+protected:
+    bool TestMemory();
+    bool TestMapped();
+    bool TestFd();
+    bool TestFifo();
+    bool TestArchive();
+    bool TestUring();
+    bool TestOpen();
+};
+
+Test::~Test()
+{
+}
+
+/**
+ * Read everything a source has to give, releasing each buffer right away.
+ */
+static std::string drain(lct::TraceSource& source, lct::TraceSource::Status* status,
+        unsigned* buffers = NULL)
+{
+    std::string data;
+    lct::TraceSource::Buffer buf;
+    while ((*status = source.Acquire(buf)) == lct::TraceSource::DATA) {
+        data.append(reinterpret_cast<const char*>(buf.Data), buf.Length);
+        source.Release(buf);
+        if (buffers) {
+            (*buffers)++;
+        }
+    }
+    return data;
+}
+
+bool Test::TestMemory()
+{
+    bool ok = true;
+    const uint8_t data[] = { 1, 2, 3, 4, 5, 6, 7 };
+    lct::MemoryTraceSource source(data, sizeof(data), 3);
+
+    // Buffers point into the caller's memory
+    lct::TraceSource::Buffer a;
+    lct::TraceSource::Buffer b;
+    ok &= source.Acquire(a) == lct::TraceSource::DATA;
+    ok &= source.Acquire(b) == lct::TraceSource::DATA;
+    ok &= a.Data == data && a.Length == 3;
+    ok &= b.Data == data + 3 && b.Length == 3;
+    ok &= source.Outstanding() == 2;
+    source.Release(a);
+    source.Release(b);
+    ok &= source.Outstanding() == 0;
+
+    ok &= source.Acquire(a) == lct::TraceSource::DATA;
+    ok &= a.Data == data + 6 && a.Length == 1;
+    source.Release(a);
+    ok &= source.Acquire(a) == lct::TraceSource::END;
+    ok &= source.GetFd() == -1;
+
+    if (!ok) {
+        LOG_ERROR("Memory source failed");
+    }
+    return ok;
+}
+
+bool Test::TestMapped()
+{
+    bool ok = true;
+    char path[] = "/tmp/lct-test-XXXXXX";
+    const int fd = mkstemp(path);
+    const std::string content(10000, 'x');
+    ok &= fd != -1 && write(fd, content.data(), content.size()) == ssize_t(content.size());
+
+    lct::MappedTraceSource source(4096);
+    ok &= source.Map(path);
+    lct::TraceSource::Status status;
+    unsigned buffers = 0;
+    ok &= drain(source, &status, &buffers) == content;
+    ok &= status == lct::TraceSource::END && buffers == 3;
+
+    // An empty file has nothing to map
+    ok &= ftruncate(fd, 0) == 0;
+    lct::MappedTraceSource empty;
+    ok &= empty.Map(path);
+    ok &= drain(empty, &status).empty() && status == lct::TraceSource::END;
+
+    close(fd);
+    unlink(path);
+
+    if (!ok) {
+        LOG_ERROR("Mapped source failed");
+    }
+    return ok;
+}
+
+bool Test::TestFd()
+{
+    bool ok = true;
+    int fds[2];
+    ok &= pipe2(fds, O_NONBLOCK) == 0;
+
+    lct::FdTraceSource source(fds[0], true, 4, 2);
+    ok &= source.GetFd() == fds[0];
+    lct::TraceSource::Buffer a;
+    lct::TraceSource::Buffer b;
+    lct::TraceSource::Buffer c;
+    ok &= source.Acquire(a) == lct::TraceSource::AGAIN;
+
+    // Both buffers lent out, so no more reads until one comes back
+    ok &= write(fds[1], "abcdefghij", 10) == 10;
+    ok &= source.Acquire(a) == lct::TraceSource::DATA;
+    ok &= source.Acquire(b) == lct::TraceSource::DATA;
+    ok &= source.Acquire(c) == lct::TraceSource::AGAIN;
+    ok &= std::string((const char*)a.Data, a.Length) == "abcd";
+    ok &= std::string((const char*)b.Data, b.Length) == "efgh";
+    ok &= a.Data != b.Data;
+    source.Release(a);
+    ok &= source.Acquire(c) == lct::TraceSource::DATA;
+    ok &= c.Data == a.Data;
+    ok &= std::string((const char*)c.Data, c.Length) == "ij";
+    source.Release(b);
+    source.Release(c);
+    ok &= source.Outstanding() == 0;
+
+    close(fds[1]);
+    ok &= source.Acquire(a) == lct::TraceSource::END;
+
+    if (!ok) {
+        LOG_ERROR("Descriptor source failed");
+    }
+    return ok;
+}
+
+bool Test::TestFifo()
+{
+    bool ok = true;
+    lct::FifoTraceSource source;
+    ok &= source.Create();
+    ok &= source.GetFd() != -1;
+
+    // A writer coming and going does not end the data
+    const int fd = open(source.GetName().c_str(), O_WRONLY);
+    ok &= fd != -1 && write(fd, "hello", 5) == 5;
+    close(fd);
+    lct::TraceSource::Status status;
+    ok &= drain(source, &status) == "hello";
+    ok &= status == lct::TraceSource::AGAIN;
+
+    if (!ok) {
+        LOG_ERROR("FIFO source failed");
+    }
+    return ok;
+}
+
+bool Test::TestArchive()
+{
+    bool ok = true;
+    char path[] = "/tmp/lct-test-XXXXXX";
+    const int fd = mkstemp(path);
+    ok &= fd != -1;
+
+    // Only pipes can be archived
+    lct::FdTraceSource file(fd, false);
+    ok &= !file.SetArchive(path);
+
+    int fds[2];
+    ok &= pipe2(fds, O_NONBLOCK) == 0;
+    lct::FdTraceSource source(fds[0], true, 8, 1);
+    ok &= source.SetArchive(path);
+
+    // The decoded copy and the archive get the same bytes
+    lct::TraceSource::Status status;
+    ok &= write(fds[1], "0123456789abcdef!", 17) == 17;
+    ok &= drain(source, &status) == "0123456789abcdef!";
+    ok &= status == lct::TraceSource::AGAIN;
+    ok &= write(fds[1], "more", 4) == 4;
+    close(fds[1]);
+    ok &= drain(source, &status) == "more";
+    ok &= status == lct::TraceSource::END;
+    ok &= source.GetArchived() == 21;
+
+    char buf[32];
+    ok &= pread(fd, buf, sizeof(buf), 0) == 21;
+    ok &= std::string(buf, 21) == "0123456789abcdef!more";
+    close(fd);
+    unlink(path);
+
+    if (!ok) {
+        LOG_ERROR("Archiving failed");
+    }
+    return ok;
+}
+
+bool Test::TestUring()
+{
+    bool ok = true;
+    char path[] = "/tmp/lct-test-XXXXXX";
+    const int fd = mkstemp(path);
+    std::string content;
+    for (unsigned i = 0; i < 10000; i++) {
+        content += char('a' + i % 26);
+    }
+    ok &= fd != -1 && write(fd, content.data(), content.size()) == ssize_t(content.size());
+
+    // Falls back to the plain path where io_uring is not allowed
+    std::unique_ptr<lct::TraceSource> named(lct::TraceSource::Open(std::string("uring:") + path));
+    lct::TraceSource::Status status;
+    ok &= named && drain(*named, &status) == content && status == lct::TraceSource::END;
+
+    if (!lct::UringTraceSource::IsAvailable()) {
+        LOG_INFO("io_uring is not available, skipping");
+        close(fd);
+        unlink(path);
+        return ok;
+    }
+
+    // Small buffers, so that reads complete while others are lent
+    lct::UringTraceSource source(1024, 4);
+    ok &= source.Open(fd, true);
+    ok &= source.GetFd() == -1;
+    lct::TraceSource::Buffer a;
+    lct::TraceSource::Buffer b;
+    ok &= source.Acquire(a) == lct::TraceSource::DATA;
+    ok &= source.Acquire(b) == lct::TraceSource::DATA;
+    ok &= a.Length == 1024 && b.Length == 1024;
+    std::string data((const char*)a.Data, a.Length);
+    data.append((const char*)b.Data, b.Length);
+    source.Release(b);
+    source.Release(a);
+    unsigned buffers = 0;
+    data += drain(source, &status, &buffers);
+    ok &= data == content;
+    ok &= status == lct::TraceSource::END && buffers == 8;
+    ok &= source.Outstanding() == 0;
+
+    // A file that grows after a short read still ends there
+    const int grow = open(path, O_RDWR | O_TRUNC);
+    ok &= grow != -1 && write(grow, content.data(), 1500) == 1500;
+    lct::UringTraceSource growing(1024, 4);
+    ok &= growing.Open(grow, true);
+    ok &= growing.Acquire(a) == lct::TraceSource::DATA && a.Length == 1024;
+    growing.Release(a);
+    ok &= growing.Acquire(a) == lct::TraceSource::DATA && a.Length == 476;
+    ok &= write(grow, content.data() + 1500, 3000) == 3000;
+    growing.Release(a);
+    ok &= growing.Acquire(a) == lct::TraceSource::END;
+
+    // Pipes are left to the other sources
+    int fds[2];
+    ok &= pipe(fds) == 0;
+    lct::UringTraceSource pipeSource(16, 4);
+    ok &= !pipeSource.Open(fds[0], true);
+    close(fds[0]);
+    close(fds[1]);
+
+    unlink(path);
+
+    if (!ok) {
+        LOG_ERROR("io_uring source failed");
+    }
+    return ok;
+}
+
+bool Test::TestOpen()
+{
+    bool ok = true;
+    char path[] = "/tmp/lct-test-XXXXXX";
+    const int fd = mkstemp(path);
+    ok &= fd != -1 && write(fd, "trace", 5) == 5;
+    close(fd);
+
+    std::unique_ptr<lct::TraceSource> file(lct::TraceSource::Open(path));
+    ok &= file && dynamic_cast<lct::MappedTraceSource*>(file.get());
+    lct::TraceSource::Status status;
+    ok &= file && drain(*file, &status) == "trace";
+    unlink(path);
+
+    std::unique_ptr<lct::TraceSource> missing(lct::TraceSource::Open(path));
+    ok &= !missing;
+    std::unique_ptr<lct::TraceSource> serial(lct::TraceSource::Open("serial:/dev/null@115200"));
+    ok &= !serial;
+    std::unique_ptr<lct::TraceSource> tcp(lct::TraceSource::Open("tcp:1234"));
+    ok &= !tcp;
+
+    // Bad numbers are reported rather than thrown
+    const char* invalid[] = { "tcp:localhost:", "tcp:localhost:port", "tcp:localhost:70000",
+            "tcp:localhost:-1", "tcp:localhost:99999999999999999999", "serial:/dev/null@",
+            "serial:/dev/null@fast", "serial:/dev/null@115200x" };
+    for (const char* name : invalid) {
+        std::unique_ptr<lct::TraceSource> source(lct::TraceSource::Open(name));
+        ok &= !source;
+    }
+
+    if (!ok) {
+        LOG_ERROR("Opening sources by name failed");
+    }
+    return ok;
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running TraceSource test");
+    bool ok = true;
+
+    ok &= TestMemory();
+    ok &= TestMapped();
+    ok &= TestFd();
+    ok &= TestFifo();
+    ok &= TestArchive();
+    ok &= TestUring();
+    ok &= TestOpen();
+
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
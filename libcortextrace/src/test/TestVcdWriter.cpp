@@ -0,0 +1,75 @@
+#include <sstream>
+#include <string>
+
+#include "log.h"
+#include "TraceEvent.h"
+#include "VcdWriter.h"
+
+class Test {
+public:
+    Test() : Out(), Writer(Out, 0, 20) { }
+    virtual ~Test();
+    int Run();
+
+protected:
+    std::ostringstream Out;
+    lct::VcdWriter Writer;
+
+    void Event(enum lct::TraceEvent::Type type, uint32_t code, uint32_t value,
+            uint64_t timestamp);
+};
+
+Test::~Test()
+{
+}
+
+void Test::Event(enum lct::TraceEvent::Type type, uint32_t code, uint32_t value,
+        uint64_t timestamp)
+{
+    lct::TraceEvent e(type, code, value, timestamp);
+    Writer.HandleTraceEvent(e);
+}
+
+int Test::Run()
+{
+    LOG_INFO("Running VcdWriter test");
+    bool ok = true;
+
+    Writer.SetWatchName(1, "counter.x");
+
+    // Data trace value from comparator 1, written twice with the same value
+    Event(lct::TraceEvent::TRACE_EVENT_HW, (0x13 << 3) | 0x3, 5, 100);
+    Event(lct::TraceEvent::TRACE_EVENT_HW, (0x13 << 3) | 0x3, 5, 110);
+    // SysTick preempted by IRQ0, at the same time as
+    // a write to ITM port 2
+    Event(lct::TraceEvent::TRACE_EVENT_HW, 0x0e, 0x1000 | 15, 200);
+    Event(lct::TraceEvent::TRACE_EVENT_INSTR, (2 << 3) | 0x1, 0x41, 200);
+    Event(lct::TraceEvent::TRACE_EVENT_HW, 0x0e, 0x1000 | 16, 210);
+    Event(lct::TraceEvent::TRACE_EVENT_HW, 0x0e, 0x2000 | 16, 220);
+    Event(lct::TraceEvent::TRACE_EVENT_HW, 0x0e, 0x2000 | 15, 230);
+    Writer.Finish();
+
+    const std::string vcd = Out.str();
+    const size_t body = vcd.find("$end\n", vcd.find("$dumpvars")) + 5;
+    ok &= vcd.find("$var wire 32 \" counter_x $end") != std::string::npos;
+    ok &= vcd.find("$var wire 1 U SysTick $end") != std::string::npos;
+    ok &= vcd.find("$var wire 1 V IRQ0 $end") != std::string::npos;
+    ok &= vcd.compare(body, std::string::npos,
+            "#100\nb101 \"\n"
+            "#200\n1U\nb1111 E\nb1000001 '\n"
+            "#210\n1V\nb10000 E\n"
+            "#220\n0V\nb1111 E\n"
+            "#230\n0U\nb0 E\n") == 0;
+
+    if (!ok) {
+        LOG_ERROR("Unexpected VCD output:\n%s", vcd.c_str());
+    }
+
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    Test t;
+    return t.Run();
+}
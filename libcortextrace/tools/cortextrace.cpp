@@ -1,65 +1,288 @@
+#include <poll.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
 
+#include "DwtCounters.h"
+#include "ElfFile.h"
+#include "EventFormatter.h"
+#include "ExceptionAnalyzer.h"
+#include "HotspotProfile.h"
+#include "LineTable.h"
+#include "OutputSink.h"
+#include "PerfettoWriter.h"
+#include "SpanAnalyzer.h"
+#include "SymbolTable.h"
 #include "TraceEvent.h"
 #include "TraceEventListener.h"
 #include "TraceFileParser.h"
+#include "TraceSource.h"
+#include "VcdWriter.h"
 #include "log.h"
 
 class CortexTrace : public lct::TraceEventListener {
 public:
-    CortexTrace() { }
+    CortexTrace() : Elf(), Symbols(), Lines(Elf), Profile(&Lines, &Symbols),
+        ReportSize(0), Exceptions(), Counters(), Spans(), TimestampFreq(0),
+        PerfettoPath(), Perfetto(), VcdPath(), Vcd(), Output(STDOUT_FILENO),
+        Formatter(new lct::TextEventFormatter(Output)) { }
     virtual ~CortexTrace();
-    int Run(std::istream& input);
+    bool LoadElf(std::string path);
+    void SetReportSize(size_t n) { ReportSize = n; }
+    void SetTimestampFreq(double hz) { TimestampFreq = hz; }
+    void SetSpanPorts(unsigned begin, unsigned end, uint32_t ids);
+    void SetPerfettoPath(std::string path) { PerfettoPath = path; }
+    void SetVcdPath(std::string path) { VcdPath = path; }
+    bool SetFormat(std::string format);
+    int Run(lct::TraceSource& input);
 
     // interface TraceEventListener
     void HandleTraceEvent(const lct::TraceEvent& event);
+
+protected:
+    lct::ElfFile Elf;
+    lct::SymbolTable Symbols;
+    lct::LineTable Lines;
+    lct::HotspotProfile Profile;
+    size_t ReportSize;
+    lct::ExceptionAnalyzer Exceptions;
+    lct::DwtCounters Counters;
+    std::unique_ptr<lct::SpanAnalyzer> Spans;
+    double TimestampFreq;
+    std::string PerfettoPath;
+    std::unique_ptr<lct::PerfettoWriter> Perfetto;
+    std::string VcdPath;
+    std::unique_ptr<lct::VcdWriter> Vcd;
+    lct::FdOutputSink Output;
+    std::unique_ptr<lct::EventFormatter> Formatter;
 };
 
 CortexTrace::~CortexTrace()
 {
 }
 
+void CortexTrace::SetSpanPorts(unsigned begin, unsigned end, uint32_t ids)
+{
+    Spans.reset(new lct::SpanAnalyzer(begin, end, ids));
+}
+
+bool CortexTrace::SetFormat(std::string format)
+{
+    lct::EventFormatter* formatter = lct::EventFormatter::Create(format, Output);
+    if (!formatter) {
+        LOG_ERROR("Unknown output format %s", format.c_str());
+        return false;
+    }
+    Formatter.reset(formatter);
+    return true;
+}
+
+bool CortexTrace::LoadElf(std::string path)
+{
+    if (!Elf.Open(path)) {
+        return false;
+    }
+    return Symbols.Load(Elf);
+}
+
 void CortexTrace::HandleTraceEvent(const lct::TraceEvent& event)
 {
-    switch (event.Type) {
-    case lct::TraceEvent::TRACE_EVENT_INSTR:
-        std::cout << static_cast<char>(event.Value);
-        break;
-    case lct::TraceEvent::TRACE_EVENT_HW: {
-        const uint8_t discriminator = event.Code >> 3;
-        switch (discriminator) {
-        case 2: // PC sample
-            std::cout << "PC: " << std::hex << event.Value << std::dec << std::endl;
-            break;
+    if (Perfetto) {
+        Perfetto->HandleTraceEvent(event);
+    }
+    if (Vcd) {
+        Vcd->HandleTraceEvent(event);
+    }
+    Exceptions.HandleTraceEvent(event);
+    Counters.HandleTraceEvent(event);
+    if (Spans) {
+        Spans->HandleTraceEvent(event);
+        if (Spans->IsSpanEvent(event)) {
+            return;
         }
-        break;
     }
-    case lct::TraceEvent::TRACE_EVENT_OVERFLOW:
-        std::cout << "Overflow" << std::endl;
-        break;
-    default:
-        std::cout << "Event " << event.Type << ", "
-        << event.Code << ", " << event.Value << std::endl;
+
+    if (event.Type != lct::TraceEvent::TRACE_EVENT_HW) {
+        Formatter->Format(event);
+        return;
+    }
+
+    // Event counters and exception trace are summarized at end of input
+    if ((event.Code >> 3) == 2) { // PC sample
+        Profile.AddSample(event.Value);
+        lct::EventFormatter::Location location;
+        location.Symbol = Symbols.Lookup(event.Value, &location.Offset);
+        if (Elf.IsOpen() && !Lines.Lookup(event.Value, &location.File, &location.Line)) {
+            location.File = NULL;
+        }
+        Formatter->Format(event, &location);
     }
 }
 
-int CortexTrace::Run(std::istream& input)
+int CortexTrace::Run(lct::TraceSource& input)
 {
     lct::TraceFileParser tfp(*this);
 
-    while (!input.eof()) {
-        char buf[1024];
-        input.read(buf, sizeof(buf));
-        const auto len = input.gcount();
-        // LOG_DEBUG("Read %lu bytes", len);
-        tfp.Feed(reinterpret_cast<const uint8_t*>(buf), len);
+    std::ofstream perfettoFile;
+    if (!PerfettoPath.empty()) {
+        perfettoFile.open(PerfettoPath, std::ios::binary);
+        if (!perfettoFile) {
+            LOG_ERROR("Failed to open %s", PerfettoPath.c_str());
+            return 1;
+        }
+        Perfetto.reset(new lct::PerfettoWriter(perfettoFile, TimestampFreq));
+        if (Spans) {
+            Perfetto->SetSpanPorts(Spans->GetBeginPort(), Spans->GetEndPort());
+        }
+    }
+
+    std::ofstream vcdFile;
+    if (!VcdPath.empty()) {
+        vcdFile.open(VcdPath);
+        if (!vcdFile) {
+            LOG_ERROR("Failed to open %s", VcdPath.c_str());
+            return 1;
+        }
+        Vcd.reset(new lct::VcdWriter(vcdFile, TimestampFreq));
+    }
+
+    for (;;) {
+        lct::TraceSource::Buffer buf;
+        const lct::TraceSource::Status status = input.Acquire(buf);
+        if (status == lct::TraceSource::AGAIN) {
+            Output.Flush();
+            pollfd pfd = { input.GetFd(), POLLIN, 0 };
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        if (status != lct::TraceSource::DATA) {
+            break;
+        }
+        tfp.Feed(buf.Data, buf.Length);
+        input.Release(buf);
+        Output.Tick();
+    }
+    tfp.Flush();
+    Output.Flush();
+
+    if (Perfetto) {
+        Perfetto->Finish();
+        Perfetto.reset();
+    }
+    if (Vcd) {
+        Vcd->Finish();
+        Vcd.reset();
+    }
+
+    Exceptions.Report(std::cout, TimestampFreq);
+    Counters.Report(std::cout);
+    if (Spans) {
+        Spans->Report(std::cout, TimestampFreq);
+    }
+
+    if (ReportSize) {
+        Profile.ReportFunctions(std::cout, ReportSize);
+        Profile.ReportLines(std::cout, ReportSize);
     }
 
     return 0;
 }
 
+// -----------------------------------------------------------------
+
+static void printHelp(const char* progname)
+{
+    printf("Usage: %s [-h] [-f HZ] [-e PATH [-r N]] [-m BEGIN:END[:IDS]] [-p PATH] [-v PATH] [-o FORMAT] [-i SOURCE] [-a PATH]\n"
+            "  -h            Print this help text\n"
+            "  -f HZ         Timestamp frequency, for printing times in us\n"
+            "  -e PATH       ELF file to resolve PC samples to symbols with\n"
+            "  -r N          Print the N hottest functions and source lines\n"
+            "                at end of input\n"
+            "  -m BEGIN:END[:IDS]\n"
+            "                Pair span IDs 0 to IDS-1 (%u) written to stimulus\n"
+            "                ports BEGIN and END and print span duration\n"
+            "                statistics\n"
+            "  -p PATH       Write a Perfetto trace of exceptions, spans, ITM\n"
+            "                text and counters to PATH\n"
+            "  -o FORMAT     Output format for events: text, json or binary\n"
+            "  -v PATH       Write data trace values, ITM port values and\n"
+            "                exception activity to PATH as a VCD file\n"
+            "  -i SOURCE     Read trace data from SOURCE instead of standard\n"
+            "                input: a file or FIFO path, tcp:HOST:PORT,\n"
+            "                serial:PATH[@BAUD] or uring:PATH to read a file\n"
+            "                with several reads in flight\n"
+            "  -a PATH       Save the raw trace data to PATH while decoding it,\n"
+            "                for pipe and FIFO input\n"
+            "\n",
+            progname, lct::SpanAnalyzer::DEFAULT_SPAN_IDS);
+}
+
 int main(int argc, char* argv[])
 {
     CortexTrace t;
-    return t.Run(std::cin);
+    std::string source = "-";
+    std::string archive;
+
+    int c;
+    while ((c = getopt(argc, argv, "he:f:r:m:p:v:o:i:a:")) != -1) {
+        switch (c) {
+        case 'e':
+            if (!t.LoadElf(optarg)) {
+                return 1;
+            }
+            break;
+        case 'f':
+            t.SetTimestampFreq(std::stod(optarg));
+            break;
+        case 'r':
+            t.SetReportSize(std::stoul(optarg));
+            break;
+        case 'm': {
+            unsigned begin, end;
+            uint32_t ids;
+            if (!lct::SpanAnalyzer::ParsePorts(optarg, &begin, &end, &ids)) {
+                return 1;
+            }
+            t.SetSpanPorts(begin, end, ids);
+            break;
+        }
+        case 'p':
+            t.SetPerfettoPath(optarg);
+            break;
+        case 'v':
+            t.SetVcdPath(optarg);
+            break;
+        case 'o':
+            if (!t.SetFormat(optarg)) {
+                return 1;
+            }
+            break;
+        case 'a':
+            archive = optarg;
+            break;
+        case 'i':
+            source = optarg;
+            break;
+        case 'h':
+        default:
+            printHelp(argv[0]);
+            exit(1);
+        }
+    }
+
+    std::unique_ptr<lct::TraceSource> input(lct::TraceSource::Open(source));
+    if (!input) {
+        return 1;
+    }
+    if (!archive.empty()) {
+        lct::FdTraceSource* fdInput = dynamic_cast<lct::FdTraceSource*>(input.get());
+        if (!fdInput || !fdInput->SetArchive(archive)) {
+            LOG_ERROR("Cannot archive %s", source.c_str());
+            return 1;
+        }
+    }
+    return t.Run(*input);
 }
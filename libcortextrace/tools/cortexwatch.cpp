@@ -1,19 +1,33 @@
-#include <sys/stat.h>
 #include <unistd.h>
 #include <signal.h>
-#include <cassert>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <vector>
-#include <thread>
-#include <fcntl.h>
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
-
+#include <sstream>
+
+#include "CaptureSession.h"
+#include "DwtCounters.h"
+#include "ElfFile.h"
+#include "EventFormatter.h"
+#include "ExceptionAnalyzer.h"
+#include "HotspotProfile.h"
+#include "LineTable.h"
+#include "OutputSink.h"
+#include "SessionManager.h"
+#include "SpanAnalyzer.h"
 #include "Registers.h"
+#include "RegisterTransaction.h"
+#include "SymbolCache.h"
+#include "SymbolTable.h"
+#include "TargetCapabilities.h"
+#include "TimeSeries.h"
 #include "TraceEvent.h"
 #include "TraceEventListener.h"
-#include "TraceFileParser.h"
+#include "VcdWriter.h"
 #include "GdbConnection.h"
 #include "log.h"
 
@@ -21,103 +35,241 @@
 #define DEFAULT_GDB_TARGET "extended-remote :3333"
 #define DEFAULT_CORE_FREQ 72000000UL
 
-class Pipe {
+/**
+ * Settings shared by all targets.
+ */
+struct WatchOptions {
+    WatchOptions() :
+        CoreFreq(DEFAULT_CORE_FREQ), ReportSize(0), TraceExceptions(false),
+        CounterEnable(0), HistoryPoints(0), SpanPorts(false), SpanBegin(0),
+        SpanEnd(0), SpanIds(0), VcdPath(), Format("text"), TracePort(0),
+        ArchivePath(), CacheDir(lct::TargetCapabilities::DefaultCacheDir()), GdbStats(false),
+        Watch() {}
+    size_t CoreFreq;
+    size_t ReportSize;
+    bool TraceExceptions;
+    uint32_t CounterEnable;
+    size_t HistoryPoints;
+    bool SpanPorts;
+    unsigned SpanBegin;
+    unsigned SpanEnd;
+    uint32_t SpanIds;
+    std::string VcdPath;
+    std::string Format;
+    uint16_t TracePort;
+    std::string ArchivePath;
+    std::string CacheDir;
+    bool GdbStats;
+    std::vector<std::string> Watch;
+};
+
+/**
+ * Trace analysis and output for one target.
+ */
+class WatchTarget : public lct::TraceEventListener {
 public:
-    Pipe() throw(std::runtime_error);
-    ~Pipe();
-    int OpenForReading();
-    std::string GetName() const { return Name; }
+    WatchTarget(unsigned id, const std::string& name, const WatchOptions& options,
+            const lct::ElfFile& elf, const lct::SymbolTable& symbols,
+            lct::LineTable& lines, lct::OutputSink& output);
+    virtual ~WatchTarget();
+    bool Setup(lct::GdbConnection& gdb);
+    void Restore(lct::GdbConnection& gdb);
+    void PrintPeriodic();
+    void Report();
+
+    // interface TraceEventListener
+    void HandleTraceEvent(const lct::TraceEvent& event);
 
 protected:
+    unsigned Id;
     std::string Name;
-    int Fd;
+    const WatchOptions& Options;
+    const lct::ElfFile& Elf;
+    const lct::SymbolTable& Symbols;
+    lct::LineTable& Lines;
+    lct::HotspotProfile Profile;
+    lct::ExceptionAnalyzer Exceptions;
+    lct::DwtCounters Counters;
+    std::vector<lct::TimeSeries> WatchSeries;
+    std::unique_ptr<lct::SpanAnalyzer> Spans;
+    std::ofstream VcdFile;
+    std::unique_ptr<lct::VcdWriter> Vcd;
+    lct::OutputSink& Output;
+    std::unique_ptr<lct::EventFormatter> Formatter;
+    uint32_t DwtCtrl;
+    uint32_t NewCtrl;
+
+    void FormatLocated(const lct::TraceEvent& event);
+    void PrintHistory();
+    void PrintName();
 };
 
-class CortexWatch : public lct::TraceEventListener {
+class CortexWatch {
 public:
-    CortexWatch() : TimeToExit(false), PipeFd(-1), TpiuPipe() { }
+    CortexWatch() : TimeToExit(false), Options() { }
     virtual ~CortexWatch();
-    int Run(std::string gdbPath, std::string gdbTarget,
-            std::string elfPath, size_t corefreq,
-            const std::vector<std::string>& watch);
+    int Run(std::string gdbPath, const std::vector<std::string>& gdbTargets,
+            std::string elfPath);
     void Exit();
-    void OpenPipe();
-
-    // interface TraceEventListener
-    void HandleTraceEvent(const lct::TraceEvent& event);
+    WatchOptions& GetOptions() { return Options; }
+    bool SetCounters(std::string list);
 
 protected:
-    bool TimeToExit;
-    int PipeFd;
-    std::unique_ptr<Pipe> TpiuPipe;
+    volatile bool TimeToExit;
+    WatchOptions Options;
 };
 
 static CortexWatch s_cortexWatch;
 
 // -----------------------------------------------------------------
 
-CortexWatch::~CortexWatch()
+WatchTarget::WatchTarget(unsigned id, const std::string& name, const WatchOptions& options,
+        const lct::ElfFile& elf, const lct::SymbolTable& symbols,
+        lct::LineTable& lines, lct::OutputSink& output) :
+        Id(id), Name(name), Options(options), Elf(elf), Symbols(symbols), Lines(lines),
+        Profile(&Lines, &Symbols), Exceptions(), Counters(), WatchSeries(), Spans(),
+        VcdFile(), Vcd(), Output(output),
+        Formatter(lct::EventFormatter::Create(options.Format, output)),
+        DwtCtrl(0), NewCtrl(0)
+{
+    if (!Name.empty()) {
+        Formatter->SetSource(Id, Name);
+    }
+    if (Options.SpanPorts) {
+        Spans.reset(new lct::SpanAnalyzer(Options.SpanBegin, Options.SpanEnd,
+                Options.SpanIds));
+    }
+}
+
+WatchTarget::~WatchTarget()
+{
+}
+
+void WatchTarget::PrintName()
 {
+    if (!Name.empty()) {
+        std::cout << Name << ": ";
+    }
 }
 
-void CortexWatch::HandleTraceEvent(const lct::TraceEvent& event)
+void WatchTarget::FormatLocated(const lct::TraceEvent& event)
 {
+    lct::EventFormatter::Location location;
+    location.Symbol = Symbols.Lookup(event.Value, &location.Offset);
+    if (Elf.IsOpen() && !Lines.Lookup(event.Value, &location.File, &location.Line)) {
+        location.File = NULL;
+    }
+    Formatter->Format(event, &location);
+}
+
+void WatchTarget::HandleTraceEvent(const lct::TraceEvent& event)
+{
+    if (Vcd) {
+        Vcd->HandleTraceEvent(event);
+    }
+    if (Spans) {
+        Spans->HandleTraceEvent(event);
+        if (Spans->IsSpanEvent(event)) {
+            return;
+        }
+    }
+
     switch (event.Type) {
-    case lct::TraceEvent::TRACE_EVENT_INSTR:
-        std::cout << static_cast<char>(event.Value);
-        break;
     case lct::TraceEvent::TRACE_EVENT_HW: {
         const uint8_t discriminator = event.Code >> 3;
-        if (discriminator == 0x2) { // PC sample
-            std::cout << "PC: " << std::hex << event.Value << std::dec << std::endl;
+        if (discriminator == 0x0) { // event counters, printed periodically
+            Counters.HandleTraceEvent(event);
+            return;
         }
-        else if ((discriminator & 0x19) == 0x08) { // PC trace
-            std::cout << "PC trace: " << std::hex << event.Value << std::dec << std::endl;
+        else if (discriminator == 0x1) { // exception trace
+            Exceptions.HandleTraceEvent(event);
         }
-        else if ((discriminator & 0x18) == 0x10) { // data trace
-            std::cout << "data trace: " << ((discriminator & 0x01) ? "W " : "R " )
-                    << std::hex << event.Value << std::dec << std::endl;
+        else if (discriminator == 0x2 || (discriminator & 0x19) == 0x08) { // PC sample or trace
+            Profile.AddSample(event.Value);
+            FormatLocated(event);
+            return;
         }
-        else {
-            std::cout << "HW event: " << std::hex << event.Code << ":" << event.Value << std::dec << std::endl;
+        else if ((discriminator & 0x18) == 0x10) { // data trace
+            const size_t comp = (discriminator >> 1) & 0x3;
+            if (comp < WatchSeries.size()) {
+                WatchSeries[comp].Append(event.Timestamp, event.Value);
+            }
         }
         break;
     }
     case lct::TraceEvent::TRACE_EVENT_OVERFLOW:
-        std::cout << "Overflow" << std::endl;
-        break;
-    case lct::TraceEvent::TRACE_EVENT_SYNC:
-        std::cout << "Sync" << std::endl;
+        Exceptions.HandleTraceEvent(event);
         break;
     default:
-        std::cout << "Event " << event.Type << ", "
-        << event.Code << ", " << event.Value << std::endl;
+        break;
     }
+    Formatter->Format(event);
 }
 
-void CortexWatch::OpenPipe()
+/**
+ * Print the decimated value history of each watched expression.
+ */
+void WatchTarget::PrintHistory()
 {
-    PipeFd = TpiuPipe->OpenForReading();
-    LOG_DEBUG("Opened pipe stream");
+    std::vector<lct::TimeSeries::Point> points;
+    for (size_t comp = 0; comp < WatchSeries.size(); comp++) {
+        const lct::TimeSeries& series = WatchSeries[comp];
+        if (series.Empty()) {
+            continue;
+        }
+        PrintName();
+        std::cout << "History of " << Options.Watch[comp] << " ("
+                << series.SampleCount() << " samples):" << std::endl;
+        points.clear();
+        series.QueryLast(series.Last().Time, Options.HistoryPoints, points);
+        for (const auto& p : points) {
+            std::cout << "  @" << p.Time << " min " << std::hex << static_cast<uint32_t>(p.Min)
+                    << " max " << static_cast<uint32_t>(p.Max) << std::dec << std::endl;
+        }
+    }
 }
 
-int CortexWatch::Run(std::string gdbPath, std::string gdbTarget,
-        std::string elfPath, size_t corefreq,
-        const std::vector<std::string>& watch)
+/**
+ * Configure tracing on a connected, halted target.
+ */
+bool WatchTarget::Setup(lct::GdbConnection& gdb)
 {
-    TpiuPipe.reset(new Pipe);
-
-    lct::GdbConnection gdb;
-    lct::TraceFileParser tfp(*this);
     lct::Registers regs;
 
-    gdb.Connect(gdbPath, elfPath);
-    gdb.TargetSelect(gdbTarget);
-    gdb.DisableTpiu();
+    // Open the output first, so that failing to does not leave the target
+    // half configured
+    if (!Options.VcdPath.empty()) {
+        // Number the files when there is more than one target
+        const std::string path = Name.empty() ? Options.VcdPath :
+                Options.VcdPath + "." + std::to_string(Id);
+        VcdFile.open(path);
+        if (!VcdFile) {
+            LOG_ERROR("Failed to open %s", path.c_str());
+            return false;
+        }
+    }
+
+    lct::RegisterTransaction t;
+    uint32_t cpuid = 0;
+    t.Read(regs.CPUID, &cpuid);
+    t.Read(regs.DWT_CTRL, &DwtCtrl);
+    if (!t.Submit(gdb)) {
+        LOG_ERROR("Failed to read the debug registers");
+        return false;
+    }
+
+    lct::TargetCapabilities caps;
+    const std::string buildId = Elf.BuildId();
+    if (!caps.LoadCached(Options.CacheDir, cpuid, buildId)) {
+        if (!caps.Probe(gdb)) {
+            return false;
+        }
+        caps.SaveCached(Options.CacheDir, buildId);
+    }
 
-    const uint32_t cpuid = gdb.ReadWord(regs.CPUID);
     const uint32_t partno = (cpuid >> 4) & 0xfff;
-    LOG_INFO("CPUID: %#x: %s %s%u r%up%u",
+    LOG_INFO("%sCPUID: %#x: %s %s%u r%up%u",
+            Name.empty() ? "" : (Name + ": ").c_str(),
             cpuid,
             (cpuid >> 24) == 0x41 ? "ARM" : "unknown",
             (partno & 0xc30) == 0xc20 ? "Cortex-M" : "unknown",
@@ -125,153 +277,330 @@ int CortexWatch::Run(std::string gdbPath, std::string gdbTarget,
             (cpuid >> 20) & 0xf,
             cpuid & 0xf);
 
-    const size_t numcomp = gdb.ReadWord(regs.DWT_CTRL) >> 28;
+    const size_t numcomp = caps.Comparators;
     LOG_DEBUG("%lu comparators on this chip", numcomp);
 
+    const std::vector<std::string>& watch = Options.Watch;
     if (watch.size() > numcomp) {
         LOG_ERROR("Too many expressions, hardware only has %lu comparators",
                 numcomp);
-        return 1;
+        return false;
     }
 
-    if ((gdb.ReadWord(regs.ROMTPIU) & 0x3) != 0x3) {
+    if (!caps.Has(lct::TargetCapabilities::TPIU)) {
         LOG_WARNING("No TPIU fitted, tracing will not work");
     }
-    if ((gdb.ReadWord(regs.ROMDWT) & 0x3) != 0x3) {
+    else if (!caps.TpiuNrz && !caps.TpiuManchester) {
+        LOG_WARNING("TPIU has no SWO output, tracing may not work");
+    }
+    if (!caps.Has(lct::TargetCapabilities::DWT)) {
         LOG_WARNING("No DWT fitted, tracing will not work");
     }
+    if (Options.TraceExceptions && !caps.TracePackets) {
+        LOG_WARNING("DWT cannot trace exceptions on this chip");
+    }
+    if ((Options.CounterEnable & ~regs.DWT_CTRL_CYCEVTENA) && !caps.ProfilingCounters) {
+        LOG_WARNING("DWT has no profiling counters on this chip");
+    }
+    if ((Options.CounterEnable & regs.DWT_CTRL_CYCEVTENA) && !caps.CycleCounter) {
+        LOG_WARNING("DWT has no cycle counter on this chip");
+    }
 
     LOG_INFO("CPU core has support for %s%s%s%s%s.",
-            (gdb.ReadWord(regs.ROMDWT) & 0x3) == 0x3 ? "DWT " : "",
-            (gdb.ReadWord(regs.ROMFPB) & 0x3) == 0x3 ? "FPB " : "",
-            (gdb.ReadWord(regs.ROMITM) & 0x3) == 0x3 ? "ITM " : "",
-            (gdb.ReadWord(regs.ROMTPIU) & 0x3) == 0x3 ? "TPIU " : "",
-            (gdb.ReadWord(regs.ROMETM) & 0x3) == 0x3 ? "ETM " : "");
-
-    // We need to open the pipe for reading before telling OpenOCD to open it
-    // for writing. The open call will block until both ends are open, so we
-    // need to do let it block "in the background" here.
-    std::thread openthread([this](){ this->OpenPipe(); });
-
-    LOG_DEBUG("Enable TPIU");
-    gdb.EnableTpiu(TpiuPipe->GetName(), corefreq);
-
-    // Clear old watches
+            caps.Has(lct::TargetCapabilities::DWT) ? "DWT " : "",
+            caps.Has(lct::TargetCapabilities::FPB) ? "FPB " : "",
+            caps.Has(lct::TargetCapabilities::ITM) ? "ITM " : "",
+            caps.Has(lct::TargetCapabilities::TPIU) ? "TPIU " : "",
+            caps.Has(lct::TargetCapabilities::ETM) ? "ETM " : "");
+
+    NewCtrl = DwtCtrl | Options.CounterEnable;
+    if (Options.TraceExceptions) {
+        NewCtrl |= regs.DWT_CTRL_EXCTRCENA;
+    }
+    if (Options.CounterEnable & regs.DWT_CTRL_CYCEVTENA) {
+        NewCtrl |= regs.DWT_CTRL_CYCCNTENA;
+    }
+    if (NewCtrl != DwtCtrl) {
+        t.Write(regs.DWT_CTRL, NewCtrl);
+    }
+    Counters.SetCycleEventPeriod(lct::DwtCounters::CycleEventPeriod(NewCtrl));
+
+    // Look up the new watches while the old ones are cleared, unless they
+    // are cached from an earlier run of the same firmware
+    lct::SymbolCache cache;
+    cache.Open(Options.CacheDir, Elf);
+    std::vector<lct::SymbolCache::Symbol> symbols(watch.size());
+    std::vector<bool> cached(watch.size());
+    std::vector<lct::GdbFuture<std::string> > sizes(watch.size());
+    std::vector<lct::GdbFuture<std::string> > addrs(watch.size());
+    for (size_t i = 0; i < watch.size(); i++) {
+        cached[i] = cache.Lookup(watch[i], &symbols[i]);
+        if (!cached[i]) {
+            sizes[i] = gdb.EvaluateAsync(std::string("sizeof(") + watch[i] + ")");
+            addrs[i] = gdb.EvaluateAsync(std::string("&(") + watch[i] + ")");
+        }
+    }
     for (size_t comp = 0; comp < numcomp; comp++) {
-        gdb.WriteWord(regs.DWT_COMP[comp], 0);
-        gdb.WriteWord(regs.DWT_MASK[comp], 0);
-        gdb.WriteWord(regs.DWT_FUNCTION[comp], 0);
+        t.Write(regs.DWT_COMP[comp], 0);
+        t.Write(regs.DWT_MASK[comp], 0);
+        t.Write(regs.DWT_FUNCTION[comp], 0);
+    }
+    if (!t.Submit(gdb)) {
+        LOG_ERROR("Failed to clear the comparators");
+        return false;
     }
 
     // Set up new watches
-    size_t comp = 0;
-    for (auto expression : watch) {
+    WatchSeries.assign(watch.size(), lct::TimeSeries());
+    for (size_t comp = 0; comp < watch.size(); comp++) {
         LOG_DEBUG("Setting watch");
-        const size_t size = std::stoul(gdb.Evaluate(std::string("sizeof(") +
-                expression + ")"));
-        const uint32_t addr = gdb.ResolveAddress(std::string("&(") + expression + ")");
+        lct::SymbolCache::Symbol& symbol = symbols[comp];
+        if (!cached[comp]) {
+            if (!sizes[comp].Wait() || !addrs[comp].Wait() ||
+                    !lct::SymbolCache::ParseAddressOf(addrs[comp].Get(), &symbol)) {
+                LOG_ERROR("Failed to look up %s", watch[comp].c_str());
+                return false;
+            }
+            symbol.Size = std::stoul(sizes[comp].Get());
+            if (lct::SymbolCache::Cacheable(watch[comp])) {
+                cache.Add(watch[comp], symbol);
+            }
+        }
+        const size_t size = symbol.Size;
+        const uint32_t addr = symbol.Address;
 
         const size_t masksize = log2(size);
         if (1U << masksize != size) {
             LOG_WARNING("Cannot watch region of size %lu, rounding down to %lu",
                     size, 1UL << masksize);
         }
-        gdb.WriteWord(regs.DWT_COMP[comp], addr);
-        gdb.WriteWord(regs.DWT_MASK[comp], masksize);
-        gdb.WriteWord(regs.DWT_FUNCTION[comp], 0x3);
-        LOG_INFO("Watching %s at %#x, size %lu (%lu bit mask)",
-                expression.c_str(), addr, size, masksize);
-        comp++;
-    }
-
-    gdb.Run();
-
-    openthread.join();
-    LOG_DEBUG("Reading from pipe");
-    while (!TimeToExit) {
-        timeval to = { 0, 100000 };
-        fd_set readfd;
-        FD_SET(PipeFd, &readfd);
-        select(PipeFd + 1, &readfd, NULL, NULL, &to);
-
-        char buf[128];
-        ssize_t readres = read(PipeFd, buf, sizeof(buf));
-        if (readres > 0) {
-            // LOG_DEBUG("Read %ld bytes", readres);
-            tfp.Feed(reinterpret_cast<const uint8_t*>(buf), readres);
-        }
-        else if (readres == -1) {
-            if (errno != EAGAIN) {
-                LOG_ERROR("Error when reading: %s", strerror(errno));
-                break;
-            }
+        t.Write(regs.DWT_COMP[comp], addr);
+        t.Write(regs.DWT_MASK[comp], masksize);
+        t.Write(regs.DWT_FUNCTION[comp], 0x3);
+        LOG_INFO("Watching %s (%s) at %#x, size %lu (%lu bit mask)%s",
+                watch[comp].c_str(), symbol.Type.c_str(), addr, size, masksize,
+                cached[comp] ? ", cached" : "");
+    }
+    if (!t.Submit(gdb)) {
+        LOG_ERROR("Failed to set up the comparators");
+        return false;
+    }
+    if (cache.Modified()) {
+        cache.Save();
+    }
+
+    if (VcdFile.is_open()) {
+        Vcd.reset(new lct::VcdWriter(VcdFile, Options.CoreFreq, 16 + caps.InterruptLines));
+        for (size_t i = 0; i < watch.size(); i++) {
+            Vcd->SetWatchName(i, watch[i]);
         }
     }
 
-    LOG_INFO("Exiting");
+    return true;
+}
 
-    gdb.Stop();
-    sleep(1);
-    gdb.DisableTpiu();
+void WatchTarget::Restore(lct::GdbConnection& gdb)
+{
+    lct::Registers regs;
+    if (NewCtrl != DwtCtrl) {
+        gdb.WriteWord(regs.DWT_CTRL, DwtCtrl);
+    }
+}
 
-    return 0;
+/**
+ * Print counter rates and span statistics since the last call.
+ */
+void WatchTarget::PrintPeriodic()
+{
+    if (Options.CounterEnable) {
+        PrintName();
+        std::cout << "Rates: ";
+        lct::DwtCounters::PrintRates(std::cout, Counters.TakeWindow());
+    }
+    if (Spans) {
+        Spans->ReportWindow(std::cout, Options.CoreFreq);
+    }
 }
 
-void CortexWatch::Exit()
+void WatchTarget::Report()
 {
-    TimeToExit = true;
+    if (!Name.empty()) {
+        std::cout << "Target " << Name << ":" << std::endl;
+    }
+    if (Options.TraceExceptions) {
+        Exceptions.Report(std::cout, Options.CoreFreq);
+    }
+    Counters.Report(std::cout);
+    if (Spans) {
+        Spans->Report(std::cout, Options.CoreFreq);
+    }
+    if (Options.HistoryPoints) {
+        PrintHistory();
+    }
+    if (Vcd) {
+        Vcd->Finish();
+        Vcd.reset();
+    }
+
+    if (Options.ReportSize) {
+        Profile.ReportFunctions(std::cout, Options.ReportSize);
+        Profile.ReportLines(std::cout, Options.ReportSize);
+    }
 }
 
 // -----------------------------------------------------------------
 
-Pipe::Pipe() throw(std::runtime_error) :
-        Name(), Fd(-1)
+CortexWatch::~CortexWatch()
 {
-    Name = "/tmp/tpiu.log";
-    int fifores = mkfifo(Name.c_str(), 0644);
-
-    if (fifores != 0) {
-        LOG_ERROR("Failed to create FIFO: %s", strerror(errno));
-        throw std::runtime_error(strerror(errno));
-    }
 }
 
-int Pipe::OpenForReading()
+/**
+ * Parse a comma separated list of DWT event counters to enable.
+ */
+bool CortexWatch::SetCounters(std::string list)
 {
-    assert(Fd == -1);
-    Fd = open(Name.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
-    if (Fd == -1) {
-        LOG_ERROR("Failed to open pipe: %s", strerror(errno));
+    std::istringstream in(list);
+    std::string name;
+    while (std::getline(in, name, ',')) {
+        unsigned c;
+        for (c = 0; c < lct::DwtCounters::NUM_COUNTERS; c++) {
+            const char* cname = lct::DwtCounters::CounterName(lct::DwtCounters::Counter(c));
+            if (strcasecmp(name.c_str(), cname) == 0) {
+                break;
+            }
+        }
+        if (c == lct::DwtCounters::NUM_COUNTERS) {
+            LOG_ERROR("Unknown counter %s", name.c_str());
+            return false;
+        }
+        Options.CounterEnable |= lct::DwtCounters::EnableBit(lct::DwtCounters::Counter(c));
     }
-    return Fd;
+    return true;
 }
 
-Pipe::~Pipe()
+int CortexWatch::Run(std::string gdbPath, const std::vector<std::string>& gdbTargets,
+        std::string elfPath)
 {
-    if (Fd == -1) {
-        return;
+    lct::ElfFile elf;
+    lct::SymbolTable symbols;
+    lct::LineTable lines(elf);
+    if (elf.Open(elfPath)) {
+        symbols.Load(elf);
+    }
+
+    lct::FdOutputSink output(STDOUT_FILENO);
+    lct::SessionManager sessions;
+    std::vector<std::unique_ptr<WatchTarget> > targets;
+
+    // Targets are only named when there is more than one, and any that
+    // were set up before a failure are restored all the same
+    const bool named = gdbTargets.size() > 1;
+    bool ok = true;
+    for (size_t i = 0; i < gdbTargets.size(); i++) {
+        const std::string name = named ? std::to_string(i) : "";
+        targets.push_back(std::unique_ptr<WatchTarget>(new WatchTarget(i, name,
+                Options, elf, symbols, lines, output)));
+
+        lct::CaptureSession* session = new lct::CaptureSession(
+                named ? name + " (" + gdbTargets[i] + ")" : gdbTargets[i], *targets.back());
+        if (Options.TracePort) {
+            session->SetTracePort(Options.TracePort + i);
+        }
+        if (!Options.ArchivePath.empty()) {
+            session->SetArchivePath(named ? Options.ArchivePath + "." + name :
+                    Options.ArchivePath);
+        }
+        if (!sessions.Start(session, gdbPath, gdbTargets[i], elfPath, Options.CoreFreq) ||
+                !targets.back()->Setup(session->Gdb())) {
+            ok = false;
+            break;
+        }
+    }
+
+    if (ok) {
+        for (size_t i = 0; i < sessions.Size(); i++) {
+            sessions.Get(i).Gdb().Run();
+        }
+        LOG_DEBUG("Reading from %lu targets", sessions.Size());
     }
+    time_t lastPeriodic = time(NULL);
+    while (ok && !TimeToExit) {
+        if (sessions.Poll(100) < 0) {
+            break;
+        }
+        output.Tick();
 
-    close(Fd);
+        if (time(NULL) != lastPeriodic) {
+            lastPeriodic = time(NULL);
+            output.Flush();
+            for (auto& t : targets) {
+                t->PrintPeriodic();
+            }
+            std::cout.flush();
+        }
+    }
 
-    LOG_DEBUG("Removing FIFO file");
-    int unlinkres = unlink(Name.c_str());
+    LOG_INFO("Exiting");
+    sessions.StopAll(ok ? 1000 : 0);
+    output.Flush();
 
-    if (unlinkres != 0) {
-        LOG_WARNING("Failed to remove FIFO file");
+    for (size_t i = 0; i < sessions.Size(); i++) {
+        targets[i]->Restore(sessions.Get(i).Gdb());
+        if (!ok) {
+            continue;
+        }
+        targets[i]->Report();
+        if (Options.GdbStats) {
+            sessions.Get(i).Gdb().ReportCommandStats(std::cout);
+        }
+    }
+    if (ok && named) {
+        sessions.ReportStats(std::cout);
     }
+
+    return ok ? 0 : 1;
+}
+
+void CortexWatch::Exit()
+{
+    TimeToExit = true;
 }
 
 // -----------------------------------------------------------------
 
 static void printHelp(const char* progname)
 {
-    printf("Usage: %s [-h] -e PATH [-g PATH] [-w EXPRESSION [-w...]]\n"
+    printf("Usage: %s [-h] -e PATH [-g PATH] [-t STRING [-t...]] [-r N] [-x] [-c LIST] [-s N] [-m BEGIN:END[:IDS]] [-v PATH] [-o FORMAT] [-n PORT] [-a PATH] [-l] [-w EXPRESSION [-w...]]\n"
             "  -h            Print this help text\n"
             "  -e PATH       Path to the ELF file to debug\n"
             "  -g PATH       Path to the GDB executable to use (%s)\n"
             "  -t STRING     GDB target specifier (%s)\n"
+            "                Give more than once to trace several targets\n"
+            "                running the same ELF file\n"
             "  -f HZ         CPU core frequency (%lu)\n"
+            "  -r N          Print the N hottest functions and source lines\n"
+            "                on exit\n"
+            "  -x            Trace exceptions and print handler statistics on exit\n"
+            "  -c LIST       Enable DWT event counters and print rates every second\n"
+            "                LIST is comma separated: cpi,exc,sleep,lsu,fold,cyc\n"
+            "  -s N          Keep a history of each watched value and print it\n"
+            "                on exit, decimated to at most N min/max points\n"
+            "  -m BEGIN:END[:IDS]\n"
+            "                Pair span IDs 0 to IDS-1 (%u) written to stimulus\n"
+            "                ports BEGIN and END and print span duration\n"
+            "                statistics every second\n"
+            "  -o FORMAT     Output format for events: text, json or binary\n"
+            "  -v PATH       Write watched values, ITM port values and exception\n"
+            "                activity to PATH as a VCD file, or to PATH.N for\n"
+            "                target N if there are several\n"
+            "  -n PORT       Have OpenOCD serve trace data on TCP port PORT,\n"
+            "                or PORT + N for target N, instead of a FIFO\n"
+            "  -a PATH       Save the raw trace data to PATH, or to PATH.N for\n"
+            "                target N if there are several\n"
+            "  -k DIR        Cache target capabilities and watch addresses in DIR,\n"
+            "                default ~/.cache/cortextrace; empty to look them up\n"
+            "                every time\n"
+            "  -l            Print GDB command latency statistics on exit\n"
             "  -w EXPRESSION C expression to watch, such as a variable or address\n"
             "       Variables can be specified by name, while memory addresses\n"
             "       should be given a type to indicate the size:\n"
@@ -279,7 +608,8 @@ static void printHelp(const char* progname)
             "       It is prudent to enclose the expression in single quotes\n"
             "       to prevent the shell from performing path expansion on it.\n"
             "\n",
-            progname, DEFAULT_GDB, DEFAULT_GDB_TARGET, DEFAULT_CORE_FREQ);
+            progname, DEFAULT_GDB, DEFAULT_GDB_TARGET, DEFAULT_CORE_FREQ,
+            lct::SpanAnalyzer::DEFAULT_SPAN_IDS);
 }
 
 static void termhandler(int)
@@ -291,28 +621,76 @@ static void termhandler(int)
 int main(int argc, char* argv[])
 {
     std::string gdbPath = DEFAULT_GDB;
-    std::string gdbTarget = DEFAULT_GDB_TARGET;
+    std::vector<std::string> gdbTargets;
     std::string elfPath;
-    size_t corefreq = DEFAULT_CORE_FREQ;
-    std::vector<std::string> watch;
+    WatchOptions& options = s_cortexWatch.GetOptions();
 
     int c;
-    while ((c = getopt(argc, argv, "hg:t:e:f:w:")) != -1) {
+    while ((c = getopt(argc, argv, "hg:t:e:f:r:w:xc:s:m:v:o:n:a:k:l")) != -1) {
         switch (c) {
         case 'g':
             gdbPath = optarg;
             break;
         case 't':
-            gdbTarget = optarg;
+            gdbTargets.push_back(optarg);
             break;
         case 'e':
             elfPath = optarg;
             break;
         case 'f':
-            corefreq = std::stoul(optarg);
+            options.CoreFreq = std::stoul(optarg);
+            break;
+        case 'r':
+            options.ReportSize = std::stoul(optarg);
             break;
         case 'w':
-            watch.push_back(optarg);
+            options.Watch.push_back(optarg);
+            break;
+        case 'x':
+            options.TraceExceptions = true;
+            break;
+        case 'c':
+            if (!s_cortexWatch.SetCounters(optarg)) {
+                return 1;
+            }
+            break;
+        case 's':
+            options.HistoryPoints = std::stoul(optarg);
+            break;
+        case 'm':
+            if (!lct::SpanAnalyzer::ParsePorts(optarg, &options.SpanBegin, &options.SpanEnd, &options.SpanIds)) {
+                return 1;
+            }
+            options.SpanPorts = true;
+            break;
+        case 'v':
+            options.VcdPath = optarg;
+            break;
+        case 'o':
+            if (!lct::EventFormatter::IsFormat(optarg)) {
+                LOG_ERROR("Unknown output format %s", optarg);
+                return 1;
+            }
+            options.Format = optarg;
+            break;
+        case 'a':
+            options.ArchivePath = optarg;
+            break;
+        case 'n': {
+            char* end = NULL;
+            const unsigned long port = strtoul(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || port == 0 || port > 65535) {
+                LOG_ERROR("Invalid trace port %s", optarg);
+                return 1;
+            }
+            options.TracePort = port;
+            break;
+        }
+        case 'k':
+            options.CacheDir = optarg;
+            break;
+        case 'l':
+            options.GdbStats = true;
             break;
         case 'h':
         default:
@@ -325,11 +703,20 @@ int main(int argc, char* argv[])
         printHelp(argv[0]);
         return 1;
     }
+    if (gdbTargets.empty()) {
+        gdbTargets.push_back(DEFAULT_GDB_TARGET);
+    }
+    if (options.TracePort && options.TracePort + gdbTargets.size() - 1 > 65535) {
+        LOG_ERROR("Trace ports from %u for %lu targets go past 65535", options.TracePort,
+                gdbTargets.size());
+        return 1;
+    }
 
     struct sigaction act;
+    memset(&act, 0, sizeof(act));
     act.sa_handler = termhandler;
     sigaction(SIGTERM, &act, NULL);
     sigaction(SIGINT, &act, NULL);
 
-    return s_cortexWatch.Run(gdbPath, gdbTarget, elfPath, corefreq, watch);
+    return s_cortexWatch.Run(gdbPath, gdbTargets, elfPath);
 }